@@ -0,0 +1,184 @@
+/* ===== [command_codec.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "command_codec.h"
+
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define COMMAND_PREFIX          "CMD_"
+#define COMMAND_PREFIX_LEN      4
+#define COMMAND_COUNT           (CMD_INVALID + 1)
+#define COMMAND_HASH_EMPTY      CMD_INVALID     // CMD_INVALID is never decoded
+#define FNV_PRIME               16777619u
+
+
+/* ===== Declaration of private or external variables ===== */
+#define COMMAND_NAME(name, origin)      #name,
+static const char* const command_names[COMMAND_COUNT] = {
+    COMMAND_LIST(COMMAND_NAME)
+};
+#undef COMMAND_NAME
+
+#define COMMAND_NAME_LEN(name, origin)  sizeof(#name) - 1,
+static const uint8_t command_name_len[COMMAND_COUNT] = {
+    COMMAND_LIST(COMMAND_NAME_LEN)
+};
+#undef COMMAND_NAME_LEN
+
+#define COMMAND_ORIGIN(name, origin)    origin,
+static const uint8_t command_origin[COMMAND_COUNT] = {
+    COMMAND_LIST(COMMAND_ORIGIN)
+};
+#undef COMMAND_ORIGIN
+
+// filled once by command_codec_init, read only afterwards
+static uint8_t hash_table[COMMAND_HASH_SIZE];
+static uint32_t hash_seed = 0;
+
+/* ===== Prototypes of private functions ===== */
+static uint8_t is_token_char(char c);
+static uint32_t hash_step(uint32_t hash, char c);
+static uint8_t hash_slot(uint32_t hash);
+static uint8_t build_table(uint32_t seed);
+
+
+/* ===== Implementations of public functions ===== */
+int8_t command_codec_init(void)
+{
+    uint32_t seed;
+
+    for (seed = 1; seed <= COMMAND_HASH_MAX_SEED; seed++)
+    {
+        if (build_table(seed))
+        {
+            hash_seed = seed;
+            return 0;
+        }
+    }
+
+    memset(hash_table, COMMAND_HASH_EMPTY, sizeof(hash_table));
+    return -1;
+}
+
+command_type_t command_decode(const char* text)
+{
+    return command_decode_args(text, NULL);
+}
+
+command_type_t command_decode_args(const char* text, const char** args)
+{
+    const char* token;
+    const char* end;
+    uint32_t hash;
+    uint8_t command;
+
+    if (text == NULL || hash_seed == 0)
+    {
+        return CMD_INVALID;
+    }
+
+    // single pass: look for the prefix at the start of a word, then hash the word
+    for (token = text; *token != '\0'; token++)
+    {
+        if (*token != COMMAND_PREFIX[0] || strncmp(token, COMMAND_PREFIX, COMMAND_PREFIX_LEN) != 0 ||
+            (token != text && is_token_char(token[-1])))
+        {
+            continue;
+        }
+
+        hash = hash_seed;
+        for (end = token; is_token_char(*end); end++)
+        {
+            hash = hash_step(hash, *end);
+        }
+
+        // only the first token counts, the table has one candidate to compare
+        command = hash_table[hash_slot(hash)];
+        if (command != COMMAND_HASH_EMPTY && command_name_len[command] == end - token &&
+            memcmp(token, command_names[command], command_name_len[command]) == 0)
+        {
+            if (args != NULL)
+            {
+                *args = end;
+            }
+            return (command_type_t)command;
+        }
+        return CMD_INVALID;
+    }
+
+    return CMD_INVALID;
+}
+
+const char* command_name(command_type_t command)
+{
+    if ((uint32_t)command >= COMMAND_COUNT)
+    {
+        return "UNKNOWN";
+    }
+    return command_names[command];
+}
+
+uint32_t command_codec_seed(void)
+{
+    return hash_seed;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static uint8_t is_token_char(char c)
+{
+    return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static uint32_t hash_step(uint32_t hash, char c)
+{
+    // FNV-1a, the seed replaces the offset basis
+    return (hash ^ (uint8_t)c) * FNV_PRIME;
+}
+
+static uint8_t hash_slot(uint32_t hash)
+{
+    return (hash ^ (hash >> 16)) & (COMMAND_HASH_SIZE - 1);
+}
+
+static uint8_t build_table(uint32_t seed)
+{
+    uint32_t hash;
+    uint8_t slot;
+    uint8_t command;
+    uint8_t i;
+
+    memset(hash_table, COMMAND_HASH_EMPTY, sizeof(hash_table));
+
+    for (command = 0; command < COMMAND_COUNT; command++)
+    {
+        if (command_origin[command] != COMMAND_EXTERNAL)
+        {
+            continue;
+        }
+
+        hash = seed;
+        for (i = 0; i < command_name_len[command]; i++)
+        {
+            hash = hash_step(hash, command_names[command][i]);
+        }
+
+        slot = hash_slot(hash);
+        if (hash_table[slot] != COMMAND_HASH_EMPTY)
+        {
+            return 0;
+        }
+        hash_table[slot] = command;
+    }
+
+    return 1;
+}
@@ -0,0 +1,109 @@
+/* ===== [command_codec.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __COMMAND_CODEC_H__
+#define __COMMAND_CODEC_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "command_list.h"
+
+/* ===== Macros of public constants ===== */
+#define COMMAND_HASH_SIZE       32      // slots of the decoder table (power of 2)
+#define COMMAND_HASH_MAX_SEED   0xFFFF  // seeds tried by command_codec_init
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: command_type_t
+| ------------------------------------------------------------------
+|  Description: possible commands that can be received (see
+|               COMMAND_LIST).
+*-------------------------------------------------------------------*/
+#define COMMAND_ENUM(name, origin)  name,
+typedef enum {
+    COMMAND_LIST(COMMAND_ENUM)
+}   command_type_t;
+#undef COMMAND_ENUM
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: command_codec_init
+| ------------------------------------------------------------------
+|  Description: builds the decoder table from COMMAND_LIST. The hash
+|               seed is searched until every external command gets
+|               its own slot (perfect hash), so the decoder does a
+|               single lookup and one compare.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  int8_t
+|           0 if OK, -1 if no seed is collision free
+*-------------------------------------------------------------------*/
+int8_t command_codec_init(void);
+
+/*------------------------------------------------------------------
+|  Function: command_decode
+| ------------------------------------------------------------------
+|  Description: finds the first "CMD_" token of a text (a whole word
+|               of letters, digits and '_') and returns its command.
+|               Only external commands are decoded.
+|
+|  Parameters:
+|       - text: NUL terminated text (request body, MQTT payload).
+|
+|  Returns:  command_type_t
+|           CMD_INVALID if there is no token or it is not a command
+*-------------------------------------------------------------------*/
+command_type_t command_decode(const char* text);
+
+/*------------------------------------------------------------------
+|  Function: command_decode_args
+| ------------------------------------------------------------------
+|  Description: same as command_decode, also returns where the
+|               arguments of the command start.
+|
+|  Parameters:
+|       - text: NUL terminated text.
+|       - args: set to the character after the command word (only
+|               if a command is found, may be NULL).
+|
+|  Returns:  command_type_t
+*-------------------------------------------------------------------*/
+command_type_t command_decode_args(const char* text, const char** args);
+
+/*------------------------------------------------------------------
+|  Function: command_name
+| ------------------------------------------------------------------
+|  Description: name of a command, for the logs and the replies.
+|
+|  Parameters:
+|       - command: command.
+|
+|  Returns:  const char*
+|           "UNKNOWN" if the value is not a command
+*-------------------------------------------------------------------*/
+const char* command_name(command_type_t command);
+
+/*------------------------------------------------------------------
+|  Function: command_codec_seed
+| ------------------------------------------------------------------
+|  Description: hash seed chosen by command_codec_init.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t command_codec_seed(void);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __COMMAND_CODEC_H__
@@ -0,0 +1,83 @@
+/* ===== [command_list.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __COMMAND_LIST_H__
+#define __COMMAND_LIST_H__
+
+/* ===== Macros of public constants ===== */
+#define COMMAND_INTERNAL    0       // only generated inside the firmware
+#define COMMAND_EXTERNAL    1       // can be received as text (MQTT, HTTP, HTTPS)
+
+/*------------------------------------------------------------------
+|  Macro: COMMAND_LIST
+| ------------------------------------------------------------------
+|  Description: every command, in command_type_t order. The value is
+|               sent to the slave and received as a raw byte (UART,
+|               BLE, scripts), so never reorder: new commands go
+|               right before CMD_INVALID. The enum, the names and
+|               the decoder hash table are all built from this list.
+|
+|       CMD_SLAVE_START_A   - starts process A in the slave
+|       CMD_SLAVE_START_B   - starts process B in the slave
+|       CMD_SLAVE_PAUSE     - pauses the slave process
+|       CMD_SLAVE_CONTINUE  - continues the paused process
+|       CMD_SLAVE_RESET     - resets the slave FSM
+|       CMD_SLAVE_STATUS    - reads the slave FSM state
+|       CMD_SLAVE_OK        - slave operation completed (I2C master)
+|       CMD_SLAVE_FAIL      - slave operation failed (I2C master)
+|       CMD_WIFI            - toggles WiFi connection (stops BLE if
+|                             enabled)
+|       CMD_BLE             - toggles BLE connection (stops WiFi if
+|                             enabled)
+|       CMD_ECHO            - sends back the same command to the RX
+|                             module that sent the command
+|       CMD_DUMMY           - logs the stored WiFi credentials
+|       CMD_JWT_BENCH       - JWT self-test, signing time and token
+|                             size (RS256/ES256, hardware/software SHA)
+|       CMD_QUEUE_BENCH     - command latency from enqueue to dispatch
+|                             (burst of CMD_BENCH_NOP commands)
+|       CMD_BENCH_NOP       - does nothing, used by the queue benchmark
+|       CMD_SCRIPT_STORE    - stores a command script in NVS
+|                             ("CMD_SCRIPT_STORE <slot> <hex>")
+|       CMD_SCRIPT_RUN      - runs a stored command script
+|                             ("CMD_SCRIPT_RUN <slot>")
+|       CMD_SCRIPT_STOP     - stops the running command script
+|       CMD_TRACE_DUMP      - logs the command latency percentiles of
+|                             every source module (and the last
+|                             traces as Chrome trace-event JSON)
+|       CMD_RING_BENCH      - callback to task handoff cost, lock-free
+|                             ring and task notification against a
+|                             FreeRTOS queue
+|       CMD_INVALID         - invalid command
+*-------------------------------------------------------------------*/
+#define COMMAND_LIST(X)                         \
+    X(CMD_SLAVE_START_A,    COMMAND_EXTERNAL)   \
+    X(CMD_SLAVE_START_B,    COMMAND_EXTERNAL)   \
+    X(CMD_SLAVE_PAUSE,      COMMAND_EXTERNAL)   \
+    X(CMD_SLAVE_CONTINUE,   COMMAND_EXTERNAL)   \
+    X(CMD_SLAVE_RESET,      COMMAND_EXTERNAL)   \
+    X(CMD_SLAVE_STATUS,     COMMAND_EXTERNAL)   \
+    X(CMD_SLAVE_OK,         COMMAND_INTERNAL)   \
+    X(CMD_SLAVE_FAIL,       COMMAND_INTERNAL)   \
+    X(CMD_WIFI,             COMMAND_EXTERNAL)   \
+    X(CMD_BLE,              COMMAND_EXTERNAL)   \
+    X(CMD_ECHO,             COMMAND_EXTERNAL)   \
+    X(CMD_DUMMY,            COMMAND_INTERNAL)   \
+    X(CMD_JWT_BENCH,        COMMAND_EXTERNAL)   \
+    X(CMD_QUEUE_BENCH,      COMMAND_EXTERNAL)   \
+    X(CMD_BENCH_NOP,        COMMAND_INTERNAL)   \
+    X(CMD_SCRIPT_STORE,     COMMAND_EXTERNAL)   \
+    X(CMD_SCRIPT_RUN,       COMMAND_EXTERNAL)   \
+    X(CMD_SCRIPT_STOP,      COMMAND_EXTERNAL)   \
+    X(CMD_TRACE_DUMP,       COMMAND_EXTERNAL)   \
+    X(CMD_RING_BENCH,       COMMAND_EXTERNAL)   \
+    X(CMD_INVALID,          COMMAND_INTERNAL)
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __COMMAND_LIST_H__
@@ -0,0 +1,283 @@
+/* ===== [command_script.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "command_script.h"
+
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define COMMAND_SCRIPT_MAX_CODE     (COMMAND_SCRIPT_MAX_SIZE - COMMAND_SCRIPT_HEADER_SIZE)
+
+
+/* ===== Prototypes of private functions ===== */
+static uint8_t instruction_size(uint8_t opcode);
+static uint8_t is_script_command(uint8_t command);
+static int8_t hex_value(char c);
+static command_script_action_t finish(command_script_t* vm, command_script_error_t error);
+
+
+/* ===== Implementations of public functions ===== */
+int8_t command_script_validate(const uint8_t* script, uint16_t size)
+{
+    const uint8_t* code = script + COMMAND_SCRIPT_HEADER_SIZE;
+    uint8_t starts[COMMAND_SCRIPT_MAX_CODE] = { 0 };
+    uint16_t len;
+    uint16_t pc;
+    uint8_t op_size;
+
+    if (script == NULL || size <= COMMAND_SCRIPT_HEADER_SIZE || size > COMMAND_SCRIPT_MAX_SIZE ||
+        script[0] != COMMAND_SCRIPT_MAGIC || script[1] != COMMAND_SCRIPT_VERSION)
+    {
+        return -1;
+    }
+    len = size - COMMAND_SCRIPT_HEADER_SIZE;
+
+    // first pass: opcodes and operands
+    for (pc = 0; pc < len; pc += op_size)
+    {
+        op_size = instruction_size(code[pc]);
+        if (op_size == 0 || pc + op_size > len)
+        {
+            return -1;
+        }
+        starts[pc] = 1;
+
+        if (code[pc] == OP_CMD && !is_script_command(code[pc + 1]))
+        {
+            return -1;
+        }
+        if ((code[pc] == OP_SET || code[pc] == OP_LOOP) && code[pc + 1] >= COMMAND_SCRIPT_COUNTERS)
+        {
+            return -1;
+        }
+    }
+
+    // second pass: every jump lands on an instruction
+    for (pc = 0; pc < len; pc += instruction_size(code[pc]))
+    {
+        switch (code[pc])
+        {
+            case OP_JUMP:
+                if (code[pc + 1] >= len || !starts[code[pc + 1]])
+                    return -1;
+                break;
+            case OP_IF_STATE:
+            case OP_IF_NOT_STATE:
+            case OP_LOOP:
+                if (code[pc + 2] >= len || !starts[code[pc + 2]])
+                    return -1;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return 0;
+}
+
+int8_t command_script_start(command_script_t* vm, const uint8_t* script, uint16_t size)
+{
+    if (command_script_validate(script, size) != 0)
+    {
+        return -1;
+    }
+
+    memset(vm, 0, sizeof(command_script_t));
+    vm->code = script + COMMAND_SCRIPT_HEADER_SIZE;
+    vm->len = size - COMMAND_SCRIPT_HEADER_SIZE;
+    return 0;
+}
+
+command_script_action_t command_script_next(command_script_t* vm)
+{
+    command_script_action_t action = { SCRIPT_ACTION_DONE, CMD_INVALID, 0 };
+    const uint8_t* op;
+    uint16_t steps;
+
+    if (vm->finished)
+    {
+        action.kind = (vm->error == SCRIPT_ERROR_NONE) ? SCRIPT_ACTION_DONE : SCRIPT_ACTION_FAILED;
+        return action;
+    }
+    if (vm->pending)
+    {
+        return finish(vm, SCRIPT_ERROR_STATE);
+    }
+    if (vm->error != SCRIPT_ERROR_NONE)
+    {
+        // set by command_script_result
+        return finish(vm, vm->error);
+    }
+
+    for (steps = 0; steps < COMMAND_SCRIPT_MAX_STEPS; steps++)
+    {
+        // running past the last instruction is the same as OP_END
+        if (vm->pc >= vm->len)
+        {
+            return finish(vm, SCRIPT_ERROR_NONE);
+        }
+
+        op = &vm->code[vm->pc];
+        vm->pc += instruction_size(op[0]);
+        vm->executed++;
+
+        switch (op[0])
+        {
+            case OP_END:
+                return finish(vm, SCRIPT_ERROR_NONE);
+
+            case OP_CMD:
+                vm->pending = 1;
+                action.kind = SCRIPT_ACTION_COMMAND;
+                action.command = (command_type_t)op[1];
+                return action;
+
+            case OP_STATUS:
+                vm->pending = 1;
+                action.kind = SCRIPT_ACTION_STATUS;
+                return action;
+
+            case OP_WAIT:
+                action.kind = SCRIPT_ACTION_WAIT;
+                action.wait_ms = ((uint16_t)op[1] << 8) | op[2];
+                return action;
+
+            case OP_IF_STATE:
+                if (vm->state == op[1])
+                    vm->pc = op[2];
+                break;
+
+            case OP_IF_NOT_STATE:
+                if (vm->state != op[1])
+                    vm->pc = op[2];
+                break;
+
+            case OP_JUMP:
+                vm->pc = op[1];
+                break;
+
+            case OP_SET:
+                vm->counters[op[1]] = op[2];
+                break;
+
+            case OP_LOOP:
+                if (vm->counters[op[1]] > 0 && --vm->counters[op[1]] > 0)
+                    vm->pc = op[2];
+                break;
+
+            case OP_FAIL:
+            default:
+                return finish(vm, SCRIPT_ERROR_FAIL);
+        }
+    }
+
+    return finish(vm, SCRIPT_ERROR_STEPS);
+}
+
+void command_script_result(command_script_t* vm, uint8_t ok, uint8_t state)
+{
+    vm->pending = 0;
+    if (!ok)
+    {
+        vm->error = SCRIPT_ERROR_SLAVE;
+        return;
+    }
+    vm->state = state;
+}
+
+int16_t command_script_from_hex(const char* hex, uint8_t* script, uint16_t size)
+{
+    int16_t written = 0;
+    int8_t high, low;
+
+    while (*hex == ' ')
+    {
+        hex++;
+    }
+
+    while ((high = hex_value(hex[0])) >= 0)
+    {
+        low = hex_value(hex[1]);
+        if (low < 0 || written >= size)
+        {
+            return -1;
+        }
+        script[written++] = (uint8_t)((high << 4) | low);
+        hex += 2;
+    }
+
+    return written;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static uint8_t instruction_size(uint8_t opcode)
+{
+    switch (opcode)
+    {
+        case OP_END:
+        case OP_STATUS:
+        case OP_FAIL:
+            return 1;
+        case OP_CMD:
+        case OP_JUMP:
+            return 2;
+        case OP_WAIT:
+        case OP_IF_STATE:
+        case OP_IF_NOT_STATE:
+        case OP_SET:
+        case OP_LOOP:
+            return 3;
+        default:
+            return 0;
+    }
+}
+
+static uint8_t is_script_command(uint8_t command)
+{
+    // status reads have their own opcode, the rest of the commands are not for the slave
+    switch (command)
+    {
+        case CMD_SLAVE_START_A:
+        case CMD_SLAVE_START_B:
+        case CMD_SLAVE_PAUSE:
+        case CMD_SLAVE_CONTINUE:
+        case CMD_SLAVE_RESET:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int8_t hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static command_script_action_t finish(command_script_t* vm, command_script_error_t error)
+{
+    command_script_action_t action = { SCRIPT_ACTION_DONE, CMD_INVALID, 0 };
+
+    vm->finished = 1;
+    vm->pending = 0;
+    vm->error = error;
+    if (error != SCRIPT_ERROR_NONE)
+    {
+        action.kind = SCRIPT_ACTION_FAILED;
+    }
+    return action;
+}
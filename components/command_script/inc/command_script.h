@@ -0,0 +1,227 @@
+/* ===== [command_script.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __COMMAND_SCRIPT_H__
+#define __COMMAND_SCRIPT_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "command_codec.h"
+
+/* ===== Macros of public constants ===== */
+#define COMMAND_SCRIPT_MAGIC        0xC5
+#define COMMAND_SCRIPT_VERSION      1
+#define COMMAND_SCRIPT_HEADER_SIZE  2       // magic, version
+#define COMMAND_SCRIPT_MAX_SIZE     64      // header included
+#define COMMAND_SCRIPT_COUNTERS     4       // loop counters
+#define COMMAND_SCRIPT_MAX_STEPS    64      // instructions between two actions (catches loops without any)
+
+/*------------------------------------------------------------------
+|  Opcodes: a script is the header followed by the code. Jump
+|           targets are offsets from the start of the code and must
+|           point to an instruction.
+|
+|       OP_END                      - ends the script
+|       OP_CMD command              - sends a slave command (start,
+|                                     pause, continue or reset) and
+|                                     waits for its completion
+|       OP_STATUS                   - reads the slave state
+|       OP_WAIT ms_high ms_low      - waits (ms, big endian, at least
+|                                     one tick of the command
+|                                     processor)
+|       OP_IF_STATE state target    - jumps if the last state read is
+|                                     state
+|       OP_IF_NOT_STATE state target- jumps if it is not
+|       OP_JUMP target              - jumps
+|       OP_SET counter value        - loads a loop counter
+|       OP_LOOP counter target      - decrements the counter, jumps
+|                                     if it is not 0
+|       OP_FAIL                     - ends the script with an error
+*-------------------------------------------------------------------*/
+#define OP_END              0x00
+#define OP_CMD              0x01
+#define OP_STATUS           0x02
+#define OP_WAIT             0x03
+#define OP_IF_STATE         0x04
+#define OP_IF_NOT_STATE     0x05
+#define OP_JUMP             0x06
+#define OP_SET              0x07
+#define OP_LOOP             0x08
+#define OP_FAIL             0x09
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: command_script_action_kind_t
+| ------------------------------------------------------------------
+|  Description: what the script needs from the command processor.
+|
+|  Values:
+|       SCRIPT_ACTION_COMMAND   - send action.command to the slave,
+|                                 then call command_script_result
+|       SCRIPT_ACTION_STATUS    - read the slave state, then call
+|                                 command_script_result
+|       SCRIPT_ACTION_WAIT      - wait action.wait_ms, then call
+|                                 command_script_next
+|       SCRIPT_ACTION_DONE      - the script ended
+|       SCRIPT_ACTION_FAILED    - the script stopped (see error)
+*-------------------------------------------------------------------*/
+typedef enum {
+    SCRIPT_ACTION_COMMAND,
+    SCRIPT_ACTION_STATUS,
+    SCRIPT_ACTION_WAIT,
+    SCRIPT_ACTION_DONE,
+    SCRIPT_ACTION_FAILED,
+}   command_script_action_kind_t;
+
+/*------------------------------------------------------------------
+|  Enum: command_script_error_t
+| ------------------------------------------------------------------
+|  Description: why a script stopped.
+|
+|  Values:
+|       SCRIPT_ERROR_NONE   - no error
+|       SCRIPT_ERROR_SLAVE  - a slave operation failed
+|       SCRIPT_ERROR_STEPS  - too many instructions without an action
+|       SCRIPT_ERROR_FAIL   - OP_FAIL reached
+|       SCRIPT_ERROR_STATE  - next called while waiting for a result
+*-------------------------------------------------------------------*/
+typedef enum {
+    SCRIPT_ERROR_NONE,
+    SCRIPT_ERROR_SLAVE,
+    SCRIPT_ERROR_STEPS,
+    SCRIPT_ERROR_FAIL,
+    SCRIPT_ERROR_STATE,
+}   command_script_error_t;
+
+/*------------------------------------------------------------------
+|  Struct: command_script_action_t
+| ------------------------------------------------------------------
+|  Description: next action of a script.
+|
+|  Members:
+|       kind    - what to do
+|       command - slave command (SCRIPT_ACTION_COMMAND)
+|       wait_ms - time to wait (SCRIPT_ACTION_WAIT)
+*-------------------------------------------------------------------*/
+typedef struct {
+    command_script_action_kind_t    kind;
+    command_type_t                  command;
+    uint16_t                        wait_ms;
+}   command_script_action_t;
+
+/*------------------------------------------------------------------
+|  Struct: command_script_t
+| ------------------------------------------------------------------
+|  Description: script being run. It does not block: the caller
+|               performs each action and feeds the result back.
+|
+|  Members:
+|       code        - code (after the header, owned by the caller)
+|       len         - code length
+|       pc          - offset of the next instruction
+|       state       - last slave state read
+|       counters    - loop counters
+|       pending     - waiting for command_script_result
+|       finished    - DONE or FAILED returned
+|       error       - why it stopped
+|       executed    - instructions run
+*-------------------------------------------------------------------*/
+typedef struct {
+    const uint8_t*          code;
+    uint8_t                 len;
+    uint8_t                 pc;
+    uint8_t                 state;
+    uint8_t                 counters[COMMAND_SCRIPT_COUNTERS];
+    uint8_t                 pending;
+    uint8_t                 finished;
+    command_script_error_t  error;
+    uint32_t                executed;
+}   command_script_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: command_script_validate
+| ------------------------------------------------------------------
+|  Description: checks the header, every opcode and operand, and
+|               that every jump lands on an instruction.
+|
+|  Parameters:
+|       - script: script (header and code).
+|       - size: script size.
+|
+|  Returns:  int8_t
+|           0 if valid, -1 otherwise
+*-------------------------------------------------------------------*/
+int8_t command_script_validate(const uint8_t* script, uint16_t size);
+
+/*------------------------------------------------------------------
+|  Function: command_script_start
+| ------------------------------------------------------------------
+|  Description: validates a script and prepares it to run. The
+|               script must stay in memory until it ends.
+|
+|  Parameters:
+|       - vm: script state.
+|       - script: script (header and code).
+|       - size: script size.
+|
+|  Returns:  int8_t
+|           0 if OK, -1 if the script is not valid
+*-------------------------------------------------------------------*/
+int8_t command_script_start(command_script_t* vm, const uint8_t* script, uint16_t size);
+
+/*------------------------------------------------------------------
+|  Function: command_script_next
+| ------------------------------------------------------------------
+|  Description: runs the script until it needs the slave, a wait or
+|               it ends.
+|
+|  Parameters:
+|       - vm: script state.
+|
+|  Returns:  command_script_action_t
+*-------------------------------------------------------------------*/
+command_script_action_t command_script_next(command_script_t* vm);
+
+/*------------------------------------------------------------------
+|  Function: command_script_result
+| ------------------------------------------------------------------
+|  Description: result of the last SCRIPT_ACTION_COMMAND or
+|               SCRIPT_ACTION_STATUS. A failed operation stops the
+|               script (the next call returns SCRIPT_ACTION_FAILED).
+|
+|  Parameters:
+|       - vm: script state.
+|       - ok: 1 if the slave completed the operation.
+|       - state: slave state read (SCRIPT_ACTION_STATUS).
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void command_script_result(command_script_t* vm, uint8_t ok, uint8_t state);
+
+/*------------------------------------------------------------------
+|  Function: command_script_from_hex
+| ------------------------------------------------------------------
+|  Description: decodes a script written in hex (leading spaces are
+|               skipped, it ends at the first non hex character).
+|
+|  Parameters:
+|       - hex: text.
+|       - script: where the bytes are written.
+|       - size: size of script.
+|
+|  Returns:  int16_t
+|           bytes written, -1 if odd length or too long
+*-------------------------------------------------------------------*/
+int16_t command_script_from_hex(const char* hex, uint8_t* script, uint16_t size);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __COMMAND_SCRIPT_H__
@@ -0,0 +1,246 @@
+/* ===== [command_trace.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "command_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define CHROME_EVENT_JSON   "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%u," \
+                            "\"args\":{\"id\":%u}}"
+
+
+/* ===== Prototypes of private functions ===== */
+static uint8_t bucket_of(int64_t latency_us);
+static int64_t bucket_low(uint8_t bucket);
+static int8_t last_stage(const command_trace_t* trace);
+static int32_t append_event(char* buffer, uint16_t size, int32_t len, const char* name, const char* category,
+                            int64_t start_us, int64_t end_us, const command_trace_t* trace);
+
+
+/* ===== Implementations of public functions ===== */
+void latency_histogram_add(latency_histogram_t* histogram, int64_t latency_us)
+{
+    if (latency_us < 0)
+    {
+        latency_us = 0;
+    }
+
+    histogram->buckets[bucket_of(latency_us)]++;
+    histogram->count++;
+    histogram->total_us += latency_us;
+    if (latency_us > histogram->max_us)
+    {
+        histogram->max_us = latency_us;
+    }
+}
+
+int64_t latency_histogram_percentile(const latency_histogram_t* histogram, uint8_t percent)
+{
+    uint32_t rank;
+    uint32_t seen = 0;
+    int64_t low, high, value;
+    uint8_t bucket;
+
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+    if (percent > 100)
+    {
+        percent = 100;
+    }
+
+    // rank of the sample, 1 based (nearest rank)
+    rank = ((uint64_t)histogram->count * percent + 99) / 100;
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    for (bucket = 0; bucket < LATENCY_HISTOGRAM_BUCKETS; bucket++)
+    {
+        if (seen + histogram->buckets[bucket] >= rank)
+        {
+            break;
+        }
+        seen += histogram->buckets[bucket];
+    }
+    if (bucket == LATENCY_HISTOGRAM_BUCKETS)
+    {
+        return histogram->max_us;
+    }
+
+    // samples are taken as spread evenly over the bucket
+    low = bucket_low(bucket);
+    high = (bucket == LATENCY_HISTOGRAM_BUCKETS - 1) ? histogram->max_us : bucket_low(bucket + 1);
+    value = low + (high - low) * (rank - seen) / histogram->buckets[bucket];
+
+    return (value > histogram->max_us) ? histogram->max_us : value;
+}
+
+void command_trace_start(command_trace_t* trace, uint8_t source, uint8_t command, uint16_t id,
+                         int64_t ingress_us, int64_t enqueue_us, int64_t dequeue_us)
+{
+    memset(trace, 0, sizeof(command_trace_t));
+    trace->source = source;
+    trace->command = command;
+    trace->id = id;
+    trace->stage_us[TRACE_STAGE_INGRESS] = (ingress_us != 0) ? ingress_us : enqueue_us;
+    trace->stage_us[TRACE_STAGE_ENQUEUE] = enqueue_us;
+    trace->stage_us[TRACE_STAGE_DEQUEUE] = dequeue_us;
+}
+
+void command_trace_mark(command_trace_t* trace, trace_stage_t stage, int64_t time_us)
+{
+    if (command_trace_active(trace) && stage < TRACE_STAGE_COUNT)
+    {
+        trace->stage_us[stage] = time_us;
+    }
+}
+
+uint8_t command_trace_active(const command_trace_t* trace)
+{
+    return trace->stage_us[TRACE_STAGE_INGRESS] != 0;
+}
+
+int64_t command_trace_add(command_trace_stats_t* stats, const command_trace_t* trace)
+{
+    int64_t previous_us;
+    uint8_t stage;
+
+    if (!command_trace_active(trace))
+    {
+        return -1;
+    }
+
+    previous_us = trace->stage_us[TRACE_STAGE_INGRESS];
+    for (stage = TRACE_STAGE_INGRESS + 1; stage < TRACE_STAGE_COUNT; stage++)
+    {
+        if (trace->stage_us[stage] != 0)
+        {
+            latency_histogram_add(&stats->stage[stage], trace->stage_us[stage] - previous_us);
+            previous_us = trace->stage_us[stage];
+        }
+    }
+
+    latency_histogram_add(&stats->total, previous_us - trace->stage_us[TRACE_STAGE_INGRESS]);
+    return previous_us - trace->stage_us[TRACE_STAGE_INGRESS];
+}
+
+const char* command_trace_span_name(trace_stage_t stage)
+{
+    switch (stage)
+    {
+        case TRACE_STAGE_ENQUEUE:
+            return "rx";
+        case TRACE_STAGE_DEQUEUE:
+            return "queue";
+        case TRACE_STAGE_I2C_WRITE:
+            return "i2c_write";
+        case TRACE_STAGE_SLAVE_ACK:
+            return "slave";
+        case TRACE_STAGE_REPLY:
+            return "reply";
+        case TRACE_STAGE_INGRESS:
+        default:
+            return "unknown";
+    }
+}
+
+int32_t command_trace_chrome_events(const command_trace_t* trace, const char* source, const char* command,
+                                    char* buffer, uint16_t size)
+{
+    int8_t last = last_stage(trace);
+    int64_t previous_us;
+    int32_t len;
+    uint8_t stage;
+
+    if (last < 0)
+    {
+        return -1;
+    }
+
+    // the whole command first, the spans nest under it
+    len = append_event(buffer, size, 0, command, source, trace->stage_us[TRACE_STAGE_INGRESS],
+                       trace->stage_us[last], trace);
+
+    previous_us = trace->stage_us[TRACE_STAGE_INGRESS];
+    for (stage = TRACE_STAGE_INGRESS + 1; stage <= last && len >= 0; stage++)
+    {
+        if (trace->stage_us[stage] != 0)
+        {
+            len = append_event(buffer, size, len, command_trace_span_name(stage), source, previous_us,
+                               trace->stage_us[stage], trace);
+            previous_us = trace->stage_us[stage];
+        }
+    }
+
+    return len;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static uint8_t bucket_of(int64_t latency_us)
+{
+    uint8_t bucket = 0;
+
+    while (bucket < LATENCY_HISTOGRAM_BUCKETS - 1 && (latency_us >> (bucket + 1)) != 0)
+    {
+        bucket++;
+    }
+    return bucket;
+}
+
+static int64_t bucket_low(uint8_t bucket)
+{
+    // bucket 0 also holds 0 us
+    return (bucket == 0) ? 0 : ((int64_t)1 << bucket);
+}
+
+static int8_t last_stage(const command_trace_t* trace)
+{
+    int8_t stage;
+
+    if (!command_trace_active(trace))
+    {
+        return -1;
+    }
+    for (stage = TRACE_STAGE_COUNT - 1; stage > TRACE_STAGE_INGRESS; stage--)
+    {
+        if (trace->stage_us[stage] != 0)
+        {
+            break;
+        }
+    }
+    return stage;
+}
+
+static int32_t append_event(char* buffer, uint16_t size, int32_t len, const char* name, const char* category,
+                            int64_t start_us, int64_t end_us, const command_trace_t* trace)
+{
+    int written;
+
+    if (len < 0)
+    {
+        return -1;
+    }
+
+    written = snprintf(buffer + len, size - len, "%s" CHROME_EVENT_JSON, (len > 0) ? "," : "", name, category,
+                       (long long)start_us, (long long)(end_us - start_us), COMMAND_TRACE_CHROME_PID,
+                       (unsigned)trace->source, (unsigned)trace->id);
+    if (written < 0 || written >= size - len)
+    {
+        return -1;
+    }
+    return len + written;
+}
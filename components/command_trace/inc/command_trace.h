@@ -0,0 +1,234 @@
+/* ===== [command_trace.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __COMMAND_TRACE_H__
+#define __COMMAND_TRACE_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+/* ===== Macros of public constants ===== */
+#define LATENCY_HISTOGRAM_BUCKETS       24      // bucket i holds [2^i, 2^(i+1)) us, the last one everything above
+#define COMMAND_TRACE_CHROME_MAX_SIZE   1024    // room for every event of one trace
+#define COMMAND_TRACE_CHROME_PID        1       // single process in the exported trace
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: trace_stage_t
+| ------------------------------------------------------------------
+|  Description: points in the life of a command, in order. A command
+|               that does not go to the slave or gets no reply skips
+|               those stages.
+|
+|  Values:
+|       TRACE_STAGE_INGRESS     - received by the RX module (UART
+|                                 byte, BLE write, MQTT data event,
+|                                 TalkBack response)
+|       TRACE_STAGE_ENQUEUE     - queued for the command processor
+|       TRACE_STAGE_DEQUEUE     - taken by the command processor
+|       TRACE_STAGE_I2C_WRITE   - frame written to the slave
+|       TRACE_STAGE_SLAVE_ACK   - slave answer read by the I2C master
+|       TRACE_STAGE_REPLY       - reply queued for the requester
+*-------------------------------------------------------------------*/
+typedef enum {
+    TRACE_STAGE_INGRESS,
+    TRACE_STAGE_ENQUEUE,
+    TRACE_STAGE_DEQUEUE,
+    TRACE_STAGE_I2C_WRITE,
+    TRACE_STAGE_SLAVE_ACK,
+    TRACE_STAGE_REPLY,
+    TRACE_STAGE_COUNT,
+}   trace_stage_t;
+
+/*------------------------------------------------------------------
+|  Struct: latency_histogram_t
+| ------------------------------------------------------------------
+|  Description: latencies in power of 2 buckets (about 100 bytes,
+|               any range from 1 us to seconds).
+|
+|  Members:
+|       buckets     - samples per bucket
+|       count       - samples added
+|       total_us    - sum of the samples
+|       max_us      - largest sample
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint32_t    buckets[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t    count;
+    int64_t     total_us;
+    int64_t     max_us;
+}   latency_histogram_t;
+
+/*------------------------------------------------------------------
+|  Struct: command_trace_t
+| ------------------------------------------------------------------
+|  Description: timestamps of one command.
+|
+|  Members:
+|       source      - module that sent the command (rx_module_t)
+|       command     - command (command_type_t)
+|       id          - request id of the command
+|       stage_us    - time of each stage (esp_timer), 0 if the stage
+|                     was not reached. A trace without ingress time
+|                     is not in use.
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint8_t     source;
+    uint8_t     command;
+    uint16_t    id;
+    int64_t     stage_us[TRACE_STAGE_COUNT];
+}   command_trace_t;
+
+/*------------------------------------------------------------------
+|  Struct: command_trace_stats_t
+| ------------------------------------------------------------------
+|  Description: latency histograms of one source module.
+|
+|  Members:
+|       total       - from the ingress to the last stage reached
+|       stage       - from the previous stage reached to this one
+|                     (stage[TRACE_STAGE_INGRESS] stays empty)
+*-------------------------------------------------------------------*/
+typedef struct {
+    latency_histogram_t total;
+    latency_histogram_t stage[TRACE_STAGE_COUNT];
+}   command_trace_stats_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: latency_histogram_add
+| ------------------------------------------------------------------
+|  Description: adds a sample to the histogram.
+|
+|  Parameters:
+|       - histogram: histogram.
+|       - latency_us: sample (negative values count as 0).
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void latency_histogram_add(latency_histogram_t* histogram, int64_t latency_us);
+
+/*------------------------------------------------------------------
+|  Function: latency_histogram_percentile
+| ------------------------------------------------------------------
+|  Description: estimates a percentile, interpolating inside the
+|               bucket that holds it (never above the max sample).
+|
+|  Parameters:
+|       - histogram: histogram.
+|       - percent: percentile (1 to 100).
+|
+|  Returns:  int64_t
+|           latency in us, 0 if the histogram is empty
+*-------------------------------------------------------------------*/
+int64_t latency_histogram_percentile(const latency_histogram_t* histogram, uint8_t percent);
+
+/*------------------------------------------------------------------
+|  Function: command_trace_start
+| ------------------------------------------------------------------
+|  Description: starts the trace of a command taken by the command
+|               processor.
+|
+|  Parameters:
+|       - trace: trace to fill in.
+|       - source: module that sent the command.
+|       - command: command.
+|       - id: request id.
+|       - ingress_us: time it was received (0 if unknown, then the
+|                     enqueue time is used).
+|       - enqueue_us: time it was queued.
+|       - dequeue_us: time it was taken.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void command_trace_start(command_trace_t* trace, uint8_t source, uint8_t command, uint16_t id,
+                         int64_t ingress_us, int64_t enqueue_us, int64_t dequeue_us);
+
+/*------------------------------------------------------------------
+|  Function: command_trace_mark
+| ------------------------------------------------------------------
+|  Description: records the time a stage was reached.
+|
+|  Parameters:
+|       - trace: trace (ignored if not in use).
+|       - stage: stage reached.
+|       - time_us: when.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void command_trace_mark(command_trace_t* trace, trace_stage_t stage, int64_t time_us);
+
+/*------------------------------------------------------------------
+|  Function: command_trace_active
+| ------------------------------------------------------------------
+|  Description: tells if the trace is in use.
+|
+|  Parameters:
+|       - trace: trace.
+|
+|  Returns:  uint8_t
+|           1 if it has an ingress time
+*-------------------------------------------------------------------*/
+uint8_t command_trace_active(const command_trace_t* trace);
+
+/*------------------------------------------------------------------
+|  Function: command_trace_add
+| ------------------------------------------------------------------
+|  Description: adds a finished trace to the histograms of its
+|               source module.
+|
+|  Parameters:
+|       - stats: histograms of the source module.
+|       - trace: finished trace.
+|
+|  Returns:  int64_t
+|           total latency in us, -1 if the trace is not in use
+*-------------------------------------------------------------------*/
+int64_t command_trace_add(command_trace_stats_t* stats, const command_trace_t* trace);
+
+/*------------------------------------------------------------------
+|  Function: command_trace_span_name
+| ------------------------------------------------------------------
+|  Description: name of the time spent before a stage, for the logs
+|               and the exported trace.
+|
+|  Parameters:
+|       - stage: stage that ends the span.
+|
+|  Returns:  const char*
+*-------------------------------------------------------------------*/
+const char* command_trace_span_name(trace_stage_t stage);
+
+/*------------------------------------------------------------------
+|  Function: command_trace_chrome_events
+| ------------------------------------------------------------------
+|  Description: writes a trace as Chrome trace-event JSON: one
+|               complete ("X") event for the whole command and one
+|               for each span, comma separated, on the thread of the
+|               source module. The caller wraps the events of every
+|               trace in "[" and "]" (JSON array format, loaded by
+|               chrome://tracing and Perfetto).
+|
+|  Parameters:
+|       - trace: finished trace.
+|       - source: name of the source module.
+|       - command: name of the command.
+|       - buffer: output.
+|       - size: size of the buffer.
+|
+|  Returns:  int32_t
+|           length written, -1 if it does not fit or the trace is
+|           not in use
+*-------------------------------------------------------------------*/
+int32_t command_trace_chrome_events(const command_trace_t* trace, const char* source, const char* command,
+                                    char* buffer, uint16_t size);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __COMMAND_TRACE_H__
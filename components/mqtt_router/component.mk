@@ -0,0 +1,2 @@
+
+COMPONENT_ADD_INCLUDEDIRS += ./inc
@@ -0,0 +1,148 @@
+/* ===== [mqtt_router.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __MQTT_ROUTER_H__
+#define __MQTT_ROUTER_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+/* ===== Macros of public constants ===== */
+#define MQTT_ROUTER_NO_NODE     0xFFFF
+
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Type: mqtt_router_handler_t
+| ------------------------------------------------------------------
+|  Description: handler of the messages that match a topic filter.
+|               topic and data are not NUL terminated.
+*-------------------------------------------------------------------*/
+typedef void (*mqtt_router_handler_t)(const char* topic, uint16_t topic_len,
+                                      const char* data, uint16_t data_len, void* context);
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_router_node_t
+| ------------------------------------------------------------------
+|  Description: node of the topic trie (one topic level).
+|
+|  Members:
+|       level       - level name (points into the filter string)
+|       level_len   - length of level
+|       child       - first child with a plain level name
+|       sibling     - next node with the same parent
+|       plus        - child for the '+' wildcard
+|       hash        - child for the '#' wildcard
+|       handler     - handler of the filter ending here (or NULL)
+|       context     - passed to handler
+*-------------------------------------------------------------------*/
+typedef struct {
+    const char*             level;
+    uint16_t                level_len;
+    uint16_t                child;
+    uint16_t                sibling;
+    uint16_t                plus;
+    uint16_t                hash;
+    mqtt_router_handler_t   handler;
+    void*                   context;
+}   mqtt_router_node_t;
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_router_t
+| ------------------------------------------------------------------
+|  Description: subscription router. The trie is built at startup
+|               in a caller provided node array (node 0 is the root).
+|
+|  Members:
+|       nodes       - node storage
+|       capacity    - number of nodes in nodes
+|       used        - nodes in use
+*-------------------------------------------------------------------*/
+typedef struct {
+    mqtt_router_node_t* nodes;
+    uint16_t            capacity;
+    uint16_t            used;
+}   mqtt_router_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: mqtt_router_init
+| ------------------------------------------------------------------
+|  Description: starts an empty router.
+|
+|  Parameters:
+|       - router: router to initialize.
+|       - nodes: node storage (one node per distinct filter level,
+|                plus the root).
+|       - capacity: number of nodes in nodes.
+|
+|  Returns:  int8_t
+|           0: OK, -1: there is no room for the root
+*-------------------------------------------------------------------*/
+int8_t mqtt_router_init(mqtt_router_t* router, mqtt_router_node_t* nodes, uint16_t capacity);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_router_add
+| ------------------------------------------------------------------
+|  Description: adds a topic filter. '+' matches exactly one level
+|               and '#' (last level only) matches any number of
+|               levels, including the parent one.
+|
+|  Parameters:
+|       - router: router to use.
+|       - filter: topic filter (must outlive the router).
+|       - handler: handler of the matching messages.
+|       - context: passed to handler.
+|
+|  Returns:  int8_t
+|           0: OK, -1: invalid or duplicated filter, or no free node
+*-------------------------------------------------------------------*/
+int8_t mqtt_router_add(mqtt_router_t* router, const char* filter, mqtt_router_handler_t handler, void* context);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_router_dispatch
+| ------------------------------------------------------------------
+|  Description: calls the handler of every filter that matches the
+|               topic. Topics starting with '$' never match a
+|               wildcard in the first level.
+|
+|  Parameters:
+|       - router: router to use.
+|       - topic: topic of the message.
+|       - topic_len: length of topic.
+|       - data: message data.
+|       - data_len: length of data.
+|
+|  Returns:  uint8_t
+|           number of handlers called
+*-------------------------------------------------------------------*/
+uint8_t mqtt_router_dispatch(const mqtt_router_t* router, const char* topic, uint16_t topic_len,
+                             const char* data, uint16_t data_len);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_topic_matches
+| ------------------------------------------------------------------
+|  Description: checks a single filter against a topic, with the
+|               same rules as the router (no trie involved).
+|
+|  Parameters:
+|       - filter: NUL terminated topic filter.
+|       - topic: topic of the message.
+|       - topic_len: length of topic.
+|
+|  Returns:  uint8_t
+|           1 if the filter matches the topic
+*-------------------------------------------------------------------*/
+uint8_t mqtt_topic_matches(const char* filter, const char* topic, uint16_t topic_len);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __MQTT_ROUTER_H__
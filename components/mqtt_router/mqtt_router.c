@@ -0,0 +1,347 @@
+/* ===== [mqtt_router.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "mqtt_router.h"
+
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define LEVEL_SEPARATOR     '/'
+#define WILDCARD_SINGLE     '+'
+#define WILDCARD_MULTI      '#'
+#define SYSTEM_PREFIX       '$'
+
+
+/* ===== Private structs and enums ===== */
+typedef struct {
+    const char* topic;
+    const char* topic_end;
+    const char* data;
+    uint16_t    topic_len;
+    uint16_t    data_len;
+}   router_message_t;
+
+
+/* ===== Prototypes of private functions ===== */
+static uint16_t new_node(mqtt_router_t* router, const char* level, uint16_t level_len);
+static uint8_t is_valid_filter(const char* filter);
+static const char* level_end(const char* level, const char* end);
+static uint8_t match(const mqtt_router_t* router, uint16_t node, const char* level, const router_message_t* message);
+static uint8_t match_child(const mqtt_router_t* router, uint16_t child, const char* next_level, const router_message_t* message);
+static uint8_t call_handler(const mqtt_router_t* router, uint16_t node, const router_message_t* message);
+
+
+/* ===== Implementations of public functions ===== */
+int8_t mqtt_router_init(mqtt_router_t* router, mqtt_router_node_t* nodes, uint16_t capacity)
+{
+    router->nodes = nodes;
+    router->capacity = capacity;
+    router->used = 0;
+
+    // root node (before the first level)
+    if (new_node(router, "", 0) == MQTT_ROUTER_NO_NODE)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+int8_t mqtt_router_add(mqtt_router_t* router, const char* filter, mqtt_router_handler_t handler, void* context)
+{
+    const char* level = filter;
+    const char* end;
+    uint16_t level_len;
+    uint16_t node = 0;
+    uint16_t* next;
+    uint16_t child;
+
+    if (router->used == 0 || handler == NULL || !is_valid_filter(filter))
+    {
+        return -1;
+    }
+
+    while (1)
+    {
+        end = strchr(level, LEVEL_SEPARATOR);
+        if (end == NULL)
+        {
+            end = level + strlen(level);
+        }
+        level_len = end - level;
+
+        if (level_len == 1 && level[0] == WILDCARD_SINGLE)
+        {
+            next = &router->nodes[node].plus;
+        }
+        else if (level_len == 1 && level[0] == WILDCARD_MULTI)
+        {
+            next = &router->nodes[node].hash;
+        }
+        else
+        {
+            // look for the level between the children, a new one is linked first
+            next = &router->nodes[node].child;
+            for (child = *next; child != MQTT_ROUTER_NO_NODE; child = router->nodes[child].sibling)
+            {
+                if (router->nodes[child].level_len == level_len &&
+                    memcmp(router->nodes[child].level, level, level_len) == 0)
+                {
+                    break;
+                }
+            }
+
+            if (child == MQTT_ROUTER_NO_NODE)
+            {
+                child = new_node(router, level, level_len);
+                if (child == MQTT_ROUTER_NO_NODE)
+                {
+                    return -1;
+                }
+                router->nodes[child].sibling = *next;
+                *next = child;
+            }
+            next = NULL;
+            node = child;
+        }
+
+        // the wildcards have a single child slot
+        if (next != NULL)
+        {
+            if (*next == MQTT_ROUTER_NO_NODE)
+            {
+                *next = new_node(router, level, level_len);
+                if (*next == MQTT_ROUTER_NO_NODE)
+                {
+                    return -1;
+                }
+            }
+            node = *next;
+        }
+
+        if (*end == '\0')
+        {
+            break;
+        }
+        level = end + 1;
+    }
+
+    if (router->nodes[node].handler != NULL)
+    {
+        return -1;
+    }
+
+    router->nodes[node].handler = handler;
+    router->nodes[node].context = context;
+
+    return 0;
+}
+
+uint8_t mqtt_router_dispatch(const mqtt_router_t* router, const char* topic, uint16_t topic_len,
+                             const char* data, uint16_t data_len)
+{
+    router_message_t message;
+
+    if (router->used == 0)
+    {
+        return 0;
+    }
+
+    message.topic = topic;
+    message.topic_end = topic + topic_len;
+    message.topic_len = topic_len;
+    message.data = data;
+    message.data_len = data_len;
+
+    return match(router, 0, topic, &message);
+}
+
+uint8_t mqtt_topic_matches(const char* filter, const char* topic, uint16_t topic_len)
+{
+    const char* topic_end = topic + topic_len;
+    const char* filter_level_end;
+    const char* topic_level_end;
+    uint8_t topic_done = 0;
+
+    // wildcards in the first level never match the system topics
+    if (topic_len > 0 && topic[0] == SYSTEM_PREFIX &&
+        (filter[0] == WILDCARD_SINGLE || filter[0] == WILDCARD_MULTI))
+    {
+        return 0;
+    }
+
+    while (1)
+    {
+        filter_level_end = strchr(filter, LEVEL_SEPARATOR);
+        if (filter_level_end == NULL)
+        {
+            filter_level_end = filter + strlen(filter);
+        }
+
+        // '#' also matches the parent level ("a/#" matches "a")
+        if (filter_level_end - filter == 1 && filter[0] == WILDCARD_MULTI)
+        {
+            return 1;
+        }
+        if (topic_done)
+        {
+            return 0;
+        }
+
+        topic_level_end = level_end(topic, topic_end);
+        if (!(filter_level_end - filter == 1 && filter[0] == WILDCARD_SINGLE) &&
+            (filter_level_end - filter != topic_level_end - topic ||
+             memcmp(filter, topic, topic_level_end - topic) != 0))
+        {
+            return 0;
+        }
+
+        if (*filter_level_end == '\0')
+        {
+            return topic_level_end == topic_end;
+        }
+        filter = filter_level_end + 1;
+
+        if (topic_level_end == topic_end)
+        {
+            topic_done = 1;
+        }
+        else
+        {
+            topic = topic_level_end + 1;
+        }
+    }
+}
+
+
+/* ===== Implementations of private functions ===== */
+static uint16_t new_node(mqtt_router_t* router, const char* level, uint16_t level_len)
+{
+    mqtt_router_node_t* node;
+
+    if (router->used >= router->capacity)
+    {
+        return MQTT_ROUTER_NO_NODE;
+    }
+
+    node = &router->nodes[router->used];
+    node->level = level;
+    node->level_len = level_len;
+    node->child = MQTT_ROUTER_NO_NODE;
+    node->sibling = MQTT_ROUTER_NO_NODE;
+    node->plus = MQTT_ROUTER_NO_NODE;
+    node->hash = MQTT_ROUTER_NO_NODE;
+    node->handler = NULL;
+    node->context = NULL;
+
+    return router->used++;
+}
+
+static uint8_t is_valid_filter(const char* filter)
+{
+    const char* level = filter;
+    const char* end;
+
+    if (filter[0] == '\0')
+    {
+        return 0;
+    }
+
+    while (1)
+    {
+        end = strchr(level, LEVEL_SEPARATOR);
+        if (end == NULL)
+        {
+            end = level + strlen(level);
+        }
+
+        // a wildcard must be the whole level, and '#' must be the last one
+        if (memchr(level, WILDCARD_SINGLE, end - level) != NULL ||
+            memchr(level, WILDCARD_MULTI, end - level) != NULL)
+        {
+            if (end - level != 1 || (level[0] == WILDCARD_MULTI && *end != '\0'))
+            {
+                return 0;
+            }
+        }
+
+        if (*end == '\0')
+        {
+            return 1;
+        }
+        level = end + 1;
+    }
+}
+
+static const char* level_end(const char* level, const char* end)
+{
+    const char* separator = memchr(level, LEVEL_SEPARATOR, end - level);
+
+    return (separator != NULL) ? separator : end;
+}
+
+static uint8_t match(const mqtt_router_t* router, uint16_t node, const char* level, const router_message_t* message)
+{
+    const mqtt_router_node_t* current = &router->nodes[node];
+    const char* end = level_end(level, message->topic_end);
+    const char* next_level = (end == message->topic_end) ? NULL : end + 1;
+    uint16_t level_len = end - level;
+    uint8_t wildcards = !(level == message->topic && level_len > 0 && level[0] == SYSTEM_PREFIX);
+    uint8_t handled = 0;
+    uint16_t child;
+
+    if (wildcards)
+    {
+        handled += call_handler(router, current->hash, message);
+        handled += match_child(router, current->plus, next_level, message);
+    }
+
+    // only the children with the same level name are visited
+    for (child = current->child; child != MQTT_ROUTER_NO_NODE; child = router->nodes[child].sibling)
+    {
+        if (router->nodes[child].level_len == level_len &&
+            memcmp(router->nodes[child].level, level, level_len) == 0)
+        {
+            handled += match_child(router, child, next_level, message);
+            break;
+        }
+    }
+
+    return handled;
+}
+
+static uint8_t match_child(const mqtt_router_t* router, uint16_t child, const char* next_level, const router_message_t* message)
+{
+    if (child == MQTT_ROUTER_NO_NODE)
+    {
+        return 0;
+    }
+
+    if (next_level != NULL)
+    {
+        return match(router, child, next_level, message);
+    }
+
+    // last topic level: the filter ends here, or continues with a '#' that also matches the parent
+    return call_handler(router, child, message) + call_handler(router, router->nodes[child].hash, message);
+}
+
+static uint8_t call_handler(const mqtt_router_t* router, uint16_t node, const router_message_t* message)
+{
+    if (node == MQTT_ROUTER_NO_NODE || router->nodes[node].handler == NULL)
+    {
+        return 0;
+    }
+
+    router->nodes[node].handler(message->topic, message->topic_len, message->data, message->data_len,
+                                router->nodes[node].context);
+    return 1;
+}
@@ -0,0 +1,176 @@
+/* ===== [spsc_ring.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SPSC_RING_H__
+#define __SPSC_RING_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Struct: spsc_ring_t
+| ------------------------------------------------------------------
+|  Description: lock-free ring of fixed size items between exactly
+|               one producer (a callback) and one consumer (a task).
+|               Neither side blocks or disables interrupts: the
+|               producer only writes head, the consumer only writes
+|               tail. When the producer is told the consumer may be
+|               waiting it wakes it up (task notification), so the
+|               ring itself does not depend on FreeRTOS.
+|
+|  Members:
+|       items       - storage, capacity * item_size bytes
+|       item_size   - size of an item
+|       mask        - capacity - 1 (the capacity is a power of 2)
+|       head        - items written, free running (producer)
+|       tail        - items read, free running (consumer)
+|       dropped     - items that did not fit (producer)
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint8_t*    items;
+    uint16_t    item_size;
+    uint32_t    mask;
+    uint32_t    head;
+    uint32_t    tail;
+    uint32_t    dropped;
+}   spsc_ring_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: spsc_ring_init
+| ------------------------------------------------------------------
+|  Description: initializes an empty ring.
+|
+|  Parameters:
+|       - ring: ring.
+|       - items: storage of capacity * item_size bytes.
+|       - item_size: size of an item.
+|       - capacity: number of items, a power of 2.
+|
+|  Returns:  int8_t
+|           0 if OK, -1 if the capacity is not a power of 2
+*-------------------------------------------------------------------*/
+int8_t spsc_ring_init(spsc_ring_t* ring, void* items, uint16_t item_size, uint32_t capacity);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_reserve
+| ------------------------------------------------------------------
+|  Description: producer side, next free item to be filled in place
+|               and published with spsc_ring_commit. A full ring
+|               counts the item as dropped.
+|
+|  Parameters:
+|       - ring: ring.
+|
+|  Returns:  void*
+|           item to fill in, NULL if the ring is full
+*-------------------------------------------------------------------*/
+void* spsc_ring_reserve(spsc_ring_t* ring);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_commit
+| ------------------------------------------------------------------
+|  Description: producer side, publishes the item returned by
+|               spsc_ring_reserve.
+|
+|  Parameters:
+|       - ring: ring.
+|
+|  Returns:  uint8_t
+|           1 if the consumer had taken every previous item (it may
+|           be waiting, wake it up), 0 otherwise
+*-------------------------------------------------------------------*/
+uint8_t spsc_ring_commit(spsc_ring_t* ring);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_push
+| ------------------------------------------------------------------
+|  Description: producer side, copies an item into the ring.
+|
+|  Parameters:
+|       - ring: ring.
+|       - item: item_size bytes to copy.
+|
+|  Returns:  int8_t
+|           1 if pushed and the consumer has to be woken up, 0 if
+|           pushed, -1 if the ring is full (item dropped)
+*-------------------------------------------------------------------*/
+int8_t spsc_ring_push(spsc_ring_t* ring, const void* item);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_peek
+| ------------------------------------------------------------------
+|  Description: consumer side, oldest item, it stays in the ring
+|               until spsc_ring_release. A NULL result is final: an
+|               item pushed after it wakes the consumer up.
+|
+|  Parameters:
+|       - ring: ring.
+|
+|  Returns:  void*
+|           oldest item, NULL if the ring is empty
+*-------------------------------------------------------------------*/
+void* spsc_ring_peek(spsc_ring_t* ring);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_release
+| ------------------------------------------------------------------
+|  Description: consumer side, frees the item returned by
+|               spsc_ring_peek.
+|
+|  Parameters:
+|       - ring: ring.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void spsc_ring_release(spsc_ring_t* ring);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_pop
+| ------------------------------------------------------------------
+|  Description: consumer side, copies and frees the oldest item.
+|
+|  Parameters:
+|       - ring: ring.
+|       - item: where the item is copied.
+|
+|  Returns:  uint8_t
+|           1 if an item was taken, 0 if the ring is empty
+*-------------------------------------------------------------------*/
+uint8_t spsc_ring_pop(spsc_ring_t* ring, void* item);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_count
+| ------------------------------------------------------------------
+|  Description: items waiting, exact from the consumer, a snapshot
+|               from anywhere else.
+|
+|  Parameters:
+|       - ring: ring.
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t spsc_ring_count(const spsc_ring_t* ring);
+
+/*------------------------------------------------------------------
+|  Function: spsc_ring_dropped
+| ------------------------------------------------------------------
+|  Description: items dropped because the ring was full.
+|
+|  Parameters:
+|       - ring: ring.
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t spsc_ring_dropped(const spsc_ring_t* ring);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SPSC_RING_H__
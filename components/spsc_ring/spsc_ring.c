@@ -0,0 +1,138 @@
+/* ===== [spsc_ring.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "spsc_ring.h"
+
+#include <stddef.h>
+#include <string.h>
+
+/*------------------------------------------------------------------
+|  head and tail are free running, head - tail is the number of
+|  items even after they wrap around. Each side reads the index of
+|  the other one with acquire and publishes its own with release, so
+|  an item is never read before it was written nor overwritten
+|  before it was read.
+|
+|  Wake up: the producer publishes head and then reads tail, the
+|  consumer publishes tail and then (only when the ring looks empty)
+|  reads head again, both with a full fence in between. At least one
+|  of them sees the store of the other: either the consumer finds
+|  the new item or the producer finds every previous item taken and
+|  wakes the consumer up.
+*-------------------------------------------------------------------*/
+
+/* ===== Prototypes of private functions ===== */
+static uint8_t* item_at(const spsc_ring_t* ring, uint32_t index);
+
+
+/* ===== Implementations of public functions ===== */
+int8_t spsc_ring_init(spsc_ring_t* ring, void* items, uint16_t item_size, uint32_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        return -1;
+    }
+
+    ring->items = items;
+    ring->item_size = item_size;
+    ring->mask = capacity - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->dropped = 0;
+    return 0;
+}
+
+void* spsc_ring_reserve(spsc_ring_t* ring)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->mask)
+    {
+        __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return item_at(ring, head);
+}
+
+uint8_t spsc_ring_commit(spsc_ring_t* ring)
+{
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) == head;
+}
+
+int8_t spsc_ring_push(spsc_ring_t* ring, const void* item)
+{
+    void* slot = spsc_ring_reserve(ring);
+
+    if (slot == NULL)
+    {
+        return -1;
+    }
+    memcpy(slot, item, ring->item_size);
+    return spsc_ring_commit(ring);
+}
+
+void* spsc_ring_peek(spsc_ring_t* ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+    {
+        // the fence is only paid when the consumer is about to wait
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+        {
+            return NULL;
+        }
+    }
+    return item_at(ring, tail);
+}
+
+void spsc_ring_release(spsc_ring_t* ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+uint8_t spsc_ring_pop(spsc_ring_t* ring, void* item)
+{
+    void* slot = spsc_ring_peek(ring);
+
+    if (slot == NULL)
+    {
+        return 0;
+    }
+    memcpy(item, slot, ring->item_size);
+    spsc_ring_release(ring);
+    return 1;
+}
+
+uint32_t spsc_ring_count(const spsc_ring_t* ring)
+{
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+}
+
+uint32_t spsc_ring_dropped(const spsc_ring_t* ring)
+{
+    return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static uint8_t* item_at(const spsc_ring_t* ring, uint32_t index)
+{
+    return ring->items + (size_t)(index & ring->mask) * ring->item_size;
+}
@@ -0,0 +1,166 @@
+/* ===== [cbor_encoder.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "cbor_encoder.h"
+
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define CBOR_MAJOR_UINT     0x00
+#define CBOR_MAJOR_NINT     0x20
+#define CBOR_MAJOR_TEXT     0x60
+#define CBOR_MAJOR_ARRAY    0x80
+#define CBOR_MAJOR_MAP      0xA0
+#define CBOR_FALSE          0xF4
+#define CBOR_TRUE           0xF5
+
+#define CBOR_INFO_UINT8     24
+#define CBOR_INFO_UINT16    25
+#define CBOR_INFO_UINT32    26
+#define CBOR_INFO_UINT64    27
+
+
+/* ===== Prototypes of private functions ===== */
+static void encode_head(cbor_encoder_t* encoder, uint8_t major, uint64_t value);
+static uint8_t* reserve(cbor_encoder_t* encoder, size_t len);
+
+
+/* ===== Implementations of public functions ===== */
+void cbor_encoder_init(cbor_encoder_t* encoder, uint8_t* buffer, size_t size)
+{
+    encoder->buffer = buffer;
+    encoder->size = size;
+    encoder->len = 0;
+    encoder->overflow = 0;
+}
+
+void cbor_encode_map(cbor_encoder_t* encoder, uint32_t pairs)
+{
+    encode_head(encoder, CBOR_MAJOR_MAP, pairs);
+}
+
+void cbor_encode_array(cbor_encoder_t* encoder, uint32_t items)
+{
+    encode_head(encoder, CBOR_MAJOR_ARRAY, items);
+}
+
+void cbor_encode_uint(cbor_encoder_t* encoder, uint64_t value)
+{
+    encode_head(encoder, CBOR_MAJOR_UINT, value);
+}
+
+void cbor_encode_int(cbor_encoder_t* encoder, int64_t value)
+{
+    if (value >= 0)
+    {
+        encode_head(encoder, CBOR_MAJOR_UINT, (uint64_t)value);
+    }
+    else
+    {
+        // negative integers are stored as -1 - value
+        encode_head(encoder, CBOR_MAJOR_NINT, (uint64_t)(-1 - value));
+    }
+}
+
+void cbor_encode_text(cbor_encoder_t* encoder, const char* text, size_t len)
+{
+    uint8_t* out;
+
+    encode_head(encoder, CBOR_MAJOR_TEXT, len);
+    out = reserve(encoder, len);
+    if (out != NULL)
+    {
+        memcpy(out, text, len);
+    }
+}
+
+void cbor_encode_cstr(cbor_encoder_t* encoder, const char* text)
+{
+    cbor_encode_text(encoder, text, strlen(text));
+}
+
+void cbor_encode_bool(cbor_encoder_t* encoder, uint8_t value)
+{
+    uint8_t* out = reserve(encoder, 1);
+    if (out != NULL)
+    {
+        out[0] = value ? CBOR_TRUE : CBOR_FALSE;
+    }
+}
+
+int32_t cbor_encoder_length(const cbor_encoder_t* encoder)
+{
+    return encoder->overflow ? -1 : (int32_t)encoder->len;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void encode_head(cbor_encoder_t* encoder, uint8_t major, uint64_t value)
+{
+    uint8_t* out;
+    uint8_t extra;
+    uint8_t info;
+    uint8_t i;
+
+    // the argument goes in the initial byte if it is small, otherwise in 1, 2, 4 or 8 big endian bytes
+    if (value < CBOR_INFO_UINT8)
+    {
+        extra = 0;
+        info = (uint8_t)value;
+    }
+    else if (value <= 0xFF)
+    {
+        extra = 1;
+        info = CBOR_INFO_UINT8;
+    }
+    else if (value <= 0xFFFF)
+    {
+        extra = 2;
+        info = CBOR_INFO_UINT16;
+    }
+    else if (value <= 0xFFFFFFFF)
+    {
+        extra = 4;
+        info = CBOR_INFO_UINT32;
+    }
+    else
+    {
+        extra = 8;
+        info = CBOR_INFO_UINT64;
+    }
+
+    out = reserve(encoder, 1 + extra);
+    if (out == NULL)
+    {
+        return;
+    }
+
+    out[0] = major | info;
+    for (i = 0; i < extra; i++)
+    {
+        out[extra - i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint8_t* reserve(cbor_encoder_t* encoder, size_t len)
+{
+    uint8_t* out;
+
+    if (encoder->overflow || encoder->size - encoder->len < len)
+    {
+        encoder->overflow = 1;
+        return NULL;
+    }
+
+    out = encoder->buffer + encoder->len;
+    encoder->len += len;
+    return out;
+}
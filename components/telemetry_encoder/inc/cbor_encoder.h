@@ -0,0 +1,167 @@
+/* ===== [cbor_encoder.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __CBOR_ENCODER_H__
+#define __CBOR_ENCODER_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+#include <stddef.h>
+
+/* ===== Macros of public constants ===== */
+
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Struct: cbor_encoder_t
+| ------------------------------------------------------------------
+|  Description: streaming CBOR (RFC 7049) encoder that writes
+|               straight into a caller buffer. Running out of space
+|               sets a sticky overflow flag, so the items can be
+|               encoded without checking every call.
+|
+|  Members:
+|       buffer      - output buffer
+|       size        - size of buffer
+|       len         - bytes written so far
+|       overflow    - 1 if an item did not fit
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint8_t*    buffer;
+    size_t      size;
+    size_t      len;
+    uint8_t     overflow;
+}   cbor_encoder_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: cbor_encoder_init
+| ------------------------------------------------------------------
+|  Description: starts encoding into buffer.
+|
+|  Parameters:
+|       - encoder: encoder to initialize.
+|       - buffer: output buffer.
+|       - size: size of buffer.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encoder_init(cbor_encoder_t* encoder, uint8_t* buffer, size_t size);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encode_map
+| ------------------------------------------------------------------
+|  Description: starts a map. It must be followed by 2 * pairs
+|               items (key, value, key, value...).
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|       - pairs: number of key/value pairs.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encode_map(cbor_encoder_t* encoder, uint32_t pairs);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encode_array
+| ------------------------------------------------------------------
+|  Description: starts an array of items.
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|       - items: number of items that follow.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encode_array(cbor_encoder_t* encoder, uint32_t items);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encode_uint
+| ------------------------------------------------------------------
+|  Description: encodes an unsigned integer in the shortest form.
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|       - value: value to encode.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encode_uint(cbor_encoder_t* encoder, uint64_t value);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encode_int
+| ------------------------------------------------------------------
+|  Description: encodes a signed integer in the shortest form.
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|       - value: value to encode.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encode_int(cbor_encoder_t* encoder, int64_t value);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encode_text
+| ------------------------------------------------------------------
+|  Description: encodes an UTF-8 text string.
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|       - text: string to encode (it does not need a NUL).
+|       - len: length of text in bytes.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encode_text(cbor_encoder_t* encoder, const char* text, size_t len);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encode_cstr
+| ------------------------------------------------------------------
+|  Description: encodes a NUL terminated string as text.
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|       - text: string to encode.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encode_cstr(cbor_encoder_t* encoder, const char* text);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encode_bool
+| ------------------------------------------------------------------
+|  Description: encodes true or false.
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|       - value: 0 for false, anything else for true.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void cbor_encode_bool(cbor_encoder_t* encoder, uint8_t value);
+
+/*------------------------------------------------------------------
+|  Function: cbor_encoder_length
+| ------------------------------------------------------------------
+|  Description: number of bytes encoded.
+|
+|  Parameters:
+|       - encoder: encoder to use.
+|
+|  Returns:  int32_t
+|           -1 if something did not fit in the buffer
+*-------------------------------------------------------------------*/
+int32_t cbor_encoder_length(const cbor_encoder_t* encoder);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __CBOR_ENCODER_H__
@@ -0,0 +1,147 @@
+/* ===== [telemetry_filter.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __TELEMETRY_FILTER_H__
+#define __TELEMETRY_FILTER_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "telemetry_payload.h"
+
+/* ===== Macros of public constants ===== */
+
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: telemetry_filter_reason_t
+| ------------------------------------------------------------------
+|  Description: why a sample was published (or not).
+|
+|  Values:
+|       TELEMETRY_SUPPRESSED        - nothing relevant changed
+|       TELEMETRY_PUBLISH_FIRST     - first sample
+|       TELEMETRY_PUBLISH_STATE     - the slave state changed
+|       TELEMETRY_PUBLISH_DEADBAND  - a value left its deadband
+|       TELEMETRY_PUBLISH_HEARTBEAT - the heartbeat interval passed
+*-------------------------------------------------------------------*/
+typedef enum {
+    TELEMETRY_SUPPRESSED,
+    TELEMETRY_PUBLISH_FIRST,
+    TELEMETRY_PUBLISH_STATE,
+    TELEMETRY_PUBLISH_DEADBAND,
+    TELEMETRY_PUBLISH_HEARTBEAT,
+}   telemetry_filter_reason_t;
+
+/*------------------------------------------------------------------
+|  Struct: telemetry_filter_stats_t
+| ------------------------------------------------------------------
+|  Description: filter counters.
+|
+|  Members:
+|       evaluated   - samples checked
+|       suppressed  - samples not published
+|       state       - samples published because of the state
+|       deadband    - samples published because of the deadband
+|       heartbeat   - samples published because of the heartbeat
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint32_t    evaluated;
+    uint32_t    suppressed;
+    uint32_t    state;
+    uint32_t    deadband;
+    uint32_t    heartbeat;
+}   telemetry_filter_stats_t;
+
+/*------------------------------------------------------------------
+|  Struct: telemetry_filter_t
+| ------------------------------------------------------------------
+|  Description: deadband and heartbeat filter. Values are compared
+|               with the last published sample, so a slow drift
+|               is published once it adds up to the deadband.
+|
+|  Members:
+|       temp_deadband   - max temperature change that is suppressed
+|       heartbeat_s     - max time between published samples
+|       published       - a sample was already published
+|       last            - last published sample
+|       stats           - filter counters
+*-------------------------------------------------------------------*/
+typedef struct {
+    int32_t                     temp_deadband;
+    uint32_t                    heartbeat_s;
+    uint8_t                     published;
+    telemetry_sample_t          last;
+    telemetry_filter_stats_t    stats;
+}   telemetry_filter_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: telemetry_filter_init
+| ------------------------------------------------------------------
+|  Description: starts a filter (the first sample is always
+|               published).
+|
+|  Parameters:
+|       - filter: filter to initialize.
+|       - temp_deadband: max temperature change that is suppressed.
+|       - heartbeat_s: max time between published samples.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void telemetry_filter_init(telemetry_filter_t* filter, int32_t temp_deadband, uint32_t heartbeat_s);
+
+/*------------------------------------------------------------------
+|  Function: telemetry_filter_check
+| ------------------------------------------------------------------
+|  Description: decides if a sample must be published. When it must,
+|               it becomes the new reference sample.
+|
+|  Parameters:
+|       - filter: filter to use.
+|       - sample: new sample.
+|
+|  Returns:  telemetry_filter_reason_t
+|           TELEMETRY_SUPPRESSED if it must not be published
+*-------------------------------------------------------------------*/
+telemetry_filter_reason_t telemetry_filter_check(telemetry_filter_t* filter, const telemetry_sample_t* sample);
+
+/*------------------------------------------------------------------
+|  Function: telemetry_filter_heartbeat_due
+| ------------------------------------------------------------------
+|  Description: checks if the next sample will be published anyway
+|               because of the heartbeat.
+|
+|  Parameters:
+|       - filter: filter to use.
+|       - now: current time (seconds since the epoch).
+|
+|  Returns:  uint8_t
+|           1 if the heartbeat interval passed (or nothing was
+|           published yet)
+*-------------------------------------------------------------------*/
+uint8_t telemetry_filter_heartbeat_due(const telemetry_filter_t* filter, long now);
+
+/*------------------------------------------------------------------
+|  Function: telemetry_filter_reason_name
+| ------------------------------------------------------------------
+|  Description: name of a reason, for logs.
+|
+|  Parameters:
+|       - reason: reason.
+|
+|  Returns:  const char*
+*-------------------------------------------------------------------*/
+const char* telemetry_filter_reason_name(telemetry_filter_reason_t reason);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __TELEMETRY_FILTER_H__
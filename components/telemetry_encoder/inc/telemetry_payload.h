@@ -0,0 +1,142 @@
+/* ===== [telemetry_payload.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __TELEMETRY_PAYLOAD_H__
+#define __TELEMETRY_PAYLOAD_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+/* ===== Macros of public constants ===== */
+#define TELEMETRY_PAYLOAD_JSON  "{\"timestamp\": %ld, \"device\": \"%s\", \"state\": \"%s\", \"state_int\": %d, \"temp\": %d}"
+#define TELEMETRY_MEASURE_JSON  "{\"timestamp\": %ld, \"device\": \"%s\", \"temp\": %d}"
+#define TELEMETRY_STATE_JSON    "{\"state\": \"%s\", \"state_int\": %d, \"firmware\": \"%s\", \"mode\": \"%s\"}"
+
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: telemetry_format_t
+| ------------------------------------------------------------------
+|  Description: encoding used for a telemetry payload.
+|
+|  Values:
+|       TELEMETRY_FORMAT_JSON   - text, for brokers that need JSON
+|       TELEMETRY_FORMAT_CBOR   - binary, same keys as the JSON
+*-------------------------------------------------------------------*/
+typedef enum {
+    TELEMETRY_FORMAT_JSON,
+    TELEMETRY_FORMAT_CBOR,
+}   telemetry_format_t;
+
+/*------------------------------------------------------------------
+|  Struct: telemetry_sample_t
+| ------------------------------------------------------------------
+|  Description: one telemetry sample.
+|
+|  Members:
+|       timestamp   - seconds since the epoch
+|       device      - device id
+|       state       - slave state name (NULL to leave the state out,
+|                     when it is reported on its own topic)
+|       state_int   - slave state number
+|       temp        - temperature
+*-------------------------------------------------------------------*/
+typedef struct {
+    long            timestamp;
+    const char*     device;
+    const char*     state;
+    int32_t         state_int;
+    int32_t         temp;
+}   telemetry_sample_t;
+
+/*------------------------------------------------------------------
+|  Struct: telemetry_device_state_t
+| ------------------------------------------------------------------
+|  Description: device state, reported only when it changes.
+|
+|  Members:
+|       state       - slave state name
+|       state_int   - slave state number
+|       firmware    - firmware version
+|       mode        - connectivity mode
+*-------------------------------------------------------------------*/
+typedef struct {
+    const char*     state;
+    int32_t         state_int;
+    const char*     firmware;
+    const char*     mode;
+}   telemetry_device_state_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: telemetry_encode
+| ------------------------------------------------------------------
+|  Description: encodes a sample straight into buffer (no
+|               intermediate string).
+|
+|  Parameters:
+|       - sample: sample to encode.
+|       - format: JSON or CBOR.
+|       - buffer: output buffer (JSON is NUL terminated if it fits).
+|       - size: size of buffer.
+|
+|  Returns:  int32_t
+|           number of bytes, -1 if the sample does not fit
+*-------------------------------------------------------------------*/
+int32_t telemetry_encode(const telemetry_sample_t* sample, telemetry_format_t format, uint8_t* buffer, uint16_t size);
+
+/*------------------------------------------------------------------
+|  Function: telemetry_encode_state
+| ------------------------------------------------------------------
+|  Description: encodes a device state straight into buffer.
+|
+|  Parameters:
+|       - state: device state to encode.
+|       - format: JSON or CBOR.
+|       - buffer: output buffer (JSON is NUL terminated if it fits).
+|       - size: size of buffer.
+|
+|  Returns:  int32_t
+|           number of bytes, -1 if the state does not fit
+*-------------------------------------------------------------------*/
+int32_t telemetry_encode_state(const telemetry_device_state_t* state, telemetry_format_t format,
+                               uint8_t* buffer, uint16_t size);
+
+/*------------------------------------------------------------------
+|  Function: telemetry_device_state_equal
+| ------------------------------------------------------------------
+|  Description: compares two device states (the state name is not
+|               compared, it follows state_int).
+|
+|  Parameters:
+|       - a: first state.
+|       - b: second state.
+|
+|  Returns:  uint8_t
+|           1 if nothing changed
+*-------------------------------------------------------------------*/
+uint8_t telemetry_device_state_equal(const telemetry_device_state_t* a, const telemetry_device_state_t* b);
+
+/*------------------------------------------------------------------
+|  Function: telemetry_format_name
+| ------------------------------------------------------------------
+|  Description: name of a format, for logs.
+|
+|  Parameters:
+|       - format: format.
+|
+|  Returns:  const char*
+*-------------------------------------------------------------------*/
+const char* telemetry_format_name(telemetry_format_t format);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __TELEMETRY_PAYLOAD_H__
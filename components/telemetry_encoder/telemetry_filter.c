@@ -0,0 +1,97 @@
+/* ===== [telemetry_filter.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "telemetry_filter.h"
+
+#include <string.h>
+
+
+/* ===== Implementations of public functions ===== */
+void telemetry_filter_init(telemetry_filter_t* filter, int32_t temp_deadband, uint32_t heartbeat_s)
+{
+    memset(filter, 0, sizeof(telemetry_filter_t));
+    filter->temp_deadband = (temp_deadband > 0) ? temp_deadband : 0;
+    filter->heartbeat_s = heartbeat_s;
+}
+
+telemetry_filter_reason_t telemetry_filter_check(telemetry_filter_t* filter, const telemetry_sample_t* sample)
+{
+    telemetry_filter_reason_t reason;
+    int32_t temp_delta;
+
+    filter->stats.evaluated++;
+
+    // the state is checked first, so a state change is never counted as anything else
+    if (!filter->published)
+    {
+        reason = TELEMETRY_PUBLISH_FIRST;
+    }
+    else if (sample->state_int != filter->last.state_int)
+    {
+        reason = TELEMETRY_PUBLISH_STATE;
+        filter->stats.state++;
+    }
+    else
+    {
+        temp_delta = sample->temp - filter->last.temp;
+        if (temp_delta > filter->temp_deadband || temp_delta < -filter->temp_deadband)
+        {
+            reason = TELEMETRY_PUBLISH_DEADBAND;
+            filter->stats.deadband++;
+        }
+        else if (telemetry_filter_heartbeat_due(filter, sample->timestamp))
+        {
+            reason = TELEMETRY_PUBLISH_HEARTBEAT;
+            filter->stats.heartbeat++;
+        }
+        else
+        {
+            filter->stats.suppressed++;
+            return TELEMETRY_SUPPRESSED;
+        }
+    }
+
+    // the strings are not kept, only the values are compared
+    filter->published = 1;
+    filter->last = *sample;
+    filter->last.device = NULL;
+    filter->last.state = NULL;
+
+    return reason;
+}
+
+uint8_t telemetry_filter_heartbeat_due(const telemetry_filter_t* filter, long now)
+{
+    if (!filter->published)
+    {
+        return 1;
+    }
+
+    return (now - filter->last.timestamp) >= (long)filter->heartbeat_s;
+}
+
+const char* telemetry_filter_reason_name(telemetry_filter_reason_t reason)
+{
+    switch (reason)
+    {
+        case TELEMETRY_SUPPRESSED:
+            return "SUPPRESSED";
+        case TELEMETRY_PUBLISH_FIRST:
+            return "FIRST";
+        case TELEMETRY_PUBLISH_STATE:
+            return "STATE";
+        case TELEMETRY_PUBLISH_DEADBAND:
+            return "DEADBAND";
+        case TELEMETRY_PUBLISH_HEARTBEAT:
+            return "HEARTBEAT";
+        default:
+            return "UNKNOWN";
+    }
+}
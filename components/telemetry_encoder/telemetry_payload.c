@@ -0,0 +1,146 @@
+/* ===== [telemetry_payload.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "telemetry_payload.h"
+#include "cbor_encoder.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define TELEMETRY_FIELDS    5
+#define MEASURE_FIELDS      3
+#define STATE_FIELDS        4
+
+
+/* ===== Prototypes of private functions ===== */
+static int32_t encode_json(const telemetry_sample_t* sample, uint8_t* buffer, uint16_t size);
+static int32_t encode_cbor(const telemetry_sample_t* sample, uint8_t* buffer, uint16_t size);
+static int32_t snprintf_length(int len, uint16_t size);
+static uint8_t same_string(const char* a, const char* b);
+
+
+/* ===== Implementations of public functions ===== */
+int32_t telemetry_encode(const telemetry_sample_t* sample, telemetry_format_t format, uint8_t* buffer, uint16_t size)
+{
+    switch (format)
+    {
+        case TELEMETRY_FORMAT_CBOR:
+            return encode_cbor(sample, buffer, size);
+        case TELEMETRY_FORMAT_JSON:
+        default:
+            return encode_json(sample, buffer, size);
+    }
+}
+
+int32_t telemetry_encode_state(const telemetry_device_state_t* state, telemetry_format_t format,
+                               uint8_t* buffer, uint16_t size)
+{
+    cbor_encoder_t encoder;
+
+    if (format != TELEMETRY_FORMAT_CBOR)
+    {
+        return snprintf_length(snprintf((char*)buffer, size, TELEMETRY_STATE_JSON, state->state,
+                                        state->state_int, state->firmware, state->mode), size);
+    }
+
+    cbor_encoder_init(&encoder, buffer, size);
+    cbor_encode_map(&encoder, STATE_FIELDS);
+    cbor_encode_cstr(&encoder, "state");
+    cbor_encode_cstr(&encoder, state->state);
+    cbor_encode_cstr(&encoder, "state_int");
+    cbor_encode_int(&encoder, state->state_int);
+    cbor_encode_cstr(&encoder, "firmware");
+    cbor_encode_cstr(&encoder, state->firmware);
+    cbor_encode_cstr(&encoder, "mode");
+    cbor_encode_cstr(&encoder, state->mode);
+
+    return cbor_encoder_length(&encoder);
+}
+
+uint8_t telemetry_device_state_equal(const telemetry_device_state_t* a, const telemetry_device_state_t* b)
+{
+    return a->state_int == b->state_int && same_string(a->firmware, b->firmware) && same_string(a->mode, b->mode);
+}
+
+const char* telemetry_format_name(telemetry_format_t format)
+{
+    switch (format)
+    {
+        case TELEMETRY_FORMAT_CBOR:
+            return "CBOR";
+        case TELEMETRY_FORMAT_JSON:
+            return "JSON";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+
+/* ===== Implementations of private functions ===== */
+static int32_t encode_json(const telemetry_sample_t* sample, uint8_t* buffer, uint16_t size)
+{
+    int len;
+
+    if (sample->state == NULL)
+    {
+        len = snprintf((char*)buffer, size, TELEMETRY_MEASURE_JSON, sample->timestamp, sample->device, sample->temp);
+    }
+    else
+    {
+        len = snprintf((char*)buffer, size, TELEMETRY_PAYLOAD_JSON, sample->timestamp, sample->device,
+                       sample->state, sample->state_int, sample->temp);
+    }
+
+    return snprintf_length(len, size);
+}
+
+static int32_t encode_cbor(const telemetry_sample_t* sample, uint8_t* buffer, uint16_t size)
+{
+    cbor_encoder_t encoder;
+
+    cbor_encoder_init(&encoder, buffer, size);
+    cbor_encode_map(&encoder, (sample->state == NULL) ? MEASURE_FIELDS : TELEMETRY_FIELDS);
+    cbor_encode_cstr(&encoder, "timestamp");
+    cbor_encode_int(&encoder, sample->timestamp);
+    cbor_encode_cstr(&encoder, "device");
+    cbor_encode_cstr(&encoder, sample->device);
+    if (sample->state != NULL)
+    {
+        cbor_encode_cstr(&encoder, "state");
+        cbor_encode_cstr(&encoder, sample->state);
+        cbor_encode_cstr(&encoder, "state_int");
+        cbor_encode_int(&encoder, sample->state_int);
+    }
+    cbor_encode_cstr(&encoder, "temp");
+    cbor_encode_int(&encoder, sample->temp);
+
+    return cbor_encoder_length(&encoder);
+}
+
+static int32_t snprintf_length(int len, uint16_t size)
+{
+    // snprintf returns the length it would have needed
+    if (len < 0 || len >= size)
+    {
+        return -1;
+    }
+    return len;
+}
+
+static uint8_t same_string(const char* a, const char* b)
+{
+    if (a == NULL || b == NULL)
+    {
+        return a == b;
+    }
+    return strcmp(a, b) == 0;
+}
@@ -16,6 +16,23 @@
 #include "mbedtls/entropy.h"
 #include "mbedtls/ctr_drbg.h"
 
+/* ===== Macros of public constants ===== */
+// Max Fragment Length (RFC 6066) requested to the server. The largest code that fits in the
+// incoming record buffer is used, so a server that accepts it never sends a record that does not fit.
+#ifndef TLS_MAX_FRAG_LEN_CODE
+	#if !defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+		#define TLS_MAX_FRAG_LEN_CODE	MBEDTLS_SSL_MAX_FRAG_LEN_NONE
+	#elif MBEDTLS_SSL_IN_CONTENT_LEN >= 4096
+		#define TLS_MAX_FRAG_LEN_CODE	MBEDTLS_SSL_MAX_FRAG_LEN_4096
+	#elif MBEDTLS_SSL_IN_CONTENT_LEN >= 2048
+		#define TLS_MAX_FRAG_LEN_CODE	MBEDTLS_SSL_MAX_FRAG_LEN_2048
+	#elif MBEDTLS_SSL_IN_CONTENT_LEN >= 1024
+		#define TLS_MAX_FRAG_LEN_CODE	MBEDTLS_SSL_MAX_FRAG_LEN_1024
+	#else
+		#define TLS_MAX_FRAG_LEN_CODE	MBEDTLS_SSL_MAX_FRAG_LEN_512
+	#endif
+#endif
+
 /* ===== Public structs and enums ===== */
 /*------------------------------------------------------------------
 |  Struct: mbedtls_connection_handler_t
@@ -31,6 +48,9 @@
 |		ssl 		- 
 |		server_fd 	- it has a single element of type int 
 |					  (the socket handler) named fd
+|		mfl_code 	- Max Fragment Length requested in the handshake,
+|					  set to MBEDTLS_SSL_MAX_FRAG_LEN_NONE once the
+|					  server refuses the extension
 *-------------------------------------------------------------------*/
 typedef struct {
 	mbedtls_entropy_context 	entropy;
@@ -39,6 +59,7 @@ typedef struct {
 	mbedtls_ssl_config 			conf;
 	mbedtls_ssl_context 		ssl;
 	mbedtls_net_context 		server_fd;
+	uint8_t 					mfl_code;
 }	mbedtls_connection_handler_t;
 
 
@@ -68,7 +89,10 @@ int configure_tls(mbedtls_connection_handler_t* mbedtls_handler, char* server, c
 |  Function: tls_send_http_request
 | ------------------------------------------------------------------
 |  Description: connects to the server, performs the SSL/TLS
-|				handshake, and sends the HTTP request.
+|				handshake, and sends the HTTP request. If the
+|				handshake fails while the Max Fragment Length
+|				extension is requested, it reconnects once without
+|				it and keeps it disabled for the next requests.
 |
 |  Parameters:
 |		- mbedtls_handler: handler with all the information of the
@@ -27,6 +27,11 @@
 static const char *TAG  = "TLS_HTTPS_CLIENT";
 
 /* ===== Prototypes of private functions ===== */
+static int tls_connect(mbedtls_connection_handler_t* mbedtls_handler, const char* server, const char* port);
+static int tls_handshake(mbedtls_connection_handler_t* mbedtls_handler);
+static void tls_log_max_frag_len(mbedtls_connection_handler_t* mbedtls_handler);
+static uint8_t tls_server_rejected_handshake(int ret_value);
+static unsigned char tls_negotiated_mfl(mbedtls_connection_handler_t* mbedtls_handler);
 
 
 /* ===== Implementations of public functions ===== */
@@ -85,6 +90,17 @@ int configure_tls(mbedtls_connection_handler_t* mbedtls_handler, char* server, c
 	mbedtls_ssl_conf_ca_chain(&mbedtls_handler->conf, &mbedtls_handler->cacert, NULL);
 	mbedtls_ssl_conf_rng(&mbedtls_handler->conf, mbedtls_ctr_drbg_random, &mbedtls_handler->ctr_drbg);
 
+	// ask the server for records that fit in the (reduced) incoming record buffer
+	mbedtls_handler->mfl_code = TLS_MAX_FRAG_LEN_CODE;
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+	ret = mbedtls_ssl_conf_max_frag_len(&mbedtls_handler->conf, mbedtls_handler->mfl_code);
+	if (ret != 0)
+	{
+		ESP_LOGE(TAG, "mbedtls_ssl_conf_max_frag_len returned -0x%x", -ret);
+		mbedtls_handler->mfl_code = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+	}
+#endif
+
 	ret = mbedtls_ssl_setup(&mbedtls_handler->ssl, &mbedtls_handler->conf);
 	if (ret != 0)
 	{
@@ -100,31 +116,41 @@ int tls_send_http_request(mbedtls_connection_handler_t* mbedtls_handler, const c
 	int ret_value, flags;
 	char cert_info[100];
 
-	mbedtls_net_init(&mbedtls_handler->server_fd);
-
-	ESP_LOGI(TAG, "Connecting to %s:%s.", server, port);
-	ret_value = mbedtls_net_connect(&mbedtls_handler->server_fd, server,
-									port, MBEDTLS_NET_PROTO_TCP);
+	ret_value = tls_connect(mbedtls_handler, server, port);
 	if (ret_value != 0)
 	{
-		ESP_LOGE(TAG, "mbedtls_net_connect returned -%x", -ret_value);
 		return ret_value;
 	}
-	ESP_LOGI(TAG, "Connected.");
 
-	mbedtls_ssl_set_bio(&mbedtls_handler->ssl, &mbedtls_handler->server_fd, 
-						mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
-
-	ESP_LOGI(TAG, "Performing the SSL/TLS handshake.");
-	while ((ret_value = mbedtls_ssl_handshake(&mbedtls_handler->ssl)) != 0)
+	ret_value = tls_handshake(mbedtls_handler);
+	if (ret_value != 0 && mbedtls_handler->mfl_code != MBEDTLS_SSL_MAX_FRAG_LEN_NONE &&
+		tls_server_rejected_handshake(ret_value))
 	{
-		if (ret_value != MBEDTLS_ERR_SSL_WANT_READ && ret_value != MBEDTLS_ERR_SSL_WANT_WRITE)
+		// some servers abort the handshake instead of ignoring an unsupported extension,
+		// so retry once without it (and do not request it again for this handler)
+		ESP_LOGW(TAG, "Handshake failed with Max Fragment Length requested, retrying without it.");
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+		mbedtls_handler->mfl_code = MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+		mbedtls_ssl_conf_max_frag_len(&mbedtls_handler->conf, MBEDTLS_SSL_MAX_FRAG_LEN_NONE);
+#endif
+		mbedtls_ssl_session_reset(&mbedtls_handler->ssl);
+		mbedtls_net_free(&mbedtls_handler->server_fd);
+
+		ret_value = tls_connect(mbedtls_handler, server, port);
+		if (ret_value != 0)
 		{
-			ESP_LOGE(TAG, "mbedtls_ssl_handshake returned -0x%x", -ret_value);
 			return ret_value;
 		}
+		ret_value = tls_handshake(mbedtls_handler);
+	}
+
+	if (ret_value != 0)
+	{
+		return ret_value;
 	}
 
+	tls_log_max_frag_len(mbedtls_handler);
+
 	ESP_LOGI(TAG, "Verifying peer X.509 certificate.");
 	flags = mbedtls_ssl_get_verify_result(&mbedtls_handler->ssl);
 	// we should close the connection if it does not return 0
@@ -190,6 +216,11 @@ int tls_receive_http_response(mbedtls_connection_handler_t* mbedtls_handler, cha
 				// ESP_LOGI(TAG, "This is an expected timeout (not an error).");
 				ret = 0;
 			}
+			else if (ret == MBEDTLS_ERR_SSL_INVALID_RECORD && tls_negotiated_mfl(mbedtls_handler) == MBEDTLS_SSL_MAX_FRAG_LEN_NONE)
+			{
+				// without a negotiated Max Fragment Length the server may send records bigger than the input buffer
+				ESP_LOGE(TAG, "Record larger than the TLS input buffer (%d bytes).", MBEDTLS_SSL_IN_CONTENT_LEN);
+			}
 			else
 			{
 				ESP_LOGE(TAG, "mbedtls_ssl_read returned -0x%x", -ret);
@@ -248,3 +279,78 @@ void tls_clean_up(mbedtls_connection_handler_t* mbedtls_handler, int error)
 
 
 /* ===== Implementations of private functions ===== */
+static int tls_connect(mbedtls_connection_handler_t* mbedtls_handler, const char* server, const char* port)
+{
+	int ret_value;
+
+	mbedtls_net_init(&mbedtls_handler->server_fd);
+
+	ESP_LOGI(TAG, "Connecting to %s:%s.", server, port);
+	ret_value = mbedtls_net_connect(&mbedtls_handler->server_fd, server,
+									port, MBEDTLS_NET_PROTO_TCP);
+	if (ret_value != 0)
+	{
+		ESP_LOGE(TAG, "mbedtls_net_connect returned -%x", -ret_value);
+		return ret_value;
+	}
+	ESP_LOGI(TAG, "Connected.");
+
+	mbedtls_ssl_set_bio(&mbedtls_handler->ssl, &mbedtls_handler->server_fd, 
+						mbedtls_net_send, NULL, mbedtls_net_recv_timeout);
+
+	return 0;
+}
+
+static int tls_handshake(mbedtls_connection_handler_t* mbedtls_handler)
+{
+	int ret_value;
+
+	ESP_LOGI(TAG, "Performing the SSL/TLS handshake.");
+	while ((ret_value = mbedtls_ssl_handshake(&mbedtls_handler->ssl)) != 0)
+	{
+		if (ret_value != MBEDTLS_ERR_SSL_WANT_READ && ret_value != MBEDTLS_ERR_SSL_WANT_WRITE)
+		{
+			ESP_LOGE(TAG, "mbedtls_ssl_handshake returned -0x%x", -ret_value);
+			return ret_value;
+		}
+	}
+
+	return 0;
+}
+
+static void tls_log_max_frag_len(mbedtls_connection_handler_t* mbedtls_handler)
+{
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+	if (tls_negotiated_mfl(mbedtls_handler) != MBEDTLS_SSL_MAX_FRAG_LEN_NONE)
+	{
+		ESP_LOGI(TAG, "Max Fragment Length negotiated (%d bytes).",
+				(int)mbedtls_ssl_get_max_frag_len(&mbedtls_handler->ssl));
+	}
+	else if (mbedtls_handler->mfl_code != MBEDTLS_SSL_MAX_FRAG_LEN_NONE)
+	{
+		ESP_LOGW(TAG, "Server ignored Max Fragment Length, records up to %d bytes accepted.",
+				MBEDTLS_SSL_IN_CONTENT_LEN);
+	}
+#endif
+}
+
+static uint8_t tls_server_rejected_handshake(int ret_value)
+{
+	// a server that does not support the extension answers with an alert, an unexpected
+	// ServerHello or just closes the connection; timeouts and certificate errors are not retried
+	return ret_value == MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE ||
+		   ret_value == MBEDTLS_ERR_SSL_BAD_HS_SERVER_HELLO ||
+		   ret_value == MBEDTLS_ERR_SSL_CONN_EOF;
+}
+
+static unsigned char tls_negotiated_mfl(mbedtls_connection_handler_t* mbedtls_handler)
+{
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+	// the session only keeps the code if the server echoed the extension back
+	if (mbedtls_handler->ssl.session != NULL)
+	{
+		return mbedtls_handler->ssl.session->mfl_code;
+	}
+#endif
+	return MBEDTLS_SSL_MAX_FRAG_LEN_NONE;
+}
@@ -1,7 +1,9 @@
 // https://raw.githubusercontent.com/zhicheng/base64/master/base64.c
 /* This is a public domain base64 implementation written by WEI Zhicheng. */
+/* Reworked to process 3 bytes <-> 4 characters per iteration with full lookup tables. */
 
 #include <stdio.h>
+#include <stdint.h>
 
 #include "base64_url.h"
 
@@ -19,77 +21,90 @@ static const char base64en[] = {
 
 #define BASE64_PAD	'='
 
+#if BASE64URL_LUT12
+/* 12 bits -> 2 characters, built on first use (8 KB) */
+static char base64en12[4096][2];
+static uint8_t base64en12_ready = 0;
 
-#define BASE64DE_FIRST	'+'
-#define BASE64DE_LAST	'z'
-/* ASCII order for BASE 64 decode, -1 in unused character */
-static const signed char base64de[] = {
-	/* '+', ',', '-', '.', '/', '0', '1', '2', */ 
-	    62,  -1,  -1,  -1,  63,  52,  53,  54,
-
-	/* '3', '4', '5', '6', '7', '8', '9', ':', */
-	    55,  56,  57,  58,  59,  60,  61,  -1,
-
-	/* ';', '<', '=', '>', '?', '@', 'A', 'B', */
-	    -1,  -1,  -1,  -1,  -1,  -1,   0,   1, 
-
-	/* 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', */
-	     2,   3,   4,   5,   6,   7,   8,   9,
-
-	/* 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', */ 
-	    10,  11,  12,  13,  14,  15,  16,  17,
-
-	/* 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z', */
-	    18,  19,  20,  21,  22,  23,  24,  25,
-
-	/* '[', '\', ']', '^', '_', '`', 'a', 'b', */ 
-	    -1,  -1,  -1,  -1,  -1,  -1,  26,  27,
-
-	/* 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', */ 
-	    28,  29,  30,  31,  32,  33,  34,  35,
-
-	/* 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', */
-	    36,  37,  38,  39,  40,  41,  42,  43,
+static void base64url_build_lut12(void)
+{
+	unsigned int i;
 
-	/* 's', 't', 'u', 'v', 'w', 'x', 'y', 'z', */
-	    44,  45,  46,  47,  48,  49,  50,  51,
+	for (i = 0; i < 4096; i++) {
+		base64en12[i][0] = base64en[i >> 6];
+		base64en12[i][1] = base64en[i & 0x3F];
+	}
+	/* a concurrent first call only builds the same table twice */
+	base64en12_ready = 1;
+}
+#endif
+
+#define ERR	0xFF
+/* character -> 6 bit value for every byte, ERR if invalid ('+' and '/' are also accepted) */
+static const uint8_t base64de[256] = {
+	/* 0x00 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0x10 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0x20 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,  62, ERR,  62, ERR,  63,
+	/* 0x30 */  52,  53,  54,  55,  56,  57,  58,  59,  60,  61, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0x40 */ ERR,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+	/* 0x50 */  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, ERR, ERR, ERR, ERR,  63,
+	/* 0x60 */ ERR,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+	/* 0x70 */  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, ERR, ERR, ERR, ERR, ERR,
+	/* 0x80 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0x90 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0xA0 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0xB0 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0xC0 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0xD0 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0xE0 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
+	/* 0xF0 */ ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR, ERR,
 };
+#undef ERR
+#define BASE64DE_INVALID_MASK	0x80
+
 
 int base64url_encode(const unsigned char *in, unsigned int inlen, char *out)
 {
 	unsigned int i, j;
-
-	for (i = j = 0; i < inlen; i++) {
-		int s = i % 3; 			/* from 6/gcd(6, 8) */
-
-		switch (s) {
-		case 0:
-			out[j++] = base64en[(in[i] >> 2) & 0x3F];
-			continue;
-		case 1:
-			out[j++] = base64en[((in[i-1] & 0x3) << 4) + ((in[i] >> 4) & 0xF)];
-			continue;
-		case 2:
-			out[j++] = base64en[((in[i-1] & 0xF) << 2) + ((in[i] >> 6) & 0x3)];
-			out[j++] = base64en[in[i] & 0x3F];
-		}
+	uint32_t v;
+
+#if BASE64URL_LUT12
+	if (!base64en12_ready)
+		base64url_build_lut12();
+#endif
+
+	/* main loop: 3 bytes -> 4 characters */
+	for (i = j = 0; i + 3 <= inlen; i += 3, j += 4) {
+		v = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+#if BASE64URL_LUT12
+		out[j]     = base64en12[v >> 12][0];
+		out[j + 1] = base64en12[v >> 12][1];
+		out[j + 2] = base64en12[v & 0xFFF][0];
+		out[j + 3] = base64en12[v & 0xFFF][1];
+#else
+		out[j]     = base64en[(v >> 18) & 0x3F];
+		out[j + 1] = base64en[(v >> 12) & 0x3F];
+		out[j + 2] = base64en[(v >> 6) & 0x3F];
+		out[j + 3] = base64en[v & 0x3F];
+#endif
 	}
 
-	/* move back */
-	i -= 1;
-
-	/* check the last and add padding */
-    
-	if ((i % 3) == 0) {
-		out[j++] = base64en[(in[i] & 0x3) << 4];
-		//out[j++] = BASE64_PAD;
-		//out[j++] = BASE64_PAD;
-	} else if ((i % 3) == 1) {
-		out[j++] = base64en[(in[i] & 0xF) << 2];
-		//out[j++] = BASE64_PAD;
+	/* tail: 1 byte -> 2 characters, 2 bytes -> 3 characters (no padding in base64url) */
+	switch (inlen - i) {
+	case 1:
+		v = (uint32_t)in[i] << 16;
+		out[j++] = base64en[(v >> 18) & 0x3F];
+		out[j++] = base64en[(v >> 12) & 0x3F];
+		break;
+	case 2:
+		v = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8);
+		out[j++] = base64en[(v >> 18) & 0x3F];
+		out[j++] = base64en[(v >> 12) & 0x3F];
+		out[j++] = base64en[(v >> 6) & 0x3F];
+		break;
 	}
 
-    out[j++] = 0;
+	out[j] = 0;
 
 	return BASE64_OK;
 }
@@ -97,40 +112,68 @@ int base64url_encode(const unsigned char *in, unsigned int inlen, char *out)
 int base64url_decode(const char *in, unsigned int inlen, unsigned char *out)
 {
 	unsigned int i, j;
+	uint32_t a, b, c, d;
+
+	/* padding is optional in base64url */
+	if (inlen > 0 && in[inlen - 1] == BASE64_PAD)
+		inlen--;
+	if (inlen > 0 && in[inlen - 1] == BASE64_PAD)
+		inlen--;
+
+	if ((inlen & 3) == 1)
+		return BASE64_INVALID;
+
+	/* main loop: 4 characters -> 3 bytes, one validity check per group */
+	for (i = j = 0; i + 4 <= inlen; i += 4, j += 3) {
+		a = base64de[(unsigned char)in[i]];
+		b = base64de[(unsigned char)in[i + 1]];
+		c = base64de[(unsigned char)in[i + 2]];
+		d = base64de[(unsigned char)in[i + 3]];
+		if ((a | b | c | d) & BASE64DE_INVALID_MASK)
+			return BASE64_INVALID;
 
-	for (i = j = 0; i < inlen; i++) {
-		int c;
-		int s = i % 4; 			/* from 8/gcd(6, 8) */
-
-		if (in[i] == '=')
-			return BASE64_OK;
+		out[j]     = (unsigned char)((a << 2) | (b >> 4));
+		out[j + 1] = (unsigned char)((b << 4) | (c >> 2));
+		out[j + 2] = (unsigned char)((c << 6) | d);
+	}
 
-		if (in[i] < BASE64DE_FIRST || in[i] > BASE64DE_LAST ||
-		    (c = base64de[in[i] - BASE64DE_FIRST]) == -1)
+	/* tail: 2 characters -> 1 byte, 3 characters -> 2 bytes */
+	switch (inlen - i) {
+	case 2:
+		a = base64de[(unsigned char)in[i]];
+		b = base64de[(unsigned char)in[i + 1]];
+		if ((a | b) & BASE64DE_INVALID_MASK)
 			return BASE64_INVALID;
-
-		switch (s) {
-		case 0:
-			out[j] = ((unsigned int)c << 2) & 0xFF;
-			continue;
-		case 1:
-			out[j++] += ((unsigned int)c >> 4) & 0x3;
-
-			/* if not last char with padding */
-			if (i < (inlen - 3) || in[inlen - 2] != '=')
-				out[j] = ((unsigned int)c & 0xF) << 4; 
-			continue;
-		case 2:
-			out[j++] += ((unsigned int)c >> 2) & 0xF;
-
-			/* if not last char with padding */
-			if (i < (inlen - 2) || in[inlen - 1] != '=')
-				out[j] =  ((unsigned int)c & 0x3) << 6;
-			continue;
-		case 3:
-			out[j++] += (unsigned char)c;
-		}
+		out[j] = (unsigned char)((a << 2) | (b >> 4));
+		break;
+	case 3:
+		a = base64de[(unsigned char)in[i]];
+		b = base64de[(unsigned char)in[i + 1]];
+		c = base64de[(unsigned char)in[i + 2]];
+		if ((a | b | c) & BASE64DE_INVALID_MASK)
+			return BASE64_INVALID;
+		out[j]     = (unsigned char)((a << 2) | (b >> 4));
+		out[j + 1] = (unsigned char)((b << 4) | (c >> 2));
+		break;
 	}
 
 	return BASE64_OK;
 }
+
+unsigned int base64url_encoded_len(unsigned int inlen)
+{
+	return BASE64URL_ENCODE_OUT_SIZE(inlen);
+}
+
+unsigned int base64url_decoded_len(const char *in, unsigned int inlen)
+{
+	if (inlen > 0 && in[inlen - 1] == BASE64_PAD)
+		inlen--;
+	if (inlen > 0 && in[inlen - 1] == BASE64_PAD)
+		inlen--;
+
+	if ((inlen & 3) == 1)
+		return 0;
+
+	return BASE64URL_DECODE_OUT_SIZE(inlen);
+}
@@ -2,14 +2,30 @@
 #ifndef __BASE64URL_H__
 #define __BASE64URL_H__
 
+/* set to 1 to encode 12 bits per table lookup (8 KB table, built on first use) */
+#ifndef BASE64URL_LUT12
+#define BASE64URL_LUT12	0
+#endif
+
 enum {BASE64_OK = 0, BASE64_INVALID};
 
 #define BASE64_ENCODE_OUT_SIZE(s)	(((s) + 2) / 3 * 4)
 #define BASE64_DECODE_OUT_SIZE(s)	(((s)) / 4 * 3)
 
+/* exact sizes without padding and without the NUL written by base64url_encode */
+#define BASE64URL_ENCODE_OUT_SIZE(s)	(((s) * 4 + 2) / 3)
+#define BASE64URL_DECODE_OUT_SIZE(s)	(((s) * 3) / 4)
+
+/* out must hold BASE64URL_ENCODE_OUT_SIZE(inlen) + 1 characters (it is NUL terminated) */
 int base64url_encode(const unsigned char *in, unsigned int inlen, char *out);
 
+/* trailing '=' padding is optional, out must hold base64url_decoded_len(in, inlen) bytes */
 int base64url_decode(const char *in, unsigned int inlen, unsigned char *out);
 
+unsigned int base64url_encoded_len(unsigned int inlen);
+
+/* number of decoded bytes (0 if inlen is not a valid base64url length) */
+unsigned int base64url_decoded_len(const char *in, unsigned int inlen);
+
 
 #endif /* __BASE64URL_H__ */
@@ -4,14 +4,58 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <time.h>
 
-#define TOKEN_PERIOD    3600    // token valid for 3600 seconds (1 hour)
+#include <mbedtls/pk.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/ctr_drbg.h>
+
+#define TOKEN_PERIOD            3600    // token valid for 3600 seconds (1 hour)
+#define JWT_SIGNATURE_MAX_SIZE  512     // RSA-4096
+#define JWT_TOKEN_MAX_SIZE      1024
+#define JWT_ES256_COORD_SIZE    32      // size of r and s in an ES256 signature
+
+typedef enum {
+    JWT_ALG_RS256,
+    JWT_ALG_ES256,
+}   jwt_alg_t;
 
 typedef struct {
     char*   token;
     time_t  exp_time;
 }   jwt_token_t;
 
+/**
+ * Signing state that is reused for every token: the parsed private key, a seeded DRBG, the base64url
+ * header (already copied at the start of token) and the buffers for the signature and the token.
+ */
+typedef struct {
+    mbedtls_pk_context          pk_context;
+    mbedtls_entropy_context     entropy;
+    mbedtls_ctr_drbg_context    ctr_drbg;
+    jwt_alg_t                   alg;            // selected from the key type
+    uint8_t                     hwAccel;        // 0 forces the software SHA256
+    size_t                      headerLen;      // length of "<base64 header>." at the start of token
+    uint8_t                     signature[JWT_SIGNATURE_MAX_SIZE];
+    char                        token[JWT_TOKEN_MAX_SIZE];
+}   jwt_signer_t;
+
+int jwt_signer_init(jwt_signer_t* signer, const uint8_t* privateKey, size_t privateKeySize);
+
+int jwt_signer_init_random_ec(jwt_signer_t* signer);
+
+const char* jwt_signer_alg_name(const jwt_signer_t* signer);
+
+jwt_token_t jwt_signer_create(jwt_signer_t* signer, const char* projectId);
+
+jwt_token_t jwt_signer_create_at(jwt_signer_t* signer, const char* projectId, time_t issuedAt);
+
+void jwt_signer_set_hw_accel(jwt_signer_t* signer, uint8_t enable);
+
+int jwt_signer_verify(jwt_signer_t* signer, const char* token);
+
+void jwt_signer_free(jwt_signer_t* signer);
+
 jwt_token_t createGCPJWT(const char* projectId, const uint8_t* privateKey, size_t privateKeySize);
 
 #endif //__JWT_TOKEN__
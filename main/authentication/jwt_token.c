@@ -9,8 +9,13 @@
 #include <mbedtls/error.h>
 #include <mbedtls/entropy.h>
 #include <mbedtls/ctr_drbg.h>
+#include <mbedtls/ecdsa.h>
 #include <esp_wifi.h>
 #include <esp_err.h>
+#include "sdkconfig.h"
+#if CONFIG_MBEDTLS_HARDWARE_SHA
+#include "hwcrypto/sha.h"
+#endif
 
 #include "base64_url.h"
 
@@ -25,34 +30,233 @@ static char* mbedtlsError(int errnum) {
 } // mbedtlsError
 
 
+/**
+ * Initialize the mbedtls contexts of a signer and seed its DRBG.
+ */
+static int signerSeed(jwt_signer_t* signer) {
+
+    mbedtls_pk_init(&signer->pk_context);
+    mbedtls_entropy_init(&signer->entropy);
+    mbedtls_ctr_drbg_init(&signer->ctr_drbg);
+    signer->hwAccel = 1;
+
+    const char* pers="MyEntropy";
+    int rc = mbedtls_ctr_drbg_seed(
+        &signer->ctr_drbg,
+        mbedtls_entropy_func,
+        &signer->entropy,
+        (const unsigned char*)pers,
+        strlen(pers));
+    if (rc != 0) {
+        printf("Failed to mbedtls_ctr_drbg_seed: %d (-0x%x): %s\n", rc, -rc, mbedtlsError(rc));
+    }
+    return rc;
+} // signerSeed
+
+
+/**
+ * Pick the JWT algorithm from the type of the loaded key and base64url encode the header straight into the
+ * token buffer.  RSA keys use RS256 and P-256 keys use ES256, the only two algorithms accepted by GCP IoT.
+ */
+static int signerPrepareHeader(jwt_signer_t* signer) {
+
+    const char* header;
+
+    if (mbedtls_pk_can_do(&signer->pk_context, MBEDTLS_PK_RSA)) {
+        signer->alg = JWT_ALG_RS256;
+        header = "{\"alg\":\"RS256\",\"typ\":\"JWT\"}";
+    }
+    else if (mbedtls_pk_can_do(&signer->pk_context, MBEDTLS_PK_ECKEY) &&
+             mbedtls_pk_ec(signer->pk_context)->grp.id == MBEDTLS_ECP_DP_SECP256R1) {
+        signer->alg = JWT_ALG_ES256;
+        header = "{\"alg\":\"ES256\",\"typ\":\"JWT\"}";
+    }
+    else {
+        printf("Unsupported JWT key type (only RSA and EC P-256)\n");
+        return MBEDTLS_ERR_PK_FEATURE_UNAVAILABLE;
+    }
+
+    base64url_encode(
+        (unsigned char *)header,   // Data to encode.
+        strlen(header),            // Length of data to encode.
+        signer->token);            // Base64 encoded data.
+
+    signer->headerLen = strlen(signer->token);
+    signer->token[signer->headerLen++] = '.';
+
+    return 0;
+} // signerPrepareHeader
+
+
+/**
+ * SHA256 of header.payload.  With hardware SHA enabled, mbedtls uses the SHA engine whenever it is free and falls
+ * back to software when it is locked, so holding the lock here forces the software path.
+ */
+static int signerDigest(jwt_signer_t* signer, const uint8_t* data, size_t dataLen, uint8_t* digest) {
+
+#if CONFIG_MBEDTLS_HARDWARE_SHA
+    if (!signer->hwAccel) {
+        esp_sha_lock_engine(SHA2_256);
+    }
+#endif
+
+    int rc = mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), data, dataLen, digest);
+
+#if CONFIG_MBEDTLS_HARDWARE_SHA
+    if (!signer->hwAccel) {
+        esp_sha_unlock_engine(SHA2_256);
+    }
+#endif
+
+    return rc;
+} // signerDigest
+
+
+/**
+ * Sign the SHA256 digest of header.payload.  RS256 uses the PKCS#1 v1.5 signature as is.  ES256 needs the raw
+ * 32 byte r and s values concatenated (not the DER structure returned by mbedtls_pk_sign).
+ */
+static int signerSign(jwt_signer_t* signer, const uint8_t* digest, size_t digestSize, size_t* retSize) {
+
+    if (signer->alg == JWT_ALG_RS256) {
+        return mbedtls_pk_sign(&signer->pk_context, MBEDTLS_MD_SHA256, digest, digestSize, signer->signature, retSize,
+                               mbedtls_ctr_drbg_random, &signer->ctr_drbg);
+    }
+
+    mbedtls_ecp_keypair* ecKey = mbedtls_pk_ec(signer->pk_context);
+    mbedtls_mpi r, s;
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+
+    int rc = mbedtls_ecdsa_sign(&ecKey->grp, &r, &s, &ecKey->d, digest, digestSize,
+                                mbedtls_ctr_drbg_random, &signer->ctr_drbg);
+    if (rc == 0) {
+        rc = mbedtls_mpi_write_binary(&r, signer->signature, JWT_ES256_COORD_SIZE);
+    }
+    if (rc == 0) {
+        rc = mbedtls_mpi_write_binary(&s, signer->signature + JWT_ES256_COORD_SIZE, JWT_ES256_COORD_SIZE);
+    }
+    *retSize = 2 * JWT_ES256_COORD_SIZE;
+
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    return rc;
+} // signerSign
+
+
+/**
+ * Prepare a signer for GCP JWT tokens.
+ * The private key is parsed and the DRBG is seeded only once here, and the constant header is base64url encoded
+ * straight into the token buffer, so creating a token later only needs to format the payload and sign it.
+ * The algorithm (RS256 or ES256) is selected from the key type.
+ * @param signer The signer to initialize.
+ * @param privateKey The PEM or DER of the private key.
+ * @param privateKeySize The size in bytes of the private key.
+ * @returns 0 on success or an mbedtls error code.
+ */
+int jwt_signer_init(jwt_signer_t* signer, const uint8_t* privateKey, size_t privateKeySize) {
+
+    int rc = signerSeed(signer);
+    if (rc == 0) {
+        rc = mbedtls_pk_parse_key(&signer->pk_context, privateKey, privateKeySize, NULL, 0);
+        if (rc != 0) {
+            printf("Failed to mbedtls_pk_parse_key: %d (-0x%x): %s\n", rc, -rc, mbedtlsError(rc));
+        }
+    }
+    if (rc == 0) {
+        rc = signerPrepareHeader(signer);
+    }
+
+    if (rc != 0) {
+        jwt_signer_free(signer);
+    }
+    return rc;
+} // jwt_signer_init
+
+
+/**
+ * Prepare an ES256 signer with a random P-256 key generated on the device.
+ * Tokens signed with it are not accepted by GCP (the public key is not registered), it is meant for tests
+ * and benchmarks.
+ * @param signer The signer to initialize.
+ * @returns 0 on success or an mbedtls error code.
+ */
+int jwt_signer_init_random_ec(jwt_signer_t* signer) {
+
+    int rc = signerSeed(signer);
+    if (rc == 0) {
+        rc = mbedtls_pk_setup(&signer->pk_context, mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY));
+    }
+    if (rc == 0) {
+        rc = mbedtls_ecp_gen_key(MBEDTLS_ECP_DP_SECP256R1, mbedtls_pk_ec(signer->pk_context),
+                                 mbedtls_ctr_drbg_random, &signer->ctr_drbg);
+        if (rc != 0) {
+            printf("Failed to mbedtls_ecp_gen_key: %d (-0x%x): %s\n", rc, -rc, mbedtlsError(rc));
+        }
+    }
+    if (rc == 0) {
+        rc = signerPrepareHeader(signer);
+    }
+
+    if (rc != 0) {
+        jwt_signer_free(signer);
+    }
+    return rc;
+} // jwt_signer_init_random_ec
+
+
+/**
+ * Select the hardware accelerated (default) or the software SHA256 for the next tokens.
+ * The RSA (MPI) accelerator is selected at build time (CONFIG_MBEDTLS_HARDWARE_MPI) and cannot be switched here.
+ */
+void jwt_signer_set_hw_accel(jwt_signer_t* signer, uint8_t enable) {
+    signer->hwAccel = enable;
+} // jwt_signer_set_hw_accel
+
+
+/**
+ * Name of the algorithm used by a signer.
+ */
+const char* jwt_signer_alg_name(const jwt_signer_t* signer) {
+    return (signer->alg == JWT_ALG_ES256) ? "ES256" : "RS256";
+} // jwt_signer_alg_name
+
+
 /**
  * Create a JWT token for GCP.
  * For full details, perform a Google search on JWT.  However, in summary, we build two strings.  One that represents the
  * header and one that represents the payload.  Both are JSON and are as described in the GCP and JWT documentation.  Next
  * we base64url encode both strings.  Note that is distinct from normal/simple base64 encoding.  Once we have a string for
  * the base64url encoding of both header and payload, we concatenate both strings together separated by a ".".   This resulting
- * string is then signed using RSASSA which basically produces an SHA256 message digest that is then signed.  The resulting
+ * string is then signed using RSASSA (or ECDSA for ES256) which basically produces an SHA256 message digest that is then signed.  The resulting
  * binary is then itself converted into base64url and concatenated with the previously built base64url combined header and
  * payload and that is our resulting JWT token.
+ * The header is already in the signer token buffer, so only the payload is encoded after it.  The returned token points
+ * to that buffer: it is overwritten by the next call and must not be freed.
+ * @param signer A signer prepared with jwt_signer_init.
  * @param projectId The GCP project.
- * @param privateKey The PEM or DER of the private key.
- * @param privateKeySize The size in bytes of the private key.
  * @returns A JWT token for transmission to GCP.
  */
-jwt_token_t createGCPJWT(const char* projectId, const uint8_t* privateKey, size_t privateKeySize) {
-    
-    jwt_token_t current_token;
-    
-    char base64Header[100];
-    const char header[] = "{\"alg\":\"RS256\",\"typ\":\"JWT\"}";
-    base64url_encode(
-        (unsigned char *)header,   // Data to encode.
-        strlen(header),            // Length of data to encode.
-        base64Header);             // Base64 encoded data.
-
+jwt_token_t jwt_signer_create(jwt_signer_t* signer, const char* projectId) {
     time_t now;
     time(&now);
-    uint32_t iat = now;                 // Set the time now.
+    return jwt_signer_create_at(signer, projectId, now);
+} // jwt_signer_create
+
+
+/**
+ * Create a JWT token for GCP issued at a given time (same header and payload for the same iat, used by the
+ * self-test to compare tokens).
+ * @param signer A signer prepared with jwt_signer_init.
+ * @param projectId The GCP project.
+ * @param issuedAt The iat claim.
+ * @returns A JWT token that points to the signer buffer.
+ */
+jwt_token_t jwt_signer_create_at(jwt_signer_t* signer, const char* projectId, time_t issuedAt) {
+
+    jwt_token_t current_token;
+
+    uint32_t iat = issuedAt;            // Set the issue time.
     uint32_t exp = iat + TOKEN_PERIOD;  // Set the expiry time.
 
     current_token.exp_time = exp;
@@ -60,71 +264,146 @@ jwt_token_t createGCPJWT(const char* projectId, const uint8_t* privateKey, size_
     char payload[100];
     sprintf(payload, "{\"iat\":%d,\"exp\":%d,\"aud\":\"%s\"}", iat, exp, projectId);
 
-    char base64Payload[100];
+    char* headerAndPayload = signer->token;
     base64url_encode(
-        (unsigned char *)payload,  // Data to encode.
-        strlen(payload),           // Length of data to encode.
-        base64Payload);            // Base64 encoded data.
-
-    uint8_t headerAndPayload[300];
-    sprintf((char*)headerAndPayload, "%s.%s", base64Header, base64Payload);
+        (unsigned char *)payload,               // Data to encode.
+        strlen(payload),                        // Length of data to encode.
+        headerAndPayload + signer->headerLen);  // Base64 encoded data, right after the header.
+    size_t headerAndPayloadLen = strlen(headerAndPayload);
 
-    // At this point we have created the header and payload parts, converted both to base64 and concatenated them
-    // together as a single string.  Now we need to sign them using RSASSA
+    // At this point we have the header and payload parts, converted to base64 and concatenated together as a
+    // single string.  Now we need to sign them using RSASSA or ECDSA, depending on the key
 
-    mbedtls_pk_context pk_context;
-    mbedtls_pk_init(&pk_context);
-    int rc = mbedtls_pk_parse_key(&pk_context, privateKey, privateKeySize, NULL, 0);
+    uint8_t digest[32];
+    int rc = signerDigest(signer, (uint8_t*)headerAndPayload, headerAndPayloadLen, digest);
     if (rc != 0) {
-        printf("\n\n\nFailed to mbedtls_pk_parse_key: %d (-0x%x): %s\n\n\n", rc, -rc, mbedtlsError(rc));
+        printf("Failed to mbedtls_md: %d (-0x%x): %s\n", rc, -rc, mbedtlsError(rc));
         current_token.exp_time = 0;
         current_token.token = NULL;
         return current_token;
     }
 
-    uint8_t oBuf[800];
-
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_entropy_init(&entropy);
-
-    const char* pers="MyEntropy";
-    mbedtls_ctr_drbg_seed(
-        &ctr_drbg,
-        mbedtls_entropy_func,
-        &entropy,
-        (const unsigned char*)pers,
-        strlen(pers));
-    
-    uint8_t digest[32];
-    rc = mbedtls_md(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), headerAndPayload, strlen((char*)headerAndPayload), digest);
+    size_t retSize;
+    rc = signerSign(signer, digest, sizeof(digest), &retSize);
     if (rc != 0) {
-        printf("Failed to mbedtls_md: %d (-0x%x): %s\n", rc, -rc, mbedtlsError(rc));
+        printf("Failed to sign the JWT (%s): %d (-0x%x): %s\n", jwt_signer_alg_name(signer), rc, -rc, mbedtlsError(rc));
         current_token.exp_time = 0;
         current_token.token = NULL;
         return current_token;
     }
 
-    size_t retSize;
-    rc = mbedtls_pk_sign(&pk_context, MBEDTLS_MD_SHA256, digest, sizeof(digest), oBuf, &retSize, mbedtls_ctr_drbg_random, &ctr_drbg);
-    if (rc != 0) {
-        printf("Failed to mbedtls_pk_sign: %d (-0x%x): %s\n", rc, -rc, mbedtlsError(rc));
+    if (headerAndPayloadLen + 1 + BASE64URL_ENCODE_OUT_SIZE(retSize) + 1 > JWT_TOKEN_MAX_SIZE) {
+        printf("JWT token does not fit in %d bytes\n", JWT_TOKEN_MAX_SIZE);
         current_token.exp_time = 0;
         current_token.token = NULL;
         return current_token;
     }
 
+    headerAndPayload[headerAndPayloadLen] = '.';
+    base64url_encode(signer->signature, retSize, headerAndPayload + headerAndPayloadLen + 1);
 
-    char base64Signature[600];
-    base64url_encode((unsigned char *)oBuf, retSize, base64Signature);
+    current_token.token = signer->token;
 
-    char* retData = (char*)malloc(strlen((char*)headerAndPayload) + 1 + strlen((char*)base64Signature) + 1);
-    sprintf(retData, "%s.%s", headerAndPayload, base64Signature);
+    return current_token;
+} // jwt_signer_create_at
+
+
+/**
+ * Verify the signature of a token with the key of a signer.  The digest is always computed with the software SHA256,
+ * so a token signed with the hardware SHA is checked against an independent implementation.  ES256 signatures are
+ * randomized, so two tokens can only be compared this way and not byte for byte.
+ * The decoded signature overwrites the signature buffer of the signer (the token buffer is not touched).
+ * @param signer The signer that created the token.
+ * @param token The JWT token (header.payload.signature).
+ * @returns 0 if the signature is valid, an mbedtls error code or -1 if the token is malformed.
+ */
+int jwt_signer_verify(jwt_signer_t* signer, const char* token) {
+
+    const char* signatureStart = strrchr(token, '.');
+    if (signatureStart == NULL) {
+        return -1;
+    }
+    size_t headerAndPayloadLen = signatureStart - token;
+    size_t encodedLen = strlen(signatureStart + 1);
+    size_t signatureLen = base64url_decoded_len(signatureStart + 1, encodedLen);
+    if (signatureLen == 0 || signatureLen > JWT_SIGNATURE_MAX_SIZE ||
+        base64url_decode(signatureStart + 1, encodedLen, signer->signature) != BASE64_OK) {
+        return -1;
+    }
+
+    uint8_t digest[32];
+    uint8_t hwAccel = signer->hwAccel;
+    signer->hwAccel = 0;
+    int rc = signerDigest(signer, (const uint8_t*)token, headerAndPayloadLen, digest);
+    signer->hwAccel = hwAccel;
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (signer->alg == JWT_ALG_RS256) {
+        return mbedtls_pk_verify(&signer->pk_context, MBEDTLS_MD_SHA256, digest, sizeof(digest),
+                                 signer->signature, signatureLen);
+    }
+
+    // raw r and s, mbedtls_pk_verify would need them in a DER structure
+    if (signatureLen != 2 * JWT_ES256_COORD_SIZE) {
+        return -1;
+    }
+    mbedtls_ecp_keypair* ecKey = mbedtls_pk_ec(signer->pk_context);
+    mbedtls_mpi r, s;
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+
+    rc = mbedtls_mpi_read_binary(&r, signer->signature, JWT_ES256_COORD_SIZE);
+    if (rc == 0) {
+        rc = mbedtls_mpi_read_binary(&s, signer->signature + JWT_ES256_COORD_SIZE, JWT_ES256_COORD_SIZE);
+    }
+    if (rc == 0) {
+        rc = mbedtls_ecdsa_verify(&ecKey->grp, digest, sizeof(digest), &ecKey->Q, &r, &s);
+    }
+
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    return rc;
+} // jwt_signer_verify
+
+
+/**
+ * Release the key and the DRBG of a signer.
+ * @param signer The signer to free.
+ */
+void jwt_signer_free(jwt_signer_t* signer) {
+    mbedtls_ctr_drbg_free(&signer->ctr_drbg);
+    mbedtls_entropy_free(&signer->entropy);
+    mbedtls_pk_free(&signer->pk_context);
+} // jwt_signer_free
+
+
+/**
+ * Create a single JWT token for GCP with a temporary signer.
+ * Prefer keeping a jwt_signer_t when several tokens are needed.
+ * @param projectId The GCP project.
+ * @param privateKey The PEM or DER of the private key.
+ * @param privateKeySize The size in bytes of the private key.
+ * @returns A JWT token for transmission to GCP (the caller frees the token string).
+ */
+jwt_token_t createGCPJWT(const char* projectId, const uint8_t* privateKey, size_t privateKeySize) {
 
-    current_token.token = retData;
+    jwt_token_t current_token = { .token = NULL, .exp_time = 0 };
 
-    mbedtls_pk_free(&pk_context);
+    jwt_signer_t* signer = (jwt_signer_t*)malloc(sizeof(jwt_signer_t));
+    if (signer == NULL) {
+        return current_token;
+    }
+
+    if (jwt_signer_init(signer, privateKey, privateKeySize) == 0) {
+        current_token = jwt_signer_create(signer, projectId);
+        if (current_token.token != NULL) {
+            current_token.token = strdup(current_token.token);
+        }
+        jwt_signer_free(signer);
+    }
 
+    free(signer);
     return current_token;
-}
+} // createGCPJWT
@@ -10,6 +10,7 @@
 /* ===== Dependencies ===== */
 #include "ble_server.h"
 #include "command_processor.h"
+#include "message_bus.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,6 +23,7 @@
 
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_bt.h"
 #include "esp_gap_ble_api.h"
 #include "esp_gatts_api.h"
@@ -43,6 +45,7 @@
 #define scan_rsp_config_flag        (1 << 1)
 #define PROFILE_NUM                 1
 #define PROFILE_APP_ID              0
+#define BLE_COMMAND_RING_LEN        8       // writes waiting for the command processor (power of 2)
 
 /* ===== Prototypes of private functions ===== */
 static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
@@ -50,11 +53,13 @@ static void gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_param
 static void gatts_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_t gatts_if, esp_ble_gatts_cb_param_t *param);
 
 /* ===== Declaration of private or external variables ===== */
-extern QueueHandle_t queue_command_processor_rx;
-QueueHandle_t queue_ble_server_tx;
 
 static const char *TAG  = "BLE_SERVER";
 
+// commands written by the client, the BT task is the only producer
+static spsc_ring_t ble_command_ring;
+static rx_command_t ble_command_items[BLE_COMMAND_RING_LEN];
+
 uint8_t char1_str[] = {0x11,0x22,0x33};
 esp_gatt_char_prop_t a_property = 0;
 
@@ -155,14 +160,20 @@ int8_t start_ble_server()
     {
         // release all the memory associated with BT classic
         ESP_ERROR_CHECK(esp_bt_controller_mem_release(ESP_BT_MODE_CLASSIC_BT));
+
+        // this runs in the command processor task, so the ring can be registered here
+        spsc_ring_init(&ble_command_ring, ble_command_items, sizeof(rx_command_t), BLE_COMMAND_RING_LEN);
+        if (command_processor_add_source(&ble_command_ring) != 0)
+        {
+            ESP_LOGE(TAG, "Could not register the BLE command ring.");
+        }
         first_time = 1;
     }
 
-    // create a queue capable of containing 5 uint8_t values
-    queue_ble_server_tx = xQueueCreate(5, sizeof(uint8_t));
-    if (queue_ble_server_tx == NULL)
+    // created only the first time, BLE can be started again later
+    if (message_bus_register(BLE_SERVER, MESSAGE_BUS_QUEUE_LEN) != 0)
     {
-        ESP_LOGE(TAG, "Could not create queue_ble_server_tx.");
+        ESP_LOGE(TAG, "Could not create the BLE TX queue.");
     }
 
     // configure and initialize BT controller 
@@ -327,12 +338,14 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
         memset(&rsp, 0, sizeof(esp_gatt_rsp_t));
         rsp.attr_value.handle = param->read.handle;
 
-        uint8_t queue_rcv_value;
+        tx_message_t tx_message;
         // read data from the queue (do not wait)
-        BaseType_t xStatus = xQueueReceive(queue_ble_server_tx, &queue_rcv_value,  0 / portTICK_RATE_MS);
+        BaseType_t xStatus = message_bus_receive(BLE_SERVER, &tx_message,  0 / portTICK_RATE_MS);
         if (xStatus == pdPASS)  {
-            rsp.attr_value.len = 1;
-            rsp.attr_value.value[0] = queue_rcv_value; 
+            // kind first, so a client can tell a command echo from a slave state
+            rsp.attr_value.len = 2;
+            rsp.attr_value.value[0] = tx_message.kind;
+            rsp.attr_value.value[1] = message_bus_value(&tx_message);
         }
         else    {
             // dummy values
@@ -348,6 +361,8 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
         break;
     }
     case ESP_GATTS_WRITE_EVT: {
+        // ingress time of the command, before the response and the logs
+        int64_t write_us = esp_timer_get_time();
         // ESP_LOGI(GATTS_TAG, "GATT_WRITE_EVT, conn_id %d, trans_id %d, handle %d", param->write.conn_id, param->write.trans_id, param->write.handle);
         ESP_LOGI(GATTS_TAG, "GATT_WRITE_EVT, conn_id %d, trans_id %d", param->write.conn_id, param->write.trans_id);
         if (!param->write.is_prep)  {
@@ -355,17 +370,20 @@ static void gatts_profile_event_handler(esp_gatts_cb_event_t event, esp_gatt_if_
             esp_log_buffer_hex(GATTS_TAG, param->write.value, param->write.len);
         }
 
-        if (param->write.need_rsp)  {
-            esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, ESP_GATT_OK, NULL);
-        }
-
-        BaseType_t xStatus;
-        rx_command_t ble_command;
+        rx_command_t ble_command = { 0 };
+        esp_gatt_status_t status = ESP_GATT_OK;
         ble_command.rx_id = BLE_SERVER;
+        ble_command.ingress_us = write_us;
         ble_command.command = *(param->write.value);   // command processor queue accepts a single value, the rest will be ignored
-        xStatus = xQueueSendToBack(queue_command_processor_rx, &ble_command, 100 / portTICK_RATE_MS);
-        if (xStatus != pdPASS)  {
-            printf("Could not send the data to the queue.\n");
+        // never blocks the BT task, the client is told when the command did not fit
+        if (command_processor_post(&ble_command_ring, &ble_command) != pdPASS)  {
+            ESP_LOGE(GATTS_TAG, "BLE command ring full, %s dropped (%u so far).",
+                     translate_command_type(ble_command.command), spsc_ring_dropped(&ble_command_ring));
+            status = ESP_GATT_BUSY;
+        }
+
+        if (param->write.need_rsp)  {
+            esp_ble_gatts_send_response(gatts_if, param->write.conn_id, param->write.trans_id, status, NULL);
         }
 
         break;
@@ -13,6 +13,7 @@
 
 /* ===== Dependencies ===== */
 #include <stdint.h>
+#include <stddef.h>
 #include "esp_err.h"
 
 /* ===== Macros of public constants ===== */
@@ -64,5 +65,34 @@ char* get_nvs_string_value(char* string_key);
 *-------------------------------------------------------------------*/
 esp_err_t set_nvs_string_value(char* string_key, char* string_value);
 
+/*------------------------------------------------------------------
+|  Function: get_nvs_blob_value
+| ------------------------------------------------------------------
+|  Description: copies the binary value associated to the key.
+|
+|  Parameters:
+|		- blob_key: 	key to use.
+|		- blob_value:	where the value is copied.
+|		- blob_size:	size of blob_value, set to the value size.
+|
+|  Returns:  esp_err_t
+*-------------------------------------------------------------------*/
+esp_err_t get_nvs_blob_value(char* blob_key, void* blob_value, size_t* blob_size);
+
+/*------------------------------------------------------------------
+|  Function: set_nvs_blob_value
+| ------------------------------------------------------------------
+|  Description: stores a binary value associated to a key and
+|				commits it, so it is kept after a reset.
+|
+|  Parameters:
+|		- blob_key: 	key to use.
+|		- blob_value:	value to store.
+|		- blob_size:	value size.
+|
+|  Returns:  esp_err_t
+*-------------------------------------------------------------------*/
+esp_err_t set_nvs_blob_value(char* blob_key, const void* blob_value, size_t blob_size);
+
 /* ===== Avoid multiple inclusion ===== */
 #endif // __NVS_STORAGE_H__
@@ -83,4 +83,19 @@ esp_err_t set_nvs_string_value(char* string_key, char* string_value)
     return nvs_set_str(storage_nvs_handler, string_key, string_value);
 }
 
+esp_err_t get_nvs_blob_value(char* blob_key, void* blob_value, size_t* blob_size)
+{
+    return nvs_get_blob(storage_nvs_handler, blob_key, blob_value, blob_size);
+}
+
+esp_err_t set_nvs_blob_value(char* blob_key, const void* blob_value, size_t blob_size)
+{
+    esp_err_t nvs_error = nvs_set_blob(storage_nvs_handler, blob_key, blob_value, blob_size);
+    if (nvs_error != ESP_OK)
+    {
+        return nvs_error;
+    }
+    return nvs_commit(storage_nvs_handler);
+}
+
 /* ===== Implementations of private functions ===== */
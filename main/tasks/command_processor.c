@@ -14,70 +14,192 @@
 #include "mqtt.h"
 #include "nvs_storage.h"
 #include "serial_protocol_common.h"
+#include "jwt_service.h"
+#include "slave_pipeline.h"
+#include "slave_state_cache.h"
+#include "message_bus.h"
+#include "command_script.h"
+#include "command_trace.h"
+#include "spsc_ring.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 
 /* ===== Macros of private constants ===== */
-#define CMD_RX_CHECK_TIME_MS    500
+#define CMD_QUEUE_BENCH_COMMANDS    50
+#define CMD_QUEUE_BENCH_TIMEOUT_MS  2000
+#define CMD_QUEUE_BENCH_STACK       2048
+#define CMD_QUEUE_BENCH_PRIORITY    6       // same as the RX tasks, so the burst really queues up
+#define CMD_RING_BENCH_COMMANDS     1000
+#define CMD_RING_BENCH_LEN          8       // ring and queue length (power of 2)
+#define CMD_RING_BENCH_STACK        3072
+#define COMMAND_SYSTEM_LANE_LEN     (2 * SLAVE_PIPELINE_DEPTH)  // room for late completions too
+#define SCRIPT_SLOTS                4       // command scripts kept in NVS
+#define SCRIPT_NVS_KEY_SIZE         10      // "script" and any uint8_t, so snprintf can not truncate
+#define TRACE_MODULES               (I2C_MASTER_MOD + 1)    // latency histograms per rx_module_t
+
+
+/* ===== Private structs and enums ===== */
+// command script run by the command processor task, one at a time
+typedef struct {
+    command_script_t    vm;
+    uint8_t             code[COMMAND_SCRIPT_MAX_SIZE];
+    uint8_t             active;
+    uint8_t             slot;
+    rx_module_t         requester;
+    uint16_t            seq;            // slave operation it waits for (0 if none)
+    uint8_t             sleeping;
+    TickType_t          wake;
+    int64_t             start_us;
+    uint32_t            operations;
+}   script_run_t;
+
+// callback to task handoff compared by the ring benchmark, the consumer is woken up by each command
+typedef struct {
+    QueueHandle_t       queue;
+    spsc_ring_t         ring;
+    rx_command_t        items[CMD_RING_BENCH_LEN];
+    uint8_t             use_queue;
+    TaskHandle_t        producer;
+    TaskHandle_t        consumer;
+    volatile uint32_t   received;
+    uint32_t            wakeups;
+}   ring_bench_t;
 
 
 /* ===== Declaration of private or external variables ===== */
-QueueHandle_t queue_command_processor_rx;
-extern QueueHandle_t queue_uart_tx;
-extern QueueHandle_t queue_http_tx;
-extern QueueHandle_t queue_tls_https_tx;
-extern QueueHandle_t queue_mqtt_tx;
-extern QueueHandle_t queue_mqtt_gcloud;
-extern QueueHandle_t queue_ble_server_tx;
-extern QueueHandle_t queue_i2c_master;
+// one queue per priority lane, a task notification wakes up the command processor
+static QueueHandle_t command_lanes[COMMAND_LANE_COUNT];
+static const UBaseType_t command_lane_len[COMMAND_LANE_COUNT] = {
+    COMMAND_SYSTEM_LANE_LEN,
+    CONFIG_COMMAND_QUEUE_LEN,
+    CONFIG_COMMAND_TELEMETRY_QUEUE_LEN,
+};
+static TaskHandle_t volatile command_processor_handle = NULL;
+// rings of the callbacks (command processor task only, or before it starts)
+static spsc_ring_t* command_sources[COMMAND_SOURCES_MAX];
+static uint8_t command_source_count = 0;
+// dispatches of higher lanes while the lane had commands waiting (command processor task only)
+static uint32_t command_lane_skipped[COMMAND_LANE_COUNT];
 
 wireless_state_t wireless_state;
 rx_module_t wifi_module;
+// commands sent to the slave (the slave state can only change after one of them)
+static volatile uint32_t slave_command_count = 0;
+// updated by every sender, read and reset by the benchmark
+static command_processor_stats_t command_stats;
+static portMUX_TYPE command_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+static script_run_t script;
+// latency traces (command processor task only, the histograms are also read under command_stats_mux)
+static command_trace_t current_trace;       // command being dispatched
+static command_trace_stats_t trace_stats[TRACE_MODULES];
+static command_trace_t trace_log[CONFIG_COMMAND_TRACE_LOG_LEN];
+static uint32_t trace_log_count = 0;
+#if defined(CONFIG_COMMAND_TRACE_CHROME_EXPORT)
+static char trace_json[COMMAND_TRACE_CHROME_MAX_SIZE];
+#endif
 static const char* TAG = "COMMAND_PROCESSOR_TASK";
 
 /* ===== Prototypes of private functions ===== */
 char* translate_rx_module(rx_module_t module);
-QueueHandle_t* get_module_queue(rx_module_t module);
-BaseType_t wait_for_slave_cmd_ack(rx_command_t* command);
+static void complete_slave_operation(slave_pending_t* operation, const rx_command_t* completion);
+static void send_slave_state(rx_module_t requester, uint16_t request_id, uint8_t state);
+static void send_slave_result(rx_module_t requester, uint16_t request_id, command_type_t result);
+static void request_slave_state(rx_module_t requester, uint16_t request_id, command_trace_t* trace);
+static void finish_status_read(const slave_pending_t* operation, uint8_t state);
+static uint16_t issue_shared_read(rx_module_t requester, uint16_t request_id, command_trace_t* trace);
+static uint16_t issue_traced(command_type_t command, rx_module_t requester, uint16_t request_id,
+                             command_trace_t* trace);
+static uint16_t issue_slave_command(command_type_t command, rx_module_t requester, uint16_t request_id,
+                                    command_trace_t* trace);
+static void script_nvs_key(uint8_t slot, char* key);
+static int8_t store_script(uint8_t slot, const char* hex);
+static void start_script(uint8_t slot, rx_module_t requester);
+static void run_script(void);
+static uint8_t script_slave_done(const slave_pending_t* operation, uint8_t ok, uint8_t state);
+static void resume_script(void);
+static TickType_t script_wait_ticks(void);
+static BaseType_t queue_command(rx_command_t* command, TickType_t ticks_to_wait);
+static command_lane_t select_lane(const rx_command_t* command);
+static uint8_t needs_slave_pipeline(const rx_command_t* command);
+static void wake_command_processor(void);
+static BaseType_t receive_command(rx_command_t* command, TickType_t ticks_to_wait);
+static void drain_sources(void);
+static BaseType_t take_next_command(rx_command_t* command);
+static void record_dispatch(command_lane_t lane, uint8_t promoted, const rx_command_t* command);
+static void command_queue_bench_task(void *pvParameter);
+static void command_ring_bench_task(void *pvParameter);
+static int64_t ring_bench_handoff(ring_bench_t* bench, const rx_command_t* command, uint8_t use_queue);
+static void ring_bench_consumer_task(void *pvParameter);
+static void begin_trace(const rx_command_t* command);
+static void end_trace(command_trace_t* trace);
+static void dump_traces(void);
 
 
 /* ===== Implementations of public functions ===== */
 int8_t initialize_command_processor(rx_module_t wifi_type)
 {
+    uint8_t lane;
+
     wifi_module = wifi_type;
     wireless_state = WIFI_MODE;
-    // create a queue capable of containing 5 rx_command_t values
-    queue_command_processor_rx = xQueueCreate(5, sizeof(rx_command_t));
-    if (queue_command_processor_rx == NULL)
+    if (command_codec_init() != 0)
     {
-        ESP_LOGE(TAG, "Could not Command Processor RX QUEUE.");
+        ESP_LOGE(TAG, "Could not build the command decoder table.");
         return -1;
     }
+    for (lane = 0; lane < COMMAND_LANE_COUNT; lane++)
+    {
+        command_lanes[lane] = xQueueCreate(command_lane_len[lane], sizeof(rx_command_t));
+        if (command_lanes[lane] == NULL)
+        {
+            ESP_LOGE(TAG, "Could not create the %s lane.", translate_command_lane(lane));
+            return -1;
+        }
+    }
     return 0;
 }
 
 void command_processor_task(void *pvParameter)
 {   
     rx_command_t current_command;
-    rx_module_t original_rx_id;
-    QueueHandle_t* generic_queue_handle_ptr;
-    uint8_t master_serial_command;
+    slave_pending_t slave_operation;
+    tx_message_t reply;
     BaseType_t xStatus;
+    TickType_t wait_ticks;
+
+    // the senders notify this task, commands queued before are found by the first receive
+    command_processor_handle = xTaskGetCurrentTaskHandle();
 
     while (1)
     {
         // read data from the queue
-        xStatus = xQueueReceive(queue_command_processor_rx, &current_command,  portMAX_DELAY);
+        // blocks until the next command (or slave timeout, or script wait), queued commands are dispatched
+        // back to back by lane priority
+        wait_ticks = slave_pipeline_wait_ticks();
+        if (script_wait_ticks() < wait_ticks)
+        {
+            wait_ticks = script_wait_ticks();
+        }
+        xStatus = receive_command(&current_command, wait_ticks);
         if (xStatus == pdPASS) 
         {
-            ESP_LOGI(TAG, "Received command %s from %s.", translate_command_type(current_command.command),
-                                                     translate_rx_module(current_command.rx_id));
+            begin_trace(&current_command);
+
+            // the benchmark commands are not logged, the UART would be most of the measured time
+            if (current_command.command != CMD_BENCH_NOP)
+            {
+                ESP_LOGI(TAG, "Received command %s from %s.", translate_command_type(current_command.command),
+                                                         translate_rx_module(current_command.rx_id));
+            }
 
             switch(current_command.command)
             {
@@ -160,127 +282,283 @@ void command_processor_task(void *pvParameter)
                     break;
                 
                 case CMD_ECHO:
-                    generic_queue_handle_ptr = get_module_queue(current_command.rx_id);
-                    if (generic_queue_handle_ptr != NULL)
+                    reply.kind = TX_MSG_COMMAND;
+                    reply.source = current_command.rx_id;
+                    reply.correlation_id = current_command.seq;
+                    reply.payload.command = current_command.command;
+                    xStatus = message_bus_send(current_command.rx_id, &reply, 1000 / portTICK_RATE_MS);
+                    if (xStatus != pdPASS)
                     {
-                        xStatus = xQueueSendToBack(*generic_queue_handle_ptr, &current_command.command, 1000 / portTICK_RATE_MS);
-                        if (xStatus != pdPASS)
-                        {
-                            ESP_LOGE(TAG, "Could not send the data to the queue.");
-                        }
+                        ESP_LOGE(TAG, "Could not send the data to %s.", translate_rx_module(current_command.rx_id));
                     }
                     else
                     {
-                        ESP_LOGE(TAG, "There is no queue handle match for module %s.", translate_rx_module(current_command.rx_id));
+                        command_trace_mark(&current_trace, TRACE_STAGE_REPLY, esp_timer_get_time());
                     }
                     break;
-                // do the same for all these commands that must be sent to the slave
+
+                case CMD_JWT_BENCH:
+                    jwt_service_benchmark();
+                    break;
+
+                case CMD_QUEUE_BENCH:
+                    // the burst is sent from another task, this one has to be free to dispatch it
+                    if (xTaskCreate(&command_queue_bench_task, "cmd_queue_bench_task", CMD_QUEUE_BENCH_STACK,
+                                    (void*)(uintptr_t)current_command.rx_id, CMD_QUEUE_BENCH_PRIORITY, NULL) != pdPASS)
+                    {
+                        ESP_LOGE(TAG, "Could not create the queue benchmark task.");
+                    }
+                    break;
+
+                case CMD_RING_BENCH:
+                    if (xTaskCreate(&command_ring_bench_task, "cmd_ring_bench_task", CMD_RING_BENCH_STACK,
+                                    (void*)(uintptr_t)current_command.rx_id, CMD_QUEUE_BENCH_PRIORITY, NULL) != pdPASS)
+                    {
+                        ESP_LOGE(TAG, "Could not create the ring benchmark task.");
+                    }
+                    break;
+
+                case CMD_BENCH_NOP:
+                    break;
+
+                // every slave operation is issued without waiting, the completion comes back later
                 case CMD_SLAVE_START_A:
                 case CMD_SLAVE_START_B:
                 case CMD_SLAVE_PAUSE:
                 case CMD_SLAVE_CONTINUE:
                 case CMD_SLAVE_RESET:
-                    // write to the I2C master queue
-                    master_serial_command = current_command.command;
-                    xStatus = xQueueSendToBack(queue_i2c_master, &master_serial_command, 500 / portTICK_RATE_MS);
-                    xStatus = wait_for_slave_cmd_ack(&current_command);
-
+                    if (issue_slave_command(current_command.command, current_command.rx_id, current_command.seq,
+                                            &current_trace) == 0)
+                    {
+                        send_slave_result(current_command.rx_id, current_command.seq, CMD_SLAVE_FAIL);
+                        command_trace_mark(&current_trace, TRACE_STAGE_REPLY, esp_timer_get_time());
+                    }
                     break;
+
                 case CMD_SLAVE_STATUS:
-                    original_rx_id = current_command.rx_id;
-                    // write to the I2C master queue
-                    master_serial_command = current_command.command;
-                    xStatus = xQueueSendToBack(queue_i2c_master, &master_serial_command, 500 / portTICK_RATE_MS);
-                    xStatus = wait_for_slave_cmd_ack(&current_command);
-
-                    // read slave FSM state
-                    xStatus = xQueueReceive(queue_command_processor_rx, &current_command, 500 / portTICK_RATE_MS);
-                    if(xStatus == pdPASS && current_command.rx_id == I2C_MASTER_MOD)
+                    request_slave_state(current_command.rx_id, current_command.seq, &current_trace);
+                    break;
+
+                // completions from the I2C master
+                case CMD_SLAVE_OK:
+                case CMD_SLAVE_FAIL:
+                    if (current_command.rx_id == I2C_MASTER_MOD &&
+                        slave_pipeline_complete(&current_command, &slave_operation) &&
+                        !script_slave_done(&slave_operation, current_command.command == CMD_SLAVE_OK,
+                                           current_command.value))
+                    {
+                        complete_slave_operation(&slave_operation, &current_command);
+                    }
+                    break;
+
+                case CMD_SCRIPT_STORE:
+                case CMD_SCRIPT_RUN:
+                    // the slot only comes with a text command, a raw byte (UART, BLE) would mean slot 0
+                    if (!current_command.has_args)
+                    {
+                        ESP_LOGE(TAG, "%s needs a script slot, only accepted as text.",
+                                 translate_command_type(current_command.command));
+                    }
+                    // CMD_SCRIPT_STORE is already in NVS, stored by command_processor_submit_text
+                    else if (current_command.command == CMD_SCRIPT_RUN)
                     {
-                        ESP_LOGI(TAG, "Slave FSM current state: %d", current_command.command);
+                        start_script(current_command.value, current_command.rx_id);
                     }
+                    break;
 
-                    // send the state to the task that requested it
-                    generic_queue_handle_ptr = get_module_queue(original_rx_id);
-                    if (generic_queue_handle_ptr != NULL)
+                case CMD_SCRIPT_STOP:
+                    if (script.active)
                     {
-                        master_serial_command = SLAVE_STATE_FRAME;  // reusing this variable
-                        xStatus = xQueueSendToBack(*generic_queue_handle_ptr, &master_serial_command, 1000 / portTICK_RATE_MS);
-                        xStatus = xQueueSendToBack(*generic_queue_handle_ptr, &current_command.command, 1000 / portTICK_RATE_MS);
-                        // if (xStatus != pdPASS)
-                        // {
-                        //     printf("Could not send the data to the queue.\n");
-                        // }
+                        // a slave operation in flight still completes, its result is ignored
+                        ESP_LOGW(TAG, "Script %u stopped.", script.slot);
+                        script.active = 0;
                     }
+                    break;
 
+                case CMD_TRACE_DUMP:
+                    dump_traces();
                     break;
+
                 default:
                     break;
             }
+
+            // unless a slave operation took it over
+            end_trace(&current_trace);
+        }
+
+        // slave operations that never completed
+        while (slave_pipeline_expire(&slave_operation))
+        {
+            ESP_LOGE(TAG, "Slave operation %u (%s) timed out.", slave_operation.seq,
+                                                             translate_command_type(slave_operation.command));
+            if (script_slave_done(&slave_operation, 0, SLAVE_STATE_ERROR))
+            {
+                continue;
+            }
+            if (slave_operation.command == CMD_SLAVE_STATUS)
+            {
+                finish_status_read(&slave_operation, SLAVE_STATE_ERROR);
+            }
+            else
+            {
+                send_slave_result(slave_operation.requester, slave_operation.request_id, CMD_SLAVE_FAIL);
+            }
+            command_trace_mark(&slave_operation.trace, TRACE_STAGE_REPLY, esp_timer_get_time());
+            end_trace(&slave_operation.trace);
         }
 
-        vTaskDelay(CMD_RX_CHECK_TIME_MS / portTICK_RATE_MS);
+        // a script whose wait ended
+        resume_script();
     }
 }
 
+BaseType_t command_processor_submit(rx_command_t* command, TickType_t ticks_to_wait)
+{
+    // a single byte command has no arguments, its value is not a script slot
+    command->has_args = 0;
+    return queue_command(command, ticks_to_wait);
+}
 
-command_type_t str_to_cmd(char* str_command)
+int8_t command_processor_add_source(spsc_ring_t* ring)
 {
-    if (strstr(str_command, "CMD_SLAVE_START_A") != NULL)
-        return CMD_SLAVE_START_A;
-    if (strstr(str_command, "CMD_SLAVE_START_B") != NULL)
-        return CMD_SLAVE_START_B;
-    if (strstr(str_command, "CMD_SLAVE_PAUSE") != NULL)
-        return CMD_SLAVE_PAUSE;
-    if (strstr(str_command, "CMD_SLAVE_CONTINUE") != NULL)
-        return CMD_SLAVE_CONTINUE;
-    if (strstr(str_command, "CMD_SLAVE_RESET") != NULL)
-        return CMD_SLAVE_RESET;
-    if (strstr(str_command, "CMD_SLAVE_STATUS") != NULL)
-        return CMD_SLAVE_STATUS;
-    if (strstr(str_command, "CMD_WIFI") != NULL)
-        return CMD_WIFI;
-    if (strstr(str_command, "CMD_BLE") != NULL)
-        return CMD_BLE;
-    if (strstr(str_command, "CMD_ECHO") != NULL)
-        return CMD_ECHO;
-
-    return CMD_INVALID;
+    if (command_source_count >= COMMAND_SOURCES_MAX)
+    {
+        return -1;
+    }
+    command_sources[command_source_count++] = ring;
+    return 0;
 }
 
-char* translate_command_type(command_type_t command)
+BaseType_t command_processor_post(spsc_ring_t* ring, rx_command_t* command)
 {
-    switch(command)
+    command_lane_t lane;
+    int8_t pushed;
+
+    command->enqueue_us = esp_timer_get_time();
+    command->has_args = 0;
+
+    pushed = spsc_ring_push(ring, command);
+    if (pushed > 0)
     {
-        case CMD_SLAVE_START_A:
-            return "CMD_SLAVE_START_A";
-        case CMD_SLAVE_START_B:
-            return "CMD_SLAVE_START_B";
-        case CMD_SLAVE_PAUSE:
-            return "CMD_SLAVE_PAUSE";
-        case CMD_SLAVE_CONTINUE:
-            return "CMD_SLAVE_CONTINUE";
-        case CMD_SLAVE_RESET:
-            return "CMD_SLAVE_RESET";
-        case CMD_SLAVE_STATUS:
-            return "CMD_SLAVE_STATUS";
-        case CMD_SLAVE_OK:
-            return "CMD_SLAVE_OK";
-        case CMD_SLAVE_FAIL:
-            return "CMD_SLAVE_FAIL";
-        case CMD_WIFI:
-            return "CMD_WIFI";
-        case CMD_BLE:
-            return "CMD_BLE";
-        case CMD_ECHO:
-            return "CMD_ECHO";
-        case CMD_INVALID:
-            return "CMD_INVALID";
+        wake_command_processor();
+    }
+    else if (pushed < 0)
+    {
+        lane = select_lane(command);
+        portENTER_CRITICAL(&command_stats_mux);
+        command_stats.lanes[lane].overflows++;
+        command_stats.lanes[lane].dropped++;
+        portEXIT_CRITICAL(&command_stats_mux);
+        return errQUEUE_FULL;
+    }
+    return pdPASS;
+}
+
+BaseType_t command_processor_submit_text(rx_command_t* command, const char* text, TickType_t ticks_to_wait)
+{
+    const char* args = NULL;
+    char* end;
+    unsigned long slot;
+
+    command->command = command_decode_args(text, &args);
+    command->has_args = 1;
+    switch (command->command)
+    {
+        case CMD_SCRIPT_STORE:
+        case CMD_SCRIPT_RUN:
+            slot = strtoul(args, &end, 10);
+            if (end == args || slot >= SCRIPT_SLOTS)
+            {
+                ESP_LOGE(TAG, "%s needs a script slot (0 to %d).", translate_command_type(command->command),
+                                                                   SCRIPT_SLOTS - 1);
+                return pdFAIL;
+            }
+            command->value = slot;
+            // the script does not fit in a command, it is stored here (NVS can be used from any task)
+            if (command->command == CMD_SCRIPT_STORE && store_script(slot, end) != 0)
+            {
+                return pdFAIL;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return queue_command(command, ticks_to_wait);
+}
+
+void get_command_processor_stats(command_processor_stats_t* stats)
+{
+    portENTER_CRITICAL(&command_stats_mux);
+    *stats = command_stats;
+    portEXIT_CRITICAL(&command_stats_mux);
+}
+
+int8_t get_command_trace_stats(rx_module_t module, command_trace_stats_t* stats)
+{
+    if (module >= TRACE_MODULES)
+    {
+        return -1;
+    }
+
+    portENTER_CRITICAL(&command_stats_mux);
+    *stats = trace_stats[module];
+    portEXIT_CRITICAL(&command_stats_mux);
+    return 0;
+}
+
+char* translate_command_lane(command_lane_t lane)
+{
+    switch(lane)
+    {
+        case COMMAND_LANE_SYSTEM:
+            return "SYSTEM";
+        case COMMAND_LANE_CONTROL:
+            return "CONTROL";
+        case COMMAND_LANE_TELEMETRY:
+            return "TELEMETRY";
+        default:
+            return "UNKNOWN";
+    }
+}
+
+uint32_t get_slave_command_count(void)
+{
+    return slave_command_count;
+}
+
+wireless_state_t get_wireless_state(void)
+{
+    return wireless_state;
+}
+
+char* translate_wireless_state(wireless_state_t state)
+{
+    switch(state)
+    {
+        case WIFI_MODE:
+            return "WIFI";
+        case BLE_MODE:
+            return "BLE";
+        case OFFLINE_MODE:
+            return "OFFLINE";
         default:
             return "UNKNOWN";
     }
 }
 
+command_type_t str_to_cmd(char* str_command)
+{
+    return command_decode(str_command);
+}
+
+char* translate_command_type(command_type_t command)
+{
+    return (char*)command_name(command);
+}
+
 /* ===== Implementations of private functions ===== */
 char* translate_rx_module(rx_module_t module)
 {
@@ -305,39 +583,826 @@ char* translate_rx_module(rx_module_t module)
     }
 }
 
-QueueHandle_t* get_module_queue(rx_module_t module)
+static void complete_slave_operation(slave_pending_t* operation, const rx_command_t* completion)
 {
-    switch(module)
+    // the I2C master stamps the write, the completion is queued right after the slave answer
+    command_trace_mark(&operation->trace, TRACE_STAGE_I2C_WRITE, completion->ingress_us);
+    command_trace_mark(&operation->trace, TRACE_STAGE_SLAVE_ACK, completion->enqueue_us);
+
+    if (completion->command != CMD_SLAVE_OK)
     {
-        case UART_RX:
-            return &queue_uart_tx;
-        case HTTP_RX:
-            return &queue_http_tx;
-        case HTTPS_RX:
-            return &queue_tls_https_tx;
-        case MQTT_RX:
-            return &queue_mqtt_tx;
-        case MQTT_GCLOUD:
-            return &queue_mqtt_gcloud;
-        case BLE_SERVER:
-            return &queue_ble_server_tx;
+        ESP_LOGE(TAG, "Slave operation %u (%s) failed.", operation->seq, translate_command_type(operation->command));
+        if (operation->command == CMD_SLAVE_STATUS)
+        {
+            finish_status_read(operation, SLAVE_STATE_ERROR);
+        }
+        else
+        {
+            send_slave_result(operation->requester, operation->request_id, CMD_SLAVE_FAIL);
+        }
+        command_trace_mark(&operation->trace, TRACE_STAGE_REPLY, esp_timer_get_time());
+        end_trace(&operation->trace);
+        return;
+    }
+
+    ESP_LOGI(TAG, "Slave operation %u (%s) completed.", operation->seq, translate_command_type(operation->command));
+    if (operation->command == CMD_SLAVE_STATUS)
+    {
+        ESP_LOGI(TAG, "Slave FSM current state: %d", completion->value);
+        finish_status_read(operation, completion->value);
+    }
+    else
+    {
+        send_slave_result(operation->requester, operation->request_id, CMD_SLAVE_OK);
+    }
+    command_trace_mark(&operation->trace, TRACE_STAGE_REPLY, esp_timer_get_time());
+    end_trace(&operation->trace);
+}
+
+static void send_slave_state(rx_module_t requester, uint16_t request_id, uint8_t state)
+{
+    tx_message_t reply;
+
+    // a single message, the command processor never waits for the requester
+    reply.kind = TX_MSG_SLAVE_STATE;
+    reply.source = I2C_MASTER_MOD;
+    reply.correlation_id = request_id;
+    reply.payload.slave_state = state;
+    if (message_bus_send(requester, &reply, 0) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Could not send the slave state to %s.", translate_rx_module(requester));
+    }
+}
+
+static void send_slave_result(rx_module_t requester, uint16_t request_id, command_type_t result)
+{
+    tx_message_t reply;
+
+    // CMD_SLAVE_OK or CMD_SLAVE_FAIL with the id of the request, the requester is never left waiting
+    reply.kind = TX_MSG_COMMAND;
+    reply.source = I2C_MASTER_MOD;
+    reply.correlation_id = request_id;
+    reply.payload.command = result;
+    if (message_bus_send(requester, &reply, 0) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Could not send the slave result to %s.", translate_rx_module(requester));
+    }
+}
+
+static void request_slave_state(rx_module_t requester, uint16_t request_id, command_trace_t* trace)
+{
+    uint16_t seq;
+    uint8_t state;
+
+    switch (slave_state_cache_request(requester, request_id, &state))
+    {
+        case SLAVE_CACHE_HIT:
+            send_slave_state(requester, request_id, state);
+            command_trace_mark(trace, TRACE_STAGE_REPLY, esp_timer_get_time());
+            break;
+
+        case SLAVE_CACHE_JOINED:
+            // answered with a shared read (only the trace of the first request follows the read)
+            break;
+
+        case SLAVE_CACHE_READ_SHARED:
+            if (issue_shared_read(requester, request_id, trace) == 0)
+            {
+                command_trace_mark(trace, TRACE_STAGE_REPLY, esp_timer_get_time());
+            }
+            break;
+
+        case SLAVE_CACHE_READ_OWN:
         default:
-            return NULL;
+            seq = issue_traced(CMD_SLAVE_STATUS, requester, request_id, trace);
+            slave_state_cache_read_issued(seq, 0);
+            if (seq == 0)
+            {
+                send_slave_state(requester, request_id, SLAVE_STATE_ERROR);
+                command_trace_mark(trace, TRACE_STAGE_REPLY, esp_timer_get_time());
+            }
+            break;
+    }
+}
+
+static void finish_status_read(const slave_pending_t* operation, uint8_t state)
+{
+    slave_waiter_t waiters[SLAVE_STATE_CACHE_WAITERS];
+    slave_waiter_t first;
+    uint8_t count = slave_state_cache_read_done(operation->seq, state, waiters);
+    uint8_t i;
+
+    if (count == 0)
+    {
+        // not the shared read, only its own requester waits for it
+        send_slave_state(operation->requester, operation->request_id, state);
+        return;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        send_slave_state(waiters[i].requester, waiters[i].request_id, state);
+    }
+
+    // requests that came after the last slave command (or did not fit) are read now, the entry just freed
+    if (slave_state_cache_next_read(&first))
+    {
+        issue_shared_read(first.requester, first.request_id, NULL);
+    }
+}
+
+static uint16_t issue_shared_read(rx_module_t requester, uint16_t request_id, command_trace_t* trace)
+{
+    slave_pending_t failed = { 0 };
+    uint16_t seq = issue_traced(CMD_SLAVE_STATUS, requester, request_id, trace);
+
+    slave_state_cache_read_issued(seq, 1);
+    if (seq == 0)
+    {
+        // seq 0 ends the shared read, every waiter gets the error
+        failed.requester = requester;
+        failed.request_id = request_id;
+        finish_status_read(&failed, SLAVE_STATE_ERROR);
+    }
+    return seq;
+}
+
+static uint16_t issue_traced(command_type_t command, rx_module_t requester, uint16_t request_id,
+                             command_trace_t* trace)
+{
+    uint16_t seq = slave_pipeline_issue(command, requester, request_id, trace);
+
+    // from now on the trace goes with the slave operation
+    if (seq != 0 && trace != NULL)
+    {
+        memset(trace, 0, sizeof(command_trace_t));
+    }
+    return seq;
+}
+
+static uint16_t issue_slave_command(command_type_t command, rx_module_t requester, uint16_t request_id,
+                                    command_trace_t* trace)
+{
+    uint16_t seq = issue_traced(command, requester, request_id, trace);
+
+    if (seq != 0)
+    {
+        slave_command_count++;
+        slave_state_cache_invalidate();
+    }
+    return seq;
+}
+
+static void script_nvs_key(uint8_t slot, char* key)
+{
+    snprintf(key, SCRIPT_NVS_KEY_SIZE, "script%u", slot);
+}
+
+static int8_t store_script(uint8_t slot, const char* hex)
+{
+    uint8_t code[COMMAND_SCRIPT_MAX_SIZE];
+    char key[SCRIPT_NVS_KEY_SIZE];
+    int16_t size = command_script_from_hex(hex, code, sizeof(code));
+
+    if (size <= 0 || command_script_validate(code, size) != 0)
+    {
+        ESP_LOGE(TAG, "Invalid script for slot %u.", slot);
+        return -1;
+    }
+
+    script_nvs_key(slot, key);
+    if (set_nvs_blob_value(key, code, size) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Could not store the script in slot %u.", slot);
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Script of %d bytes stored in slot %u.", size, slot);
+    return 0;
+}
+
+static void start_script(uint8_t slot, rx_module_t requester)
+{
+    char key[SCRIPT_NVS_KEY_SIZE];
+    size_t size = sizeof(script.code);
+
+    if (script.active)
+    {
+        ESP_LOGE(TAG, "Script %u still running, script %u not started.", script.slot, slot);
+        return;
+    }
+
+    // the code is copied, a new CMD_SCRIPT_STORE does not change the running script
+    script_nvs_key(slot, key);
+    if (get_nvs_blob_value(key, script.code, &size) != ESP_OK ||
+        command_script_start(&script.vm, script.code, size) != 0)
+    {
+        ESP_LOGE(TAG, "No valid script in slot %u.", slot);
+        return;
+    }
+
+    script.active = 1;
+    script.slot = slot;
+    script.requester = requester;
+    script.sleeping = 0;
+    script.operations = 0;
+    script.start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Running script %u (%d bytes) for %s.", slot, (int)size, translate_rx_module(requester));
+
+    run_script();
+}
+
+static void run_script(void)
+{
+    command_script_action_t action;
+    TickType_t wait_ticks;
+
+    while (script.active)
+    {
+        action = command_script_next(&script.vm);
+        switch (action.kind)
+        {
+            case SCRIPT_ACTION_COMMAND:
+            case SCRIPT_ACTION_STATUS:
+                // status reads skip the cache, scripts poll for changes the slave makes by itself
+                if (action.kind == SCRIPT_ACTION_COMMAND)
+                {
+                    script.seq = issue_slave_command(action.command, script.requester, 0, NULL);
+                }
+                else
+                {
+                    script.seq = slave_pipeline_issue(CMD_SLAVE_STATUS, script.requester, 0, NULL);
+                }
+                if (script.seq == 0)
+                {
+                    // the next step reports the failure
+                    command_script_result(&script.vm, 0, SLAVE_STATE_ERROR);
+                    break;
+                }
+                script.operations++;
+                return;
+
+            case SCRIPT_ACTION_WAIT:
+                // rounded up to whole ticks, at least one: a wait of 0 ticks in a loop would never let the task block
+                script.sleeping = 1;
+                wait_ticks = (action.wait_ms + portTICK_RATE_MS - 1) / portTICK_RATE_MS;
+                script.wake = xTaskGetTickCount() + ((wait_ticks > 0) ? wait_ticks : 1);
+                return;
+
+            case SCRIPT_ACTION_DONE:
+            case SCRIPT_ACTION_FAILED:
+            default:
+                if (action.kind == SCRIPT_ACTION_DONE)
+                {
+                    ESP_LOGI(TAG, "Script %u done.", script.slot);
+                }
+                else
+                {
+                    ESP_LOGE(TAG, "Script %u failed (error %d, at %u).", script.slot, script.vm.error, script.vm.pc);
+                }
+                ESP_LOGI(TAG, "Script %u: %u instructions, %u slave operations in %lld us.", script.slot,
+                         script.vm.executed, script.operations, esp_timer_get_time() - script.start_us);
+                script.active = 0;
+                return;
+        }
+    }
+}
+
+static uint8_t script_slave_done(const slave_pending_t* operation, uint8_t ok, uint8_t state)
+{
+    if (script.seq == 0 || operation->seq != script.seq)
+    {
+        return 0;
+    }
+
+    // the next step starts right away, without a round trip to the requester
+    script.seq = 0;
+    if (script.active)
+    {
+        command_script_result(&script.vm, ok, state);
+        run_script();
+    }
+    return 1;
+}
+
+static void resume_script(void)
+{
+    if (script.active && script.sleeping && script_wait_ticks() == 0)
+    {
+        script.sleeping = 0;
+        run_script();
+    }
+}
+
+static TickType_t script_wait_ticks(void)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    if (!script.active || !script.sleeping)
+    {
+        return portMAX_DELAY;
     }
+    if (tick_deadline_passed(script.wake, now))
+    {
+        return 0;
+    }
+    return script.wake - now;
 }
 
-BaseType_t wait_for_slave_cmd_ack(rx_command_t* command)
+static BaseType_t queue_command(rx_command_t* command, TickType_t ticks_to_wait)
 {
+    command_lane_t lane = select_lane(command);
+    QueueHandle_t queue = command_lanes[lane];
     BaseType_t xStatus;
-    xStatus = xQueueReceive(queue_command_processor_rx, command,  2000 / portTICK_RATE_MS);
-    if (xStatus == pdPASS && command->rx_id == I2C_MASTER_MOD && command->command == CMD_SLAVE_OK)
+    uint8_t overflow = 0;
+    uint8_t dropped = 0;
+    uint32_t waiting;
+#if defined(CONFIG_COMMAND_QUEUE_OVERFLOW_DROP_OLDEST)
+    rx_command_t oldest;
+#endif
+
+    command->enqueue_us = esp_timer_get_time();
+
+    // try without blocking first, so a full lane is counted even if the sender can wait
+    xStatus = xQueueSendToBack(queue, command, 0);
+    if (xStatus != pdPASS)
+    {
+        overflow = 1;
+#if defined(CONFIG_COMMAND_QUEUE_OVERFLOW_DROP_OLDEST)
+        // make room for the new command, only commands of the same lane are dropped
+        if (xQueueReceive(queue, &oldest, 0) == pdPASS)
+        {
+            dropped++;
+            ESP_LOGW(TAG, "%s lane full, dropped %s from %s.", translate_command_lane(lane),
+                     translate_command_type(oldest.command), translate_rx_module(oldest.rx_id));
+        }
+        xStatus = xQueueSendToBack(queue, command, 0);
+#elif defined(CONFIG_COMMAND_QUEUE_OVERFLOW_DROP_NEWEST)
+        xStatus = errQUEUE_FULL;
+#else
+        xStatus = xQueueSendToBack(queue, command, ticks_to_wait);
+#endif
+        if (xStatus != pdPASS)
+        {
+            dropped++;
+        }
+    }
+    waiting = uxQueueMessagesWaiting(queue);
+
+    if (xStatus == pdPASS)
     {
-        ESP_LOGI(TAG, "Command successfully sent to Slave.");
+        wake_command_processor();
     }
-    else
+
+    portENTER_CRITICAL(&command_stats_mux);
+    if (xStatus == pdPASS)
+    {
+        command_stats.lanes[lane].received++;
+    }
+    command_stats.lanes[lane].overflows += overflow;
+    command_stats.lanes[lane].dropped += dropped;
+    if (waiting > command_stats.lanes[lane].high_water)
     {
-        ESP_LOGE(TAG, "Command could not be sent to Slave (%d).", command->command);
+        command_stats.lanes[lane].high_water = waiting;
     }
+    portEXIT_CRITICAL(&command_stats_mux);
 
     return xStatus;
 }
+
+static command_lane_t select_lane(const rx_command_t* command)
+{
+    // slave completions first: the operations they close hold pipeline entries
+    if (command->rx_id == I2C_MASTER_MOD)
+    {
+        return COMMAND_LANE_SYSTEM;
+    }
+    // periodic polls must never delay a user command
+    if (command->command == CMD_SLAVE_STATUS || command->command == CMD_BENCH_NOP)
+    {
+        return COMMAND_LANE_TELEMETRY;
+    }
+    return COMMAND_LANE_CONTROL;
+}
+
+static uint8_t needs_slave_pipeline(const rx_command_t* command)
+{
+    if (command->rx_id == I2C_MASTER_MOD)
+    {
+        return 0;
+    }
+    switch (command->command)
+    {
+        case CMD_SLAVE_START_A:
+        case CMD_SLAVE_START_B:
+        case CMD_SLAVE_PAUSE:
+        case CMD_SLAVE_CONTINUE:
+        case CMD_SLAVE_RESET:
+        case CMD_SCRIPT_RUN:
+            return 1;
+        case CMD_SLAVE_STATUS:
+            // a cache hit or a shared read needs no entry of its own
+            return slave_state_cache_needs_read();
+        default:
+            return 0;
+    }
+}
+
+static void wake_command_processor(void)
+{
+    TaskHandle_t handle = command_processor_handle;
+
+    // not started yet: the task looks at every lane and ring before it waits
+    if (handle != NULL)
+    {
+        xTaskNotifyGive(handle);
+    }
+}
+
+static BaseType_t receive_command(rx_command_t* command, TickType_t ticks_to_wait)
+{
+    drain_sources();
+    if (take_next_command(command) == pdPASS)
+    {
+        return pdPASS;
+    }
+
+    // the notification may be left over from a command already dispatched, then nothing is found
+    if (ulTaskNotifyTake(pdTRUE, ticks_to_wait) == 0)
+    {
+        return pdFAIL;
+    }
+    drain_sources();
+    return take_next_command(command);
+}
+
+static void drain_sources(void)
+{
+    rx_command_t* command;
+    command_lane_t lane;
+    UBaseType_t waiting;
+    uint8_t source;
+
+    for (source = 0; source < command_source_count; source++)
+    {
+        // in place, a command that does not fit in its lane waits in the ring (and the ring drops the new ones)
+        while ((command = spsc_ring_peek(command_sources[source])) != NULL)
+        {
+            lane = select_lane(command);
+            if (xQueueSendToBack(command_lanes[lane], command, 0) != pdPASS)
+            {
+                break;
+            }
+            spsc_ring_release(command_sources[source]);
+            waiting = uxQueueMessagesWaiting(command_lanes[lane]);
+
+            portENTER_CRITICAL(&command_stats_mux);
+            command_stats.lanes[lane].received++;
+            if (waiting > command_stats.lanes[lane].high_water)
+            {
+                command_stats.lanes[lane].high_water = waiting;
+            }
+            portEXIT_CRITICAL(&command_stats_mux);
+        }
+    }
+}
+
+static BaseType_t take_next_command(rx_command_t* command)
+{
+    UBaseType_t waiting[COMMAND_LANE_COUNT];
+    rx_command_t head;
+    uint8_t pipeline_room = slave_pipeline_has_room();
+    int8_t selected = -1;
+    uint8_t promoted = 0;
+    uint8_t lane;
+
+    for (lane = 0; lane < COMMAND_LANE_COUNT; lane++)
+    {
+        waiting[lane] = uxQueueMessagesWaiting(command_lanes[lane]);
+        // backpressure: with every pipeline entry in use a slave operation stays at the head of its lane
+        // (the lane keeps its order) until a completion or a timeout frees an entry
+        if (waiting[lane] > 0 && !pipeline_room && xQueuePeek(command_lanes[lane], &head, 0) == pdPASS &&
+            needs_slave_pipeline(&head))
+        {
+            waiting[lane] = 0;
+        }
+    }
+
+    // a lane passed over too many times goes first, the highest one if several are starving
+    for (lane = 0; lane < COMMAND_LANE_COUNT && selected < 0; lane++)
+    {
+        if (waiting[lane] > 0 && command_lane_skipped[lane] >= CONFIG_COMMAND_LANE_STARVATION_LIMIT)
+        {
+            selected = lane;
+            promoted = 1;
+        }
+    }
+    // otherwise strict priority
+    for (lane = 0; lane < COMMAND_LANE_COUNT && selected < 0; lane++)
+    {
+        if (waiting[lane] > 0)
+        {
+            selected = lane;
+        }
+    }
+
+    // a drop oldest overflow can empty the lane in between
+    if (selected < 0 || xQueueReceive(command_lanes[selected], command, 0) != pdPASS)
+    {
+        return pdFAIL;
+    }
+
+    command_lane_skipped[selected] = 0;
+    for (lane = selected + 1; lane < COMMAND_LANE_COUNT; lane++)
+    {
+        command_lane_skipped[lane] = (waiting[lane] > 0) ? command_lane_skipped[lane] + 1 : 0;
+    }
+
+    record_dispatch(selected, promoted, command);
+    return pdPASS;
+}
+
+static void record_dispatch(command_lane_t lane, uint8_t promoted, const rx_command_t* command)
+{
+    command_lane_stats_t* lane_stats = &command_stats.lanes[lane];
+    int64_t latency_us = esp_timer_get_time() - command->enqueue_us;
+
+    portENTER_CRITICAL(&command_stats_mux);
+    lane_stats->dispatched++;
+    lane_stats->promoted += promoted;
+    lane_stats->latency_total_us += latency_us;
+    if (latency_us > lane_stats->latency_max_us)
+    {
+        lane_stats->latency_max_us = latency_us;
+    }
+    portEXIT_CRITICAL(&command_stats_mux);
+}
+
+static void command_queue_bench_task(void *pvParameter)
+{
+    rx_command_t bench_command = { 0 };
+    command_processor_stats_t stats;
+    command_lane_stats_t* lane_stats;
+    int64_t start_us;
+    int64_t elapsed_us;
+    uint32_t sent = 0;
+    uint32_t i;
+
+    bench_command.rx_id = (rx_module_t)(uintptr_t)pvParameter;
+    bench_command.command = CMD_BENCH_NOP;
+
+    // the counters only cover the benchmark from here on
+    portENTER_CRITICAL(&command_stats_mux);
+    memset(&command_stats, 0, sizeof(command_stats));
+    portEXIT_CRITICAL(&command_stats_mux);
+
+    start_us = esp_timer_get_time();
+    for (i = 0; i < CMD_QUEUE_BENCH_COMMANDS; i++)
+    {
+        if (command_processor_submit(&bench_command, 100 / portTICK_RATE_MS) == pdPASS)
+        {
+            sent++;
+        }
+    }
+
+    // wait until the whole burst was dispatched (the benchmark commands use the telemetry lane)
+    lane_stats = &stats.lanes[COMMAND_LANE_TELEMETRY];
+    do
+    {
+        vTaskDelay(1);
+        get_command_processor_stats(&stats);
+        elapsed_us = esp_timer_get_time() - start_us;
+    } while (lane_stats->dispatched < sent && elapsed_us < CMD_QUEUE_BENCH_TIMEOUT_MS * 1000);
+
+    ESP_LOGI(TAG, "Queue benchmark: %u/%u commands dispatched in %lld us (lane length %d).",
+             lane_stats->dispatched, CMD_QUEUE_BENCH_COMMANDS, elapsed_us, CONFIG_COMMAND_TELEMETRY_QUEUE_LEN);
+
+    // every lane, to see what the burst did to the commands received meanwhile
+    for (i = 0; i < COMMAND_LANE_COUNT; i++)
+    {
+        lane_stats = &stats.lanes[i];
+        ESP_LOGI(TAG, "%s lane: %u received, %u dispatched (%u promoted), %u overflows, %u dropped, high water %u.",
+                 translate_command_lane(i), lane_stats->received, lane_stats->dispatched, lane_stats->promoted,
+                 lane_stats->overflows, lane_stats->dropped, lane_stats->high_water);
+        if (lane_stats->dispatched > 0)
+        {
+            ESP_LOGI(TAG, "%s lane: latency avg = %lld us, max = %lld us.", translate_command_lane(i),
+                     lane_stats->latency_total_us / lane_stats->dispatched, lane_stats->latency_max_us);
+        }
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void command_ring_bench_task(void *pvParameter)
+{
+    ring_bench_t bench = { 0 };
+    rx_command_t bench_command = { 0 };
+    int64_t start_us;
+    int64_t queue_us;
+    int64_t ring_us;
+    int64_t queue_handoff_us;
+    int64_t ring_handoff_us;
+    uint32_t i;
+
+    bench_command.rx_id = (rx_module_t)(uintptr_t)pvParameter;
+    bench_command.command = CMD_BENCH_NOP;
+    bench.producer = xTaskGetCurrentTaskHandle();
+    bench.queue = xQueueCreate(CMD_RING_BENCH_LEN, sizeof(rx_command_t));
+    if (bench.queue == NULL)
+    {
+        ESP_LOGE(TAG, "Could not create the ring benchmark queue.");
+        vTaskDelete(NULL);
+        return;
+    }
+    spsc_ring_init(&bench.ring, bench.items, sizeof(rx_command_t), CMD_RING_BENCH_LEN);
+
+    // same task: the cost of putting a command in and taking it out, without context switches
+    start_us = esp_timer_get_time();
+    for (i = 0; i < CMD_RING_BENCH_COMMANDS; i++)
+    {
+        xQueueSendToBack(bench.queue, &bench_command, 0);
+        xQueueReceive(bench.queue, &bench_command, 0);
+    }
+    queue_us = esp_timer_get_time() - start_us;
+
+    start_us = esp_timer_get_time();
+    for (i = 0; i < CMD_RING_BENCH_COMMANDS; i++)
+    {
+        spsc_ring_push(&bench.ring, &bench_command);
+        spsc_ring_pop(&bench.ring, &bench_command);
+    }
+    ring_us = esp_timer_get_time() - start_us;
+
+    // handoff: the consumer waits for every command, like the command processor waits for a callback
+    queue_handoff_us = ring_bench_handoff(&bench, &bench_command, 1);
+    ring_handoff_us = ring_bench_handoff(&bench, &bench_command, 0);
+
+    ESP_LOGI(TAG, "Ring benchmark: same task, queue = %lld ns/command, ring = %lld ns/command (%d commands).",
+             queue_us * 1000 / CMD_RING_BENCH_COMMANDS, ring_us * 1000 / CMD_RING_BENCH_COMMANDS,
+             CMD_RING_BENCH_COMMANDS);
+    if (queue_handoff_us < 0 || ring_handoff_us < 0)
+    {
+        ESP_LOGE(TAG, "Could not create the ring benchmark consumer task.");
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Ring benchmark: handoff, queue = %lld ns/command, ring = %lld ns/command (%u notifications).",
+                 queue_handoff_us * 1000 / CMD_RING_BENCH_COMMANDS, ring_handoff_us * 1000 / CMD_RING_BENCH_COMMANDS,
+                 bench.wakeups);
+    }
+
+    vQueueDelete(bench.queue);
+    vTaskDelete(NULL);
+}
+
+static int64_t ring_bench_handoff(ring_bench_t* bench, const rx_command_t* command, uint8_t use_queue)
+{
+    int64_t start_us;
+    int64_t elapsed_us;
+    uint32_t i;
+    int8_t pushed;
+
+    bench->use_queue = use_queue;
+    bench->received = 0;
+    bench->wakeups = 0;
+    // higher priority, each command wakes it up (on either core)
+    if (xTaskCreate(&ring_bench_consumer_task, "cmd_ring_bench_rx", CMD_RING_BENCH_STACK, bench,
+                    CMD_QUEUE_BENCH_PRIORITY + 1, &bench->consumer) != pdPASS)
+    {
+        return -1;
+    }
+
+    start_us = esp_timer_get_time();
+    for (i = 0; i < CMD_RING_BENCH_COMMANDS; i++)
+    {
+        if (use_queue)
+        {
+            xQueueSendToBack(bench->queue, command, portMAX_DELAY);
+            continue;
+        }
+        while ((pushed = spsc_ring_push(&bench->ring, command)) < 0)
+        {
+            vTaskDelay(1);
+        }
+        if (pushed > 0)
+        {
+            bench->wakeups++;
+            xTaskNotifyGive(bench->consumer);
+        }
+    }
+
+    // the consumer notifies the last command (bench lives in this stack, it cannot give up before)
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    elapsed_us = esp_timer_get_time() - start_us;
+    return elapsed_us;
+}
+
+static void ring_bench_consumer_task(void *pvParameter)
+{
+    ring_bench_t* bench = pvParameter;
+    rx_command_t command;
+
+    while (bench->received < CMD_RING_BENCH_COMMANDS)
+    {
+        if (bench->use_queue)
+        {
+            if (xQueueReceive(bench->queue, &command, portMAX_DELAY) == pdPASS)
+            {
+                bench->received++;
+            }
+        }
+        else if (spsc_ring_pop(&bench->ring, &command))
+        {
+            bench->received++;
+        }
+        else
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+    }
+
+    xTaskNotifyGive(bench->producer);
+    vTaskDelete(NULL);
+}
+
+static void begin_trace(const rx_command_t* command)
+{
+    // completions belong to the trace of their slave operation, benchmark bursts would only add noise
+    if (command->rx_id == I2C_MASTER_MOD || command->rx_id >= TRACE_MODULES || command->command == CMD_BENCH_NOP)
+    {
+        memset(&current_trace, 0, sizeof(current_trace));
+        return;
+    }
+
+    command_trace_start(&current_trace, command->rx_id, command->command, command->seq, command->ingress_us,
+                        command->enqueue_us, esp_timer_get_time());
+}
+
+static void end_trace(command_trace_t* trace)
+{
+    if (!command_trace_active(trace))
+    {
+        return;
+    }
+
+    // the histograms can be copied from other tasks
+    portENTER_CRITICAL(&command_stats_mux);
+    command_trace_add(&trace_stats[trace->source], trace);
+    portEXIT_CRITICAL(&command_stats_mux);
+    // the oldest one is overwritten once the log is full
+    trace_log[trace_log_count % CONFIG_COMMAND_TRACE_LOG_LEN] = *trace;
+    trace_log_count++;
+    memset(trace, 0, sizeof(command_trace_t));
+}
+
+static void dump_traces(void)
+{
+    const command_trace_stats_t* stats;
+    uint8_t module;
+    uint8_t stage;
+#if defined(CONFIG_COMMAND_TRACE_CHROME_EXPORT)
+    const command_trace_t* trace;
+    uint32_t i;
+#endif
+
+    for (module = 0; module < TRACE_MODULES; module++)
+    {
+        stats = &trace_stats[module];
+        if (stats->total.count == 0)
+        {
+            continue;
+        }
+
+        ESP_LOGI(TAG, "%s: %u commands, p50 = %lld us, p90 = %lld us, p99 = %lld us, max = %lld us.",
+                 translate_rx_module(module), stats->total.count, latency_histogram_percentile(&stats->total, 50),
+                 latency_histogram_percentile(&stats->total, 90), latency_histogram_percentile(&stats->total, 99),
+                 stats->total.max_us);
+        for (stage = TRACE_STAGE_INGRESS + 1; stage < TRACE_STAGE_COUNT; stage++)
+        {
+            if (stats->stage[stage].count > 0)
+            {
+                ESP_LOGI(TAG, "%s   %s: p50 = %lld us, p99 = %lld us, max = %lld us (%u).", translate_rx_module(module),
+                         command_trace_span_name(stage), latency_histogram_percentile(&stats->stage[stage], 50),
+                         latency_histogram_percentile(&stats->stage[stage], 99), stats->stage[stage].max_us,
+                         stats->stage[stage].count);
+            }
+        }
+    }
+
+#if defined(CONFIG_COMMAND_TRACE_CHROME_EXPORT)
+    // JSON array format: save from "[" to "]" and load it in chrome://tracing or Perfetto
+    i = (trace_log_count > CONFIG_COMMAND_TRACE_LOG_LEN) ? trace_log_count - CONFIG_COMMAND_TRACE_LOG_LEN : 0;
+    printf("[\n");
+    for (; i < trace_log_count; i++)
+    {
+        trace = &trace_log[i % CONFIG_COMMAND_TRACE_LOG_LEN];
+        if (command_trace_chrome_events(trace, translate_rx_module(trace->source), translate_command_type(trace->command),
+                                        trace_json, sizeof(trace_json)) > 0)
+        {
+            printf("%s%s\n", trace_json, (i + 1 < trace_log_count) ? "," : "");
+        }
+    }
+    printf("]\n");
+#endif
+}
@@ -12,8 +12,10 @@
 #include "freertos/FreeRTOS.h"
 #include "driver/uart.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "command_processor.h"
+#include "message_bus.h"
 
 /* ===== Macros of private constants ===== */
 #define UART_RX_CHECK_TIME_MS   100
@@ -21,8 +23,6 @@
 #define UART_RX_PIN             3
 
 /* ===== Declaration of private or external variables ===== */
-extern QueueHandle_t queue_command_processor_rx;
-QueueHandle_t queue_uart_tx;
 
 static const char* TAG = "UART_TASK";
 
@@ -44,11 +44,9 @@ void initialize_uart()
     uart_set_pin(UART_NUM_0, UART_TX_PIN, UART_RX_PIN, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
     uart_driver_install(UART_NUM_0, 1024, 0, 0, NULL, 0);
 
-    // create a queue capable of containing 5 uint8_t values
-    queue_uart_tx = xQueueCreate(5, sizeof(uint8_t));
-    if (queue_uart_tx == NULL)
+    if (message_bus_register(UART_RX, MESSAGE_BUS_QUEUE_LEN) != 0)
     {
-        ESP_LOGE(TAG, "Could not create queue_uart_tx.");
+        ESP_LOGE(TAG, "Could not create the UART TX queue.");
     }
 }
 
@@ -56,8 +54,8 @@ void echo_task(void *pvParameter)
 {   
     uint8_t* uart_rcv_buffer = (uint8_t*) malloc(1);
     int32_t rcv_len;
-    uint8_t command_type;
-    rx_command_t uart_command;
+    tx_message_t tx_message;
+    rx_command_t uart_command = { 0 };
     uart_command.rx_id = UART_RX;
 
     BaseType_t xStatus;
@@ -68,11 +66,13 @@ void echo_task(void *pvParameter)
         rcv_len = uart_read_bytes(UART_NUM_0, (uint8_t*)uart_rcv_buffer, 1, 20 / portTICK_RATE_MS);
         if (rcv_len > 0)
         {
+            // the byte may have waited up to the read timeout in the driver
+            uart_command.ingress_us = esp_timer_get_time();
             ESP_LOGI(TAG, "Received from UART: %d", *uart_rcv_buffer - '0');
 
             // send the received value to the queue (wait 1000ms if the queue is full)
             uart_command.command = *uart_rcv_buffer - '0';
-            xStatus = xQueueSendToBack(queue_command_processor_rx, &uart_command, 1000 / portTICK_RATE_MS);
+            xStatus = command_processor_submit(&uart_command, 1000 / portTICK_RATE_MS);
             if (xStatus != pdPASS)
             {
                 ESP_LOGE(TAG, "Could not send the data to the queue.");
@@ -80,10 +80,10 @@ void echo_task(void *pvParameter)
         }
 
         // read data from the tx queue
-        xStatus = xQueueReceive(queue_uart_tx, &command_type, 100 / portTICK_RATE_MS);
-        if (xStatus == pdPASS && command_type < 50) 
+        xStatus = message_bus_receive(UART_RX, &tx_message, 100 / portTICK_RATE_MS);
+        if (xStatus == pdPASS) 
         {
-            ESP_LOGI(TAG, "Received from Command Processor: %d", command_type);
+            ESP_LOGI(TAG, "Received from Command Processor: %d", message_bus_value(&tx_message));
         }
 
         vTaskDelay(UART_RX_CHECK_TIME_MS / portTICK_RATE_MS);
@@ -12,6 +12,7 @@
 #include "thingspeak_http_request.h"
 #include "http_client.h"
 #include "command_processor.h"
+#include "message_bus.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -23,6 +24,7 @@
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 
 /* ===== Macros of private constants ===== */
@@ -31,7 +33,6 @@
 
 /* ===== Declaration of private or external variables ===== */
 extern EventGroupHandle_t wifi_event_group;
-extern QueueHandle_t queue_command_processor_rx;
 
 static const int CONNECTED_BIT = BIT0;
 static const char *TAG_TX = "HTTP_TX_TASK";
@@ -39,7 +40,6 @@ static const char *TAG_RX = "HTTP_RX_TASK";
 
 // queue to pass the IP resolution from wifi_tx_task to wifi_rx_cmd_task
 QueueHandle_t queue_wifi_tx_to_rx;
-QueueHandle_t queue_http_tx;
 
 
 /* ===== Prototypes of private functions ===== */
@@ -48,10 +48,8 @@ QueueHandle_t queue_http_tx;
 /* ===== Implementations of public functions ===== */
 void wifi_tx_task(void *pvParameter)
 {
-	// create a queue capable of containing 5 uint8_t values
-    queue_http_tx = xQueueCreate(5, sizeof(uint8_t));
-    if (queue_http_tx == NULL)	{
-        printf("Could not create queue_http_tx.\n");
+    if (message_bus_register(HTTP_RX, MESSAGE_BUS_QUEUE_LEN) != 0)	{
+        printf("Could not create the HTTP TX queue.\n");
     }
 
 	// create a queue capable of containing a single pointer to struct addrinfo
@@ -97,6 +95,7 @@ void wifi_tx_task(void *pvParameter)
 		printf("Could not send the IP address resolve information to the queue.\n");
 	}
 
+	tx_message_t tx_message;
 	uint8_t queue_rcv_value;
 	char request_buffer[strlen(HTTP_REQUEST_WRITE)];
 	int32_t socket_http, request_status;
@@ -106,8 +105,9 @@ void wifi_tx_task(void *pvParameter)
 		xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, portMAX_DELAY);
 		
 		// Read data from the queue
-		xStatus = xQueueReceive(queue_http_tx, &queue_rcv_value,  20 / portTICK_RATE_MS);
+		xStatus = message_bus_receive(HTTP_RX, &tx_message,  20 / portTICK_RATE_MS);
 		if (xStatus == pdPASS)	{
+			queue_rcv_value = message_bus_value(&tx_message);
 			ESP_LOGI(TAG_TX, "Received from Command Processor TASK: %d\n", queue_rcv_value);
 			sprintf(request_buffer, HTTP_REQUEST_WRITE, queue_rcv_value);
 			
@@ -165,7 +165,7 @@ void wifi_rx_cmd_task(void * pvParameter)
 	char * pch;
 	int32_t socket_http, request_status;
 	// command to send to the command processor
-	rx_command_t http_command;
+	rx_command_t http_command = { 0 };
     http_command.rx_id = HTTP_RX;
 
 	if (xQueueReceive(queue_wifi_tx_to_rx, &res, portMAX_DELAY) != pdTRUE)	{
@@ -193,6 +193,8 @@ void wifi_rx_cmd_task(void * pvParameter)
 		int32_t flag_rsp_ok;
 		content_buf[0] = '\0';
 		flag_rsp_ok = receive_http_response(socket_http, recv_buf, content_buf, RX_BUFFER_SIZE);
+		// the TalkBack response is the ingress of its command
+		http_command.ingress_us = esp_timer_get_time();
 
 		// close socket after receiving the response
 		lwip_close_r(socket_http);
@@ -205,8 +207,7 @@ void wifi_rx_cmd_task(void * pvParameter)
 			if (pch != NULL)	{
 				ESP_LOGI(TAG_RX, "Received new command:\n%s", content_buf);
 				
-				http_command.command = str_to_cmd(content_buf);
-				xStatus = xQueueSendToBack(queue_command_processor_rx, &http_command, 1000 / portTICK_RATE_MS);
+				xStatus = command_processor_submit_text(&http_command, content_buf, 1000 / portTICK_RATE_MS);
 	            if (xStatus != pdPASS)	{
 	                printf("Could not send the data to the queue.\n");
 	            }
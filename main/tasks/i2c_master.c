@@ -11,11 +11,13 @@
 #include "i2c_master.h"
 #include "serial_protocol_common.h"
 #include "command_processor.h"
+#include "slave_pipeline.h"
 #include <stdio.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 /* ===== Macros of private constants ===== */
 #define I2C_MASTER_FREQ_HZ          100000      //I2C master clock frequency */
@@ -27,9 +29,10 @@
 #define ACK_VAL                     0x0         // I2C ack value
 #define NACK_VAL                    0x1         // I2C nack value
 
+#define I2C_MASTER_IDLE_POLL_MS     1000        // slave poll period when there are no requests
+
 /* ===== Declaration of private or external variables ===== */
 static const char* TAG = "I2C_MASTER_TASK";
-extern QueueHandle_t queue_command_processor_rx;
 QueueHandle_t queue_i2c_master;
 
 /* ===== Prototypes of private functions ===== */
@@ -38,8 +41,8 @@ QueueHandle_t queue_i2c_master;
 /* ===== Implementations of public functions ===== */
 esp_err_t initialize_i2c_master()
 {
-    // create a queue capable of containing 5 uint8_t values
-    queue_i2c_master = xQueueCreate(5, sizeof(uint8_t));
+    // one entry per slave operation that can be in flight
+    queue_i2c_master = xQueueCreate(SLAVE_PIPELINE_DEPTH, sizeof(slave_request_t));
     if (queue_i2c_master == NULL)
     {
         printf("Could not create queue_i2c_master QUEUE.\n");
@@ -67,11 +70,11 @@ void i2c_master_task(void *pvParameter)
     int ret;
     uint8_t data_to_slave[COMMAND_FRAME_LENGTH];
     uint8_t data_from_slave[COMMAND_FRAME_LENGTH];
-    uint8_t command_received;
+    slave_request_t request;
     BaseType_t xStatus;
 
-    rx_command_t ack_command;
-    ack_command.rx_id = I2C_MASTER_MOD;
+    rx_command_t completion;
+    completion.rx_id = I2C_MASTER_MOD;
 
 
     data_to_slave[0] = COMMAND_FRAME_START;
@@ -79,14 +82,19 @@ void i2c_master_task(void *pvParameter)
 
     while (1)   
     {
-        // read data from the command processor queue
-        xStatus = xQueueReceive(queue_i2c_master, &command_received, 500 / portTICK_RATE_MS);
+        // requests are run back to back, the slave is only polled when there is nothing to send
+        xStatus = xQueueReceive(queue_i2c_master, &request, I2C_MASTER_IDLE_POLL_MS / portTICK_RATE_MS);
         if (xStatus == pdPASS)
         {
-            ack_command.command = CMD_SLAVE_FAIL;
-            ESP_LOGI(TAG, "Received %d from Command Processor, sending it to slave.", command_received);
-            data_to_slave[1] = command_received;
+            // exactly one completion per request, with the same sequence id
+            completion.seq = request.seq;
+            completion.command = CMD_SLAVE_FAIL;
+            completion.value = 0;
+            ESP_LOGI(TAG, "Received %d (seq %u) from Command Processor, sending it to slave.", request.command, request.seq);
+            data_to_slave[1] = request.command;
             ret = i2c_master_write_slave(I2C_MASTER_NUM, I2C_ESP_SLAVE_ADDR, data_to_slave, COMMAND_FRAME_LENGTH);
+            // traced as the I2C write stage of the command
+            completion.ingress_us = esp_timer_get_time();
             if(ret == ESP_OK)
             {
                 // wait to make sure that the slave response is ready
@@ -97,34 +105,33 @@ void i2c_master_task(void *pvParameter)
                 {
                     if(data_from_slave[1] == CMD_SLAVE_OK)
                     {
-                        // ESP_LOGI(TAG, "Received ACK from slave for command %d\n", command_received);
-                        ack_command.command = CMD_SLAVE_OK;
+                        completion.command = CMD_SLAVE_OK;
                     }
                 }
             }
 
-            // send back ack status to command processor
-            xStatus = xQueueSendToBack(queue_command_processor_rx, &ack_command, 100 / portTICK_RATE_MS);
-            if (xStatus != pdPASS)
-            {
-                ESP_LOGE(TAG, "Could not send ACK back to the Command Processor.");
-            }
-
             // read the slave FSM status
-            if(command_received == CMD_SLAVE_STATUS)
+            if(completion.command == CMD_SLAVE_OK && request.command == CMD_SLAVE_STATUS)
             {
                 ESP_LOGI(TAG, "Reading Slave status.");
                 ret = i2c_master_read_slave(I2C_MASTER_NUM, I2C_ESP_SLAVE_ADDR, data_from_slave, COMMAND_FRAME_LENGTH);
                 if (ret == ESP_OK && check_frame_format(data_from_slave))
                 {
-                    ack_command.command = data_from_slave[1];
-                    xStatus = xQueueSendToBack(queue_command_processor_rx, &ack_command, 100 / portTICK_RATE_MS);
-                    if (xStatus != pdPASS)
-                    {
-                        ESP_LOGE(TAG, "Could not send Slave FSM state to the Command Processor.");
-                    }
+                    completion.value = data_from_slave[1];
+                }
+                else
+                {
+                    completion.command = CMD_SLAVE_FAIL;
                 }
             }
+
+            // send the completion back to the command processor
+            xStatus = command_processor_submit(&completion, 100 / portTICK_RATE_MS);
+            if (xStatus != pdPASS)
+            {
+                ESP_LOGE(TAG, "Could not send the completion of seq %u to the Command Processor.", request.seq);
+            }
+            continue;
         }
 
         // read data from the slave
@@ -134,8 +141,6 @@ void i2c_master_task(void *pvParameter)
         {
             ESP_LOGI(TAG, "Received (%d) from slave.", data_from_slave[1]);
         }
-
-        vTaskDelay(1000 / portTICK_RATE_MS);
     }
 }
 
@@ -15,9 +15,15 @@
 /* ===== Dependencies ===== */
 #include <stdint.h>
 
+#include "freertos/FreeRTOS.h"
+#include "command_codec.h"
+#include "command_trace.h"
+#include "spsc_ring.h"
+
 
 /* ===== Macros of public constants ===== */
-#define SLAVE_STATE_FRAME   123
+#define SLAVE_STATE_ERROR   255     // slave state reported when it could not be read
+#define COMMAND_SOURCES_MAX 4       // command rings drained by the command processor
 
 /* ===== Public structs and enums ===== */
 /*------------------------------------------------------------------
@@ -43,38 +49,6 @@ typedef enum {
     I2C_MASTER_MOD,
 }   rx_module_t;
 
-/*------------------------------------------------------------------
-|  Enum: command_type_t
-| ------------------------------------------------------------------
-|  Description: possible commands that can be received.
-|
-|  Values:
-|       CMD_START   - TBD
-|       CMD_STOP    - TBD
-|       CMD_STATUS  - TBD
-|       CMD_RESTART - TBD
-|       CMD_WIFI    - toggles WiFi connection (stops BLE if enabled)
-|       CMD_BLE     - toggles BLE connection (stops WiFi if enabled)
-|       CMD_ECHO    - sends back the same command to the RX module
-|                     that sent the command.
-|       CMD_INVALID - invalid command
-*-------------------------------------------------------------------*/
-typedef enum {
-    CMD_SLAVE_START_A,
-    CMD_SLAVE_START_B,
-    CMD_SLAVE_PAUSE,
-    CMD_SLAVE_CONTINUE,
-    CMD_SLAVE_RESET,
-    CMD_SLAVE_STATUS,
-    CMD_SLAVE_OK,
-    CMD_SLAVE_FAIL,
-    CMD_WIFI,
-    CMD_BLE,
-    CMD_ECHO,
-    CMD_DUMMY,
-    CMD_INVALID,
-}   command_type_t;
-
 /*------------------------------------------------------------------
 |  Enum: wireless_state_t
 | ------------------------------------------------------------------
@@ -98,14 +72,93 @@ typedef enum {
 |  Description: represents a received command.
 |
 |  Members:
-|       rx_id   - module that sent the command
-|       command - type of command received
+|       rx_id       - module that sent the command
+|       command     - type of command received
+|       ingress_us  - time the RX module received it (0 if unknown,
+|                     then enqueue_us is used). For I2C master
+|                     completions: when the frame was written to
+|                     the slave
+|       enqueue_us  - time it was queued (set by
+|                     command_processor_submit or
+|                     command_processor_post)
+|       seq         - request id chosen by the sender, echoed as the
+|                     correlation id of the reply (for I2C master
+|                     completions: the slave operation)
+|       value       - slave state read by CMD_SLAVE_STATUS (I2C
+|                     master only), script slot of CMD_SCRIPT_STORE
+|                     and CMD_SCRIPT_RUN
+|       has_args    - 1 if value was decoded from the arguments of a
+|                     text command (set when the command is queued)
 *-------------------------------------------------------------------*/
 typedef struct {
     rx_module_t     rx_id;
     command_type_t  command; 
+    int64_t         ingress_us;
+    int64_t         enqueue_us;
+    uint16_t        seq;
+    uint8_t         value;
+    uint8_t         has_args;
 }   rx_command_t;
 
+/*------------------------------------------------------------------
+|  Enum: command_lane_t
+| ------------------------------------------------------------------
+|  Description: priority lanes of the command processor, from the
+|               highest to the lowest priority. Each lane has its own
+|               queue; a lane passed over too many times is served
+|               before the higher ones (starvation protection).
+|
+|  Values:
+|       COMMAND_LANE_SYSTEM     - completions from the I2C master
+|       COMMAND_LANE_CONTROL    - user and slave action commands
+|       COMMAND_LANE_TELEMETRY  - slave status polls and benchmark
+|                                 commands
+*-------------------------------------------------------------------*/
+typedef enum {
+    COMMAND_LANE_SYSTEM,
+    COMMAND_LANE_CONTROL,
+    COMMAND_LANE_TELEMETRY,
+    COMMAND_LANE_COUNT,
+}   command_lane_t;
+
+/*------------------------------------------------------------------
+|  Struct: command_lane_stats_t
+| ------------------------------------------------------------------
+|  Description: counters of a command processor lane.
+|
+|  Members:
+|       received        - commands accepted in the lane
+|       dispatched      - commands taken by the command processor
+|       overflows       - times a sender found the lane full
+|       dropped         - commands lost because of an overflow
+|       high_water      - max commands waiting at the same time
+|       promoted        - dispatches forced by the starvation limit
+|       latency_total_us- sum of the enqueue to dispatch times
+|       latency_max_us  - max enqueue to dispatch time
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint32_t    received;
+    uint32_t    dispatched;
+    uint32_t    overflows;
+    uint32_t    dropped;
+    uint32_t    high_water;
+    uint32_t    promoted;
+    int64_t     latency_total_us;
+    int64_t     latency_max_us;
+}   command_lane_stats_t;
+
+/*------------------------------------------------------------------
+|  Struct: command_processor_stats_t
+| ------------------------------------------------------------------
+|  Description: command processor queue counters.
+|
+|  Members:
+|       lanes   - counters of each lane (index command_lane_t)
+*-------------------------------------------------------------------*/
+typedef struct {
+    command_lane_stats_t    lanes[COMMAND_LANE_COUNT];
+}   command_processor_stats_t;
+
 
 /* ===== Prototypes of public functions ===== */
 /*------------------------------------------------------------------
@@ -133,11 +186,165 @@ int8_t initialize_command_processor();
 *-------------------------------------------------------------------*/
 void command_processor_task(void *pvParameter);
 
+/*------------------------------------------------------------------
+|  Function: command_processor_submit
+| ------------------------------------------------------------------
+|  Description: queues a command in its priority lane, applying the
+|               configured overflow policy (wait, drop the new command
+|               or drop the oldest one of the lane).
+|
+|  Parameters:
+|       - command: command to queue (enqueue_us and has_args are
+|                  set here).
+|       - ticks_to_wait: max time to wait if the lane is full (only
+|                        used by the wait policy).
+|
+|  Returns:  BaseType_t
+|           pdPASS if the command was queued
+*-------------------------------------------------------------------*/
+BaseType_t command_processor_submit(rx_command_t* command, TickType_t ticks_to_wait);
+
+/*------------------------------------------------------------------
+|  Function: command_processor_add_source
+| ------------------------------------------------------------------
+|  Description: registers the command ring of a source module. The
+|               command processor moves its commands to their lanes
+|               before taking the next one; a full lane leaves them
+|               in the ring. Call it from the command processor task
+|               or before the task starts.
+|
+|  Parameters:
+|       - ring: ring of rx_command_t, the module is its only
+|               producer.
+|
+|  Returns:  int8_t
+|           0 if OK, -1 if there are already COMMAND_SOURCES_MAX
+|           sources
+*-------------------------------------------------------------------*/
+int8_t command_processor_add_source(spsc_ring_t* ring);
+
+/*------------------------------------------------------------------
+|  Function: command_processor_post
+| ------------------------------------------------------------------
+|  Description: pushes a command to the ring of its source module
+|               and wakes the command processor up if it drained
+|               the ring. Never blocks, meant for callbacks (the BLE
+|               GATT events). A command that does not fit is counted
+|               as dropped in its lane.
+|
+|  Parameters:
+|       - ring: ring registered with command_processor_add_source.
+|       - command: command to post (enqueue_us and has_args are set
+|                  here).
+|
+|  Returns:  BaseType_t
+|           pdPASS if the command was posted, errQUEUE_FULL if the
+|           ring is full
+*-------------------------------------------------------------------*/
+BaseType_t command_processor_post(spsc_ring_t* ring, rx_command_t* command);
+
+/*------------------------------------------------------------------
+|  Function: command_processor_submit_text
+| ------------------------------------------------------------------
+|  Description: decodes a text command (HTTP, HTTPS and MQTT) with
+|               its arguments and queues it. CMD_SCRIPT_STORE and
+|               CMD_SCRIPT_RUN take a script slot, and the script is
+|               stored in NVS here ("CMD_SCRIPT_STORE <slot> <hex>").
+|
+|  Parameters:
+|       - command: command to fill in and queue (rx_id set by the
+|                  caller).
+|       - text: NUL terminated text received.
+|       - ticks_to_wait: max time to wait if the lane is full.
+|
+|  Returns:  BaseType_t
+|           pdPASS if the command was queued
+*-------------------------------------------------------------------*/
+BaseType_t command_processor_submit_text(rx_command_t* command, const char* text, TickType_t ticks_to_wait);
+
+/*------------------------------------------------------------------
+|  Function: get_command_processor_stats
+| ------------------------------------------------------------------
+|  Description: copies the command processor queue counters.
+|
+|  Parameters:
+|       - stats: where the counters are copied.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void get_command_processor_stats(command_processor_stats_t* stats);
+
+/*------------------------------------------------------------------
+|  Function: get_command_trace_stats
+| ------------------------------------------------------------------
+|  Description: copies the latency histograms of the commands sent
+|               by a module (see CMD_TRACE_DUMP).
+|
+|  Parameters:
+|       - module: module that sent the commands.
+|       - stats: where the histograms are copied.
+|
+|  Returns:  int8_t
+|           0 if OK, -1 if the module is not traced
+*-------------------------------------------------------------------*/
+int8_t get_command_trace_stats(rx_module_t module, command_trace_stats_t* stats);
+
+/*------------------------------------------------------------------
+|  Function: translate_command_lane
+| ------------------------------------------------------------------
+|  Description: name of a command processor lane, for the logs.
+|
+|  Parameters:
+|       - lane: lane.
+|
+|  Returns:  char*
+*-------------------------------------------------------------------*/
+char* translate_command_lane(command_lane_t lane);
+
+/*------------------------------------------------------------------
+|  Function: get_slave_command_count
+| ------------------------------------------------------------------
+|  Description: number of commands sent to the slave so far. The
+|               slave state can only change after one of them (or
+|               when process A ends).
+|
+|  Parameters:
+|       -
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t get_slave_command_count(void);
+
+/*------------------------------------------------------------------
+|  Function: get_wireless_state
+| ------------------------------------------------------------------
+|  Description: wireless connection that is currently active.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  wireless_state_t
+*-------------------------------------------------------------------*/
+wireless_state_t get_wireless_state(void);
+
+/*------------------------------------------------------------------
+|  Function: translate_wireless_state
+| ------------------------------------------------------------------
+|  Description: translates a wireless state to a string.
+|
+|  Parameters:
+|       - state: wireless state to translate
+|
+|  Returns:  char*
+*-------------------------------------------------------------------*/
+char* translate_wireless_state(wireless_state_t state);
+
 /*------------------------------------------------------------------
 |  Function: str_to_cmd
 | ------------------------------------------------------------------
 |  Description: translates a string representing the command to the
-|               corresponding enum value.
+|               corresponding enum value (first whole "CMD_" word,
+|               see command_decode).
 |
 |  Parameters:
 |       - str_command: string with the command to translate
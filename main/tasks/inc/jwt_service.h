@@ -0,0 +1,97 @@
+/* ===== [jwt_service.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __JWT_SERVICE_H__
+#define __JWT_SERVICE_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "jwt_token.h"
+
+/* ===== Macros of public constants ===== */
+#define JWT_SERVICE_REFRESH_MARGIN_S	600		// next token is minted 10 minutes before expiry
+#define JWT_SERVICE_RETRY_TIME_MS		10000
+#define JWT_SERVICE_TASK_PRIORITY		1
+#define JWT_SERVICE_TASK_STACK			(2048 * 3.5)
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: jwt_service_start
+| ------------------------------------------------------------------
+|  Description: creates the low priority task that mints the JWT
+|				tokens. The first token is minted right away and
+|				every next one JWT_SERVICE_REFRESH_MARGIN_S before
+|				the previous one expires. The system time must be
+|				already set.
+|
+|  Parameters:
+|		- project_id: Google Cloud project (JWT audience).
+|		- private_key: PEM of the device private key.
+|		- private_key_size: size of private_key in bytes.
+|
+|  Returns:  int8_t
+|			0: OK, -1: the queue or the task could not be created
+*-------------------------------------------------------------------*/
+int8_t jwt_service_start(const char* project_id, const uint8_t* private_key, size_t private_key_size);
+
+/*------------------------------------------------------------------
+|  Function: jwt_service_take
+| ------------------------------------------------------------------
+|  Description: takes the last minted token. The token string is
+|				the service buffer: the caller must copy it (the
+|				MQTT client does) and then call jwt_service_release
+|				so the next token can be minted.
+|
+|  Parameters:
+|		- token: where the token is copied.
+|		- ticks_to_wait: maximum time to wait for a new token.
+|
+|  Returns:  BaseType_t
+|			pdPASS if a new token was taken
+*-------------------------------------------------------------------*/
+BaseType_t jwt_service_take(jwt_token_t* token, TickType_t ticks_to_wait);
+
+/*------------------------------------------------------------------
+|  Function: jwt_service_release
+| ------------------------------------------------------------------
+|  Description: gives the token buffer back to the service.
+|
+|  Parameters:
+|		- token: token returned by jwt_service_take (its string
+|				 is cleared, exp_time is kept).
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void jwt_service_release(jwt_token_t* token);
+
+/*------------------------------------------------------------------
+|  Function: jwt_service_benchmark
+| ------------------------------------------------------------------
+|  Description: starts a one shot task that logs the signing time
+|				and the token size with the device key and with a
+|				random P-256 key (RS256 vs ES256), with hardware and
+|				software SHA. It also checks that both SHA paths give
+|				the same token.
+|
+|  Parameters:
+|		- none
+|
+|  Returns:  int8_t
+|			0: OK, -1: the task could not be created
+*-------------------------------------------------------------------*/
+int8_t jwt_service_benchmark(void);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __JWT_SERVICE_H__
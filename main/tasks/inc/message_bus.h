@@ -0,0 +1,140 @@
+/* ===== [message_bus.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __MESSAGE_BUS_H__
+#define __MESSAGE_BUS_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "command_processor.h"
+
+/* ===== Macros of public constants ===== */
+#define MESSAGE_BUS_QUEUE_LEN   5       // default queue length of a TX module
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: tx_message_kind_t
+| ------------------------------------------------------------------
+|  Description: what a message sent to a TX module carries.
+|
+|  Values:
+|       TX_MSG_COMMAND      - a command (payload.command)
+|       TX_MSG_SLAVE_STATE  - the slave FSM state (payload.slave_state,
+|                             SLAVE_STATE_ERROR if it could not be
+|                             read)
+*-------------------------------------------------------------------*/
+typedef enum {
+    TX_MSG_COMMAND,
+    TX_MSG_SLAVE_STATE,
+}   tx_message_kind_t;
+
+/*------------------------------------------------------------------
+|  Struct: tx_message_t
+| ------------------------------------------------------------------
+|  Description: message from the command processor to a TX module,
+|               always sent with a single queue operation.
+|
+|  Members:
+|       kind            - what the payload holds
+|       source          - module that produced the message
+|       correlation_id  - seq of the request it answers (0 if none)
+|       timestamp_us    - time it was sent (set by message_bus_send)
+|       payload         - command or slave state
+*-------------------------------------------------------------------*/
+typedef struct {
+    tx_message_kind_t   kind;
+    rx_module_t         source;
+    uint16_t            correlation_id;
+    int64_t             timestamp_us;
+    union {
+        command_type_t  command;
+        uint8_t         slave_state;
+    }   payload;
+}   tx_message_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: message_bus_register
+| ------------------------------------------------------------------
+|  Description: creates the TX queue of a module (only the first
+|               time, later calls keep the same queue).
+|
+|  Parameters:
+|       - module: module that receives the messages.
+|       - queue_len: max messages waiting.
+|
+|  Returns:  int8_t
+|           0 if the queue is ready, -1 otherwise
+*-------------------------------------------------------------------*/
+int8_t message_bus_register(rx_module_t module, uint8_t queue_len);
+
+/*------------------------------------------------------------------
+|  Function: message_bus_send
+| ------------------------------------------------------------------
+|  Description: sends a message to a module (timestamp_us is set
+|               here).
+|
+|  Parameters:
+|       - destination: module that receives the message.
+|       - message: message to send.
+|       - ticks_to_wait: max time to wait if the queue is full.
+|
+|  Returns:  BaseType_t
+|           pdPASS if queued, pdFAIL if the queue is full or the
+|           module is not registered
+*-------------------------------------------------------------------*/
+BaseType_t message_bus_send(rx_module_t destination, tx_message_t* message, TickType_t ticks_to_wait);
+
+/*------------------------------------------------------------------
+|  Function: message_bus_receive
+| ------------------------------------------------------------------
+|  Description: takes the next message of a module.
+|
+|  Parameters:
+|       - module: module whose queue is read.
+|       - message: where the message is copied.
+|       - ticks_to_wait: max time to wait for a message.
+|
+|  Returns:  BaseType_t
+|           pdPASS if a message was received
+*-------------------------------------------------------------------*/
+BaseType_t message_bus_receive(rx_module_t module, tx_message_t* message, TickType_t ticks_to_wait);
+
+/*------------------------------------------------------------------
+|  Function: message_bus_value
+| ------------------------------------------------------------------
+|  Description: the number a message carries, for the modules that
+|               only forward a value (HTTP field, BLE read, UART).
+|
+|  Parameters:
+|       - message: message.
+|
+|  Returns:  uint8_t
+|           command or slave state
+*-------------------------------------------------------------------*/
+uint8_t message_bus_value(const tx_message_t* message);
+
+/*------------------------------------------------------------------
+|  Function: message_bus_dropped
+| ------------------------------------------------------------------
+|  Description: messages that could not be delivered (full queue or
+|               module not registered).
+|
+|  Parameters:
+|       -
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t message_bus_dropped(void);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __MESSAGE_BUS_H__
@@ -11,32 +11,56 @@
 #define __MQTT_H__
 
 /* ===== Dependencies ===== */
+#include <stdint.h>
 
 
 /* ===== Macros of public constants ===== */
+#define MQTT_RX_RING_LEN		4		// messages per broker waiting for the RX task (power of 2)
+#define MQTT_RX_TOPIC_MAX_SIZE	64
+#define MQTT_RX_DATA_MAX_SIZE	128
 
 
 /* ===== Public structs and enums ===== */
 /*------------------------------------------------------------------
 |  Struct: mqtt_sub_data_received_t
 | ------------------------------------------------------------------
-|  Description:
+|  Description: item of the MQTT RX ring of a broker. The event
+|				handler copies each received message straight into
+|				the ring, so the esp-mqtt buffers are never used
+|				after the callback.
 |
 |  Members:
-|		data_len 	-
-|		data 		-
-|		topic_len 	-
-|		topic 		-
+|		data_len 	- number of bytes in data
+|		data 		- NUL terminated copy of the message data
+|		topic_len 	- number of bytes in topic
+|		topic 		- NUL terminated copy of the topic
+|		received_us - esp_timer time when the event handler got it
 *-------------------------------------------------------------------*/
 typedef struct {
 	int 	data_len;
-	char* 	data;
+	char 	data[MQTT_RX_DATA_MAX_SIZE + 1];
 	int 	topic_len;
-	char* 	topic;
+	char 	topic[MQTT_RX_TOPIC_MAX_SIZE + 1];
+	int64_t received_us;
 }	mqtt_sub_data_received_t;
 
 
 /* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: initialize_mqtt_brokers
+| ------------------------------------------------------------------
+|  Description: creates the MQTT queues and adds every broker of the
+|				broker table (the clients are started by the tasks).
+|				Must be called before creating the MQTT tasks.
+|
+|  Parameters:
+|		- void
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void initialize_mqtt_brokers(void);
+
+
 /*------------------------------------------------------------------
 |  Function: mqtt_publish_task
 | ------------------------------------------------------------------
@@ -0,0 +1,251 @@
+/* ===== [mqtt_broker.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __MQTT_BROKER_H__
+#define __MQTT_BROKER_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "mqtt_client.h"
+
+#include "mqtt_scheduler.h"
+#include "mqtt_outbox.h"
+
+/* ===== Macros of public constants ===== */
+#define MQTT_BROKER_MAX_BROKERS		4
+#define MQTT_BROKER_MAX_SUBSCRIPTIONS	4
+#define MQTT_BROKER_ALL				0xFF	// broker mask with every broker
+#define MQTT_BROKER_OUTBOX_BATCH	5		// max outbox records replayed per wake up
+#define MQTT_BROKER_TASK_STACK		(1024 * 3)
+#define MQTT_BROKER_TASK_PRIORITY	6
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: mqtt_topic_id_t
+| ------------------------------------------------------------------
+|  Description: logical topics. Each broker maps them to its own
+|				topic names (or does not publish them at all).
+|
+|  Values:
+|		MQTT_TOPIC_COMMAND 		- command received by the device
+|		MQTT_TOPIC_STATUS 		- slave state requested by the user
+|		MQTT_TOPIC_TELEMETRY 	- periodic telemetry samples
+|		MQTT_TOPIC_STATE 		- device state
+*-------------------------------------------------------------------*/
+typedef enum {
+	MQTT_TOPIC_COMMAND,
+	MQTT_TOPIC_STATUS,
+	MQTT_TOPIC_TELEMETRY,
+	MQTT_TOPIC_STATE,
+	MQTT_TOPIC_COUNT,
+}	mqtt_topic_id_t;
+
+/*------------------------------------------------------------------
+|  Type: mqtt_broker_connection_cb_t / mqtt_broker_data_cb_t
+| ------------------------------------------------------------------
+|  Description: callbacks run from the MQTT client task of the
+|				broker, so they must never block.
+*-------------------------------------------------------------------*/
+typedef void (*mqtt_broker_connection_cb_t)(uint8_t broker, uint8_t connected);
+typedef void (*mqtt_broker_data_cb_t)(uint8_t broker, esp_mqtt_event_handle_t event);
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_broker_config_t
+| ------------------------------------------------------------------
+|  Description: entry of the broker table.
+|
+|  Members:
+|		name 			- used in the logs
+|		client 			- esp-mqtt configuration (the event handler
+|						  is set by the broker manager)
+|		topics 			- topic name of each logical topic (NULL if
+|						  the broker does not publish it)
+|		subscribe_topics - filters subscribed on connection (unused
+|						  entries are NULL)
+|		qos 			- QoS of the publishes and subscriptions
+|		rate_burst 		- publish token bucket size
+|		rate_period_ms 	- time to earn a publish token
+|		queue_len 		- normal priority messages waiting for a token
+|		outbox_label 	- outbox partition (or NULL)
+|		outbox_topic 	- logical topic stored in the outbox
+|		connected_bit 	- wifi_event_group bit set while connected
+|		on_connection 	- connection callback (or NULL)
+|		on_data 		- received data callback (or NULL)
+*-------------------------------------------------------------------*/
+typedef struct {
+	const char* 				name;
+	esp_mqtt_client_config_t 	client;
+	const char* 				topics[MQTT_TOPIC_COUNT];
+	const char* 				subscribe_topics[MQTT_BROKER_MAX_SUBSCRIPTIONS];
+	uint8_t 					qos;
+	uint32_t 					rate_burst;
+	uint32_t 					rate_period_ms;
+	uint32_t 					queue_len;
+	const char* 				outbox_label;
+	mqtt_topic_id_t 			outbox_topic;
+	EventBits_t 				connected_bit;
+	mqtt_broker_connection_cb_t on_connection;
+	mqtt_broker_data_cb_t 		on_data;
+}	mqtt_broker_config_t;
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_broker_t
+| ------------------------------------------------------------------
+|  Description: runtime state of a broker. Every broker has its own
+|				publish task, so a broker that stops responding only
+|				fills its own queue.
+|
+|  Members:
+|		config 			- entry of the broker table
+|		client 			- esp-mqtt client
+|		scheduler 		- rate limited publish queue
+|		outbox 			- persistent records (if outbox_ready)
+|		outbox_ready 	- the outbox partition is available
+|		outbox_waiting 	- the last replay stopped with records
+|						  left (rate limit or batch size)
+|		connected 		- the client is connected
+|		connections 	- times the client connected (a message
+|						  not acknowledged before may be lost)
+|		publish_errors 	- queued messages and outbox records the
+|						  client did not take
+|		task 			- publish task of the broker
+|		fanout_dropped 	- fan-out messages this broker rejected
+*-------------------------------------------------------------------*/
+typedef struct {
+	const mqtt_broker_config_t* config;
+	esp_mqtt_client_handle_t 	client;
+	mqtt_scheduler_t 			scheduler;
+	mqtt_outbox_t 				outbox;
+	uint8_t 					outbox_ready;
+	uint8_t 					outbox_waiting;
+	volatile uint8_t 			connected;
+	volatile uint32_t 			connections;
+	volatile uint32_t 			publish_errors;
+	TaskHandle_t 				task;
+	uint32_t 					fanout_dropped;
+}	mqtt_broker_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: mqtt_broker_add
+| ------------------------------------------------------------------
+|  Description: adds an entry to the broker table, creating its
+|				publish queue and opening its outbox. The client is
+|				not started yet.
+|
+|  Parameters:
+|		- config: broker configuration (must outlive the broker).
+|
+|  Returns:  int8_t
+|			index of the broker, -1 on error
+*-------------------------------------------------------------------*/
+int8_t mqtt_broker_add(const mqtt_broker_config_t* config);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_broker_start
+| ------------------------------------------------------------------
+|  Description: creates the client and the publish task of a broker
+|				and connects it.
+|
+|  Parameters:
+|		- broker: index returned by mqtt_broker_add.
+|		- password: overrides the configured password (or NULL).
+|				The client keeps its own copy.
+|
+|  Returns:  esp_err_t
+*-------------------------------------------------------------------*/
+esp_err_t mqtt_broker_start(uint8_t broker, const char* password);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_broker_reconnect
+| ------------------------------------------------------------------
+|  Description: reconnects a broker with a new password (e.g. a new
+|				JWT). In flight outbox records are sent again.
+|
+|  Parameters:
+|		- broker: index returned by mqtt_broker_add.
+|		- password: new password (the client keeps its own copy).
+|
+|  Returns:  esp_err_t
+*-------------------------------------------------------------------*/
+esp_err_t mqtt_broker_reconnect(uint8_t broker, const char* password);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_broker_start_all / mqtt_broker_stop_all
+| ------------------------------------------------------------------
+|  Description: starts or stops every client already created.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void mqtt_broker_start_all(void);
+void mqtt_broker_stop_all(void);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_broker_publish
+| ------------------------------------------------------------------
+|  Description: fans a message out to the chosen brokers. It never
+|				blocks: the message is queued (or stored in the
+|				outbox) for each broker that maps the topic, and
+|				the publish tasks send it.
+|
+|  Parameters:
+|		- broker_mask: bit n selects broker n (MQTT_BROKER_ALL).
+|		- topic: logical topic.
+|		- priority: scheduler priority.
+|		- payload: data to publish (it is copied).
+|		- len: length of payload.
+|
+|  Returns:  uint8_t
+|			number of brokers that accepted the message
+*-------------------------------------------------------------------*/
+uint8_t mqtt_broker_publish(uint8_t broker_mask, mqtt_topic_id_t topic, mqtt_publish_priority_t priority,
+							const void* payload, uint16_t len);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_broker_publish_encoded
+| ------------------------------------------------------------------
+|  Description: same as mqtt_broker_publish, but the payload is
+|				produced by encoder: straight into the record for
+|				the outbox brokers, and only once for the others.
+|
+|  Parameters:
+|		- broker_mask: bit n selects broker n (MQTT_BROKER_ALL).
+|		- topic: logical topic.
+|		- priority: scheduler priority.
+|		- encoder: callback that writes the payload.
+|		- context: passed to encoder.
+|
+|  Returns:  uint8_t
+|			number of brokers that accepted the message
+*-------------------------------------------------------------------*/
+uint8_t mqtt_broker_publish_encoded(uint8_t broker_mask, mqtt_topic_id_t topic, mqtt_publish_priority_t priority,
+									mqtt_outbox_encoder_t encoder, void* context);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_broker_get
+| ------------------------------------------------------------------
+|  Description: runtime state of a broker (read only use).
+|
+|  Parameters:
+|		- broker: index returned by mqtt_broker_add.
+|
+|  Returns:  mqtt_broker_t*
+|			NULL if the index is not valid
+*-------------------------------------------------------------------*/
+mqtt_broker_t* mqtt_broker_get(uint8_t broker);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __MQTT_BROKER_H__
@@ -0,0 +1,255 @@
+/* ===== [mqtt_outbox.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __MQTT_OUTBOX_H__
+#define __MQTT_OUTBOX_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+/* ===== Macros of public constants ===== */
+#define MQTT_OUTBOX_PARTITION_LABEL		"outbox"
+#define MQTT_OUTBOX_PARTITION_SUBTYPE	0x40
+#define MQTT_OUTBOX_SECTOR_SIZE			4096
+#define MQTT_OUTBOX_RECORD_SIZE			256		// must divide MQTT_OUTBOX_SECTOR_SIZE
+#define MQTT_OUTBOX_HEADER_SIZE			16
+#define MQTT_OUTBOX_PAYLOAD_MAX_SIZE	(MQTT_OUTBOX_RECORD_SIZE - MQTT_OUTBOX_HEADER_SIZE)
+#define MQTT_OUTBOX_MAX_INFLIGHT		8
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Type: mqtt_outbox_encoder_t
+| ------------------------------------------------------------------
+|  Description: callback that encodes a payload straight into the
+|				record buffer. Returns the number of bytes written,
+|				or -1 if the payload does not fit in size.
+*-------------------------------------------------------------------*/
+typedef int32_t (*mqtt_outbox_encoder_t)(uint8_t* buffer, uint16_t size, void* context);
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_outbox_record_t
+| ------------------------------------------------------------------
+|  Description: layout of a record slot in flash. Slots never cross
+|				a sector boundary, and a record is acknowledged by
+|				clearing the acked word in place (1 -> 0 bit writes
+|				do not need an erase).
+|
+|  Members:
+|		magic 		- MQTT_OUTBOX_RECORD_MAGIC for a written slot
+|		seq 		- sequence number of the record
+|		len 		- number of valid payload bytes
+|		reserved 	- left erased (0xFFFF)
+|		acked 		- 0xFFFFFFFF while pending, 0 once published
+|		payload 	- data to publish
+*-------------------------------------------------------------------*/
+typedef struct {
+	uint32_t	magic;
+	uint32_t	seq;
+	uint16_t	len;
+	uint16_t	reserved;
+	uint32_t	acked;
+	uint8_t		payload[MQTT_OUTBOX_PAYLOAD_MAX_SIZE];
+}	mqtt_outbox_record_t;
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_outbox_inflight_t
+| ------------------------------------------------------------------
+|  Description: record handed to the MQTT client and waiting for
+|				the broker acknowledge.
+|
+|  Members:
+|		slot 	- slot of the record in the partition
+|		seq 	- sequence number of the record
+|		msg_id 	- MQTT message id (-1 while not published yet)
+*-------------------------------------------------------------------*/
+typedef struct {
+	uint32_t	slot;
+	uint32_t	seq;
+	int32_t		msg_id;
+}	mqtt_outbox_inflight_t;
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_outbox_t
+| ------------------------------------------------------------------
+|  Description: persistent ring buffer of records waiting to be
+|				published.
+|
+|  Members:
+|		partition 		- flash partition holding the records
+|		slot_count 		- number of record slots in the partition
+|		head 			- next slot to write
+|		tail 			- oldest slot that may still be pending
+|		next_seq 		- sequence number of the next record
+|		stored 			- records appended since boot
+|		acked 			- records acknowledged since boot
+|		dropped 		- pending records overwritten since boot
+|		inflight 		- records waiting for the broker ack
+|		inflight_count 	- number of used entries in inflight
+|		early_acks 		- acks received before the msg_id was set
+|		early_ack_index - next entry to overwrite in early_acks
+|		lock 			- mutex (the ack comes from the MQTT task)
+*-------------------------------------------------------------------*/
+typedef struct {
+	const esp_partition_t* 	partition;
+	uint32_t 				slot_count;
+	uint32_t 				head;
+	uint32_t 				tail;
+	uint32_t 				next_seq;
+	uint32_t 				stored;
+	uint32_t 				acked;
+	uint32_t 				dropped;
+	mqtt_outbox_inflight_t 	inflight[MQTT_OUTBOX_MAX_INFLIGHT];
+	uint32_t 				inflight_count;
+	int32_t 				early_acks[MQTT_OUTBOX_MAX_INFLIGHT];
+	uint32_t 				early_ack_index;
+	SemaphoreHandle_t 		lock;
+}	mqtt_outbox_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_init
+| ------------------------------------------------------------------
+|  Description: finds the outbox partition and scans it to recover
+|				the records still pending from a previous boot.
+|
+|  Parameters:
+|		- outbox: outbox to initialize.
+|		- label: label of the partition in the partition table.
+|
+|  Returns:  esp_err_t
+*-------------------------------------------------------------------*/
+esp_err_t mqtt_outbox_init(mqtt_outbox_t* outbox, const char* label);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_append
+| ------------------------------------------------------------------
+|  Description: stores a new record. When the head enters a new
+|				sector the sector is erased, dropping the oldest
+|				records if the ring is full.
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|		- payload: data to store.
+|		- len: length of payload.
+|
+|  Returns:  esp_err_t
+*-------------------------------------------------------------------*/
+esp_err_t mqtt_outbox_append(mqtt_outbox_t* outbox, const void* payload, uint16_t len);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_append_encoded
+| ------------------------------------------------------------------
+|  Description: same as mqtt_outbox_append, but the payload is
+|				encoded directly into the record (no intermediate
+|				copy).
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|		- encoder: callback that writes the payload.
+|		- context: passed to encoder.
+|
+|  Returns:  esp_err_t
+|			ESP_ERR_INVALID_SIZE if the payload does not fit
+*-------------------------------------------------------------------*/
+esp_err_t mqtt_outbox_append_encoded(mqtt_outbox_t* outbox, mqtt_outbox_encoder_t encoder, void* context);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_next
+| ------------------------------------------------------------------
+|  Description: returns the oldest pending record that is not in
+|				flight yet and marks it as in flight.
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|		- record: where the record is copied.
+|		- slot: where the slot of the record is stored.
+|
+|  Returns:  esp_err_t
+|			ESP_ERR_NOT_FOUND if there is nothing else to send
+*-------------------------------------------------------------------*/
+esp_err_t mqtt_outbox_next(mqtt_outbox_t* outbox, mqtt_outbox_record_t* record, uint32_t* slot);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_set_msg_id
+| ------------------------------------------------------------------
+|  Description: associates an in flight record with the MQTT msg_id
+|				returned by the publish. A msg_id of -1 (publish
+|				error) releases the record so it is sent again.
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|		- slot: slot returned by mqtt_outbox_next.
+|		- msg_id: MQTT message id.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void mqtt_outbox_set_msg_id(mqtt_outbox_t* outbox, uint32_t slot, int32_t msg_id);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_ack
+| ------------------------------------------------------------------
+|  Description: marks the record published with msg_id as
+|				acknowledged and trims the ring.
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|		- msg_id: MQTT message id from MQTT_EVENT_PUBLISHED.
+|
+|  Returns:  esp_err_t
+|			ESP_ERR_NOT_FOUND if msg_id is not an outbox record
+*-------------------------------------------------------------------*/
+esp_err_t mqtt_outbox_ack(mqtt_outbox_t* outbox, int32_t msg_id);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_release_all
+| ------------------------------------------------------------------
+|  Description: forgets every in flight record (after a disconnect)
+|				so they are replayed on the next connection.
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void mqtt_outbox_release_all(mqtt_outbox_t* outbox);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_pending
+| ------------------------------------------------------------------
+|  Description: number of slots between the tail and the head (it
+|				may include records acknowledged out of order).
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t mqtt_outbox_pending(mqtt_outbox_t* outbox);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_outbox_inflight
+| ------------------------------------------------------------------
+|  Description: number of records still waiting for the broker ack.
+|
+|  Parameters:
+|		- outbox: outbox to use.
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t mqtt_outbox_inflight(mqtt_outbox_t* outbox);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __MQTT_OUTBOX_H__
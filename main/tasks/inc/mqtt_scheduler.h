@@ -0,0 +1,204 @@
+/* ===== [mqtt_scheduler.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __MQTT_SCHEDULER_H__
+#define __MQTT_SCHEDULER_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+/* ===== Macros of public constants ===== */
+#define MQTT_SCHEDULER_PAYLOAD_MAX_SIZE		200		// fits a JSON telemetry sample
+#define MQTT_SCHEDULER_HIGH_QUEUE_LEN		4		// status and state messages only
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: mqtt_publish_priority_t
+| ------------------------------------------------------------------
+|  Description: priority of a queued publish. High priority messages
+|				are sent before any normal priority message. Each
+|				priority keeps the arrival order (FIFO).
+|
+|  Values:
+|		MQTT_PRIORITY_HIGH 		- sent first (own queue)
+|		MQTT_PRIORITY_NORMAL 	- sent when no high one waits
+*-------------------------------------------------------------------*/
+typedef enum {
+	MQTT_PRIORITY_HIGH,
+	MQTT_PRIORITY_NORMAL,
+}	mqtt_publish_priority_t;
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_publish_msg_t
+| ------------------------------------------------------------------
+|  Description: message waiting for a token to be published.
+|
+|  Members:
+|		topic 			- topic to publish to (must outlive the msg)
+|		payload 		- copy of the data to publish
+|		payload_len 	- number of valid bytes in payload
+|		priority 		- priority used when it was queued
+|		enqueue_tick 	- tick count when it was queued
+*-------------------------------------------------------------------*/
+typedef struct {
+	const char* 			topic;
+	char 					payload[MQTT_SCHEDULER_PAYLOAD_MAX_SIZE];
+	uint16_t 				payload_len;
+	mqtt_publish_priority_t priority;
+	TickType_t 				enqueue_tick;
+}	mqtt_publish_msg_t;
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_scheduler_stats_t
+| ------------------------------------------------------------------
+|  Description: statistics of a publish scheduler.
+|
+|  Members:
+|		sent 				- messages handed to the broker
+|		dropped 			- messages dropped because the queue
+|							  was full (or too long)
+|		total_delay_ms 		- sum of the queueing delays
+|		max_delay_ms 		- worst queueing delay
+*-------------------------------------------------------------------*/
+typedef struct {
+	uint32_t	sent;
+	uint32_t	dropped;
+	uint64_t	total_delay_ms;
+	uint32_t	max_delay_ms;
+}	mqtt_scheduler_stats_t;
+
+/*------------------------------------------------------------------
+|  Struct: mqtt_scheduler_t
+| ------------------------------------------------------------------
+|  Description: token bucket publish scheduler (one per broker).
+|				A token is added every period_ms up to burst tokens,
+|				and each publish consumes one token.
+|
+|  Members:
+|		queue 		- pending normal priority messages
+|		high_queue 	- pending high priority messages
+|		burst 		- maximum number of stored tokens
+|		period_ms 	- time to generate a new token
+|		tokens 		- currently available tokens
+|		last_refill - tick of the last generated token
+|		stats 		- scheduler statistics
+*-------------------------------------------------------------------*/
+typedef struct {
+	QueueHandle_t 			queue;
+	QueueHandle_t 			high_queue;
+	uint32_t 				burst;
+	uint32_t 				period_ms;
+	uint32_t 				tokens;
+	TickType_t 				last_refill;
+	mqtt_scheduler_stats_t 	stats;
+}	mqtt_scheduler_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: mqtt_scheduler_init
+| ------------------------------------------------------------------
+|  Description: creates the pending queues and fills the bucket.
+|
+|  Parameters:
+|		- scheduler: scheduler to initialize.
+|		- burst: maximum number of back to back publishes.
+|		- period_ms: time between tokens (broker rate limit).
+|		- queue_len: maximum number of pending normal priority
+|				messages (MQTT_SCHEDULER_HIGH_QUEUE_LEN for high).
+|
+|  Returns:  int8_t
+|			0: OK, -1: the queues could not be created
+*-------------------------------------------------------------------*/
+int8_t mqtt_scheduler_init(mqtt_scheduler_t* scheduler, uint32_t burst, uint32_t period_ms, uint32_t queue_len);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_scheduler_enqueue
+| ------------------------------------------------------------------
+|  Description: queues a message without blocking. If the queue is
+|				full the message is dropped and counted.
+|
+|  Parameters:
+|		- scheduler: scheduler to use.
+|		- priority: message priority.
+|		- topic: topic to publish to.
+|		- payload: data to publish (it is copied).
+|		- payload_len: length of payload.
+|
+|  Returns:  BaseType_t
+|			pdPASS if the message was queued
+*-------------------------------------------------------------------*/
+BaseType_t mqtt_scheduler_enqueue(mqtt_scheduler_t* scheduler, mqtt_publish_priority_t priority,
+									const char* topic, const char* payload, uint16_t payload_len);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_scheduler_dequeue
+| ------------------------------------------------------------------
+|  Description: returns the next message to publish only if there is
+|				a token available, consuming it. It never blocks.
+|
+|  Parameters:
+|		- scheduler: scheduler to use.
+|		- msg: where the message is copied.
+|
+|  Returns:  BaseType_t
+|			pdPASS if msg can be published now
+*-------------------------------------------------------------------*/
+BaseType_t mqtt_scheduler_dequeue(mqtt_scheduler_t* scheduler, mqtt_publish_msg_t* msg);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_scheduler_take_token
+| ------------------------------------------------------------------
+|  Description: consumes a token for a message that is not in the
+|				queue (e.g. an outbox record), so it shares the same
+|				broker rate limit. It never blocks.
+|
+|  Parameters:
+|		- scheduler: scheduler to use.
+|
+|  Returns:  BaseType_t
+|			pdPASS if the message can be published now
+*-------------------------------------------------------------------*/
+BaseType_t mqtt_scheduler_take_token(mqtt_scheduler_t* scheduler);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_scheduler_wait_ticks
+| ------------------------------------------------------------------
+|  Description: time that the caller can block waiting for new data
+|				before the next queued message is ready to be sent.
+|
+|  Parameters:
+|		- scheduler: scheduler to use.
+|		- external_waiting: a message outside the queue is waiting
+|				for a token (see mqtt_scheduler_take_token).
+|
+|  Returns:  TickType_t
+|			portMAX_DELAY if there is nothing waiting
+*-------------------------------------------------------------------*/
+TickType_t mqtt_scheduler_wait_ticks(mqtt_scheduler_t* scheduler, uint8_t external_waiting);
+
+/*------------------------------------------------------------------
+|  Function: mqtt_scheduler_log_stats
+| ------------------------------------------------------------------
+|  Description: logs the scheduler statistics.
+|
+|  Parameters:
+|		- scheduler: scheduler to use.
+|		- tag: log tag of the caller.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void mqtt_scheduler_log_stats(mqtt_scheduler_t* scheduler, const char* tag);
+
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __MQTT_SCHEDULER_H__
@@ -0,0 +1,199 @@
+/* ===== [slave_pipeline.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SLAVE_PIPELINE_H__
+#define __SLAVE_PIPELINE_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "command_processor.h"
+#include "command_trace.h"
+
+/* ===== Macros of public constants ===== */
+#define SLAVE_PIPELINE_DEPTH        4       // slave operations in flight at the same time
+#define SLAVE_PIPELINE_TIMEOUT_MS   3000    // from the moment the operation is issued
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Struct: slave_request_t
+| ------------------------------------------------------------------
+|  Description: operation sent to the I2C master task. The I2C
+|               master answers every request with one completion
+|               (an rx_command_t from I2C_MASTER_MOD with the same
+|               seq).
+|
+|  Members:
+|       seq     - sequence id of the operation
+|       command - command to send to the slave
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint16_t    seq;
+    uint8_t     command;
+}   slave_request_t;
+
+/*------------------------------------------------------------------
+|  Struct: slave_pending_t
+| ------------------------------------------------------------------
+|  Description: slave operation waiting for its completion.
+|
+|  Members:
+|       seq         - sequence id of the operation
+|       command     - command sent to the slave
+|       requester   - module that asked for it
+|       request_id  - id of the request (correlation id of the reply)
+|       deadline    - tick count when it times out
+|       trace       - latency trace of the command that issued it
+|                     (not in use if it is not traced)
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint16_t        seq;
+    command_type_t  command;
+    rx_module_t     requester;
+    uint16_t        request_id;
+    TickType_t      deadline;
+    command_trace_t trace;
+}   slave_pending_t;
+
+/*------------------------------------------------------------------
+|  Struct: slave_pipeline_stats_t
+| ------------------------------------------------------------------
+|  Description: slave pipeline counters.
+|
+|  Members:
+|       issued          - operations sent to the I2C master
+|       completed       - operations acknowledged by the slave
+|       failed          - operations the slave did not acknowledge
+|       timeouts        - operations without completion in time
+|       late            - completions that arrived after the timeout
+|       rejected        - operations not issued (table or queue full)
+|       max_in_flight   - max operations in flight at the same time
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint32_t    issued;
+    uint32_t    completed;
+    uint32_t    failed;
+    uint32_t    timeouts;
+    uint32_t    late;
+    uint32_t    rejected;
+    uint8_t     max_in_flight;
+}   slave_pipeline_stats_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: slave_pipeline_issue
+| ------------------------------------------------------------------
+|  Description: gives the operation a sequence id, stores it in the
+|               pending table and sends it to the I2C master without
+|               waiting for the slave.
+|
+|  Parameters:
+|       - command: command to send to the slave.
+|       - requester: module the completion is routed to.
+|       - request_id: id of the request, kept for the reply.
+|       - trace: latency trace of the command, kept until the
+|                completion (NULL if not traced).
+|
+|  Returns:  uint16_t
+|           sequence id of the operation, 0 if the table or the I2C
+|           queue is full
+*-------------------------------------------------------------------*/
+uint16_t slave_pipeline_issue(command_type_t command, rx_module_t requester, uint16_t request_id,
+                              const command_trace_t* trace);
+
+/*------------------------------------------------------------------
+|  Function: slave_pipeline_has_room
+| ------------------------------------------------------------------
+|  Description: whether slave_pipeline_issue finds a free entry, the
+|               command processor leaves the slave operations in
+|               their lane while it does not.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  uint8_t
+|           1 if fewer than SLAVE_PIPELINE_DEPTH are in flight
+*-------------------------------------------------------------------*/
+uint8_t slave_pipeline_has_room(void);
+
+/*------------------------------------------------------------------
+|  Function: slave_pipeline_complete
+| ------------------------------------------------------------------
+|  Description: matches a completion from the I2C master with its
+|               pending operation and removes it from the table.
+|
+|  Parameters:
+|       - completion: completion received (seq, CMD_SLAVE_OK or
+|                     CMD_SLAVE_FAIL, value).
+|       - operation: where the pending operation is copied.
+|
+|  Returns:  uint8_t
+|           1 if found, 0 if unknown or already timed out
+*-------------------------------------------------------------------*/
+uint8_t slave_pipeline_complete(const rx_command_t* completion, slave_pending_t* operation);
+
+/*------------------------------------------------------------------
+|  Function: slave_pipeline_expire
+| ------------------------------------------------------------------
+|  Description: removes one operation whose deadline passed.
+|
+|  Parameters:
+|       - operation: where the expired operation is copied.
+|
+|  Returns:  uint8_t
+|           1 if an operation expired (call again until 0)
+*-------------------------------------------------------------------*/
+uint8_t slave_pipeline_expire(slave_pending_t* operation);
+
+/*------------------------------------------------------------------
+|  Function: slave_pipeline_wait_ticks
+| ------------------------------------------------------------------
+|  Description: time until the next deadline, so the command
+|               processor can block on its queue until then.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  TickType_t
+|           portMAX_DELAY if nothing is in flight
+*-------------------------------------------------------------------*/
+TickType_t slave_pipeline_wait_ticks(void);
+
+/*------------------------------------------------------------------
+|  Function: tick_deadline_passed
+| ------------------------------------------------------------------
+|  Description: compares a deadline with the tick count, also when
+|               one of them already wrapped around (deadlines less
+|               than half the tick range away).
+|
+|  Parameters:
+|       - deadline: tick count the deadline falls on.
+|       - now: current tick count.
+|
+|  Returns:  uint8_t
+|           1 if now is at or after the deadline
+*-------------------------------------------------------------------*/
+uint8_t tick_deadline_passed(TickType_t deadline, TickType_t now);
+
+/*------------------------------------------------------------------
+|  Function: slave_pipeline_get_stats
+| ------------------------------------------------------------------
+|  Description: copies the pipeline counters.
+|
+|  Parameters:
+|       - stats: where the counters are copied.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void slave_pipeline_get_stats(slave_pipeline_stats_t* stats);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SLAVE_PIPELINE_H__
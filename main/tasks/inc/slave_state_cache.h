@@ -0,0 +1,196 @@
+/* ===== [slave_state_cache.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SLAVE_STATE_CACHE_H__
+#define __SLAVE_STATE_CACHE_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "command_processor.h"
+
+/* ===== Macros of public constants ===== */
+#define SLAVE_STATE_CACHE_WAITERS   8       // status requests answered by the same I2C read
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Enum: slave_cache_result_t
+| ------------------------------------------------------------------
+|  Description: how a status request has to be answered.
+|
+|  Values:
+|       SLAVE_CACHE_HIT         - the cached state is fresh, answer
+|                                 with it now
+|       SLAVE_CACHE_JOINED      - the request is answered by the read
+|                                 in flight or, if that one is older
+|                                 than the last slave command or
+|                                 full, by the read issued after it
+|       SLAVE_CACHE_READ_SHARED - the request is the first waiter,
+|                                 issue the read and report its seq
+|                                 with slave_state_cache_read_issued
+|       SLAVE_CACHE_READ_OWN    - both reads are full, issue a read
+|                                 answered only to this request
+*-------------------------------------------------------------------*/
+typedef enum {
+    SLAVE_CACHE_HIT,
+    SLAVE_CACHE_JOINED,
+    SLAVE_CACHE_READ_SHARED,
+    SLAVE_CACHE_READ_OWN,
+}   slave_cache_result_t;
+
+/*------------------------------------------------------------------
+|  Struct: slave_waiter_t
+| ------------------------------------------------------------------
+|  Description: status request waiting for a shared read.
+|
+|  Members:
+|       requester   - module the state is sent to
+|       request_id  - id of the request (correlation id of the reply)
+*-------------------------------------------------------------------*/
+typedef struct {
+    rx_module_t     requester;
+    uint16_t        request_id;
+}   slave_waiter_t;
+
+/*------------------------------------------------------------------
+|  Struct: slave_state_cache_stats_t
+| ------------------------------------------------------------------
+|  Description: slave state cache counters.
+|
+|  Members:
+|       requests        - status requests received
+|       hits            - answered from the cache
+|       coalesced       - answered by a read already in flight
+|       reads           - I2C status reads issued
+|       invalidations   - times a slave command cleared the cache
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint32_t    requests;
+    uint32_t    hits;
+    uint32_t    coalesced;
+    uint32_t    reads;
+    uint32_t    invalidations;
+}   slave_state_cache_stats_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: slave_state_cache_request
+| ------------------------------------------------------------------
+|  Description: looks up the cached slave state for a status request
+|               and, if it is not fresh, adds the request to the read
+|               in flight (or to a new one).
+|
+|  Parameters:
+|       - requester: module that asked for the state.
+|       - request_id: id of the request.
+|       - state: where the state is copied (SLAVE_CACHE_HIT only).
+|
+|  Returns:  slave_cache_result_t
+*-------------------------------------------------------------------*/
+slave_cache_result_t slave_state_cache_request(rx_module_t requester, uint16_t request_id, uint8_t* state);
+
+/*------------------------------------------------------------------
+|  Function: slave_state_cache_needs_read
+| ------------------------------------------------------------------
+|  Description: whether a status request received now would have to
+|               issue a read (SLAVE_CACHE_READ_SHARED or
+|               SLAVE_CACHE_READ_OWN).
+|
+|  Parameters:
+|       -
+|
+|  Returns:  uint8_t
+|           1 if it needs a pipeline entry
+*-------------------------------------------------------------------*/
+uint8_t slave_state_cache_needs_read(void);
+
+/*------------------------------------------------------------------
+|  Function: slave_state_cache_read_issued
+| ------------------------------------------------------------------
+|  Description: records a status read issued for a request (after
+|               SLAVE_CACHE_READ_SHARED, SLAVE_CACHE_READ_OWN or
+|               slave_state_cache_next_read), only the reads that
+|               were issued are counted.
+|
+|  Parameters:
+|       - seq: sequence id returned by slave_pipeline_issue (0 if
+|              it was rejected).
+|       - shared: 1 for the shared read, its seq is kept.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void slave_state_cache_read_issued(uint16_t seq, uint8_t shared);
+
+/*------------------------------------------------------------------
+|  Function: slave_state_cache_read_done
+| ------------------------------------------------------------------
+|  Description: ends a status read. If it is the shared read, the
+|               state is cached (unless a slave command was issued
+|               meanwhile) and its waiters are returned. The
+|               requests that waited for it become the next shared
+|               read (see slave_state_cache_next_read).
+|
+|  Parameters:
+|       - seq: sequence id of the read (0 if the shared read could
+|              not be issued).
+|       - state: slave state read, SLAVE_STATE_ERROR if it failed
+|                (not cached).
+|       - waiters: where the waiters are copied (room for
+|                  SLAVE_STATE_CACHE_WAITERS).
+|
+|  Returns:  uint8_t
+|           number of waiters, 0 if it is not the shared read
+*-------------------------------------------------------------------*/
+uint8_t slave_state_cache_read_done(uint16_t seq, uint8_t state, slave_waiter_t* waiters);
+
+/*------------------------------------------------------------------
+|  Function: slave_state_cache_next_read
+| ------------------------------------------------------------------
+|  Description: shared read opened by slave_state_cache_read_done
+|               that still has to be issued (then reported with
+|               slave_state_cache_read_issued).
+|
+|  Parameters:
+|       - first: where its first waiter is copied, the read is
+|                issued on its behalf.
+|
+|  Returns:  uint8_t
+|           1 if there is a read to issue
+*-------------------------------------------------------------------*/
+uint8_t slave_state_cache_next_read(slave_waiter_t* first);
+
+/*------------------------------------------------------------------
+|  Function: slave_state_cache_invalidate
+| ------------------------------------------------------------------
+|  Description: clears the cached state, called when a command that
+|               changes the slave state is issued.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void slave_state_cache_invalidate(void);
+
+/*------------------------------------------------------------------
+|  Function: slave_state_cache_get_stats
+| ------------------------------------------------------------------
+|  Description: copies the cache counters.
+|
+|  Parameters:
+|       - stats: where the counters are copied.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void slave_state_cache_get_stats(slave_state_cache_stats_t* stats);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SLAVE_STATE_CACHE_H__
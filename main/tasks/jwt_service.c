@@ -0,0 +1,270 @@
+/* ===== [jwt_service.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "jwt_service.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+/* ===== Macros of private constants ===== */
+#define JWT_BENCHMARK_ITERATIONS	5
+
+
+/* ===== Private structs and enums ===== */
+typedef struct {
+	const char* 	project_id;
+	const uint8_t* 	private_key;
+	size_t 			private_key_size;
+}	jwt_service_config_t;
+
+
+/* ===== Declaration of private or external variables ===== */
+// holds at most one minted token until the GCloud task takes it
+static QueueHandle_t queue_jwt_service;
+static jwt_service_config_t jwt_service_config;
+static TaskHandle_t jwt_service_task_handle;
+// key, DRBG and token buffer, prepared once and reused for every token
+static jwt_signer_t jwt_signer;
+
+static const char *TAG_JWT_SERVICE = "JWT_SERVICE";
+
+
+/* ===== Prototypes of private functions ===== */
+static void jwt_service_task(void *pvParameter);
+static void jwt_benchmark_task(void *pvParameter);
+static void jwt_benchmark_signer(jwt_signer_t* signer, const char* key_name);
+static void jwt_selftest_signer(jwt_signer_t* signer, const char* key_name);
+
+
+/* ===== Implementations of public functions ===== */
+int8_t jwt_service_start(const char* project_id, const uint8_t* private_key, size_t private_key_size)
+{
+	jwt_service_config.project_id 		= project_id;
+	jwt_service_config.private_key 		= private_key;
+	jwt_service_config.private_key_size = private_key_size;
+
+	queue_jwt_service = xQueueCreate(1, sizeof(jwt_token_t));
+	if (queue_jwt_service == NULL)
+	{
+		return -1;
+	}
+
+	if (xTaskCreate(&jwt_service_task, "jwt_service_task", JWT_SERVICE_TASK_STACK, NULL,
+					JWT_SERVICE_TASK_PRIORITY, &jwt_service_task_handle) != pdPASS)
+	{
+		return -1;
+	}
+
+	return 0;
+}
+
+BaseType_t jwt_service_take(jwt_token_t* token, TickType_t ticks_to_wait)
+{
+	return xQueueReceive(queue_jwt_service, token, ticks_to_wait);
+}
+
+void jwt_service_release(jwt_token_t* token)
+{
+	token->token = NULL;
+	// the signer buffer can be used for the next token
+	xTaskNotifyGive(jwt_service_task_handle);
+}
+
+
+int8_t jwt_service_benchmark(void)
+{
+	// runs in its own task so the caller is not blocked by the signatures
+	if (xTaskCreate(&jwt_benchmark_task, "jwt_benchmark_task", JWT_SERVICE_TASK_STACK, NULL,
+					JWT_SERVICE_TASK_PRIORITY, NULL) != pdPASS)
+	{
+		ESP_LOGE(TAG_JWT_SERVICE, "Could not create the JWT benchmark task.");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void jwt_service_task(void *pvParameter)
+{
+	jwt_token_t next_token;
+	time_t now;
+	time_t refresh_time;
+
+	// parse the key and seed the DRBG only once
+	while (jwt_signer_init(&jwt_signer, jwt_service_config.private_key, jwt_service_config.private_key_size) != 0)
+	{
+		ESP_LOGE(TAG_JWT_SERVICE, "Could not initialize the JWT signer, retrying.");
+		vTaskDelay(JWT_SERVICE_RETRY_TIME_MS / portTICK_RATE_MS);
+	}
+
+	while(1)
+	{
+		ESP_LOGI(TAG_JWT_SERVICE, "Creating JWT Token.");
+		next_token = jwt_signer_create(&jwt_signer, jwt_service_config.project_id);
+		if (next_token.token == NULL)
+		{
+			ESP_LOGE(TAG_JWT_SERVICE, "Could not create the JWT Token, retrying.");
+			vTaskDelay(JWT_SERVICE_RETRY_TIME_MS / portTICK_RATE_MS);
+			continue;
+		}
+
+		// the queue only holds one token, so this waits until the previous one was taken
+		xQueueSendToBack(queue_jwt_service, &next_token, portMAX_DELAY);
+		ESP_LOGI(TAG_JWT_SERVICE, "JWT Token ready (expires at %ld).", next_token.exp_time);
+
+		// the token lives in the signer buffer, wait until the MQTT client has copied it
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+		// sleep until the next token has to be ready
+		time(&now);
+		refresh_time = next_token.exp_time - JWT_SERVICE_REFRESH_MARGIN_S;
+		if (refresh_time > now)
+		{
+			vTaskDelay((refresh_time - now) * 1000 / portTICK_RATE_MS);
+		}
+	}
+}
+
+static void jwt_benchmark_task(void *pvParameter)
+{
+	jwt_signer_t* signer = malloc(sizeof(jwt_signer_t));
+	int64_t start_us;
+
+	if (signer == NULL)
+	{
+		ESP_LOGE(TAG_JWT_SERVICE, "Not enough memory for the JWT benchmark.");
+		vTaskDelete(NULL);
+		return;
+	}
+
+	// device key (RS256 or ES256, depending on the key that is flashed)
+	if (jwt_service_config.private_key != NULL &&
+		jwt_signer_init(signer, jwt_service_config.private_key, jwt_service_config.private_key_size) == 0)
+	{
+		jwt_selftest_signer(signer, "device");
+		jwt_signer_set_hw_accel(signer, 1);
+		jwt_benchmark_signer(signer, "device, HW SHA");
+		jwt_signer_set_hw_accel(signer, 0);
+		jwt_benchmark_signer(signer, "device, SW SHA");
+		jwt_signer_free(signer);
+	}
+	else
+	{
+		ESP_LOGW(TAG_JWT_SERVICE, "JWT benchmark: device key not available.");
+	}
+
+	// random P-256 key, so ES256 can be compared even if the device key is RSA
+	start_us = esp_timer_get_time();
+	if (jwt_signer_init_random_ec(signer) == 0)
+	{
+		ESP_LOGI(TAG_JWT_SERVICE, "JWT benchmark: P-256 key generated in %lld ms.", (esp_timer_get_time() - start_us) / 1000);
+		jwt_selftest_signer(signer, "random P-256");
+		jwt_signer_set_hw_accel(signer, 1);
+		jwt_benchmark_signer(signer, "random P-256, HW SHA");
+		jwt_signer_set_hw_accel(signer, 0);
+		jwt_benchmark_signer(signer, "random P-256, SW SHA");
+		jwt_signer_free(signer);
+	}
+
+	free(signer);
+	vTaskDelete(NULL);
+}
+
+static void jwt_benchmark_signer(jwt_signer_t* signer, const char* key_name)
+{
+	jwt_token_t token = { .token = NULL, .exp_time = 0 };
+	int64_t start_us;
+	int64_t elapsed_us;
+	int64_t max_us = 0;
+	int64_t total_us = 0;
+	uint8_t i;
+
+	for (i = 0; i < JWT_BENCHMARK_ITERATIONS; i++)
+	{
+		start_us = esp_timer_get_time();
+		token = jwt_signer_create(signer, jwt_service_config.project_id != NULL ? jwt_service_config.project_id : "benchmark");
+		elapsed_us = esp_timer_get_time() - start_us;
+		if (token.token == NULL)
+		{
+			ESP_LOGE(TAG_JWT_SERVICE, "JWT benchmark: %s token could not be created.", jwt_signer_alg_name(signer));
+			return;
+		}
+
+		total_us += elapsed_us;
+		if (elapsed_us > max_us)
+		{
+			max_us = elapsed_us;
+		}
+	}
+
+	ESP_LOGI(TAG_JWT_SERVICE, "JWT benchmark (%s key): %s, sign avg = %lld ms, max = %lld ms, token = %u bytes.",
+			key_name, jwt_signer_alg_name(signer), total_us / JWT_BENCHMARK_ITERATIONS / 1000, max_us / 1000,
+			strlen(token.token));
+}
+
+static void jwt_selftest_signer(jwt_signer_t* signer, const char* key_name)
+{
+	const char* project_id = jwt_service_config.project_id != NULL ? jwt_service_config.project_id : "benchmark";
+	char* hw_token = malloc(JWT_TOKEN_MAX_SIZE);
+	jwt_token_t token;
+	int hw_rc;
+	int sw_rc;
+	time_t now;
+
+	if (hw_token == NULL)
+	{
+		ESP_LOGE(TAG_JWT_SERVICE, "Not enough memory for the JWT self-test.");
+		return;
+	}
+
+	// same header and payload both ways
+	time(&now);
+
+	jwt_signer_set_hw_accel(signer, 1);
+	token = jwt_signer_create_at(signer, project_id, now);
+	if (token.token == NULL)
+	{
+		free(hw_token);
+		return;
+	}
+	strcpy(hw_token, token.token);
+
+	jwt_signer_set_hw_accel(signer, 0);
+	token = jwt_signer_create_at(signer, project_id, now);
+	if (token.token == NULL)
+	{
+		free(hw_token);
+		return;
+	}
+
+	// ECDSA signatures are randomized, so both tokens are verified with the key instead of compared
+	hw_rc = jwt_signer_verify(signer, hw_token);
+	sw_rc = jwt_signer_verify(signer, token.token);
+	if (hw_rc == 0 && sw_rc == 0)
+	{
+		ESP_LOGI(TAG_JWT_SERVICE, "JWT self-test (%s key, %s): HW and SW signatures verified.", key_name, jwt_signer_alg_name(signer));
+	}
+	else
+	{
+		ESP_LOGE(TAG_JWT_SERVICE, "JWT self-test (%s key, %s): verification failed (HW: -0x%x, SW: -0x%x)!", key_name,
+				jwt_signer_alg_name(signer), -hw_rc, -sw_rc);
+	}
+
+	free(hw_token);
+}
@@ -0,0 +1,95 @@
+/* ===== [message_bus.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "message_bus.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+
+/* ===== Macros of private constants ===== */
+#define MESSAGE_BUS_MODULES     (I2C_MASTER_MOD + 1)
+
+
+/* ===== Declaration of private or external variables ===== */
+// one TX queue per module, NULL until the module registers
+static QueueHandle_t bus_queues[MESSAGE_BUS_MODULES];
+static volatile uint32_t bus_dropped = 0;
+static const char* TAG = "MESSAGE_BUS";
+
+
+/* ===== Implementations of public functions ===== */
+int8_t message_bus_register(rx_module_t module, uint8_t queue_len)
+{
+    if (module >= MESSAGE_BUS_MODULES)
+    {
+        return -1;
+    }
+
+    if (bus_queues[module] == NULL)
+    {
+        bus_queues[module] = xQueueCreate(queue_len, sizeof(tx_message_t));
+        if (bus_queues[module] == NULL)
+        {
+            ESP_LOGE(TAG, "Could not create the TX queue of module %d.", module);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+BaseType_t message_bus_send(rx_module_t destination, tx_message_t* message, TickType_t ticks_to_wait)
+{
+    if (destination >= MESSAGE_BUS_MODULES || bus_queues[destination] == NULL)
+    {
+        bus_dropped++;
+        return pdFAIL;
+    }
+
+    message->timestamp_us = esp_timer_get_time();
+    if (xQueueSendToBack(bus_queues[destination], message, ticks_to_wait) != pdPASS)
+    {
+        bus_dropped++;
+        return pdFAIL;
+    }
+
+    return pdPASS;
+}
+
+BaseType_t message_bus_receive(rx_module_t module, tx_message_t* message, TickType_t ticks_to_wait)
+{
+    if (module >= MESSAGE_BUS_MODULES || bus_queues[module] == NULL)
+    {
+        return pdFAIL;
+    }
+
+    return xQueueReceive(bus_queues[module], message, ticks_to_wait);
+}
+
+uint8_t message_bus_value(const tx_message_t* message)
+{
+    switch (message->kind)
+    {
+        case TX_MSG_SLAVE_STATE:
+            return message->payload.slave_state;
+        case TX_MSG_COMMAND:
+        default:
+            return message->payload.command;
+    }
+}
+
+uint32_t message_bus_dropped(void)
+{
+    return bus_dropped;
+}
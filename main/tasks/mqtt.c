@@ -11,8 +11,16 @@
 #include "command_processor.h"
 #include "slave_sim_task.h"
 #include "jwt_token.h"
+#include "jwt_service.h"
+#include "mqtt_broker.h"
+#include "mqtt_router.h"
+#include "telemetry_payload.h"
+#include "telemetry_filter.h"
+#include "message_bus.h"
+#include "spsc_ring.h"
 
 #include <stdio.h>
+#include <limits.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
@@ -21,23 +29,26 @@
 #include "freertos/event_groups.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
 #include "mqtt_client.h"
 #include "lwip/apps/sntp.h"
 
 /* ===== Macros of private constants ===== */
+#define MQTT_RX_BROKERS		2		// entries of the broker table, each one has its own RX ring
 #ifdef CONFIG_THINGSPEAK
+	#define MQTT_BROKER_NAME 				"THINGSPEAK"
 	#define CONFIG_BROKER_URI 				"mqtts://mqtt.thingspeak.com:8883"
-	#define MQTT_PUBLISH_TOPIC 				"channels/776064/publish/fields/field1/2WBYREDTIXQ6X9PF"
-	#define MQTT_SUBSCRIBE_TOPIC 			"channels/776064/subscribe/fields/field2/E5V8ERAC6B0Y8160"
+	#define MQTT_PUBLISH_TOPIC_TX 			"channels/776064/publish/fields/field1/2WBYREDTIXQ6X9PF"
+	#define MQTT_PUBLISH_TOPIC_STATUS 		NULL
+	#define MQTT_SUBSCRIBE_TOPIC_RX 		"channels/776064/subscribe/fields/field2/E5V8ERAC6B0Y8160"
 	#define MQTT_USERNAME 					"mbrignone"
 	#define MQTT_PASSWORD 					"FP650XEYQ5XX0NY7"
 	#define BINARY_CERTIFICATE_START 		"_binary_thingspeak_mqtts_certificate_pem_start"
 	#define BINARY_CERTIFICATE_END 			"_binary_thingspeak_mqtts_certificate_pem_end"
-	// ThingSpeak free cloud requires some time between transactions (15 seconds)
-	#define MQTT_TRANSACTION_WAIT_TIME		15000
 #else
-	#define MQTT_TRANSACTION_WAIT_TIME		1000
 	#ifdef CONFIG_ADAFRUIT
+		#define MQTT_BROKER_NAME 			"ADAFRUIT"
 		#define CONFIG_BROKER_URI 			"mqtts://io.adafruit.com:8883"
 		#define MQTT_PUBLISH_TOPIC_TX 		"mbrignone/feeds/command-received"
 		#define MQTT_PUBLISH_TOPIC_STATUS 	"mbrignone/feeds/status"
@@ -57,30 +68,62 @@
 #define GCLOUD_CLIENT_ID		"projects/esp32-cese/locations/us-central1/registries/esp32_registry/devices/esp32_real"
 #define GCLOUD_DEVICE_TOPIC		"/devices/esp32_real/events"
 #define GCLOUD_DEVICE_STATE		"/devices/esp32_real/state"
+#define GCLOUD_CONFIG_TOPIC		"/devices/esp32_real/config"
+#define GCLOUD_COMMANDS_FILTER	"/devices/esp32_real/commands/#"
 #define GCLOUD_PROJECT_NAME		"esp32-cese"
 #define GCLOUD_PUBLISH_INTERVAL	30000
-// #define GCLOUD_PAYLOAD_JSON		"{\"timestamp\": %ld, \"state\": \"%s\", \"state_int\": %d, \"other\": %d}"
-#define GCLOUD_PAYLOAD_JSON		"{\"timestamp\": %ld, \"device\": \"%s\", \"state\": \"%s\", \"state_int\": %d, \"temp\": %d}"
 #define GCLOUD_PAYLOAD_MAX_SIZE	200
+#ifdef CONFIG_GCLOUD_TELEMETRY_CBOR
+	#define GCLOUD_TELEMETRY_FORMAT	TELEMETRY_FORMAT_CBOR
+#else
+	#define GCLOUD_TELEMETRY_FORMAT	TELEMETRY_FORMAT_JSON
+#endif
+#ifdef CONFIG_GCLOUD_DEVICE_STATE_REPORT
+	#define GCLOUD_STATE_REPORT	1	// the state goes to GCLOUD_DEVICE_STATE, events carry measurements only
+#else
+	#define GCLOUD_STATE_REPORT	0
+#endif
+#define GCLOUD_RATE_PERIOD_MS	1000	// Cloud IoT Core accepts one telemetry event per second
+#define GCLOUD_RATE_BURST		5
+#define GCLOUD_QUEUE_LEN		5
+#define GCLOUD_SLAVE_STATE_UNKNOWN	SLAVE_STATE_ERROR
+
+#define MQTT_ROUTER_NODES		16		// one per distinct filter level
+
+// event bits
+#define MQTT_ADAFRUIT_CONNECTED_BIT	BIT4
+#define MQTT_GCLOUD_CONNECTED_BIT	BIT5
 
 
 /* ===== Private structs and enums ===== */
-typedef enum {
-	CLIENT_TYPE_ADAFRUIT,
-	CLIENT_TYPE_GCLOUD,
-}	client_type_t;
+typedef struct {
+	const char* 		topic;
+	telemetry_format_t 	format;
+}	gcloud_topic_format_t;
+
+typedef struct {
+	const telemetry_sample_t* 	sample;
+	telemetry_format_t 			format;
+}	gcloud_encode_context_t;
+
+typedef struct {
+	const char* 			filter;
+	mqtt_router_handler_t 	handler;
+}	mqtt_route_t;
+
+typedef struct {
+	uint32_t	count;
+	int64_t		total_us;
+	int64_t		max_us;
+}	mqtt_rx_latency_t;
 
 
 /* ===== Declaration of private or external variables ===== */
 extern EventGroupHandle_t wifi_event_group;
-extern QueueHandle_t queue_command_processor_rx;
 
 // Adafruit/Thingspeak variables
 extern const uint8_t mqtts_cert_start[] asm(BINARY_CERTIFICATE_START);
 extern const uint8_t mqtts_cert_end[]   asm(BINARY_CERTIFICATE_END);
-static char* mqtt_publish_topic 		= MQTT_PUBLISH_TOPIC_TX;
-static char* mqtt_publish_topic_status 	= MQTT_PUBLISH_TOPIC_STATUS;
-static char* mqtt_subscribe_topic 		= MQTT_SUBSCRIBE_TOPIC_RX;
 
 // Google Cloud variables
 extern const uint8_t device_bsas_key_start[] 	asm(DEVICE_BSAS_KEY_START);
@@ -89,126 +132,197 @@ extern const uint8_t gcloud_cert_start[]   		asm(GCLOUD_KEY_START);
 
 // event bits
 const int WIFI_CONNECTED_BIT 			= BIT0;
-const int MQTT_ADAFRUIT_CONNECTED_BIT 	= BIT4;
-const int MQTT_GCLOUD_CONNECTED_BIT 	= BIT5;
-
-// queue to pass data from the mqtt event handler to the mqtt rx task
-QueueHandle_t queue_mqtt_subs_to_rx_task;
-QueueHandle_t queue_mqtt_tx;
-QueueHandle_t queue_mqtt_gcloud;
 
-static esp_mqtt_client_handle_t client_adafruit;
-static esp_mqtt_client_handle_t client_gcloud;
+// messages from the event handler to the mqtt rx task, one ring per broker (each client runs its own task)
+static spsc_ring_t mqtt_rx_rings[MQTT_RX_BROKERS];
+static mqtt_sub_data_received_t mqtt_rx_items[MQTT_RX_BROKERS][MQTT_RX_RING_LEN];
+static TaskHandle_t volatile mqtt_rx_task_handle = NULL;
+// time from MQTT_EVENT_DATA until the command is in the command processor queue
+static mqtt_rx_latency_t mqtt_rx_latency;
+// MQTT data event time of the message being routed (MQTT RX task only)
+static int64_t mqtt_rx_received_us;
+// subscription router (topic filter -> handler), built once at startup
+static mqtt_router_node_t mqtt_router_nodes[MQTT_ROUTER_NODES];
+static mqtt_router_t mqtt_router;
+
+static int8_t broker_adafruit = -1;
+static int8_t broker_gcloud = -1;
+
+// payload encoding of each Google Cloud topic
+static const gcloud_topic_format_t gcloud_topic_formats[] = {
+	{ GCLOUD_DEVICE_TOPIC, GCLOUD_TELEMETRY_FORMAT },
+	{ GCLOUD_DEVICE_STATE, TELEMETRY_FORMAT_JSON },
+};
 
 static const char *TAG_USER_TASK = "MQTTS_USER_TASK";
 static const char *TAG_GCLOUD_TASK = "MQTTS_GCLOUD_TASK";
-static const char *TAG_MQTT_EVENT_HANDLER = "MQTTS_EVENT_HANDLER";
+static const char *TAG_MQTT_RX = "MQTTS_RX";
 
 /* ===== Prototypes of private functions ===== */
-static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event);
+static void mqtt_rx_on_data(uint8_t broker, esp_mqtt_event_handle_t event);
+static void route_command(const char* topic, uint16_t topic_len, const char* data, uint16_t data_len, void* context);
+static void route_config(const char* topic, uint16_t topic_len, const char* data, uint16_t data_len, void* context);
+static int8_t mqtt_router_setup(void);
 static void obtain_time(void);
-static int32_t get_json_string(char* json_string, time_t timestamp, char* state, int32_t state_int, int32_t temp);
+static telemetry_format_t gcloud_topic_format(const char* topic);
+static int32_t gcloud_encode_sample(uint8_t* buffer, uint16_t size, void* context);
+static int32_t gcloud_encode_state(uint8_t* buffer, uint16_t size, void* context);
+static int8_t mqtt_rx_rings_init(void);
+static void mqtt_rx_ring_copy(uint8_t broker, esp_mqtt_event_handle_t event);
+static void mqtt_rx_dispatch(const mqtt_sub_data_received_t* mqtt_data_received);
+
+
+/* ===== Broker table ===== */
+// broker table: each broker has its own topic map, QoS, rate limit and (optional) outbox
+static const mqtt_broker_config_t broker_table[] = {
+	{
+		.name = MQTT_BROKER_NAME,
+		.client = {
+			.uri = CONFIG_BROKER_URI,
+			.client_id = "dummy",
+			.cert_pem = (const char *)mqtts_cert_start,
+			.username = MQTT_USERNAME,
+			.password = MQTT_PASSWORD,
+			.disable_clean_session = 0,
+		},
+		.topics = {
+			[MQTT_TOPIC_COMMAND] = MQTT_PUBLISH_TOPIC_TX,
+			[MQTT_TOPIC_STATUS] = MQTT_PUBLISH_TOPIC_STATUS,
+		},
+		.subscribe_topics = { MQTT_SUBSCRIBE_TOPIC_RX },
+		.qos = 0,
+		.rate_burst = CONFIG_MQTT_RATE_BURST,
+		.rate_period_ms = CONFIG_MQTT_RATE_PERIOD_MS,
+		.queue_len = CONFIG_MQTT_PUBLISH_QUEUE_LEN,
+		.outbox_label = NULL,
+		.connected_bit = MQTT_ADAFRUIT_CONNECTED_BIT,
+		.on_data = mqtt_rx_on_data,
+	},
+	{
+		// the password is the JWT minted at runtime
+		.name = "GCLOUD",
+		.client = {
+			.uri = GCLOUD_MQTT_URI,
+			.client_id = GCLOUD_CLIENT_ID,
+			.cert_pem = (const char *)gcloud_cert_start,
+			.username = "unused",
+			.disable_clean_session = 0,
+		},
+		.topics = {
+			[MQTT_TOPIC_TELEMETRY] = GCLOUD_DEVICE_TOPIC,
+			[MQTT_TOPIC_STATE] = GCLOUD_DEVICE_STATE,
+		},
+		.subscribe_topics = { GCLOUD_CONFIG_TOPIC, GCLOUD_COMMANDS_FILTER },
+		.qos = 1,
+		.rate_burst = GCLOUD_RATE_BURST,
+		.rate_period_ms = GCLOUD_RATE_PERIOD_MS,
+		.queue_len = GCLOUD_QUEUE_LEN,
+		// telemetry waiting to be acknowledged by Google Cloud (survives disconnections and reboots)
+		.outbox_label = MQTT_OUTBOX_PARTITION_LABEL,
+		.outbox_topic = MQTT_TOPIC_TELEMETRY,
+		.connected_bit = MQTT_GCLOUD_CONNECTED_BIT,
+		.on_data = mqtt_rx_on_data,
+	},
+};
+
+// handler of each subscription, whatever broker it comes from
+static const mqtt_route_t mqtt_routes[] = {
+	{ MQTT_SUBSCRIBE_TOPIC_RX, route_command },
+	{ GCLOUD_COMMANDS_FILTER, route_command },
+	{ GCLOUD_CONFIG_TOPIC, route_config },
+};
 
 
 /* ===== Implementations of public functions ===== */
-void mqtt_publish_task(void *pvParameter)
+void initialize_mqtt_brokers(void)
 {
-	// create a queue capable of containing 5 uint8_t values
-    queue_mqtt_tx = xQueueCreate(5, sizeof(uint8_t));
-    if (queue_mqtt_tx == NULL)	{
-        ESP_LOGE(TAG_USER_TASK, "Could not create queue_mqtt_tx.");
-    }
+	if (message_bus_register(MQTT_RX, MESSAGE_BUS_QUEUE_LEN) != 0)	{
+		ESP_LOGE(TAG_USER_TASK, "Could not create the MQTT TX queue.");
+	}
+
+	// rings that hand the received messages from the event handlers to the rx task
+	if (mqtt_rx_rings_init() != 0)	{
+		ESP_LOGE(TAG_USER_TASK, "Could not create the MQTT RX rings.");
+	}
+
+	if (mqtt_router_setup() != 0)	{
+		ESP_LOGE(TAG_USER_TASK, "Could not build the MQTT subscription router.");
+	}
 
-	// create a queue capable of containing a 5 pointers to struct subscription_data_received_t
-	queue_mqtt_subs_to_rx_task = xQueueCreate(5, sizeof(mqtt_sub_data_received_t));
+	broker_adafruit = mqtt_broker_add(&broker_table[0]);
+	broker_gcloud = mqtt_broker_add(&broker_table[1]);
+	if (broker_adafruit < 0 || broker_gcloud < 0)	{
+		ESP_LOGE(TAG_USER_TASK, "Could not create the broker table.");
+	}
+}
 
+void mqtt_publish_task(void *pvParameter)
+{
 	// wait for wifi connection
 	xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
 
-	int msg_id;
-	uint8_t queue_rcv_value;
+	tx_message_t tx_message;
 	char* command_string_value;
 	BaseType_t xStatus;
+	uint8_t accepted;
 
-	const esp_mqtt_client_config_t mqtt_cfg = {
-		.uri = CONFIG_BROKER_URI,
-		.client_id = "dummy",
-		.event_handle = mqtt_event_handler,
-		.cert_pem = (const char *)mqtts_cert_start,
-		.username = MQTT_USERNAME,
-		.password = MQTT_PASSWORD,
-		.disable_clean_session = 0,
-	};
-
-	client_adafruit = esp_mqtt_client_init(&mqtt_cfg);
-	esp_mqtt_client_start(client_adafruit);
+	mqtt_broker_start(broker_adafruit, NULL);
 
 	while(1)	{
-		// always wait for this
-		xEventGroupWaitBits(wifi_event_group, MQTT_ADAFRUIT_CONNECTED_BIT, false, true, portMAX_DELAY);
-
-		// read data from the queue
-		xStatus = xQueueReceive(queue_mqtt_tx, &queue_rcv_value,  20 / portTICK_RATE_MS);
+		// the broker tasks publish, this task only fans the data out
+		xStatus = message_bus_receive(MQTT_RX, &tx_message, portMAX_DELAY);
 		if (xStatus == pdPASS)	{
 			// publish to the slave topic if the state was requested
-			if(queue_rcv_value == SLAVE_STATE_FRAME)
+			if(tx_message.kind == TX_MSG_SLAVE_STATE)
 			{
-				// receive the next value, which will be the slave state
-				xStatus = xQueueReceive(queue_mqtt_tx, &queue_rcv_value,  50 / portTICK_RATE_MS);
-				command_string_value = translate_slave_machine_state(queue_rcv_value);
-				ESP_LOGI(TAG_USER_TASK, "Received from Command Processor TASK: %s (%d).", command_string_value, queue_rcv_value);
-				vTaskDelay(MQTT_TRANSACTION_WAIT_TIME / portTICK_RATE_MS);
+				command_string_value = translate_slave_machine_state(tx_message.payload.slave_state);
+				ESP_LOGI(TAG_USER_TASK, "Received from Command Processor TASK: %s (%d).", command_string_value,
+						 tx_message.payload.slave_state);
 
-				msg_id = esp_mqtt_client_publish(client_adafruit, mqtt_publish_topic_status, command_string_value, 0, 0, 0);
+				accepted = mqtt_broker_publish(MQTT_BROKER_ALL, MQTT_TOPIC_STATUS, MQTT_PRIORITY_HIGH,
+											   command_string_value, strlen(command_string_value));
 			}
 			else
 			{
-				command_string_value = translate_command_type(queue_rcv_value);
-				ESP_LOGI(TAG_USER_TASK, "Received from Command Processor TASK: %s (%d).", command_string_value, queue_rcv_value);
-				vTaskDelay(MQTT_TRANSACTION_WAIT_TIME / portTICK_RATE_MS);
+				command_string_value = translate_command_type(tx_message.payload.command);
+				ESP_LOGI(TAG_USER_TASK, "Received from Command Processor TASK: %s (%d).", command_string_value,
+						 tx_message.payload.command);
 
-				msg_id = esp_mqtt_client_publish(client_adafruit, mqtt_publish_topic, command_string_value, 0, 0, 0);
+				accepted = mqtt_broker_publish(MQTT_BROKER_ALL, MQTT_TOPIC_COMMAND, MQTT_PRIORITY_NORMAL,
+											   command_string_value, strlen(command_string_value));
 			}
 
-			if (msg_id != -1)	{
-				ESP_LOGI(TAG_USER_TASK, "Sent publish successful.\n");
-			}
-			else	{
-				ESP_LOGE(TAG_USER_TASK, "Error publishing.");
+			if (accepted == 0)	{
+				ESP_LOGE(TAG_USER_TASK, "No broker accepted the message, message dropped.");
 			}
 		}
-		vTaskDelay(1000 / portTICK_RATE_MS);
 	}
 }
 
 void mqtt_rx_task(void *pvParameter)
 {
-	BaseType_t xStatus;
+	// local copy, so the ring item is free before any handler blocks
 	mqtt_sub_data_received_t mqtt_data_received;
-	// command to send to the command processor
-	rx_command_t mqtt_command;
-    mqtt_command.rx_id = MQTT_RX;
+	uint8_t broker;
+	uint8_t received;
 
-	xEventGroupWaitBits(wifi_event_group, MQTT_ADAFRUIT_CONNECTED_BIT, false, true, portMAX_DELAY);
+	// the event handlers notify this task, messages received before are found by the first pass
+	mqtt_rx_task_handle = xTaskGetCurrentTaskHandle();
 
 	while(1)	{
-		// always wait for this
-		xEventGroupWaitBits(wifi_event_group, MQTT_ADAFRUIT_CONNECTED_BIT, false, true, portMAX_DELAY);
+		// one message per broker and pass, a busy broker does not delay the others
+		received = 0;
+		for (broker = 0; broker < MQTT_RX_BROKERS; broker++)	{
+			if (spsc_ring_pop(&mqtt_rx_rings[broker], &mqtt_data_received))	{
+				mqtt_rx_dispatch(&mqtt_data_received);
+				received = 1;
+			}
+		}
 
-		// read data from the queue (passed from the event handler)
-		xStatus = xQueueReceive(queue_mqtt_subs_to_rx_task, &(mqtt_data_received),  50 / portTICK_RATE_MS);
-		if (xStatus == pdPASS)	{
-			printf("MQTT RX received data.\n");
-			printf("TOPIC = %.*s\r\n", mqtt_data_received.topic_len, mqtt_data_received.topic);
-			printf("DATA = %.*s\r\n", mqtt_data_received.data_len, mqtt_data_received.data);
-
-			mqtt_command.command = str_to_cmd(mqtt_data_received.data);
-			xStatus = xQueueSendToBack(queue_command_processor_rx, &mqtt_command, 1000 / portTICK_RATE_MS);
-            if (xStatus != pdPASS)	{
-                ESP_LOGE(TAG_USER_TASK, "Could not send the data to the queue.");
-            }
+		// block until an event handler passes a message (only happens while connected)
+		if (received == 0)	{
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 		}
-		vTaskDelay(1000 / portTICK_RATE_MS);
 	}
 }
 
@@ -216,14 +330,19 @@ void mqtt_rx_task(void *pvParameter)
 void mqtt_gcloud_publish_task(void *pvParameter)
 {
 	BaseType_t xStatus;
-	rx_command_t mqtt_command;
+	rx_command_t mqtt_command = { 0 };
     mqtt_command.rx_id = MQTT_GCLOUD;
 
-	// create a queue capable of containing 5 uint8_t values
-    queue_mqtt_gcloud = xQueueCreate(5, sizeof(uint8_t));
-    if (queue_mqtt_gcloud == NULL)	{
-        ESP_LOGE(TAG_GCLOUD_TASK, "Could not create queue_mqtt_gcloud.");
-    }
+	if (message_bus_register(MQTT_GCLOUD, MESSAGE_BUS_QUEUE_LEN) != 0)	{
+		ESP_LOGE(TAG_GCLOUD_TASK, "Could not create the GCloud TX queue.");
+	}
+
+	mqtt_broker_t* gcloud = mqtt_broker_get(broker_gcloud);
+	if (gcloud == NULL)	{
+		ESP_LOGE(TAG_GCLOUD_TASK, "GCloud broker not available, deleting the task.");
+		vTaskDelete(NULL);
+		return;
+	}
 
 	// wait for wifi connection
 	xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, false, true, portMAX_DELAY);
@@ -251,82 +370,167 @@ void mqtt_gcloud_publish_task(void *pvParameter)
     // strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
     // ESP_LOGI(TAG_GCLOUD_TASK, "The current date/time is: %s", strftime_buf);
 
-	ESP_LOGI(TAG_GCLOUD_TASK, "Creating JWT Token.");
-	jwt_token_t current_token = createGCPJWT(GCLOUD_PROJECT_NAME, device_bsas_key_start, device_bsas_key_end - device_bsas_key_start);
-	// check current_token.token != NULL
-
-	esp_mqtt_client_config_t mqtt_cfg = {
-		.uri = GCLOUD_MQTT_URI,
-		.client_id = GCLOUD_CLIENT_ID,
-		.event_handle = mqtt_event_handler,
-		.cert_pem = (const char *)gcloud_cert_start,
-		.username = "unused",
-		.password = current_token.token,
-		.disable_clean_session = 0,
-	};
+	// tokens are minted by a low priority task, so the RSA signature never runs in this task
+	if (jwt_service_start(GCLOUD_PROJECT_NAME, device_bsas_key_start, device_bsas_key_end - device_bsas_key_start) != 0)	{
+		ESP_LOGE(TAG_GCLOUD_TASK, "Could not start the JWT service.");
+	}
+	jwt_token_t current_token;
+	jwt_token_t next_token = { .token = NULL, .exp_time = 0 };
+	ESP_LOGI(TAG_GCLOUD_TASK, "Waiting for the first JWT Token.");
+	jwt_service_take(&current_token, portMAX_DELAY);
 
-	client_gcloud = esp_mqtt_client_init(&mqtt_cfg);
-	esp_mqtt_client_start(client_gcloud);
+	mqtt_broker_start(broker_gcloud, current_token.token);
+	// the client keeps its own copy of the password
+	jwt_service_release(&current_token);
 
-	int msg_id;
 	uint8_t queue_rcv_value;
+	tx_message_t tx_message;
+	uint16_t status_request_id = 0;
 	char* command_string_value;
 	char command_number_string[4];
-	char json_to_send[GCLOUD_PAYLOAD_MAX_SIZE];
+	telemetry_sample_t sample;
+	telemetry_filter_t telemetry_filter;
+	telemetry_filter_reason_t publish_reason;
+	uint8_t last_slave_state = GCLOUD_SLAVE_STATE_UNKNOWN;
+	uint32_t slave_commands;
+	uint32_t slave_commands_seen = 0;
+	uint32_t status_polls = 0;
+	uint32_t status_polls_skipped = 0;
+	telemetry_device_state_t device_state = { .firmware = esp_ota_get_app_description()->version };
+	telemetry_device_state_t reported_state;
+	uint8_t state_reported = 0;
+	uint32_t reported_connections = 0;
+	uint32_t reported_publish_errors = 0;
+	uint32_t state_reports = 0;
+	gcloud_encode_context_t encode_context = { .sample = &sample, .format = gcloud_topic_format(GCLOUD_DEVICE_TOPIC) };
 	uint32_t current_temp = 25;
 
+	telemetry_filter_init(&telemetry_filter, CONFIG_GCLOUD_TELEMETRY_DEADBAND, CONFIG_GCLOUD_TELEMETRY_HEARTBEAT_S);
+	// the first sample is taken right away
+	TickType_t last_sample_tick = xTaskGetTickCount() - GCLOUD_PUBLISH_INTERVAL / portTICK_RATE_MS;
+
 
 	while(1)	
 	{
-		// always wait for this
-		xEventGroupWaitBits(wifi_event_group, MQTT_GCLOUD_CONNECTED_BIT, false, true, portMAX_DELAY);
-
-		// ask the command processor to get the slave status
-		mqtt_command.command = CMD_SLAVE_STATUS;
-		xStatus = xQueueSendToBack(queue_command_processor_rx, &mqtt_command, 1000 / portTICK_RATE_MS);
-		if (xStatus != pdPASS)	{
-			ESP_LOGE(TAG_GCLOUD_TASK, "Could not send the data to the queue.\n");
+		// the broker task replays the outbox on its own as soon as the client reconnects
+		vTaskDelayUntil(&last_sample_tick, GCLOUD_PUBLISH_INTERVAL / portTICK_RATE_MS);
+
+		// pick up the token minted in the background, if there is a new one
+		if (next_token.token == NULL)	{
+			jwt_service_take(&next_token, 0);
 		}
 
-		// read back the slave status from the command processor
-		xStatus = xQueueReceive(queue_mqtt_gcloud, &queue_rcv_value, 2000 / portTICK_RATE_MS);
-		if(xStatus == pdPASS && queue_rcv_value == SLAVE_STATE_FRAME)
+		// reconnect with it at a quiet point (nothing waiting for an ack), or right away if the current one is about to expire
+		time(&current_time);
+		if (next_token.token != NULL &&
+			(!gcloud->outbox_ready || mqtt_outbox_inflight(&gcloud->outbox) == 0 || (current_token.exp_time - 60) <= current_time))
 		{
-			// receive the next value, which will be the slave state
-			xStatus = xQueueReceive(queue_mqtt_gcloud, &queue_rcv_value,  50 / portTICK_RATE_MS);
-			command_string_value = translate_slave_machine_state(queue_rcv_value);
-			ESP_LOGI(TAG_GCLOUD_TASK, "Received from Command Processor TASK: %s (%d)", command_string_value, queue_rcv_value);
+			ESP_LOGI(TAG_GCLOUD_TASK, "Updating MQTT GCloud client configuration.");
+			mqtt_broker_reconnect(broker_gcloud, next_token.token);
+
+			// the client keeps its own copy of the password, so the service can reuse its buffer
+			current_token = next_token;
+			jwt_service_release(&current_token);
+			next_token.token = NULL;
+			// samples keep being stored, the outbox is replayed once the client reconnects
+		}
+
+		// the slave state only changes with a command, when process A ends on its own or when
+		// SLAVE_DONE goes back to idle, otherwise the I2C request is skipped and the last state is reused
+		time(&current_time);
+		slave_commands = get_slave_command_count();
+		if (slave_commands != slave_commands_seen || last_slave_state == GCLOUD_SLAVE_STATE_UNKNOWN ||
+			last_slave_state == SLAVE_PROCESS_A || last_slave_state == SLAVE_DONE ||
+			telemetry_filter_heartbeat_due(&telemetry_filter, current_time))
+		{
+			slave_commands_seen = slave_commands;
+			status_polls++;
+
+			// ask the command processor to get the slave status, the reply carries the same id
+			mqtt_command.command = CMD_SLAVE_STATUS;
+			mqtt_command.seq = ++status_request_id;
+			if (mqtt_command.seq == 0)	{
+				mqtt_command.seq = ++status_request_id;
+			}
+			xStatus = command_processor_submit(&mqtt_command, 1000 / portTICK_RATE_MS);
+			if (xStatus != pdPASS)	{
+				ESP_LOGE(TAG_GCLOUD_TASK, "Could not send the data to the queue.\n");
+			}
+
+			// read back the slave status, a late answer to a previous request is skipped
+			queue_rcv_value = GCLOUD_SLAVE_STATE_UNKNOWN;
+			while (message_bus_receive(MQTT_GCLOUD, &tx_message, 2000 / portTICK_RATE_MS) == pdPASS)
+			{
+				if (tx_message.kind == TX_MSG_SLAVE_STATE && tx_message.correlation_id == mqtt_command.seq)
+				{
+					queue_rcv_value = tx_message.payload.slave_state;
+					break;
+				}
+			}
+
+			if (queue_rcv_value != GCLOUD_SLAVE_STATE_UNKNOWN)	{
+				ESP_LOGI(TAG_GCLOUD_TASK, "Received from Command Processor TASK: %s (%d)",
+						translate_slave_machine_state(queue_rcv_value), queue_rcv_value);
+			}
+			else	{
+				ESP_LOGI(TAG_GCLOUD_TASK, "Could not get Slave State.");
+			}
+			last_slave_state = queue_rcv_value;
 		}
 		else
 		{
-			ESP_LOGI(TAG_GCLOUD_TASK, "Could not get Slave State.");
-			queue_rcv_value = 255;
+			status_polls_skipped++;
+			queue_rcv_value = last_slave_state;
+		}
+
+		if (queue_rcv_value == GCLOUD_SLAVE_STATE_UNKNOWN)	{
 			command_string_value = "get_error";
 		}
+		else	{
+			command_string_value = translate_slave_machine_state(queue_rcv_value);
+		}
 
 		sprintf(command_number_string, "%d", queue_rcv_value);
 
-		// update token if it is about to expire
-		time(&current_time);
-		if ((current_token.exp_time - 60) <= current_time)
+		// the state is only reported when it changes, Google Cloud keeps the last one. The report is only queued
+		// here: if the client reconnected or failed a publish since then it may never have arrived, so it is sent again
+		if (state_reported && (gcloud->connections != reported_connections ||
+							   gcloud->publish_errors != reported_publish_errors))	{
+			state_reported = 0;
+		}
+		device_state.state = command_string_value;
+		device_state.state_int = queue_rcv_value;
+		device_state.mode = translate_wireless_state(get_wireless_state());
+		if (GCLOUD_STATE_REPORT && (!state_reported || !telemetry_device_state_equal(&device_state, &reported_state)))
 		{
-			ESP_LOGI(TAG_GCLOUD_TASK, "Time expired, updating JWT Token.");
-			current_token = createGCPJWT(GCLOUD_PROJECT_NAME, device_bsas_key_start, device_bsas_key_end - device_bsas_key_start);
-
-			ESP_LOGI(TAG_GCLOUD_TASK, "Updating MQTT GCloud client configuration.");
-			mqtt_cfg.password = current_token.token;
-			esp_mqtt_client_stop(client_gcloud);
-			xEventGroupClearBits(wifi_event_group, MQTT_GCLOUD_CONNECTED_BIT);
-			esp_mqtt_set_config(client_gcloud, &mqtt_cfg);
-			esp_mqtt_client_start(client_gcloud);
-
-			ESP_LOGI(TAG_GCLOUD_TASK, "Waiting for MQTT GCloud reconnection.");
-			xEventGroupWaitBits(wifi_event_group, MQTT_GCLOUD_CONNECTED_BIT, false, true, portMAX_DELAY);
+			if (mqtt_broker_publish_encoded(1 << broker_gcloud, MQTT_TOPIC_STATE, MQTT_PRIORITY_HIGH,
+											gcloud_encode_state, &device_state) != 0)	{
+				reported_state = device_state;
+				state_reported = 1;
+				reported_connections = gcloud->connections;
+				reported_publish_errors = gcloud->publish_errors;
+				state_reports++;
+				ESP_LOGI(TAG_GCLOUD_TASK, "Device state queued: %s, %s, firmware %s (%u reports).",
+						device_state.state, device_state.mode, device_state.firmware, state_reports);
+			}
+			else	{
+				// tried again with the next sample
+				ESP_LOGE(TAG_GCLOUD_TASK, "Could not queue the device state.");
+			}
 		}
 
-		ESP_LOGI(TAG_GCLOUD_TASK, "Publishing to Google Cloud.");
-		get_json_string(json_to_send, current_time, command_string_value, queue_rcv_value, current_temp);
-		ESP_LOGI(TAG_GCLOUD_TASK, "JSON value = %s", json_to_send);
+		sample.timestamp = current_time;
+		sample.device = DEVICE_ID;
+		if (GCLOUD_STATE_REPORT)	{
+			// measurements only, so the filter does not publish events for state changes either
+			sample.state = NULL;
+			sample.state_int = 0;
+		}
+		else	{
+			sample.state = command_string_value;
+			sample.state_int = queue_rcv_value;
+		}
+		sample.temp = current_temp;
 
 		if (current_time & 1)	{
 			current_temp = current_temp + 2;
@@ -335,19 +539,25 @@ void mqtt_gcloud_publish_task(void *pvParameter)
 			current_temp = current_temp - 1;
 		}
 
-
-		// msg_id = esp_mqtt_client_publish(client_gcloud, GCLOUD_DEVICE_TOPIC, command_number_string, 0, 0, 0);
-		msg_id = esp_mqtt_client_publish(client_gcloud, GCLOUD_DEVICE_TOPIC, json_to_send, 0, 0, 0);
-		if (msg_id != -1)	
-		{
-			ESP_LOGI(TAG_GCLOUD_TASK, "Sent publish successful.\n");
+		// only publish when the state changed, the temperature left its deadband or the heartbeat is due
+		publish_reason = telemetry_filter_check(&telemetry_filter, &sample);
+		ESP_LOGI(TAG_GCLOUD_TASK, "Sample %s: %u evaluated, %u suppressed, published on %u state / %u deadband / %u heartbeat, "
+				"slave polls %u, skipped %u.", telemetry_filter_reason_name(publish_reason),
+				telemetry_filter.stats.evaluated, telemetry_filter.stats.suppressed, telemetry_filter.stats.state,
+				telemetry_filter.stats.deadband, telemetry_filter.stats.heartbeat, status_polls, status_polls_skipped);
+		if (publish_reason == TELEMETRY_SUPPRESSED)	{
+			continue;
 		}
-		else	
-		{
-			ESP_LOGE(TAG_GCLOUD_TASK, "Error publishing.\n");
+
+		// queued (or stored in the outbox, trimmed once Google Cloud acknowledges it) and sent by the broker task
+		if (mqtt_broker_publish_encoded(1 << broker_gcloud, MQTT_TOPIC_TELEMETRY, MQTT_PRIORITY_NORMAL,
+										gcloud_encode_sample, &encode_context) == 0)	{
+			ESP_LOGE(TAG_GCLOUD_TASK, "Could not queue the sample.");
 		}
 
-		vTaskDelay(GCLOUD_PUBLISH_INTERVAL / portTICK_RATE_MS);
+		if (!gcloud->connected && gcloud->outbox_ready)	{
+			ESP_LOGI(TAG_GCLOUD_TASK, "GCloud offline, %u records waiting in the outbox.", mqtt_outbox_pending(&gcloud->outbox));
+		}
 	}
 }
 
@@ -356,114 +566,62 @@ void start_custom_mqtt_client()
 {
 	// wait for wifi connection (max 10 seconds)
 	// xEventGroupWaitBits(wifi_event_group, WIFI_CONNECTED_BIT, false, true, 10000 / portTICK_RATE_MS);
-	esp_mqtt_client_start(client_adafruit);
-	esp_mqtt_client_start(client_gcloud);
+	mqtt_broker_start_all();
 }
 
 
 void stop_custom_mqtt_client()
 {
-	esp_mqtt_client_stop(client_adafruit);
-	esp_mqtt_client_stop(client_gcloud);
+	mqtt_broker_stop_all();
 }
 
 
 /* ===== Implementations of private functions ===== */
-static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
+static void mqtt_rx_on_data(uint8_t broker, esp_mqtt_event_handle_t event)
 {
-	esp_mqtt_client_handle_t client = event->client;
-	int msg_id = 0;
-	BaseType_t xStatus;
-	mqtt_sub_data_received_t mqtt_data_received;
-	client_type_t client_type;
-
-	// directly comapare pointers because it is not possible to access client->config->uri
-	if (client == client_adafruit)	{
-		client_type = CLIENT_TYPE_ADAFRUIT;
-	}
-	else if (client_gcloud)	{
-		client_type = CLIENT_TYPE_GCLOUD;
-	}
-	else	{
-		ESP_LOGE(TAG_MQTT_EVENT_HANDLER, "MQTT event from unknown client, returning with error.\n");
-		return ESP_FAIL;
-	}
-
-	// uint32_t free_heap =  esp_get_free_heap_size();
-	// uint32_t min_free_heap =  esp_get_minimum_free_heap_size();
-	// uint32_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
-	// printf("Current free heap = %d, Minimum free heap = %d, Largest block = %d\n", free_heap, min_free_heap, largest_block);
-
-	switch (event->event_id)	{
-		case MQTT_EVENT_CONNECTED:
-			if (client_type == CLIENT_TYPE_ADAFRUIT)
-			{
-				ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_CONNECTED to ADAFRUIT.");
-				xEventGroupSetBits(wifi_event_group, MQTT_ADAFRUIT_CONNECTED_BIT);
-
-				msg_id = esp_mqtt_client_subscribe(client, mqtt_subscribe_topic, 0);
-				ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "Subscribing to topic %s with msg_id = %d.", mqtt_subscribe_topic, msg_id);
-			}
-			else
-			{
-				ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_CONNECTED to GCLOUD.");
-				xEventGroupSetBits(wifi_event_group, MQTT_GCLOUD_CONNECTED_BIT);
-			}
-			break;
+	mqtt_rx_ring_copy(broker, event);
+}
 
-		case MQTT_EVENT_DISCONNECTED:
-			ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_DISCONNECTED (client %d).", client_type);
-			if (client_type == CLIENT_TYPE_ADAFRUIT)
-			{
-				xEventGroupClearBits(wifi_event_group, MQTT_ADAFRUIT_CONNECTED_BIT);
-			}
-			else
-			{
-				xEventGroupClearBits(wifi_event_group, MQTT_GCLOUD_CONNECTED_BIT);
-			}
-			break;
 
-		case MQTT_EVENT_SUBSCRIBED:
-			ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_SUBSCRIBED with msg_id = %d (client %d).", event->msg_id, client_type);
-			break;
+static void route_command(const char* topic, uint16_t topic_len, const char* data, uint16_t data_len, void* context)
+{
+	rx_command_t mqtt_command = { 0 };
 
-		case MQTT_EVENT_UNSUBSCRIBED:
-			ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d (client %d).", event->msg_id, client_type);
-			break;
+	// data is the NUL terminated copy of the RX ring item
+	mqtt_command.rx_id = MQTT_RX;
+	mqtt_command.ingress_us = mqtt_rx_received_us;
 
-		case MQTT_EVENT_PUBLISHED:
-			ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_PUBLISHED, msg_id=%d (client %d).", event->msg_id, client_type);
-			break;
+	if (command_processor_submit_text(&mqtt_command, data, 1000 / portTICK_RATE_MS) != pdPASS)	{
+		ESP_LOGE(TAG_USER_TASK, "Could not send the data to the queue.");
+	}
+}
 
-		case MQTT_EVENT_DATA:
-			if (client_type == CLIENT_TYPE_ADAFRUIT)
-			{
-				ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_DATA from ADAFRUIT.");
-
-				mqtt_data_received.data_len = event->data_len;
-				mqtt_data_received.data = event->data;
-				mqtt_data_received.topic_len = event->topic_len;
-				mqtt_data_received.topic = event->topic;
-				xStatus = xQueueSendToBack(queue_mqtt_subs_to_rx_task, &mqtt_data_received, 0);
-				if (xStatus != pdPASS)
-				{
-					ESP_LOGE(TAG_MQTT_EVENT_HANDLER, "Could not send MQTT data_received to the queue.");
-				}
-			}
+static void route_config(const char* topic, uint16_t topic_len, const char* data, uint16_t data_len, void* context)
+{
+	// Google Cloud sends the device configuration after every (re)connection
+	ESP_LOGI(TAG_USER_TASK, "Device configuration received (%u bytes): %.*s", data_len, data_len, data);
+}
 
-			break;
+static int8_t mqtt_router_setup(void)
+{
+	uint8_t i;
 
-		case MQTT_EVENT_ERROR:
-			ESP_LOGE(TAG_MQTT_EVENT_HANDLER, "MQTT_EVENT_ERROR (client %d).", client_type);
-			break;
+	if (mqtt_router_init(&mqtt_router, mqtt_router_nodes, MQTT_ROUTER_NODES) != 0)
+	{
+		return -1;
+	}
 
-		default:
-			ESP_LOGI(TAG_MQTT_EVENT_HANDLER, "Other event - id: %d (client %d).", event->event_id, client_type);
-			break;
+	for (i = 0; i < sizeof(mqtt_routes) / sizeof(mqtt_routes[0]); i++)
+	{
+		if (mqtt_router_add(&mqtt_router, mqtt_routes[i].filter, mqtt_routes[i].handler, NULL) != 0)
+		{
+			ESP_LOGE(TAG_USER_TASK, "Could not add the route %s.", mqtt_routes[i].filter);
+			return -1;
+		}
 	}
-	return ESP_OK;
-}
 
+	return 0;
+}
 
 static void obtain_time(void)
 {
@@ -480,7 +638,126 @@ static void obtain_time(void)
     }
 }
 
-static int32_t get_json_string(char* json_string, time_t timestamp, char* state, int32_t state_int, int32_t temp)
+static telemetry_format_t gcloud_topic_format(const char* topic)
 {
-	return sprintf(json_string, GCLOUD_PAYLOAD_JSON, timestamp, DEVICE_ID, state, state_int, temp);
+	uint8_t i;
+
+	for (i = 0; i < sizeof(gcloud_topic_formats) / sizeof(gcloud_topic_formats[0]); i++)
+	{
+		if (strcmp(gcloud_topic_formats[i].topic, topic) == 0)
+		{
+			return gcloud_topic_formats[i].format;
+		}
+	}
+
+	return TELEMETRY_FORMAT_JSON;
+}
+
+static int32_t gcloud_encode_sample(uint8_t* buffer, uint16_t size, void* context)
+{
+	gcloud_encode_context_t* encode_context = (gcloud_encode_context_t*)context;
+	int32_t len = telemetry_encode(encode_context->sample, encode_context->format, buffer, size);
+
+	ESP_LOGI(TAG_GCLOUD_TASK, "Sample encoded as %s (%d bytes).", telemetry_format_name(encode_context->format), len);
+	return len;
+}
+
+static int32_t gcloud_encode_state(uint8_t* buffer, uint16_t size, void* context)
+{
+	return telemetry_encode_state((const telemetry_device_state_t*)context, gcloud_topic_format(GCLOUD_DEVICE_STATE),
+								  buffer, size);
+}
+
+static int8_t mqtt_rx_rings_init(void)
+{
+	uint8_t broker;
+
+	for (broker = 0; broker < MQTT_RX_BROKERS; broker++)
+	{
+		if (spsc_ring_init(&mqtt_rx_rings[broker], mqtt_rx_items[broker], sizeof(mqtt_sub_data_received_t),
+						   MQTT_RX_RING_LEN) != 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void mqtt_rx_ring_copy(uint8_t broker, esp_mqtt_event_handle_t event)
+{
+	mqtt_sub_data_received_t* mqtt_data_received;
+	spsc_ring_t* ring;
+	TaskHandle_t rx_task;
+	int64_t received_us = esp_timer_get_time();
+	int topic_len = event->topic_len;
+	int data_len = event->data_len;
+
+	if (broker >= MQTT_RX_BROKERS)
+	{
+		ESP_LOGE(TAG_MQTT_RX, "No MQTT RX ring for broker %d, message dropped.", broker);
+		return;
+	}
+	ring = &mqtt_rx_rings[broker];
+
+	// never block the MQTT client task, drop the message if the ring is full
+	mqtt_data_received = spsc_ring_reserve(ring);
+	if (mqtt_data_received == NULL)
+	{
+		ESP_LOGE(TAG_MQTT_RX, "MQTT RX ring full, message dropped (%u so far).", spsc_ring_dropped(ring));
+		return;
+	}
+
+	if (topic_len > MQTT_RX_TOPIC_MAX_SIZE)
+	{
+		topic_len = MQTT_RX_TOPIC_MAX_SIZE;
+	}
+	if (data_len > MQTT_RX_DATA_MAX_SIZE)
+	{
+		ESP_LOGW(TAG_MQTT_RX, "MQTT data truncated (%d bytes).", data_len);
+		data_len = MQTT_RX_DATA_MAX_SIZE;
+	}
+
+	memcpy(mqtt_data_received->topic, event->topic, topic_len);
+	mqtt_data_received->topic[topic_len] = '\0';
+	mqtt_data_received->topic_len = topic_len;
+	memcpy(mqtt_data_received->data, event->data, data_len);
+	mqtt_data_received->data[data_len] = '\0';
+	mqtt_data_received->data_len = data_len;
+	mqtt_data_received->received_us = received_us;
+
+	// the rx task only has to be woken up if it already took every message
+	rx_task = mqtt_rx_task_handle;
+	if (spsc_ring_commit(ring) && rx_task != NULL)
+	{
+		xTaskNotifyGive(rx_task);
+	}
+}
+
+static void mqtt_rx_dispatch(const mqtt_sub_data_received_t* mqtt_data_received)
+{
+	int64_t latency_us;
+
+	mqtt_rx_received_us = mqtt_data_received->received_us;
+
+	printf("MQTT RX received data.\n");
+	printf("TOPIC = %.*s\r\n", mqtt_data_received->topic_len, mqtt_data_received->topic);
+	printf("DATA = %.*s\r\n", mqtt_data_received->data_len, mqtt_data_received->data);
+
+	// the router walks the topic levels once, whatever the number of subscriptions
+	if (mqtt_router_dispatch(&mqtt_router, mqtt_data_received->topic, mqtt_data_received->topic_len,
+							 mqtt_data_received->data, mqtt_data_received->data_len) == 0)	{
+		ESP_LOGW(TAG_USER_TASK, "No handler for topic %s.", mqtt_data_received->topic);
+		return;
+	}
+
+	latency_us = esp_timer_get_time() - mqtt_data_received->received_us;
+	mqtt_rx_latency.count++;
+	mqtt_rx_latency.total_us += latency_us;
+	if (latency_us > mqtt_rx_latency.max_us)	{
+		mqtt_rx_latency.max_us = latency_us;
+	}
+	ESP_LOGI(TAG_USER_TASK, "Message latency = %lld us (avg = %lld us, max = %lld us, n = %u).",
+			latency_us, mqtt_rx_latency.total_us / mqtt_rx_latency.count,
+			mqtt_rx_latency.max_us, mqtt_rx_latency.count);
 }
@@ -0,0 +1,445 @@
+/* ===== [mqtt_broker.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "mqtt_broker.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+
+#include "esp_log.h"
+#include "mqtt_client.h"
+
+/* ===== Macros of private constants ===== */
+#define MQTT_BROKER_NOT_ENCODED		(-2)	// the fan-out payload was not encoded yet
+
+
+/* ===== Private structs and enums ===== */
+typedef struct {
+	const void* payload;
+	uint16_t 	len;
+}	mqtt_broker_copy_context_t;
+
+
+/* ===== Declaration of private or external variables ===== */
+extern EventGroupHandle_t wifi_event_group;
+
+static mqtt_broker_t brokers[MQTT_BROKER_MAX_BROKERS];
+static uint8_t broker_count = 0;
+
+static const char* TAG = "MQTT_BROKER";
+
+
+/* ===== Prototypes of private functions ===== */
+static void mqtt_broker_task(void *pvParameter);
+static esp_err_t mqtt_broker_event_handler(esp_mqtt_event_handle_t event);
+static int8_t find_broker(esp_mqtt_client_handle_t client);
+static void build_client_config(mqtt_broker_t* broker, const char* password, esp_mqtt_client_config_t* config);
+static void replay_outbox(mqtt_broker_t* broker);
+static int32_t copy_encoder(uint8_t* buffer, uint16_t size, void* context);
+
+
+/* ===== Implementations of public functions ===== */
+int8_t mqtt_broker_add(const mqtt_broker_config_t* config)
+{
+	mqtt_broker_t* broker;
+
+	if (broker_count >= MQTT_BROKER_MAX_BROKERS)
+	{
+		ESP_LOGE(TAG, "Broker table full, %s not added.", config->name);
+		return -1;
+	}
+
+	broker = &brokers[broker_count];
+	memset(broker, 0, sizeof(mqtt_broker_t));
+	broker->config = config;
+
+	if (mqtt_scheduler_init(&broker->scheduler, config->rate_burst, config->rate_period_ms, config->queue_len) != 0)
+	{
+		ESP_LOGE(TAG, "Could not create the publish queue of %s.", config->name);
+		return -1;
+	}
+
+	if (config->outbox_label != NULL)
+	{
+		if (mqtt_outbox_init(&broker->outbox, config->outbox_label) == ESP_OK)
+		{
+			broker->outbox_ready = 1;
+		}
+		else
+		{
+			ESP_LOGE(TAG, "Outbox of %s not available, its messages are only queued in RAM.", config->name);
+		}
+	}
+
+	return broker_count++;
+}
+
+esp_err_t mqtt_broker_start(uint8_t index, const char* password)
+{
+	mqtt_broker_t* broker = mqtt_broker_get(index);
+	esp_mqtt_client_config_t client_config;
+
+	if (broker == NULL || broker->client != NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	build_client_config(broker, password, &client_config);
+	broker->client = esp_mqtt_client_init(&client_config);
+	if (broker->client == NULL)
+	{
+		ESP_LOGE(TAG, "Could not create the client of %s.", broker->config->name);
+		return ESP_FAIL;
+	}
+
+	// the task must exist before the first event notifies it, and no event arrives before the client starts
+	if (xTaskCreate(&mqtt_broker_task, "mqtt_broker_task", MQTT_BROKER_TASK_STACK, broker,
+					MQTT_BROKER_TASK_PRIORITY, &broker->task) != pdPASS)
+	{
+		ESP_LOGE(TAG, "Could not create the publish task of %s.", broker->config->name);
+		esp_mqtt_client_destroy(broker->client);
+		broker->client = NULL;
+		return ESP_ERR_NO_MEM;
+	}
+
+	return esp_mqtt_client_start(broker->client);
+}
+
+esp_err_t mqtt_broker_reconnect(uint8_t index, const char* password)
+{
+	mqtt_broker_t* broker = mqtt_broker_get(index);
+	esp_mqtt_client_config_t client_config;
+
+	if (broker == NULL || broker->client == NULL)
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+
+	esp_mqtt_client_stop(broker->client);
+	broker->connected = 0;
+	xEventGroupClearBits(wifi_event_group, broker->config->connected_bit);
+	if (broker->outbox_ready)
+	{
+		mqtt_outbox_release_all(&broker->outbox);
+	}
+
+	build_client_config(broker, password, &client_config);
+	esp_mqtt_set_config(broker->client, &client_config);
+
+	return esp_mqtt_client_start(broker->client);
+}
+
+void mqtt_broker_start_all(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < broker_count; i++)
+	{
+		if (brokers[i].client != NULL)
+		{
+			esp_mqtt_client_start(brokers[i].client);
+		}
+	}
+}
+
+void mqtt_broker_stop_all(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < broker_count; i++)
+	{
+		if (brokers[i].client != NULL)
+		{
+			esp_mqtt_client_stop(brokers[i].client);
+			brokers[i].connected = 0;
+			xEventGroupClearBits(wifi_event_group, brokers[i].config->connected_bit);
+			if (brokers[i].outbox_ready)
+			{
+				mqtt_outbox_release_all(&brokers[i].outbox);
+			}
+		}
+	}
+}
+
+uint8_t mqtt_broker_publish(uint8_t broker_mask, mqtt_topic_id_t topic, mqtt_publish_priority_t priority,
+							const void* payload, uint16_t len)
+{
+	mqtt_broker_copy_context_t context = { .payload = payload, .len = len };
+
+	return mqtt_broker_publish_encoded(broker_mask, topic, priority, copy_encoder, &context);
+}
+
+uint8_t mqtt_broker_publish_encoded(uint8_t broker_mask, mqtt_topic_id_t topic, mqtt_publish_priority_t priority,
+									mqtt_outbox_encoder_t encoder, void* context)
+{
+	uint8_t payload[MQTT_SCHEDULER_PAYLOAD_MAX_SIZE];
+	int32_t payload_len = MQTT_BROKER_NOT_ENCODED;
+	mqtt_broker_t* broker;
+	uint8_t accepted = 0;
+	uint8_t ok;
+	uint8_t i;
+
+	if (topic >= MQTT_TOPIC_COUNT)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < broker_count; i++)
+	{
+		broker = &brokers[i];
+		if ((broker_mask & (1 << i)) == 0 || broker->config->topics[topic] == NULL)
+		{
+			continue;
+		}
+
+		if (broker->outbox_ready && broker->config->outbox_topic == topic)
+		{
+			ok = (mqtt_outbox_append_encoded(&broker->outbox, encoder, context) == ESP_OK);
+		}
+		else
+		{
+			// encode once and share the payload between every queue
+			if (payload_len == MQTT_BROKER_NOT_ENCODED)
+			{
+				payload_len = encoder(payload, sizeof(payload), context);
+			}
+			ok = (payload_len >= 0 &&
+				  mqtt_scheduler_enqueue(&broker->scheduler, priority, broker->config->topics[topic],
+										 (const char*)payload, payload_len) == pdPASS);
+		}
+
+		// a slow broker only drops its own copy, the others are not affected
+		if (!ok)
+		{
+			broker->fanout_dropped++;
+			ESP_LOGW(TAG, "%s rejected a message (%u so far).", broker->config->name, broker->fanout_dropped);
+			continue;
+		}
+
+		accepted++;
+		if (broker->task != NULL)
+		{
+			xTaskNotifyGive(broker->task);
+		}
+	}
+
+	return accepted;
+}
+
+mqtt_broker_t* mqtt_broker_get(uint8_t index)
+{
+	if (index >= broker_count)
+	{
+		return NULL;
+	}
+
+	return &brokers[index];
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void mqtt_broker_task(void *pvParameter)
+{
+	mqtt_broker_t* broker = (mqtt_broker_t*)pvParameter;
+	mqtt_publish_msg_t publish_msg;
+	TickType_t wait_ticks;
+	int msg_id;
+
+	while(1)	{
+		// woken up by the fan-out, the connection events and the outbox acks
+		wait_ticks = broker->connected ? mqtt_scheduler_wait_ticks(&broker->scheduler, broker->outbox_waiting)
+									  : portMAX_DELAY;
+		ulTaskNotifyTake(pdTRUE, wait_ticks);
+		if (!broker->connected)	{
+			continue;
+		}
+
+		// publish everything the broker rate limit allows right now
+		while (broker->connected && mqtt_scheduler_dequeue(&broker->scheduler, &publish_msg) == pdPASS)	{
+			msg_id = esp_mqtt_client_publish(broker->client, publish_msg.topic, publish_msg.payload,
+											 publish_msg.payload_len, broker->config->qos, 0);
+			if (msg_id != -1)	{
+				ESP_LOGI(TAG, "%s: sent publish successful.", broker->config->name);
+			}
+			else	{
+				broker->publish_errors++;
+				ESP_LOGE(TAG, "%s: error publishing.", broker->config->name);
+			}
+			mqtt_scheduler_log_stats(&broker->scheduler, TAG);
+		}
+
+		replay_outbox(broker);
+	}
+}
+
+static esp_err_t mqtt_broker_event_handler(esp_mqtt_event_handle_t event)
+{
+	int8_t index;
+	mqtt_broker_t* broker;
+	int msg_id;
+	uint8_t i;
+
+	// directly compare pointers because it is not possible to access client->config->uri
+	index = find_broker(event->client);
+	if (index < 0)	{
+		ESP_LOGE(TAG, "MQTT event from unknown client, returning with error.");
+		return ESP_FAIL;
+	}
+	broker = &brokers[index];
+
+	switch (event->event_id)	{
+		case MQTT_EVENT_CONNECTED:
+			ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED to %s.", broker->config->name);
+			broker->connected = 1;
+			broker->connections++;
+			xEventGroupSetBits(wifi_event_group, broker->config->connected_bit);
+
+			for (i = 0; i < MQTT_BROKER_MAX_SUBSCRIPTIONS && broker->config->subscribe_topics[i] != NULL; i++)	{
+				msg_id = esp_mqtt_client_subscribe(event->client, broker->config->subscribe_topics[i], broker->config->qos);
+				ESP_LOGI(TAG, "Subscribing to topic %s with msg_id = %d.", broker->config->subscribe_topics[i], msg_id);
+			}
+			if (broker->config->on_connection != NULL)	{
+				broker->config->on_connection(index, 1);
+			}
+			// flush what was queued or stored while offline
+			xTaskNotifyGive(broker->task);
+			break;
+
+		case MQTT_EVENT_DISCONNECTED:
+			ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED from %s.", broker->config->name);
+			broker->connected = 0;
+			xEventGroupClearBits(wifi_event_group, broker->config->connected_bit);
+			if (broker->outbox_ready)	{
+				mqtt_outbox_release_all(&broker->outbox);
+			}
+			if (broker->config->on_connection != NULL)	{
+				broker->config->on_connection(index, 0);
+			}
+			break;
+
+		case MQTT_EVENT_SUBSCRIBED:
+			ESP_LOGI(TAG, "MQTT_EVENT_SUBSCRIBED with msg_id = %d (%s).", event->msg_id, broker->config->name);
+			break;
+
+		case MQTT_EVENT_UNSUBSCRIBED:
+			ESP_LOGI(TAG, "MQTT_EVENT_UNSUBSCRIBED, msg_id=%d (%s).", event->msg_id, broker->config->name);
+			break;
+
+		case MQTT_EVENT_PUBLISHED:
+			ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d (%s).", event->msg_id, broker->config->name);
+			// an ack frees an in flight slot, so more records can be replayed
+			if (broker->outbox_ready && mqtt_outbox_ack(&broker->outbox, event->msg_id) == ESP_OK)	{
+				xTaskNotifyGive(broker->task);
+			}
+			break;
+
+		case MQTT_EVENT_DATA:
+			ESP_LOGI(TAG, "MQTT_EVENT_DATA from %s.", broker->config->name);
+			if (broker->config->on_data != NULL)	{
+				broker->config->on_data(index, event);
+			}
+			break;
+
+		case MQTT_EVENT_ERROR:
+			ESP_LOGE(TAG, "MQTT_EVENT_ERROR (%s).", broker->config->name);
+			break;
+
+		default:
+			ESP_LOGI(TAG, "Other event - id: %d (%s).", event->event_id, broker->config->name);
+			break;
+	}
+
+	return ESP_OK;
+}
+
+static int8_t find_broker(esp_mqtt_client_handle_t client)
+{
+	uint8_t i;
+
+	for (i = 0; i < broker_count; i++)
+	{
+		if (brokers[i].client == client)
+		{
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+static void build_client_config(mqtt_broker_t* broker, const char* password, esp_mqtt_client_config_t* config)
+{
+	*config = broker->config->client;
+	config->event_handle = mqtt_broker_event_handler;
+	if (password != NULL)
+	{
+		config->password = password;
+	}
+}
+
+static void replay_outbox(mqtt_broker_t* broker)
+{
+	mqtt_outbox_record_t record;
+	uint32_t slot;
+	uint32_t sent = 0;
+	int msg_id;
+
+	broker->outbox_waiting = 0;
+	if (!broker->outbox_ready)
+	{
+		return;
+	}
+
+	// records spend the same tokens as the queued messages, so the replay after a reconnection
+	// can not go over the broker rate limit
+	while (broker->connected && mqtt_outbox_next(&broker->outbox, &record, &slot) == ESP_OK)
+	{
+		if (sent >= MQTT_BROKER_OUTBOX_BATCH || mqtt_scheduler_take_token(&broker->scheduler) != pdPASS)
+		{
+			// give the record back, the task wakes up again when the next token is available
+			mqtt_outbox_set_msg_id(&broker->outbox, slot, -1);
+			broker->outbox_waiting = 1;
+			break;
+		}
+
+		// always QoS 1, the record is trimmed when MQTT_EVENT_PUBLISHED arrives with this msg_id
+		msg_id = esp_mqtt_client_publish(broker->client, broker->config->topics[broker->config->outbox_topic],
+										 (const char*)record.payload, record.len, 1, 0);
+		mqtt_outbox_set_msg_id(&broker->outbox, slot, msg_id);
+		if (msg_id == -1)
+		{
+			broker->publish_errors++;
+			ESP_LOGE(TAG, "%s: error publishing record %u.", broker->config->name, record.seq);
+			break;
+		}
+		sent++;
+	}
+
+	if (sent > 0)
+	{
+		ESP_LOGI(TAG, "%s outbox: %u records sent, %u pending, %u dropped.", broker->config->name, sent,
+				mqtt_outbox_pending(&broker->outbox), broker->outbox.dropped);
+	}
+}
+
+static int32_t copy_encoder(uint8_t* buffer, uint16_t size, void* context)
+{
+	mqtt_broker_copy_context_t* copy_context = (mqtt_broker_copy_context_t*)context;
+
+	if (copy_context->len > size)
+	{
+		return -1;
+	}
+
+	memcpy(buffer, copy_context->payload, copy_context->len);
+	return copy_context->len;
+}
@@ -0,0 +1,424 @@
+/* ===== [mqtt_outbox.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "mqtt_outbox.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_partition.h"
+#include "esp_log.h"
+
+/* ===== Macros of private constants ===== */
+#define MQTT_OUTBOX_RECORD_MAGIC	0x424F514D	// "MQOB"
+#define MQTT_OUTBOX_ERASED_WORD		0xFFFFFFFF
+#define MQTT_OUTBOX_ACKED_OFFSET	12			// offset of the acked word inside a record
+#define SLOTS_PER_SECTOR			(MQTT_OUTBOX_SECTOR_SIZE / MQTT_OUTBOX_RECORD_SIZE)
+
+
+/* ===== Declaration of private or external variables ===== */
+static const char* TAG = "MQTT_OUTBOX";
+
+
+/* ===== Prototypes of private functions ===== */
+static esp_err_t write_record(mqtt_outbox_t* outbox, mqtt_outbox_record_t* record);
+static esp_err_t read_header(mqtt_outbox_t* outbox, uint32_t slot, mqtt_outbox_record_t* record);
+static uint8_t is_pending(mqtt_outbox_record_t* record);
+static uint32_t next_slot(mqtt_outbox_t* outbox, uint32_t slot);
+static int32_t find_inflight_slot(mqtt_outbox_t* outbox, uint32_t slot);
+static void remove_inflight(mqtt_outbox_t* outbox, uint32_t index);
+static esp_err_t ack_inflight(mqtt_outbox_t* outbox, uint32_t index);
+static void advance_tail(mqtt_outbox_t* outbox);
+static void make_room(mqtt_outbox_t* outbox);
+
+
+/* ===== Implementations of public functions ===== */
+esp_err_t mqtt_outbox_init(mqtt_outbox_t* outbox, const char* label)
+{
+	mqtt_outbox_record_t header;
+	uint32_t slot, max_seq = 0, min_pending_seq = 0;
+	uint32_t max_slot = 0, min_pending_slot = 0;
+	uint8_t found = 0, found_pending = 0;
+
+	memset(outbox, 0, sizeof(mqtt_outbox_t));
+
+	outbox->partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, MQTT_OUTBOX_PARTITION_SUBTYPE, label);
+	if (outbox->partition == NULL)
+	{
+		ESP_LOGE(TAG, "Partition %s not found.", label);
+		return ESP_ERR_NOT_FOUND;
+	}
+
+	outbox->slot_count = (outbox->partition->size / MQTT_OUTBOX_SECTOR_SIZE) * SLOTS_PER_SECTOR;
+	if (outbox->slot_count < 2 * SLOTS_PER_SECTOR)
+	{
+		ESP_LOGE(TAG, "Partition %s needs at least two sectors.", label);
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	for (slot = 0; slot < MQTT_OUTBOX_MAX_INFLIGHT; slot++)
+	{
+		outbox->early_acks[slot] = -1;
+	}
+
+	outbox->lock = xSemaphoreCreateMutex();
+	if (outbox->lock == NULL)
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	// recover the newest record (head) and the oldest record not acknowledged yet (tail)
+	for (slot = 0; slot < outbox->slot_count; slot++)
+	{
+		if (read_header(outbox, slot, &header) != ESP_OK || header.magic != MQTT_OUTBOX_RECORD_MAGIC)
+		{
+			continue;
+		}
+
+		if (!found || (int32_t)(header.seq - max_seq) > 0)
+		{
+			max_seq = header.seq;
+			max_slot = slot;
+			found = 1;
+		}
+
+		if (is_pending(&header) && (!found_pending || (int32_t)(header.seq - min_pending_seq) < 0))
+		{
+			min_pending_seq = header.seq;
+			min_pending_slot = slot;
+			found_pending = 1;
+		}
+	}
+
+	if (found)
+	{
+		outbox->head = next_slot(outbox, max_slot);
+		outbox->next_seq = max_seq + 1;
+		outbox->tail = found_pending ? min_pending_slot : outbox->head;
+	}
+
+	ESP_LOGI(TAG, "Outbox ready: %u slots, %u pending records, next sequence %u.",
+			outbox->slot_count, mqtt_outbox_pending(outbox), outbox->next_seq);
+
+	return ESP_OK;
+}
+
+esp_err_t mqtt_outbox_append(mqtt_outbox_t* outbox, const void* payload, uint16_t len)
+{
+	mqtt_outbox_record_t record;
+
+	if (len > MQTT_OUTBOX_PAYLOAD_MAX_SIZE)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+
+	// the whole slot is written at once, unused bytes are left erased
+	memset(&record, 0xFF, sizeof(record));
+	record.magic = MQTT_OUTBOX_RECORD_MAGIC;
+	record.len = len;
+	memcpy(record.payload, payload, len);
+
+	return write_record(outbox, &record);
+}
+
+esp_err_t mqtt_outbox_append_encoded(mqtt_outbox_t* outbox, mqtt_outbox_encoder_t encoder, void* context)
+{
+	mqtt_outbox_record_t record;
+	int32_t len;
+
+	memset(&record, 0xFF, sizeof(record));
+	record.magic = MQTT_OUTBOX_RECORD_MAGIC;
+
+	// the encoder writes straight into the record that goes to flash
+	len = encoder(record.payload, MQTT_OUTBOX_PAYLOAD_MAX_SIZE, context);
+	if (len < 0 || len > MQTT_OUTBOX_PAYLOAD_MAX_SIZE)
+	{
+		return ESP_ERR_INVALID_SIZE;
+	}
+	record.len = len;
+
+	return write_record(outbox, &record);
+}
+
+esp_err_t mqtt_outbox_next(mqtt_outbox_t* outbox, mqtt_outbox_record_t* record, uint32_t* slot)
+{
+	esp_err_t ret = ESP_ERR_NOT_FOUND;
+	mqtt_outbox_inflight_t* inflight;
+	uint32_t current;
+
+	xSemaphoreTake(outbox->lock, portMAX_DELAY);
+
+	if (outbox->inflight_count < MQTT_OUTBOX_MAX_INFLIGHT)
+	{
+		for (current = outbox->tail; current != outbox->head; current = next_slot(outbox, current))
+		{
+			if (find_inflight_slot(outbox, current) >= 0 ||
+				read_header(outbox, current, record) != ESP_OK || !is_pending(record))
+			{
+				continue;
+			}
+
+			ret = esp_partition_read(outbox->partition, current * MQTT_OUTBOX_RECORD_SIZE, record, MQTT_OUTBOX_RECORD_SIZE);
+			if (ret == ESP_OK)
+			{
+				inflight = &outbox->inflight[outbox->inflight_count++];
+				inflight->slot = current;
+				inflight->seq = record->seq;
+				inflight->msg_id = -1;
+				*slot = current;
+			}
+			break;
+		}
+	}
+
+	xSemaphoreGive(outbox->lock);
+
+	return ret;
+}
+
+void mqtt_outbox_set_msg_id(mqtt_outbox_t* outbox, uint32_t slot, int32_t msg_id)
+{
+	int32_t index;
+	uint32_t early;
+
+	xSemaphoreTake(outbox->lock, portMAX_DELAY);
+
+	index = find_inflight_slot(outbox, slot);
+	if (index >= 0)
+	{
+		if (msg_id < 0)
+		{
+			remove_inflight(outbox, index);
+		}
+		else
+		{
+			outbox->inflight[index].msg_id = msg_id;
+
+			// the broker ack can be processed before the publisher gets here
+			for (early = 0; early < MQTT_OUTBOX_MAX_INFLIGHT; early++)
+			{
+				if (outbox->early_acks[early] == msg_id)
+				{
+					outbox->early_acks[early] = -1;
+					ack_inflight(outbox, index);
+					break;
+				}
+			}
+		}
+	}
+
+	xSemaphoreGive(outbox->lock);
+}
+
+esp_err_t mqtt_outbox_ack(mqtt_outbox_t* outbox, int32_t msg_id)
+{
+	esp_err_t ret = ESP_ERR_NOT_FOUND;
+	uint32_t index;
+
+	xSemaphoreTake(outbox->lock, portMAX_DELAY);
+
+	for (index = 0; index < outbox->inflight_count; index++)
+	{
+		if (outbox->inflight[index].msg_id == msg_id)
+		{
+			ret = ack_inflight(outbox, index);
+			break;
+		}
+	}
+
+	// remember it in case the msg_id has not been associated yet
+	if (ret == ESP_ERR_NOT_FOUND)
+	{
+		outbox->early_acks[outbox->early_ack_index] = msg_id;
+		outbox->early_ack_index = (outbox->early_ack_index + 1) % MQTT_OUTBOX_MAX_INFLIGHT;
+	}
+
+	xSemaphoreGive(outbox->lock);
+
+	return ret;
+}
+
+void mqtt_outbox_release_all(mqtt_outbox_t* outbox)
+{
+	uint32_t early;
+
+	xSemaphoreTake(outbox->lock, portMAX_DELAY);
+	outbox->inflight_count = 0;
+	for (early = 0; early < MQTT_OUTBOX_MAX_INFLIGHT; early++)
+	{
+		outbox->early_acks[early] = -1;
+	}
+	xSemaphoreGive(outbox->lock);
+}
+
+uint32_t mqtt_outbox_pending(mqtt_outbox_t* outbox)
+{
+	return (outbox->head + outbox->slot_count - outbox->tail) % outbox->slot_count;
+}
+
+uint32_t mqtt_outbox_inflight(mqtt_outbox_t* outbox)
+{
+	return outbox->inflight_count;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static esp_err_t write_record(mqtt_outbox_t* outbox, mqtt_outbox_record_t* record)
+{
+	esp_err_t ret;
+
+	xSemaphoreTake(outbox->lock, portMAX_DELAY);
+
+	make_room(outbox);
+
+	record->seq = outbox->next_seq;
+	ret = esp_partition_write(outbox->partition, outbox->head * MQTT_OUTBOX_RECORD_SIZE, record, MQTT_OUTBOX_RECORD_SIZE);
+	if (ret == ESP_OK)
+	{
+		outbox->head = next_slot(outbox, outbox->head);
+		outbox->next_seq++;
+		outbox->stored++;
+	}
+	else
+	{
+		ESP_LOGE(TAG, "Could not write record %u (%s).", record->seq, esp_err_to_name(ret));
+	}
+
+	xSemaphoreGive(outbox->lock);
+
+	return ret;
+}
+
+static esp_err_t read_header(mqtt_outbox_t* outbox, uint32_t slot, mqtt_outbox_record_t* record)
+{
+	return esp_partition_read(outbox->partition, slot * MQTT_OUTBOX_RECORD_SIZE, record, MQTT_OUTBOX_HEADER_SIZE);
+}
+
+static uint8_t is_pending(mqtt_outbox_record_t* record)
+{
+	return (record->magic == MQTT_OUTBOX_RECORD_MAGIC && record->acked == MQTT_OUTBOX_ERASED_WORD);
+}
+
+static uint32_t next_slot(mqtt_outbox_t* outbox, uint32_t slot)
+{
+	return (slot + 1) % outbox->slot_count;
+}
+
+static int32_t find_inflight_slot(mqtt_outbox_t* outbox, uint32_t slot)
+{
+	uint32_t index;
+	for (index = 0; index < outbox->inflight_count; index++)
+	{
+		if (outbox->inflight[index].slot == slot)
+		{
+			return index;
+		}
+	}
+	return -1;
+}
+
+static void remove_inflight(mqtt_outbox_t* outbox, uint32_t index)
+{
+	outbox->inflight_count--;
+	outbox->inflight[index] = outbox->inflight[outbox->inflight_count];
+}
+
+static esp_err_t ack_inflight(mqtt_outbox_t* outbox, uint32_t index)
+{
+	mqtt_outbox_record_t header;
+	mqtt_outbox_inflight_t* inflight = &outbox->inflight[index];
+	const uint32_t acked_word = 0;
+	esp_err_t ret;
+
+	// the slot could have been reused if the ring wrapped while the publish was in flight
+	ret = read_header(outbox, inflight->slot, &header);
+	if (ret == ESP_OK && is_pending(&header) && header.seq == inflight->seq)
+	{
+		ret = esp_partition_write(outbox->partition, inflight->slot * MQTT_OUTBOX_RECORD_SIZE + MQTT_OUTBOX_ACKED_OFFSET,
+									&acked_word, sizeof(acked_word));
+		if (ret == ESP_OK)
+		{
+			outbox->acked++;
+		}
+	}
+
+	remove_inflight(outbox, index);
+	advance_tail(outbox);
+
+	return ret;
+}
+
+static void advance_tail(mqtt_outbox_t* outbox)
+{
+	mqtt_outbox_record_t header;
+
+	while (outbox->tail != outbox->head)
+	{
+		if (read_header(outbox, outbox->tail, &header) == ESP_OK && is_pending(&header))
+		{
+			break;
+		}
+		outbox->tail = next_slot(outbox, outbox->tail);
+	}
+}
+
+static void make_room(mqtt_outbox_t* outbox)
+{
+	mqtt_outbox_record_t header;
+	uint32_t sector_start, sector_end, slot;
+	uint8_t empty = (outbox->tail == outbox->head);
+	int32_t index;
+
+	// a slot that is not erased in the middle of a sector means an interrupted write,
+	// skip the rest of that sector instead of writing over it
+	if (outbox->head % SLOTS_PER_SECTOR != 0)
+	{
+		if (read_header(outbox, outbox->head, &header) == ESP_OK && header.magic == MQTT_OUTBOX_ERASED_WORD)
+		{
+			return;
+		}
+		outbox->head = ((outbox->head / SLOTS_PER_SECTOR + 1) * SLOTS_PER_SECTOR) % outbox->slot_count;
+	}
+
+	sector_start = outbox->head;
+	sector_end = (sector_start + SLOTS_PER_SECTOR) % outbox->slot_count;
+
+	// ring full: the oldest records live in the sector about to be erased
+	if (!empty &&
+		outbox->tail >= sector_start && outbox->tail < sector_start + SLOTS_PER_SECTOR)
+	{
+		for (slot = outbox->tail; slot < sector_start + SLOTS_PER_SECTOR; slot++)
+		{
+			if (read_header(outbox, slot, &header) == ESP_OK && is_pending(&header))
+			{
+				outbox->dropped++;
+			}
+
+			index = find_inflight_slot(outbox, slot);
+			if (index >= 0)
+			{
+				remove_inflight(outbox, index);
+			}
+		}
+
+		ESP_LOGW(TAG, "Outbox full, %u records dropped so far.", outbox->dropped);
+		outbox->tail = sector_end;
+		advance_tail(outbox);
+	}
+
+	// one erase every SLOTS_PER_SECTOR records keeps the write latency bounded
+	esp_partition_erase_range(outbox->partition, sector_start * MQTT_OUTBOX_RECORD_SIZE, MQTT_OUTBOX_SECTOR_SIZE);
+
+	if (empty)
+	{
+		outbox->tail = sector_start;
+	}
+}
@@ -0,0 +1,209 @@
+/* ===== [mqtt_scheduler.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "mqtt_scheduler.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+
+/* ===== Macros of private constants ===== */
+
+
+/* ===== Declaration of private or external variables ===== */
+
+
+/* ===== Prototypes of private functions ===== */
+static void mqtt_scheduler_refill(mqtt_scheduler_t* scheduler);
+static UBaseType_t mqtt_scheduler_queued(mqtt_scheduler_t* scheduler);
+
+
+/* ===== Implementations of public functions ===== */
+int8_t mqtt_scheduler_init(mqtt_scheduler_t* scheduler, uint32_t burst, uint32_t period_ms, uint32_t queue_len)
+{
+	memset(scheduler, 0, sizeof(mqtt_scheduler_t));
+	scheduler->burst 		= (burst > 0) ? burst : 1;
+	scheduler->period_ms 	= (period_ms > 0) ? period_ms : 1;
+	scheduler->tokens 		= scheduler->burst;
+	scheduler->last_refill 	= xTaskGetTickCount();
+
+	scheduler->queue = xQueueCreate(queue_len, sizeof(mqtt_publish_msg_t));
+	if (scheduler->queue == NULL)
+	{
+		return -1;
+	}
+
+	scheduler->high_queue = xQueueCreate(MQTT_SCHEDULER_HIGH_QUEUE_LEN, sizeof(mqtt_publish_msg_t));
+	if (scheduler->high_queue == NULL)
+	{
+		vQueueDelete(scheduler->queue);
+		scheduler->queue = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+BaseType_t mqtt_scheduler_enqueue(mqtt_scheduler_t* scheduler, mqtt_publish_priority_t priority,
+									const char* topic, const char* payload, uint16_t payload_len)
+{
+	mqtt_publish_msg_t msg;
+	BaseType_t xStatus;
+
+	if (payload_len > MQTT_SCHEDULER_PAYLOAD_MAX_SIZE)
+	{
+		scheduler->stats.dropped++;
+		return pdFAIL;
+	}
+
+	msg.topic 			= topic;
+	msg.payload_len 	= payload_len;
+	msg.priority 		= priority;
+	msg.enqueue_tick 	= xTaskGetTickCount();
+	memcpy(msg.payload, payload, payload_len);
+
+	// high priority messages have their own queue, so they jump ahead of the normal ones but keep their order
+	if (priority == MQTT_PRIORITY_HIGH)
+	{
+		xStatus = xQueueSendToBack(scheduler->high_queue, &msg, 0);
+	}
+	else
+	{
+		xStatus = xQueueSendToBack(scheduler->queue, &msg, 0);
+	}
+
+	if (xStatus != pdPASS)
+	{
+		scheduler->stats.dropped++;
+	}
+
+	return xStatus;
+}
+
+BaseType_t mqtt_scheduler_dequeue(mqtt_scheduler_t* scheduler, mqtt_publish_msg_t* msg)
+{
+	uint32_t delay_ms;
+
+	mqtt_scheduler_refill(scheduler);
+	if (scheduler->tokens == 0)
+	{
+		return pdFAIL;
+	}
+
+	if (xQueueReceive(scheduler->high_queue, msg, 0) != pdPASS &&
+		xQueueReceive(scheduler->queue, msg, 0) != pdPASS)
+	{
+		return pdFAIL;
+	}
+
+	scheduler->tokens--;
+
+	delay_ms = (xTaskGetTickCount() - msg->enqueue_tick) * portTICK_PERIOD_MS;
+	scheduler->stats.sent++;
+	scheduler->stats.total_delay_ms += delay_ms;
+	if (delay_ms > scheduler->stats.max_delay_ms)
+	{
+		scheduler->stats.max_delay_ms = delay_ms;
+	}
+
+	return pdPASS;
+}
+
+BaseType_t mqtt_scheduler_take_token(mqtt_scheduler_t* scheduler)
+{
+	mqtt_scheduler_refill(scheduler);
+	if (scheduler->tokens == 0)
+	{
+		return pdFAIL;
+	}
+
+	scheduler->tokens--;
+
+	return pdPASS;
+}
+
+TickType_t mqtt_scheduler_wait_ticks(mqtt_scheduler_t* scheduler, uint8_t external_waiting)
+{
+	TickType_t next_token_tick;
+	TickType_t now;
+
+	if (mqtt_scheduler_queued(scheduler) == 0 && !external_waiting)
+	{
+		return portMAX_DELAY;
+	}
+
+	mqtt_scheduler_refill(scheduler);
+	if (scheduler->tokens > 0)
+	{
+		return 0;
+	}
+
+	now = xTaskGetTickCount();
+	next_token_tick = scheduler->last_refill + pdMS_TO_TICKS(scheduler->period_ms);
+	if ((int32_t)(next_token_tick - now) <= 0)
+	{
+		return 1;
+	}
+
+	return next_token_tick - now;
+}
+
+void mqtt_scheduler_log_stats(mqtt_scheduler_t* scheduler, const char* tag)
+{
+	mqtt_scheduler_stats_t* stats = &scheduler->stats;
+	uint32_t average_delay_ms = (stats->sent > 0) ? (uint32_t)(stats->total_delay_ms / stats->sent) : 0;
+
+	ESP_LOGI(tag, "Publish scheduler: sent = %u, dropped = %u, queued = %u, delay avg = %u ms, max = %u ms.",
+			stats->sent, stats->dropped, mqtt_scheduler_queued(scheduler),
+			average_delay_ms, stats->max_delay_ms);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void mqtt_scheduler_refill(mqtt_scheduler_t* scheduler)
+{
+	TickType_t now = xTaskGetTickCount();
+	TickType_t period_ticks = pdMS_TO_TICKS(scheduler->period_ms);
+	uint32_t new_tokens;
+
+	if (scheduler->tokens >= scheduler->burst)
+	{
+		scheduler->last_refill = now;
+		return;
+	}
+
+	if (period_ticks == 0)
+	{
+		period_ticks = 1;
+	}
+
+	new_tokens = (now - scheduler->last_refill) / period_ticks;
+	if (new_tokens == 0)
+	{
+		return;
+	}
+
+	// keep the remainder so the long term rate is exactly one token per period
+	scheduler->last_refill += new_tokens * period_ticks;
+	scheduler->tokens += new_tokens;
+	if (scheduler->tokens >= scheduler->burst)
+	{
+		scheduler->tokens = scheduler->burst;
+		scheduler->last_refill = now;
+	}
+}
+
+static UBaseType_t mqtt_scheduler_queued(mqtt_scheduler_t* scheduler)
+{
+	return uxQueueMessagesWaiting(scheduler->high_queue) + uxQueueMessagesWaiting(scheduler->queue);
+}
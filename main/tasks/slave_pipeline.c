@@ -0,0 +1,194 @@
+/* ===== [slave_pipeline.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "slave_pipeline.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include "esp_log.h"
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define SLAVE_PIPELINE_FREE     0       // seq 0 is never used, it marks a free entry
+
+
+/* ===== Declaration of private or external variables ===== */
+extern QueueHandle_t queue_i2c_master;
+
+// only used from the command processor task
+static slave_pending_t pending[SLAVE_PIPELINE_DEPTH];
+static uint8_t in_flight = 0;
+static uint16_t next_seq = 1;
+static slave_pipeline_stats_t pipeline_stats;
+static const char* TAG = "SLAVE_PIPELINE";
+
+/* ===== Prototypes of private functions ===== */
+static int8_t find_entry(uint16_t seq);
+
+
+/* ===== Implementations of public functions ===== */
+uint16_t slave_pipeline_issue(command_type_t command, rx_module_t requester, uint16_t request_id,
+                              const command_trace_t* trace)
+{
+    slave_request_t request;
+    int8_t entry = find_entry(SLAVE_PIPELINE_FREE);
+
+    if (entry < 0)
+    {
+        pipeline_stats.rejected++;
+        ESP_LOGE(TAG, "%d operations in flight, %s rejected.", SLAVE_PIPELINE_DEPTH, translate_command_type(command));
+        return SLAVE_PIPELINE_FREE;
+    }
+
+    request.seq = next_seq++;
+    if (next_seq == SLAVE_PIPELINE_FREE)
+    {
+        next_seq++;
+    }
+    request.command = command;
+
+    // the I2C master runs the requests in order, the completion comes back through the command queue
+    if (xQueueSendToBack(queue_i2c_master, &request, 0) != pdPASS)
+    {
+        pipeline_stats.rejected++;
+        ESP_LOGE(TAG, "I2C master queue full, %s rejected.", translate_command_type(command));
+        return SLAVE_PIPELINE_FREE;
+    }
+
+    pending[entry].seq = request.seq;
+    pending[entry].command = command;
+    pending[entry].requester = requester;
+    pending[entry].request_id = request_id;
+    pending[entry].deadline = xTaskGetTickCount() + SLAVE_PIPELINE_TIMEOUT_MS / portTICK_RATE_MS;
+    if (trace != NULL)
+    {
+        pending[entry].trace = *trace;
+    }
+    else
+    {
+        memset(&pending[entry].trace, 0, sizeof(command_trace_t));
+    }
+
+    in_flight++;
+    pipeline_stats.issued++;
+    if (in_flight > pipeline_stats.max_in_flight)
+    {
+        pipeline_stats.max_in_flight = in_flight;
+    }
+
+    return request.seq;
+}
+
+uint8_t slave_pipeline_has_room(void)
+{
+    return in_flight < SLAVE_PIPELINE_DEPTH;
+}
+
+uint8_t slave_pipeline_complete(const rx_command_t* completion, slave_pending_t* operation)
+{
+    int8_t entry;
+
+    if (completion->seq == SLAVE_PIPELINE_FREE || (entry = find_entry(completion->seq)) < 0)
+    {
+        pipeline_stats.late++;
+        ESP_LOGW(TAG, "Completion for unknown or expired operation %u.", completion->seq);
+        return 0;
+    }
+
+    *operation = pending[entry];
+    pending[entry].seq = SLAVE_PIPELINE_FREE;
+    in_flight--;
+
+    if (completion->command == CMD_SLAVE_OK)
+    {
+        pipeline_stats.completed++;
+    }
+    else
+    {
+        pipeline_stats.failed++;
+    }
+
+    return 1;
+}
+
+uint8_t slave_pipeline_expire(slave_pending_t* operation)
+{
+    TickType_t now = xTaskGetTickCount();
+    uint8_t i;
+
+    for (i = 0; i < SLAVE_PIPELINE_DEPTH; i++)
+    {
+        if (pending[i].seq != SLAVE_PIPELINE_FREE && tick_deadline_passed(pending[i].deadline, now))
+        {
+            *operation = pending[i];
+            pending[i].seq = SLAVE_PIPELINE_FREE;
+            in_flight--;
+            pipeline_stats.timeouts++;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+TickType_t slave_pipeline_wait_ticks(void)
+{
+    TickType_t now = xTaskGetTickCount();
+    TickType_t wait_ticks = portMAX_DELAY;
+    uint8_t i;
+
+    for (i = 0; i < SLAVE_PIPELINE_DEPTH; i++)
+    {
+        if (pending[i].seq == SLAVE_PIPELINE_FREE)
+        {
+            continue;
+        }
+        if (tick_deadline_passed(pending[i].deadline, now))
+        {
+            return 0;
+        }
+        if (pending[i].deadline - now < wait_ticks)
+        {
+            wait_ticks = pending[i].deadline - now;
+        }
+    }
+
+    return wait_ticks;
+}
+
+uint8_t tick_deadline_passed(TickType_t deadline, TickType_t now)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+void slave_pipeline_get_stats(slave_pipeline_stats_t* stats)
+{
+    *stats = pipeline_stats;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static int8_t find_entry(uint16_t seq)
+{
+    uint8_t i;
+
+    for (i = 0; i < SLAVE_PIPELINE_DEPTH; i++)
+    {
+        if (pending[i].seq == seq)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
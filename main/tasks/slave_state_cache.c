@@ -0,0 +1,191 @@
+/* ===== [slave_state_cache.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "slave_state_cache.h"
+#include "slave_pipeline.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+
+
+/* ===== Macros of private constants ===== */
+#define SLAVE_STATE_CACHE_TTL_TICKS     (CONFIG_SLAVE_STATE_CACHE_TTL_MS / portTICK_RATE_MS)
+
+
+/* ===== Declaration of private or external variables ===== */
+// only used from the command processor task
+static uint8_t cache_valid = 0;
+static uint8_t cache_state;
+static TickType_t cache_expires;
+// incremented by every slave command, a read older than that is not cached
+static uint32_t cache_generation = 0;
+
+static uint8_t read_in_flight = 0;
+static uint16_t read_seq;
+static uint32_t read_generation;
+static slave_waiter_t read_waiters[SLAVE_STATE_CACHE_WAITERS];
+static uint8_t read_waiter_count = 0;
+// requests the read in flight can not answer (older than the last slave command, or full), read next
+static slave_waiter_t next_waiters[SLAVE_STATE_CACHE_WAITERS];
+static uint8_t next_waiter_count = 0;
+
+static slave_state_cache_stats_t cache_stats;
+static const char* TAG = "SLAVE_STATE_CACHE";
+
+/* ===== Prototypes of private functions ===== */
+static uint8_t cache_fresh(TickType_t now);
+static uint8_t read_joinable(void);
+
+
+/* ===== Implementations of public functions ===== */
+slave_cache_result_t slave_state_cache_request(rx_module_t requester, uint16_t request_id, uint8_t* state)
+{
+    cache_stats.requests++;
+
+    if (cache_fresh(xTaskGetTickCount()))
+    {
+        cache_stats.hits++;
+        *state = cache_state;
+        return SLAVE_CACHE_HIT;
+    }
+
+    if (read_in_flight)
+    {
+        if (read_joinable())
+        {
+            read_waiters[read_waiter_count].requester = requester;
+            read_waiters[read_waiter_count].request_id = request_id;
+            read_waiter_count++;
+            cache_stats.coalesced++;
+            return SLAVE_CACHE_JOINED;
+        }
+        // the read in flight could be from before the last slave command, the next one is issued after it
+        if (next_waiter_count < SLAVE_STATE_CACHE_WAITERS)
+        {
+            next_waiters[next_waiter_count].requester = requester;
+            next_waiters[next_waiter_count].request_id = request_id;
+            next_waiter_count++;
+            cache_stats.coalesced++;
+            return SLAVE_CACHE_JOINED;
+        }
+        return SLAVE_CACHE_READ_OWN;
+    }
+
+    read_in_flight = 1;
+    read_seq = 0;
+    read_generation = cache_generation;
+    read_waiters[0].requester = requester;
+    read_waiters[0].request_id = request_id;
+    read_waiter_count = 1;
+    return SLAVE_CACHE_READ_SHARED;
+}
+
+uint8_t slave_state_cache_needs_read(void)
+{
+    if (cache_fresh(xTaskGetTickCount()) || (read_in_flight && read_joinable()))
+    {
+        return 0;
+    }
+    return !read_in_flight || next_waiter_count >= SLAVE_STATE_CACHE_WAITERS;
+}
+
+void slave_state_cache_read_issued(uint16_t seq, uint8_t shared)
+{
+    if (shared)
+    {
+        read_seq = seq;
+    }
+    if (seq != 0)
+    {
+        cache_stats.reads++;
+    }
+}
+
+uint8_t slave_state_cache_read_done(uint16_t seq, uint8_t state, slave_waiter_t* waiters)
+{
+    uint8_t count = read_waiter_count;
+    uint8_t i;
+
+    if (!read_in_flight || seq != read_seq)
+    {
+        return 0;
+    }
+
+    if (state != SLAVE_STATE_ERROR && read_generation == cache_generation)
+    {
+        cache_valid = 1;
+        cache_state = state;
+        cache_expires = xTaskGetTickCount() + SLAVE_STATE_CACHE_TTL_TICKS;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        waiters[i] = read_waiters[i];
+    }
+    read_in_flight = 0;
+    read_waiter_count = 0;
+
+    // the requests that waited for this read become the next shared read
+    if (next_waiter_count > 0)
+    {
+        read_in_flight = 1;
+        read_seq = 0;
+        read_generation = cache_generation;
+        for (i = 0; i < next_waiter_count; i++)
+        {
+            read_waiters[i] = next_waiters[i];
+        }
+        read_waiter_count = next_waiter_count;
+        next_waiter_count = 0;
+    }
+
+    ESP_LOGI(TAG, "%u requests, %u hits, %u coalesced, %u reads (hit rate %u%%).", cache_stats.requests,
+             cache_stats.hits, cache_stats.coalesced, cache_stats.reads,
+             100 * (cache_stats.hits + cache_stats.coalesced) / cache_stats.requests);
+
+    return count;
+}
+
+uint8_t slave_state_cache_next_read(slave_waiter_t* first)
+{
+    // opened by slave_state_cache_read_done, not issued yet
+    if (!read_in_flight || read_seq != 0)
+    {
+        return 0;
+    }
+    *first = read_waiters[0];
+    return 1;
+}
+
+void slave_state_cache_invalidate(void)
+{
+    cache_valid = 0;
+    cache_generation++;
+    cache_stats.invalidations++;
+}
+
+void slave_state_cache_get_stats(slave_state_cache_stats_t* stats)
+{
+    *stats = cache_stats;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static uint8_t cache_fresh(TickType_t now)
+{
+    return cache_valid && !tick_deadline_passed(cache_expires, now);
+}
+
+static uint8_t read_joinable(void)
+{
+    return read_generation == cache_generation && read_waiter_count < SLAVE_STATE_CACHE_WAITERS;
+}
@@ -12,6 +12,7 @@
 #include "http_client.h"
 #include "tls_https_client.h"
 #include "command_processor.h"
+#include "message_bus.h"
 
 #include <stdio.h>
 #include <string.h>
@@ -23,6 +24,7 @@
 #include "esp_wifi.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 
 /* ===== Macros of private constants ===== */
@@ -34,7 +36,6 @@
 #define RX_BUFFER_SIZE 			128
 
 /* ===== Declaration of private or external variables ===== */
-extern QueueHandle_t queue_command_processor_rx;
 extern EventGroupHandle_t wifi_event_group;
 
 // the PEM file was extracted from the output of this command:
@@ -46,7 +47,6 @@ extern const uint8_t thingspeak_https_cert_end[]   asm("_binary_thingspeak_https
 static const int CONNECTED_BIT = BIT0;
 static const char *TAG = "TLS_HTTPS_TASK";
 
-QueueHandle_t queue_tls_https_tx;
 
 
 /* ===== Prototypes of private functions ===== */
@@ -59,10 +59,8 @@ void wifi_secure_tx_task(void *pvParameter)
 	char content_buf[RX_BUFFER_SIZE];
 	int ret;
 
-	// create a queue capable of containing 5 uint8_t values
-    queue_tls_https_tx = xQueueCreate(5, sizeof(uint8_t));
-    if (queue_tls_https_tx == NULL)	{
-        ESP_LOGE(TAG, "Could not create queue_tls_https_tx.");
+    if (message_bus_register(HTTPS_RX, MESSAGE_BUS_QUEUE_LEN) != 0)	{
+        ESP_LOGE(TAG, "Could not create the HTTPS TX queue.");
     }
 
 	xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, portMAX_DELAY);
@@ -75,6 +73,7 @@ void wifi_secure_tx_task(void *pvParameter)
 	}
 
 	BaseType_t xStatus;
+	tx_message_t tx_message;
 	uint8_t queue_rcv_value;
 	char request_buffer[strlen(HTTP_REQUEST_WRITE)];
 
@@ -83,8 +82,9 @@ void wifi_secure_tx_task(void *pvParameter)
 		xEventGroupWaitBits(wifi_event_group, CONNECTED_BIT, false, true, portMAX_DELAY);
 
 		// read data from the queue
-		xStatus = xQueueReceive(queue_tls_https_tx, &queue_rcv_value,  20 / portTICK_RATE_MS);
+		xStatus = message_bus_receive(HTTPS_RX, &tx_message,  20 / portTICK_RATE_MS);
 		if (xStatus == pdPASS)	{
+			queue_rcv_value = message_bus_value(&tx_message);
 			ESP_LOGI(TAG, "Received from Command Processor TASK: %d", queue_rcv_value);
 			sprintf(request_buffer, HTTP_REQUEST_WRITE, queue_rcv_value);
 
@@ -128,7 +128,7 @@ void wifi_secure_rx_cmd_task(void * pvParameter)
 	BaseType_t xStatus;
 
 	// command to send to the command processor
-	rx_command_t tls_https_command;
+	rx_command_t tls_https_command = { 0 };
     tls_https_command.rx_id = HTTPS_RX;
 
 	mbedtls_connection_handler_t mbedtls_handler;
@@ -152,6 +152,8 @@ void wifi_secure_rx_cmd_task(void * pvParameter)
 		ESP_LOGI(TAG, "Receiving HTTP response.\n");
 		content_buf[0] = '\0';
 		int flag_rsp_ok = tls_receive_http_response(&mbedtls_handler, recv_buf, content_buf, RX_BUFFER_SIZE);
+		// the TalkBack response is the ingress of its command
+		tls_https_command.ingress_us = esp_timer_get_time();
 
 		tls_clean_up(&mbedtls_handler, ret);
 
@@ -163,8 +165,7 @@ void wifi_secure_rx_cmd_task(void * pvParameter)
 			if (pch != NULL)	{
 				ESP_LOGI(TAG, "Received new command: %s", content_buf);
 
-				tls_https_command.command = str_to_cmd(content_buf);
-				xStatus = xQueueSendToBack(queue_command_processor_rx, &tls_https_command, 1000 / portTICK_RATE_MS);
+				xStatus = command_processor_submit_text(&tls_https_command, content_buf, 1000 / portTICK_RATE_MS);
 	            if (xStatus != pdPASS)	{
 	                ESP_LOGE(TAG, "Could not send the data to the queue.");
 	            }
@@ -0,0 +1,51 @@
+// https://raw.githubusercontent.com/zhicheng/base64/master/base64.c
+/* This is a public domain base64 implementation written by WEI Zhicheng. */
+/* Byte at a time encoder that was used before the 3 bytes -> 4 characters rewrite. */
+
+#include "base64_url_reference.h"
+
+static const char base64en[] = {
+	'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
+	'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
+	'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+	'Y', 'Z', 'a', 'b', 'c', 'd', 'e', 'f',
+	'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n',
+	'o', 'p', 'q', 'r', 's', 't', 'u', 'v',
+	'w', 'x', 'y', 'z', '0', '1', '2', '3',
+	'4', '5', '6', '7', '8', '9', '-', '_',
+};
+
+int base64url_encode_reference(const unsigned char *in, unsigned int inlen, char *out)
+{
+	unsigned int i, j;
+
+	for (i = j = 0; i < inlen; i++) {
+		int s = i % 3; 			/* from 6/gcd(6, 8) */
+
+		switch (s) {
+		case 0:
+			out[j++] = base64en[(in[i] >> 2) & 0x3F];
+			continue;
+		case 1:
+			out[j++] = base64en[((in[i-1] & 0x3) << 4) + ((in[i] >> 4) & 0xF)];
+			continue;
+		case 2:
+			out[j++] = base64en[((in[i-1] & 0xF) << 2) + ((in[i] >> 6) & 0x3)];
+			out[j++] = base64en[in[i] & 0x3F];
+		}
+	}
+
+	/* move back */
+	i -= 1;
+
+	/* check the last */
+	if ((i % 3) == 0) {
+		out[j++] = base64en[(in[i] & 0x3) << 4];
+	} else if ((i % 3) == 1) {
+		out[j++] = base64en[(in[i] & 0xF) << 2];
+	}
+
+	out[j++] = 0;
+
+	return 0;
+}
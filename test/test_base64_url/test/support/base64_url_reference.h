@@ -0,0 +1,18 @@
+/* ===== [base64_url_reference.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __BASE64_URL_REFERENCE_H__
+#define __BASE64_URL_REFERENCE_H__
+
+/* ===== Prototypes of public functions ===== */
+// previous byte at a time encoder, only used as benchmark baseline
+int base64url_encode_reference(const unsigned char *in, unsigned int inlen, char *out);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __BASE64_URL_REFERENCE_H__
@@ -0,0 +1,219 @@
+/* ===== [test_base64_url.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "base64_url.h"
+#include "base64_url_reference.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Macros of private constants ===== */
+#define NUMBER_OF_VECTORS       7
+#define MAX_TEST_LENGTH         300
+#define BENCHMARK_INPUT_SIZE    256     // about the size of an RS256 signature
+#define BENCHMARK_ITERATIONS    20000
+
+/* ===== Declaration of private or external variables ===== */
+// RFC 4648 test vectors, without padding
+static const char* plain_vectors[NUMBER_OF_VECTORS] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+static const char* encoded_vectors[NUMBER_OF_VECTORS] = {"", "Zg", "Zm8", "Zm9v", "Zm9vYg", "Zm9vYmE", "Zm9vYmFy"};
+
+static unsigned char input[MAX_TEST_LENGTH];
+static char encoded[BASE64URL_ENCODE_OUT_SIZE(MAX_TEST_LENGTH) + 1];
+static char reference[BASE64URL_ENCODE_OUT_SIZE(MAX_TEST_LENGTH) + 1];
+static unsigned char decoded[MAX_TEST_LENGTH];
+
+/* ===== Prototypes of private functions ===== */
+static void fill_input(unsigned int len);
+static double elapsed_ms(clock_t start);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    fill_input(MAX_TEST_LENGTH);
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_encode_vectors
+| ------------------------------------------------------------------
+|  Description: tests the RFC 4648 vectors (all tail lengths).
+*-------------------------------------------------------------------*/
+void test_encode_vectors(void)  {
+    uint8_t i;
+    for (i = 0; i < NUMBER_OF_VECTORS; i++)
+    {
+        TEST_ASSERT_EQUAL(BASE64_OK, base64url_encode((const unsigned char*)plain_vectors[i], strlen(plain_vectors[i]), encoded));
+        TEST_ASSERT_EQUAL_STRING(encoded_vectors[i], encoded);
+    }
+}
+
+/*------------------------------------------------------------------
+|  Test: test_encode_url_alphabet
+| ------------------------------------------------------------------
+|  Description: tests that '-' and '_' are used instead of '+'
+|               and '/'.
+*-------------------------------------------------------------------*/
+void test_encode_url_alphabet(void)  {
+    const unsigned char data[] = {0xFB, 0xFF, 0xBF};
+    base64url_encode(data, sizeof(data), encoded);
+    TEST_ASSERT_EQUAL_STRING("-_-_", encoded);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_encode_matches_reference
+| ------------------------------------------------------------------
+|  Description: tests that the new encoder gives the same output as
+|               the previous one for every length.
+*-------------------------------------------------------------------*/
+void test_encode_matches_reference(void)  {
+    unsigned int len;
+    for (len = 1; len <= MAX_TEST_LENGTH; len++)
+    {
+        base64url_encode(input, len, encoded);
+        base64url_encode_reference(input, len, reference);
+        TEST_ASSERT_EQUAL_STRING(reference, encoded);
+    }
+}
+
+/*------------------------------------------------------------------
+|  Test: test_encoded_len
+| ------------------------------------------------------------------
+|  Description: tests that the length helper is exact.
+*-------------------------------------------------------------------*/
+void test_encoded_len(void)  {
+    unsigned int len;
+    for (len = 0; len <= MAX_TEST_LENGTH; len++)
+    {
+        base64url_encode(input, len, encoded);
+        TEST_ASSERT_EQUAL_UINT(strlen(encoded), base64url_encoded_len(len));
+    }
+}
+
+/*------------------------------------------------------------------
+|  Test: test_decode_vectors
+| ------------------------------------------------------------------
+|  Description: tests decoding of the RFC 4648 vectors.
+*-------------------------------------------------------------------*/
+void test_decode_vectors(void)  {
+    uint8_t i;
+    unsigned int len;
+    for (i = 0; i < NUMBER_OF_VECTORS; i++)
+    {
+        len = base64url_decoded_len(encoded_vectors[i], strlen(encoded_vectors[i]));
+        TEST_ASSERT_EQUAL_UINT(strlen(plain_vectors[i]), len);
+        TEST_ASSERT_EQUAL(BASE64_OK, base64url_decode(encoded_vectors[i], strlen(encoded_vectors[i]), decoded));
+        if (len > 0)
+        {
+            TEST_ASSERT_EQUAL_MEMORY(plain_vectors[i], decoded, len);
+        }
+    }
+}
+
+/*------------------------------------------------------------------
+|  Test: test_decode_padding
+| ------------------------------------------------------------------
+|  Description: tests that optional '=' padding is ignored.
+*-------------------------------------------------------------------*/
+void test_decode_padding(void)  {
+    TEST_ASSERT_EQUAL_UINT(1, base64url_decoded_len("Zg==", 4));
+    TEST_ASSERT_EQUAL(BASE64_OK, base64url_decode("Zg==", 4, decoded));
+    TEST_ASSERT_EQUAL_UINT8('f', decoded[0]);
+
+    TEST_ASSERT_EQUAL_UINT(2, base64url_decoded_len("Zm8=", 4));
+    TEST_ASSERT_EQUAL(BASE64_OK, base64url_decode("Zm8=", 4, decoded));
+    TEST_ASSERT_EQUAL_MEMORY("fo", decoded, 2);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_decode_invalid
+| ------------------------------------------------------------------
+|  Description: tests invalid characters and lengths.
+*-------------------------------------------------------------------*/
+void test_decode_invalid(void)  {
+    TEST_ASSERT_EQUAL(BASE64_INVALID, base64url_decode("Zm9v!mFy", 8, decoded));
+    TEST_ASSERT_EQUAL(BASE64_INVALID, base64url_decode("Zm9vY", 5, decoded));
+    TEST_ASSERT_EQUAL(BASE64_INVALID, base64url_decode("Zm9vY\x80", 6, decoded));
+    TEST_ASSERT_EQUAL_UINT(0, base64url_decoded_len("Zm9vY", 5));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_round_trip
+| ------------------------------------------------------------------
+|  Description: tests encode + decode for every length.
+*-------------------------------------------------------------------*/
+void test_round_trip(void)  {
+    unsigned int len;
+    for (len = 0; len <= MAX_TEST_LENGTH; len++)
+    {
+        base64url_encode(input, len, encoded);
+        TEST_ASSERT_EQUAL_UINT(len, base64url_decoded_len(encoded, strlen(encoded)));
+        TEST_ASSERT_EQUAL(BASE64_OK, base64url_decode(encoded, strlen(encoded), decoded));
+        if (len > 0)
+        {
+            TEST_ASSERT_EQUAL_MEMORY(input, decoded, len);
+        }
+    }
+}
+
+/*------------------------------------------------------------------
+|  Test: test_benchmark_encode
+| ------------------------------------------------------------------
+|  Description: compares the encoder throughput with the previous
+|               implementation (only reported, never fails).
+*-------------------------------------------------------------------*/
+void test_benchmark_encode(void)  {
+    char message[128];
+    clock_t start;
+    double new_ms, reference_ms;
+    uint32_t i;
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        input[0] = (unsigned char)i;
+        base64url_encode(input, BENCHMARK_INPUT_SIZE, encoded);
+    }
+    new_ms = elapsed_ms(start);
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        input[0] = (unsigned char)i;
+        base64url_encode_reference(input, BENCHMARK_INPUT_SIZE, reference);
+    }
+    reference_ms = elapsed_ms(start);
+
+    snprintf(message, sizeof(message), "encode %d x %d bytes: new = %.2f ms (%.1f MB/s), reference = %.2f ms (%.1f MB/s)",
+             BENCHMARK_ITERATIONS, BENCHMARK_INPUT_SIZE,
+             new_ms, (BENCHMARK_ITERATIONS * (double)BENCHMARK_INPUT_SIZE) / (new_ms * 1000.0 + 1e-9),
+             reference_ms, (BENCHMARK_ITERATIONS * (double)BENCHMARK_INPUT_SIZE) / (reference_ms * 1000.0 + 1e-9));
+    printf("%s\n", message);
+    TEST_ASSERT_EQUAL_STRING(reference, encoded);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void fill_input(unsigned int len)
+{
+    unsigned int i;
+    for (i = 0; i < len; i++)
+    {
+        input[i] = (unsigned char)(i * 37 + 11);
+    }
+}
+
+static double elapsed_ms(clock_t start)
+{
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
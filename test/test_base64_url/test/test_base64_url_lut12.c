@@ -0,0 +1,80 @@
+/* ===== [test_base64_url_lut12.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "base64_url.h"
+#include "base64_url_reference.h"
+
+#include <string.h>
+
+/* ===== Macros of private constants ===== */
+#define MAX_TEST_LENGTH     300
+
+/* ===== Declaration of private or external variables ===== */
+static unsigned char input[MAX_TEST_LENGTH];
+static char encoded[BASE64URL_ENCODE_OUT_SIZE(MAX_TEST_LENGTH) + 1];
+static char reference[BASE64URL_ENCODE_OUT_SIZE(MAX_TEST_LENGTH) + 1];
+static unsigned char decoded[MAX_TEST_LENGTH];
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    unsigned int i;
+    for (i = 0; i < MAX_TEST_LENGTH; i++)
+    {
+        input[i] = (unsigned char)(i * 37 + 11);
+    }
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_lut12_enabled
+| ------------------------------------------------------------------
+|  Description: checks that this file is built with the 12 bit
+|               lookup table (defined in project.yml).
+*-------------------------------------------------------------------*/
+void test_lut12_enabled(void)  {
+    TEST_ASSERT_EQUAL(1, BASE64URL_LUT12);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_lut12_matches_reference
+| ------------------------------------------------------------------
+|  Description: tests that the table encoder gives the same output
+|               as the previous encoder for every length.
+*-------------------------------------------------------------------*/
+void test_lut12_matches_reference(void)  {
+    unsigned int len;
+    for (len = 1; len <= MAX_TEST_LENGTH; len++)
+    {
+        base64url_encode(input, len, encoded);
+        base64url_encode_reference(input, len, reference);
+        TEST_ASSERT_EQUAL_STRING(reference, encoded);
+    }
+}
+
+/*------------------------------------------------------------------
+|  Test: test_lut12_round_trip
+| ------------------------------------------------------------------
+|  Description: tests encode + decode for every length.
+*-------------------------------------------------------------------*/
+void test_lut12_round_trip(void)  {
+    unsigned int len;
+    for (len = 0; len <= MAX_TEST_LENGTH; len++)
+    {
+        base64url_encode(input, len, encoded);
+        TEST_ASSERT_EQUAL(BASE64_OK, base64url_decode(encoded, strlen(encoded), decoded));
+        if (len > 0)
+        {
+            TEST_ASSERT_EQUAL_MEMORY(input, decoded, len);
+        }
+    }
+}
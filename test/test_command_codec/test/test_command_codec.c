@@ -0,0 +1,231 @@
+/* ===== [test_command_codec.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "command_codec.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Macros of private constants ===== */
+#define BENCHMARK_MESSAGES      8
+#define BENCHMARK_ITERATIONS    200000
+#define LEGACY_COMMANDS         11      // commands known by the strstr chain
+
+/* ===== Declaration of private or external variables ===== */
+#define COMMAND_ROW(name, origin)   { name, #name, origin },
+static const struct {
+    command_type_t  command;
+    const char*     name;
+    uint8_t         origin;
+}   commands[] = {
+    COMMAND_LIST(COMMAND_ROW)
+};
+#undef COMMAND_ROW
+
+// same kind of payloads the firmware gets (ThingSpeak TalkBack, MQTT, HTTP bodies)
+static const char* benchmark_messages[BENCHMARK_MESSAGES] = {
+    "CMD_SLAVE_START_A",
+    "CMD_QUEUE_BENCH",
+    "{\"command\":\"CMD_SLAVE_STATUS\",\"id\":17}",
+    "command=CMD_SLAVE_CONTINUE&device=esp32_real",
+    "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 8\r\n\r\nCMD_ECHO",
+    "CMD_WIFI",
+    "no command in this message at all, only text",
+    "CMD_UNKNOWN_THING",
+};
+
+/* ===== Prototypes of private functions ===== */
+static command_type_t legacy_str_to_cmd(char* str_command);
+static double elapsed_ms(clock_t start);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    TEST_ASSERT_EQUAL(0, command_codec_init());
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_every_command_round_trip
+| ------------------------------------------------------------------
+|  Description: tests that every external command of the list is
+|               decoded from its name, that internal commands are
+|               not, and that the names match the enum.
+*-------------------------------------------------------------------*/
+void test_every_command_round_trip(void)  {
+    uint32_t i;
+
+    TEST_ASSERT_EQUAL(CMD_INVALID + 1, sizeof(commands) / sizeof(commands[0]));
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        TEST_ASSERT_EQUAL(i, commands[i].command);
+        TEST_ASSERT_EQUAL_STRING(commands[i].name, command_name(commands[i].command));
+        if (commands[i].origin == COMMAND_EXTERNAL)
+        {
+            TEST_ASSERT_EQUAL(commands[i].command, command_decode(commands[i].name));
+        }
+        else
+        {
+            TEST_ASSERT_EQUAL(CMD_INVALID, command_decode(commands[i].name));
+        }
+    }
+    TEST_ASSERT_EQUAL_STRING("UNKNOWN", command_name((command_type_t)(CMD_INVALID + 1)));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_whole_token_only
+| ------------------------------------------------------------------
+|  Description: tests that only a whole word matches (the old
+|               substring search accepted longer tokens).
+*-------------------------------------------------------------------*/
+void test_whole_token_only(void)  {
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode("CMD_SLAVE_START_AB"));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode("XCMD_WIFI"));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode("CMD_WIFI2"));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode("CMD_wifi"));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode("CMD_"));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode("CMD"));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode(""));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode(NULL));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_token_inside_text
+| ------------------------------------------------------------------
+|  Description: tests commands surrounded by other text, and that
+|               only the first command word counts.
+*-------------------------------------------------------------------*/
+void test_token_inside_text(void)  {
+    TEST_ASSERT_EQUAL(CMD_SLAVE_PAUSE, command_decode("command=CMD_SLAVE_PAUSE&x=1"));
+    TEST_ASSERT_EQUAL(CMD_SLAVE_STATUS, command_decode("{\"command\":\"CMD_SLAVE_STATUS\"}"));
+    TEST_ASSERT_EQUAL(CMD_BLE, command_decode("\r\n\r\nCMD_BLE\r\n"));
+    TEST_ASSERT_EQUAL(CMD_ECHO, command_decode("XCMD_WIFI CMD_ECHO"));
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode("CMD_NOPE CMD_ECHO"));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_arguments
+| ------------------------------------------------------------------
+|  Description: tests that the arguments start right after the
+|               command word.
+*-------------------------------------------------------------------*/
+void test_arguments(void)  {
+    const char* args = NULL;
+
+    TEST_ASSERT_EQUAL(CMD_SCRIPT_RUN, command_decode_args("CMD_SCRIPT_RUN 2", &args));
+    TEST_ASSERT_EQUAL_STRING(" 2", args);
+    TEST_ASSERT_EQUAL(CMD_WIFI, command_decode_args("x=CMD_WIFI", &args));
+    TEST_ASSERT_EQUAL_STRING("", args);
+
+    args = NULL;
+    TEST_ASSERT_EQUAL(CMD_INVALID, command_decode_args("CMD_NOPE 2", &args));
+    TEST_ASSERT_NULL(args);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_same_result_as_legacy
+| ------------------------------------------------------------------
+|  Description: tests that the plain command messages decode as
+|               they did with the strstr chain (commands added later
+|               are skipped).
+*-------------------------------------------------------------------*/
+void test_same_result_as_legacy(void)  {
+    char message[32];
+    uint32_t compared = 0;
+    uint32_t i;
+
+    for (i = 0; i < sizeof(commands) / sizeof(commands[0]); i++)
+    {
+        strcpy(message, commands[i].name);
+        if (commands[i].origin == COMMAND_EXTERNAL && legacy_str_to_cmd(message) != CMD_INVALID)
+        {
+            TEST_ASSERT_EQUAL(legacy_str_to_cmd(message), command_decode(message));
+            compared++;
+        }
+    }
+    TEST_ASSERT_EQUAL(LEGACY_COMMANDS, compared);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_benchmark_decode
+| ------------------------------------------------------------------
+|  Description: compares the decoder with the strstr chain it
+|               replaces over a set of typical messages.
+*-------------------------------------------------------------------*/
+void test_benchmark_decode(void)  {
+    char messages[BENCHMARK_MESSAGES][96];
+    volatile uint32_t sum = 0;
+    double decode_ms, legacy_ms;
+    clock_t start;
+    uint32_t i;
+
+    for (i = 0; i < BENCHMARK_MESSAGES; i++)
+    {
+        strcpy(messages[i], benchmark_messages[i]);
+    }
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        sum += command_decode(messages[i % BENCHMARK_MESSAGES]);
+    }
+    decode_ms = elapsed_ms(start);
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        sum += legacy_str_to_cmd(messages[i % BENCHMARK_MESSAGES]);
+    }
+    legacy_ms = elapsed_ms(start);
+
+    printf("decode %d messages: hash = %.1f ns/message, strstr chain = %.1f ns/message (seed %u)\n",
+           BENCHMARK_ITERATIONS, decode_ms * 1e6 / BENCHMARK_ITERATIONS, legacy_ms * 1e6 / BENCHMARK_ITERATIONS,
+           command_codec_seed());
+    TEST_ASSERT_NOT_EQUAL(0, sum);
+}
+
+
+/* ===== Implementations of private functions ===== */
+// str_to_cmd before the decoder, kept for the comparison
+static command_type_t legacy_str_to_cmd(char* str_command)
+{
+    if (strstr(str_command, "CMD_SLAVE_START_A") != NULL)
+        return CMD_SLAVE_START_A;
+    if (strstr(str_command, "CMD_SLAVE_START_B") != NULL)
+        return CMD_SLAVE_START_B;
+    if (strstr(str_command, "CMD_SLAVE_PAUSE") != NULL)
+        return CMD_SLAVE_PAUSE;
+    if (strstr(str_command, "CMD_SLAVE_CONTINUE") != NULL)
+        return CMD_SLAVE_CONTINUE;
+    if (strstr(str_command, "CMD_SLAVE_RESET") != NULL)
+        return CMD_SLAVE_RESET;
+    if (strstr(str_command, "CMD_SLAVE_STATUS") != NULL)
+        return CMD_SLAVE_STATUS;
+    if (strstr(str_command, "CMD_WIFI") != NULL)
+        return CMD_WIFI;
+    if (strstr(str_command, "CMD_BLE") != NULL)
+        return CMD_BLE;
+    if (strstr(str_command, "CMD_ECHO") != NULL)
+        return CMD_ECHO;
+    if (strstr(str_command, "CMD_JWT_BENCH") != NULL)
+        return CMD_JWT_BENCH;
+    if (strstr(str_command, "CMD_QUEUE_BENCH") != NULL)
+        return CMD_QUEUE_BENCH;
+
+    return CMD_INVALID;
+}
+
+static double elapsed_ms(clock_t start)
+{
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
@@ -0,0 +1,49 @@
+/* ===== [gpio.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_GPIO_H__
+#define __SIM_GPIO_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+#include "esp_err.h"
+
+/* ===== Public structs and enums ===== */
+typedef int gpio_num_t;
+
+typedef enum {
+    GPIO_MODE_DISABLE,
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+}   gpio_mode_t;
+
+typedef enum {
+    GPIO_PIN_INTR_DISABLE,
+}   gpio_int_type_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE,
+    GPIO_PULLUP_ENABLE,
+}   gpio_pullup_t;
+
+typedef struct {
+    uint64_t        pin_bit_mask;
+    gpio_mode_t     mode;
+    uint32_t        pull_up_en;
+    uint32_t        pull_down_en;
+    gpio_int_type_t intr_type;
+}   gpio_config_t;
+
+
+/* ===== Prototypes of public functions ===== */
+esp_err_t gpio_config(const gpio_config_t* config);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_GPIO_H__
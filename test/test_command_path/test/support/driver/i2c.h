@@ -0,0 +1,84 @@
+/* ===== [i2c.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_I2C_H__
+#define __SIM_I2C_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"        // also included by the ESP-IDF driver
+
+/* ===== Public structs and enums ===== */
+typedef enum {
+    I2C_NUM_0,
+    I2C_NUM_1,
+    I2C_NUM_MAX,
+}   i2c_port_t;
+
+typedef enum {
+    I2C_MODE_SLAVE,
+    I2C_MODE_MASTER,
+}   i2c_mode_t;
+
+typedef enum {
+    I2C_MASTER_WRITE,
+    I2C_MASTER_READ,
+}   i2c_rw_t;
+
+typedef enum {
+    I2C_MASTER_ACK,
+    I2C_MASTER_NACK,
+    I2C_MASTER_LAST_NACK,
+}   i2c_ack_type_t;
+
+typedef struct {
+    i2c_mode_t      mode;
+    int             sda_io_num;
+    gpio_pullup_t   sda_pullup_en;
+    int             scl_io_num;
+    gpio_pullup_t   scl_pullup_en;
+    union {
+        struct {
+            uint32_t    clk_speed;
+        }   master;
+        struct {
+            uint8_t     addr_10bit_en;
+            uint16_t    slave_addr;
+        }   slave;
+    };
+}   i2c_config_t;
+
+typedef struct sim_i2c_cmd* i2c_cmd_handle_t;
+
+
+/* ===== Prototypes of public functions ===== */
+// both ports share one in-memory bus, see sim_drivers.h
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t* i2c_conf);
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len,
+                             int intr_alloc_flags);
+
+i2c_cmd_handle_t i2c_cmd_link_create(void);
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle);
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle);
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, int ack_en);
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t* data, size_t data_len, int ack_en);
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t* data, int ack);
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t* data, size_t data_len, int ack);
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle);
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait);
+
+int i2c_slave_read_buffer(i2c_port_t i2c_num, uint8_t* data, size_t max_size, TickType_t ticks_to_wait);
+int i2c_slave_write_buffer(i2c_port_t i2c_num, uint8_t* data, int size, TickType_t ticks_to_wait);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_I2C_H__
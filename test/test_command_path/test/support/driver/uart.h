@@ -0,0 +1,65 @@
+/* ===== [uart.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_UART_H__
+#define __SIM_UART_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"        // also included by the ESP-IDF driver
+#include "freertos/queue.h"
+
+/* ===== Macros of public constants ===== */
+#define UART_PIN_NO_CHANGE  (-1)
+
+/* ===== Public structs and enums ===== */
+typedef enum {
+    UART_NUM_0,
+    UART_NUM_1,
+    UART_NUM_2,
+}   uart_port_t;
+
+typedef enum {
+    UART_DATA_8_BITS = 3,
+}   uart_word_length_t;
+
+typedef enum {
+    UART_PARITY_DISABLE,
+}   uart_parity_t;
+
+typedef enum {
+    UART_STOP_BITS_1 = 1,
+}   uart_stop_bits_t;
+
+typedef enum {
+    UART_HW_FLOWCTRL_DISABLE,
+}   uart_hw_flowcontrol_t;
+
+typedef struct {
+    int                     baud_rate;
+    uart_word_length_t      data_bits;
+    uart_parity_t           parity;
+    uart_stop_bits_t        stop_bits;
+    uart_hw_flowcontrol_t   flow_ctrl;
+}   uart_config_t;
+
+
+/* ===== Prototypes of public functions ===== */
+// the RX FIFO is filled by sim_uart_feed, TX is discarded
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config);
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num);
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t* uart_queue, int intr_alloc_flags);
+int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickType_t ticks_to_wait);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_UART_H__
@@ -0,0 +1,27 @@
+/* ===== [esp_err.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_ESP_ERR_H__
+#define __SIM_ESP_ERR_H__
+
+/* ===== Public structs and enums ===== */
+typedef int esp_err_t;
+
+/* ===== Macros of public constants ===== */
+#define ESP_OK                  0
+#define ESP_FAIL                -1
+#define ESP_ERR_NO_MEM          0x101
+#define ESP_ERR_INVALID_ARG     0x102
+#define ESP_ERR_INVALID_STATE   0x103
+#define ESP_ERR_INVALID_SIZE    0x104
+#define ESP_ERR_NOT_FOUND       0x105
+#define ESP_ERR_TIMEOUT         0x107
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_ESP_ERR_H__
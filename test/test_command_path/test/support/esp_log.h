@@ -0,0 +1,40 @@
+/* ===== [esp_log.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_ESP_LOG_H__
+#define __SIM_ESP_LOG_H__
+
+/* ===== Dependencies ===== */
+#include <stdio.h>
+#include "esp_err.h"
+
+/* ===== Public structs and enums ===== */
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+}   esp_log_level_t;
+
+/* ===== Macros of public constants ===== */
+// nothing is printed unless the SIM_LOG_LEVEL environment variable is set (1 errors to 5 verbose)
+#define ESP_LOGE(tag, format, ...)  sim_log(ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  sim_log(ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  sim_log(ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  sim_log(ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)  sim_log(ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+/* ===== Prototypes of public functions ===== */
+// not checked as printf, the firmware prints int64_t with %lld (long long on the ESP32)
+void sim_log(esp_log_level_t level, const char* tag, const char* format, ...);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_ESP_LOG_H__
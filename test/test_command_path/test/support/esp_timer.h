@@ -0,0 +1,21 @@
+/* ===== [esp_timer.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_ESP_TIMER_H__
+#define __SIM_ESP_TIMER_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+
+/* ===== Prototypes of public functions ===== */
+// simulated time, see sim_set_time_scale
+int64_t esp_timer_get_time(void);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_ESP_TIMER_H__
@@ -0,0 +1,22 @@
+/* ===== [esp_wifi.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_ESP_WIFI_H__
+#define __SIM_ESP_WIFI_H__
+
+/* ===== Public structs and enums ===== */
+typedef enum {
+    WIFI_MODE_NULL,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA,
+}   wifi_mode_t;
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_ESP_WIFI_H__
@@ -0,0 +1,138 @@
+/* ===== [FreeRTOS.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_FREERTOS_H__
+#define __SIM_FREERTOS_H__
+
+/*------------------------------------------------------------------
+|  Host simulation of the FreeRTOS API used by the firmware. Tasks
+|  are POSIX threads (they run in parallel, like the two ESP32
+|  cores, and priorities are ignored), queues, semaphores and task
+|  notifications are built on mutexes and condition variables. Time
+|  runs faster than the wall clock by the factor set with
+|  sim_set_time_scale, ticks and esp_timer_get_time both count
+|  simulated time.
+*-------------------------------------------------------------------*/
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>         // also included by the ESP-IDF FreeRTOSConfig.h
+#include <time.h>
+#include <pthread.h>
+
+#include "sdkconfig.h"
+
+/* ===== Macros of public constants ===== */
+#define pdPASS                      1
+#define pdFAIL                      0
+#define pdTRUE                      1
+#define pdFALSE                     0
+#define errQUEUE_FULL               0
+#define errQUEUE_EMPTY              0
+
+#define configTICK_RATE_HZ          CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS          (1000 / configTICK_RATE_HZ)
+#define portTICK_RATE_MS            portTICK_PERIOD_MS
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define portMAX_DELAY               ((TickType_t)0xFFFFFFFF)
+
+// critical sections only exclude the other users of the same mux
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
+
+/* ===== Public structs and enums ===== */
+typedef uint32_t        TickType_t;
+typedef int             BaseType_t;
+typedef unsigned int    UBaseType_t;
+typedef pthread_mutex_t portMUX_TYPE;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: sim_set_time_scale
+| ------------------------------------------------------------------
+|  Description: simulated microseconds per wall clock microsecond.
+|               Must be set before the first task is created. Code
+|               running on the host CPU looks that many times slower
+|               in simulated time.
+|
+|  Parameters:
+|       - scale: 1 for real time.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void sim_set_time_scale(uint32_t scale);
+
+/*------------------------------------------------------------------
+|  Function: sim_time_us
+| ------------------------------------------------------------------
+|  Description: simulated time since the start.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  int64_t
+*-------------------------------------------------------------------*/
+int64_t sim_time_us(void);
+
+/*------------------------------------------------------------------
+|  Function: sim_wall_us
+| ------------------------------------------------------------------
+|  Description: wall clock time since the start.
+|
+|  Parameters:
+|       -
+|
+|  Returns:  int64_t
+*-------------------------------------------------------------------*/
+int64_t sim_wall_us(void);
+
+/*------------------------------------------------------------------
+|  Function: sim_sleep_us
+| ------------------------------------------------------------------
+|  Description: blocks the calling thread for a simulated time.
+|
+|  Parameters:
+|       - sim_us: simulated microseconds.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void sim_sleep_us(int64_t sim_us);
+
+/*------------------------------------------------------------------
+|  Function: sim_deadline
+| ------------------------------------------------------------------
+|  Description: wall clock deadline (CLOCK_MONOTONIC) of a timeout
+|               in ticks, for pthread_cond_timedwait.
+|
+|  Parameters:
+|       - ticks: timeout in ticks (not portMAX_DELAY).
+|       - deadline: where the deadline is written.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void sim_deadline(TickType_t ticks, struct timespec* deadline);
+
+/*------------------------------------------------------------------
+|  Function: sim_cond_init
+| ------------------------------------------------------------------
+|  Description: initializes a condition variable that waits on
+|               CLOCK_MONOTONIC (the clock of sim_deadline).
+|
+|  Parameters:
+|       - cond: condition variable.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void sim_cond_init(pthread_cond_t* cond);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_FREERTOS_H__
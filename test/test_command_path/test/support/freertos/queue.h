@@ -0,0 +1,32 @@
+/* ===== [queue.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_QUEUE_H__
+#define __SIM_QUEUE_H__
+
+/* ===== Dependencies ===== */
+#include "freertos/FreeRTOS.h"
+
+/* ===== Public structs and enums ===== */
+typedef struct sim_queue* QueueHandle_t;
+
+
+/* ===== Prototypes of public functions ===== */
+// an item size of 0 makes a counting queue (semaphores)
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+void vQueueDelete(QueueHandle_t queue);
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait);
+BaseType_t xQueuePeek(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#define xQueueSend(queue, item, ticks)  xQueueSendToBack(queue, item, ticks)
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_QUEUE_H__
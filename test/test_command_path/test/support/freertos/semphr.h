@@ -0,0 +1,27 @@
+/* ===== [semphr.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_SEMPHR_H__
+#define __SIM_SEMPHR_H__
+
+/* ===== Dependencies ===== */
+#include "freertos/queue.h"
+
+/* ===== Public structs and enums ===== */
+typedef QueueHandle_t SemaphoreHandle_t;
+
+/* ===== Macros of public constants ===== */
+// same as FreeRTOS: a semaphore is a queue of empty items
+#define xSemaphoreCreateBinary()            xQueueCreate(1, 0)
+#define xSemaphoreGive(semaphore)           xQueueSendToBack(semaphore, NULL, 0)
+#define xSemaphoreTake(semaphore, ticks)    xQueueReceive(semaphore, NULL, ticks)
+#define vSemaphoreDelete(semaphore)         vQueueDelete(semaphore)
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_SEMPHR_H__
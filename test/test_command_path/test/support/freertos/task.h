@@ -0,0 +1,37 @@
+/* ===== [task.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_TASK_H__
+#define __SIM_TASK_H__
+
+/* ===== Dependencies ===== */
+#include "freertos/FreeRTOS.h"
+
+/* ===== Public structs and enums ===== */
+typedef void*   TaskHandle_t;
+typedef void    (*TaskFunction_t)(void*);
+
+
+/* ===== Prototypes of public functions ===== */
+// the stack size is accepted and ignored, the thread gets the default stack
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created_task);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+// NULL outside the tasks created by xTaskCreate (the test itself)
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+// counting notification, like the FreeRTOS one (a single value per task)
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+// ulTaskNotifyTake calls of a task with a 0 timeout (a task that never blocks keeps counting)
+uint32_t sim_task_polls(TaskHandle_t task);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_TASK_H__
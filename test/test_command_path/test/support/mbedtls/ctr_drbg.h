@@ -0,0 +1,20 @@
+/* ===== [ctr_drbg.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_MBEDTLS_CTR_DRBG_H__
+#define __SIM_MBEDTLS_CTR_DRBG_H__
+
+/* ===== Public structs and enums ===== */
+// only the type, jwt_token.h needs it but the simulation does not sign tokens
+typedef struct {
+    void*   context;
+}   mbedtls_ctr_drbg_context;
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_MBEDTLS_CTR_DRBG_H__
@@ -0,0 +1,26 @@
+/* ===== [sdkconfig.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_SDKCONFIG_H__
+#define __SIM_SDKCONFIG_H__
+
+/*------------------------------------------------------------------
+|  Configuration of the host simulation (same values as the
+|  sdkconfig of the firmware, WiFi and MQTT disabled).
+*-------------------------------------------------------------------*/
+#define CONFIG_FREERTOS_HZ                      100
+#define CONFIG_COMMAND_QUEUE_LEN                16
+#define CONFIG_COMMAND_QUEUE_OVERFLOW_WAIT      1
+#define CONFIG_COMMAND_TELEMETRY_QUEUE_LEN      4
+#define CONFIG_COMMAND_LANE_STARVATION_LIMIT    8
+#define CONFIG_SLAVE_STATE_CACHE_TTL_MS         2000
+#define CONFIG_COMMAND_TRACE_LOG_LEN            16
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_SDKCONFIG_H__
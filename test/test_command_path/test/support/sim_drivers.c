@@ -0,0 +1,467 @@
+/* ===== [sim_drivers.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "sim_drivers.h"
+#include "driver/i2c.h"
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "freertos/FreeRTOS.h"
+
+#include <errno.h>
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define I2C_CMD_MAX_OPS     8
+#define I2C_BITS_PER_BYTE   9           // 8 data bits and the ack
+#define GPIO_COUNT          40
+
+
+/* ===== Private structs and enums ===== */
+typedef enum {
+    I2C_OP_START,
+    I2C_OP_WRITE,
+    I2C_OP_READ,
+    I2C_OP_STOP,
+}   i2c_op_kind_t;
+
+typedef struct {
+    i2c_op_kind_t   kind;
+    uint8_t*        data;               // NULL for a single byte write
+    uint8_t         byte;
+    size_t          len;
+}   i2c_op_t;
+
+struct sim_i2c_cmd {
+    i2c_op_t    ops[I2C_CMD_MAX_OPS];
+    uint8_t     count;
+};
+
+typedef struct {
+    uint8_t     data[SIM_UART_FIFO_SIZE];   // large enough for the I2C and UART FIFOs
+    size_t      capacity;
+    size_t      head;
+    size_t      count;
+}   sim_fifo_t;
+
+
+/* ===== Declaration of private or external variables ===== */
+// a single bus: one slave, any port configured as master talks to it
+static pthread_mutex_t bus_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bus_changed;
+static pthread_once_t bus_once = PTHREAD_ONCE_INIT;
+static i2c_config_t port_config[I2C_NUM_MAX];
+static sim_fifo_t slave_rx = { .capacity = SIM_I2C_FIFO_SIZE };
+static sim_fifo_t slave_tx = { .capacity = SIM_I2C_FIFO_SIZE };
+static uint16_t slave_address = 0xFFFF;
+static uint32_t clk_speed = 100000;
+static uint32_t bus_latency_us = 0;
+static uint16_t bus_error_permille = 0;
+static uint32_t bus_random = 1;
+static sim_i2c_stats_t bus_stats;
+
+static sim_fifo_t uart_rx = { .capacity = SIM_UART_FIFO_SIZE };
+static uint32_t gpio_levels[GPIO_COUNT];
+
+
+/* ===== Prototypes of private functions ===== */
+static void init_bus(void);
+static i2c_op_t* add_op(i2c_cmd_handle_t cmd_handle, i2c_op_kind_t kind);
+static size_t fifo_push(sim_fifo_t* fifo, const uint8_t* data, size_t size);
+static size_t fifo_pop(sim_fifo_t* fifo, uint8_t* data, size_t size);
+static int wait_bus(uint8_t (*ready)(size_t), size_t size, TickType_t ticks_to_wait);
+static uint8_t slave_rx_ready(size_t size);
+static uint8_t slave_tx_room(size_t size);
+static uint8_t uart_rx_ready(size_t size);
+static uint32_t next_random(void);
+
+
+/* ===== Implementations of public functions ===== */
+void sim_i2c_configure(uint32_t latency_us, uint16_t error_permille, uint32_t seed)
+{
+    pthread_mutex_lock(&bus_lock);
+    bus_latency_us = latency_us;
+    bus_error_permille = error_permille;
+    bus_random = (seed != 0) ? seed : 1;
+    pthread_mutex_unlock(&bus_lock);
+}
+
+void sim_i2c_get_stats(sim_i2c_stats_t* stats)
+{
+    pthread_mutex_lock(&bus_lock);
+    *stats = bus_stats;
+    stats->pending_bytes = slave_tx.count;
+    pthread_mutex_unlock(&bus_lock);
+}
+
+size_t sim_uart_feed(const uint8_t* data, size_t size)
+{
+    size_t written;
+
+    pthread_once(&bus_once, init_bus);
+    pthread_mutex_lock(&bus_lock);
+    written = fifo_push(&uart_rx, data, size);
+    pthread_cond_broadcast(&bus_changed);
+    pthread_mutex_unlock(&bus_lock);
+    return written;
+}
+
+uint32_t sim_gpio_get_level(gpio_num_t gpio_num)
+{
+    return (gpio_num >= 0 && gpio_num < GPIO_COUNT) ? gpio_levels[gpio_num] : 0;
+}
+
+esp_err_t i2c_param_config(i2c_port_t i2c_num, const i2c_config_t* i2c_conf)
+{
+    if (i2c_num >= I2C_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    port_config[i2c_num] = *i2c_conf;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t i2c_num, i2c_mode_t mode, size_t slv_rx_buf_len, size_t slv_tx_buf_len,
+                             int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    if (i2c_num >= I2C_NUM_MAX || mode != port_config[i2c_num].mode)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_once(&bus_once, init_bus);
+    pthread_mutex_lock(&bus_lock);
+    if (mode == I2C_MODE_SLAVE)
+    {
+        slave_address = port_config[i2c_num].slave.slave_addr;
+        slave_rx.capacity = (slv_rx_buf_len < SIM_I2C_FIFO_SIZE) ? slv_rx_buf_len : SIM_I2C_FIFO_SIZE;
+        slave_tx.capacity = (slv_tx_buf_len < SIM_I2C_FIFO_SIZE) ? slv_tx_buf_len : SIM_I2C_FIFO_SIZE;
+    }
+    else if (port_config[i2c_num].master.clk_speed > 0)
+    {
+        clk_speed = port_config[i2c_num].master.clk_speed;
+    }
+    pthread_mutex_unlock(&bus_lock);
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(struct sim_i2c_cmd));
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
+{
+    free(cmd_handle);
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd_handle)
+{
+    return (add_op(cmd_handle, I2C_OP_START) != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, int ack_en)
+{
+    i2c_op_t* op = add_op(cmd_handle, I2C_OP_WRITE);
+
+    (void)ack_en;
+    if (op == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    op->byte = data;
+    op->len = 1;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd_handle, uint8_t* data, size_t data_len, int ack_en)
+{
+    i2c_op_t* op = add_op(cmd_handle, I2C_OP_WRITE);
+
+    (void)ack_en;
+    if (op == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    // same as the driver, the data is only read when the command runs
+    op->data = data;
+    op->len = data_len;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd_handle, uint8_t* data, int ack)
+{
+    return i2c_master_read(cmd_handle, data, 1, ack);
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd_handle, uint8_t* data, size_t data_len, int ack)
+{
+    i2c_op_t* op = add_op(cmd_handle, I2C_OP_READ);
+
+    (void)ack;
+    if (op == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    op->data = data;
+    op->len = data_len;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle)
+{
+    return (add_op(cmd_handle, I2C_OP_STOP) != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    i2c_op_t* op;
+    size_t bytes = 0;
+    size_t read;
+    int64_t duration_us;
+    uint8_t failed;
+    uint8_t i;
+
+    (void)ticks_to_wait;
+    if (i2c_num >= I2C_NUM_MAX || port_config[i2c_num].mode != I2C_MODE_MASTER || cmd_handle->count < 2 ||
+        cmd_handle->ops[1].kind != I2C_OP_WRITE || cmd_handle->ops[1].data != NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (i = 0; i < cmd_handle->count; i++)
+    {
+        bytes += cmd_handle->ops[i].len;
+    }
+
+    // the master holds the bus for the whole transaction
+    pthread_mutex_lock(&bus_lock);
+    duration_us = bus_latency_us + (int64_t)bytes * I2C_BITS_PER_BYTE * 1000000 / clk_speed;
+    failed = (bus_error_permille > 0 && next_random() % 1000 < bus_error_permille);
+    pthread_mutex_unlock(&bus_lock);
+    sim_sleep_us(duration_us);
+
+    pthread_mutex_lock(&bus_lock);
+    bus_stats.transactions++;
+    bus_stats.busy_us += duration_us;
+    if ((cmd_handle->ops[1].byte >> 1) != slave_address)
+    {
+        bus_stats.nacks++;
+        pthread_mutex_unlock(&bus_lock);
+        return ESP_FAIL;
+    }
+    if (failed)
+    {
+        bus_stats.errors++;
+        pthread_mutex_unlock(&bus_lock);
+        return ESP_FAIL;
+    }
+
+    if (cmd_handle->ops[1].byte & I2C_MASTER_READ)
+    {
+        bus_stats.reads++;
+    }
+    else
+    {
+        bus_stats.writes++;
+    }
+    for (i = 2; i < cmd_handle->count; i++)
+    {
+        op = &cmd_handle->ops[i];
+        if (op->kind == I2C_OP_WRITE)
+        {
+            fifo_push(&slave_rx, (op->data != NULL) ? op->data : &op->byte, op->len);
+        }
+        else if (op->kind == I2C_OP_READ)
+        {
+            read = fifo_pop(&slave_tx, op->data, op->len);
+            if (read < op->len)
+            {
+                memset(op->data + read, SIM_I2C_IDLE_BYTE, op->len - read);
+                bus_stats.idle_bytes += op->len - read;
+            }
+        }
+    }
+    pthread_cond_broadcast(&bus_changed);
+    pthread_mutex_unlock(&bus_lock);
+    return ESP_OK;
+}
+
+int i2c_slave_read_buffer(i2c_port_t i2c_num, uint8_t* data, size_t max_size, TickType_t ticks_to_wait)
+{
+    int read;
+
+    (void)i2c_num;
+    pthread_mutex_lock(&bus_lock);
+    wait_bus(slave_rx_ready, max_size, ticks_to_wait);
+    read = fifo_pop(&slave_rx, data, max_size);
+    pthread_mutex_unlock(&bus_lock);
+    return read;
+}
+
+int i2c_slave_write_buffer(i2c_port_t i2c_num, uint8_t* data, int size, TickType_t ticks_to_wait)
+{
+    int written;
+
+    (void)i2c_num;
+    pthread_mutex_lock(&bus_lock);
+    wait_bus(slave_tx_room, size, ticks_to_wait);
+    written = fifo_push(&slave_tx, data, size);
+    pthread_mutex_unlock(&bus_lock);
+    return written;
+}
+
+esp_err_t gpio_config(const gpio_config_t* config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num < 0 || gpio_num >= GPIO_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    gpio_levels[gpio_num] = level;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t* uart_config)
+{
+    (void)uart_num;
+    (void)uart_config;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+    (void)uart_num;
+    (void)tx_io_num;
+    (void)rx_io_num;
+    (void)rts_io_num;
+    (void)cts_io_num;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size,
+                              QueueHandle_t* uart_queue, int intr_alloc_flags)
+{
+    (void)uart_num;
+    (void)tx_buffer_size;
+    (void)queue_size;
+    (void)uart_queue;
+    (void)intr_alloc_flags;
+
+    pthread_once(&bus_once, init_bus);
+    pthread_mutex_lock(&bus_lock);
+    uart_rx.capacity = (rx_buffer_size < SIM_UART_FIFO_SIZE) ? rx_buffer_size : SIM_UART_FIFO_SIZE;
+    pthread_mutex_unlock(&bus_lock);
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, uint8_t* buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    int read;
+
+    (void)uart_num;
+    pthread_mutex_lock(&bus_lock);
+    wait_bus(uart_rx_ready, length, ticks_to_wait);
+    read = fifo_pop(&uart_rx, buf, length);
+    pthread_mutex_unlock(&bus_lock);
+    return read;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void init_bus(void)
+{
+    sim_cond_init(&bus_changed);
+}
+
+static i2c_op_t* add_op(i2c_cmd_handle_t cmd_handle, i2c_op_kind_t kind)
+{
+    i2c_op_t* op;
+
+    if (cmd_handle == NULL || cmd_handle->count >= I2C_CMD_MAX_OPS)
+    {
+        return NULL;
+    }
+    op = &cmd_handle->ops[cmd_handle->count++];
+    memset(op, 0, sizeof(i2c_op_t));
+    op->kind = kind;
+    return op;
+}
+
+static size_t fifo_push(sim_fifo_t* fifo, const uint8_t* data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size && fifo->count < fifo->capacity; i++)
+    {
+        fifo->data[(fifo->head + fifo->count) % fifo->capacity] = data[i];
+        fifo->count++;
+    }
+    return i;
+}
+
+static size_t fifo_pop(sim_fifo_t* fifo, uint8_t* data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size && fifo->count > 0; i++)
+    {
+        data[i] = fifo->data[fifo->head];
+        fifo->head = (fifo->head + 1) % fifo->capacity;
+        fifo->count--;
+    }
+    return i;
+}
+
+// called with the bus locked, returns 0 on timeout
+static int wait_bus(uint8_t (*ready)(size_t), size_t size, TickType_t ticks_to_wait)
+{
+    struct timespec deadline;
+
+    pthread_once(&bus_once, init_bus);
+    sim_deadline(ticks_to_wait, &deadline);
+    while (!ready(size))
+    {
+        if (ticks_to_wait == 0 || pthread_cond_timedwait(&bus_changed, &bus_lock, &deadline) == ETIMEDOUT)
+        {
+            return ready(size);
+        }
+    }
+    return 1;
+}
+
+static uint8_t slave_rx_ready(size_t size)
+{
+    return slave_rx.count >= size;
+}
+
+static uint8_t slave_tx_room(size_t size)
+{
+    return slave_tx.capacity - slave_tx.count >= size;
+}
+
+static uint8_t uart_rx_ready(size_t size)
+{
+    return uart_rx.count >= size;
+}
+
+static uint32_t next_random(void)
+{
+    // xorshift32, the errors only depend on the seed and the order of the transactions
+    bus_random ^= bus_random << 13;
+    bus_random ^= bus_random >> 17;
+    bus_random ^= bus_random << 5;
+    return bus_random;
+}
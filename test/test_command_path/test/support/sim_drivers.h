@@ -0,0 +1,112 @@
+/* ===== [sim_drivers.h] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Avoid multiple inclusion ===== */
+#ifndef __SIM_DRIVERS_H__
+#define __SIM_DRIVERS_H__
+
+/* ===== Dependencies ===== */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "driver/gpio.h"
+
+/* ===== Macros of public constants ===== */
+#define SIM_I2C_FIFO_SIZE   512     // slave RX and TX FIFOs (same as the slave driver buffers)
+#define SIM_I2C_IDLE_BYTE   0xFF    // read when the slave has nothing to send (SDA pulled up)
+#define SIM_UART_FIFO_SIZE  1024
+
+/* ===== Public structs and enums ===== */
+/*------------------------------------------------------------------
+|  Struct: sim_i2c_stats_t
+| ------------------------------------------------------------------
+|  Description: counters of the in-memory I2C bus.
+|
+|  Members:
+|       transactions    - i2c_master_cmd_begin calls
+|       writes          - transactions that wrote to the slave
+|       reads           - transactions that read from the slave
+|       errors          - transactions failed by error injection
+|       nacks           - transactions to an address without slave
+|       idle_bytes      - bytes read while the slave TX FIFO was
+|                         empty (answer not ready yet)
+|       pending_bytes   - bytes left in the slave TX FIFO (answers
+|                         the master has not read)
+|       busy_us         - simulated time the bus was in use
+*-------------------------------------------------------------------*/
+typedef struct {
+    uint32_t    transactions;
+    uint32_t    writes;
+    uint32_t    reads;
+    uint32_t    errors;
+    uint32_t    nacks;
+    uint32_t    idle_bytes;
+    uint32_t    pending_bytes;
+    int64_t     busy_us;
+}   sim_i2c_stats_t;
+
+
+/* ===== Prototypes of public functions ===== */
+/*------------------------------------------------------------------
+|  Function: sim_i2c_configure
+| ------------------------------------------------------------------
+|  Description: sets the behavior of the in-memory I2C bus. Each
+|               transaction takes the latency plus 9 clock periods
+|               per byte (address included) at the master clock
+|               speed; failed transactions move no data.
+|
+|  Parameters:
+|       - latency_us: extra simulated time of every transaction.
+|       - error_permille: transactions failed out of 1000.
+|       - seed: seed of the error generator (same seed, same
+|               sequence of errors).
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void sim_i2c_configure(uint32_t latency_us, uint16_t error_permille, uint32_t seed);
+
+/*------------------------------------------------------------------
+|  Function: sim_i2c_get_stats
+| ------------------------------------------------------------------
+|  Description: copies the bus counters.
+|
+|  Parameters:
+|       - stats: where the counters are copied.
+|
+|  Returns:  void
+*-------------------------------------------------------------------*/
+void sim_i2c_get_stats(sim_i2c_stats_t* stats);
+
+/*------------------------------------------------------------------
+|  Function: sim_uart_feed
+| ------------------------------------------------------------------
+|  Description: bytes received by UART0 (what the user types).
+|
+|  Parameters:
+|       - data: received bytes.
+|       - size: number of bytes.
+|
+|  Returns:  size_t
+|           bytes that fit in the RX FIFO
+*-------------------------------------------------------------------*/
+size_t sim_uart_feed(const uint8_t* data, size_t size);
+
+/*------------------------------------------------------------------
+|  Function: sim_gpio_get_level
+| ------------------------------------------------------------------
+|  Description: last level set on a GPIO.
+|
+|  Parameters:
+|       - gpio_num: GPIO number.
+|
+|  Returns:  uint32_t
+*-------------------------------------------------------------------*/
+uint32_t sim_gpio_get_level(gpio_num_t gpio_num);
+
+/* ===== Avoid multiple inclusion ===== */
+#endif // __SIM_DRIVERS_H__
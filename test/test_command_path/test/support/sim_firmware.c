@@ -0,0 +1,196 @@
+/* ===== [sim_firmware.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "wifi.h"
+#include "ble_server.h"
+#include "mqtt.h"
+#include "nvs_storage.h"
+#include "jwt_service.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*------------------------------------------------------------------
+|  Modules of the firmware the command processor calls but that are
+|  not part of the simulated command path: the radio (WiFi, BLE,
+|  MQTT) only changes state, NVS is kept in memory.
+*-------------------------------------------------------------------*/
+
+/* ===== Macros of private constants ===== */
+#define NVS_ENTRIES         16
+#define NVS_KEY_SIZE        16
+#define NVS_VALUE_SIZE      256
+
+
+/* ===== Private structs and enums ===== */
+typedef struct {
+    char    key[NVS_KEY_SIZE];
+    uint8_t value[NVS_VALUE_SIZE];
+    size_t  size;
+}   nvs_entry_t;
+
+
+/* ===== Declaration of private or external variables ===== */
+static wifi_credential_t wifi_credentials;
+static nvs_entry_t nvs_entries[NVS_ENTRIES];
+static pthread_mutex_t nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ===== Prototypes of private functions ===== */
+static nvs_entry_t* find_entry(const char* key, uint8_t create);
+static esp_err_t set_value(const char* key, const void* value, size_t size);
+
+
+/* ===== Implementations of public functions ===== */
+void initialize_wifi(uint8_t first_time, wifi_mode_t wifi_mode, wifi_credential_t* wifi_credential)
+{
+    (void)first_time;
+    (void)wifi_mode;
+    (void)wifi_credential;
+}
+
+void stop_wifi()
+{
+}
+
+wifi_credential_t* get_current_wifi_credentials()
+{
+    return &wifi_credentials;
+}
+
+void set_current_wifi_credentials(char* ssid, char* password)
+{
+    strncpy((char*)wifi_credentials.ssid, ssid, sizeof(wifi_credentials.ssid) - 1);
+    strncpy((char*)wifi_credentials.password, password, sizeof(wifi_credentials.password) - 1);
+}
+
+int8_t start_ble_server()
+{
+    return 0;
+}
+
+int8_t stop_ble_server()
+{
+    return 0;
+}
+
+void start_custom_mqtt_client()
+{
+}
+
+void stop_custom_mqtt_client()
+{
+}
+
+int8_t jwt_service_benchmark(void)
+{
+    return -1;
+}
+
+esp_err_t init_nvs_storage(uint8_t storage)
+{
+    (void)storage;
+    return ESP_OK;
+}
+
+char* get_nvs_string_value(char* string_key)
+{
+    char* value = NULL;
+    nvs_entry_t* entry;
+
+    pthread_mutex_lock(&nvs_lock);
+    entry = find_entry(string_key, 0);
+    if (entry != NULL && (value = malloc(entry->size)) != NULL)
+    {
+        memcpy(value, entry->value, entry->size);
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return value;
+}
+
+esp_err_t set_nvs_string_value(char* string_key, char* string_value)
+{
+    return set_value(string_key, string_value, strlen(string_value) + 1);
+}
+
+esp_err_t get_nvs_blob_value(char* blob_key, void* blob_value, size_t* blob_size)
+{
+    esp_err_t error = ESP_OK;
+    nvs_entry_t* entry;
+
+    pthread_mutex_lock(&nvs_lock);
+    entry = find_entry(blob_key, 0);
+    if (entry == NULL)
+    {
+        error = ESP_ERR_NOT_FOUND;
+    }
+    else if (entry->size > *blob_size)
+    {
+        error = ESP_ERR_INVALID_SIZE;
+    }
+    else
+    {
+        memcpy(blob_value, entry->value, entry->size);
+        *blob_size = entry->size;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return error;
+}
+
+esp_err_t set_nvs_blob_value(char* blob_key, const void* blob_value, size_t blob_size)
+{
+    return set_value(blob_key, blob_value, blob_size);
+}
+
+
+/* ===== Implementations of private functions ===== */
+// called with the NVS locked
+static nvs_entry_t* find_entry(const char* key, uint8_t create)
+{
+    uint8_t i;
+
+    for (i = 0; i < NVS_ENTRIES; i++)
+    {
+        if (strncmp(nvs_entries[i].key, key, NVS_KEY_SIZE) == 0)
+        {
+            return &nvs_entries[i];
+        }
+    }
+    for (i = 0; create && i < NVS_ENTRIES; i++)
+    {
+        if (nvs_entries[i].key[0] == '\0')
+        {
+            strncpy(nvs_entries[i].key, key, NVS_KEY_SIZE - 1);
+            return &nvs_entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t set_value(const char* key, const void* value, size_t size)
+{
+    nvs_entry_t* entry;
+
+    if (size > NVS_VALUE_SIZE || strlen(key) >= NVS_KEY_SIZE)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    pthread_mutex_lock(&nvs_lock);
+    entry = find_entry(key, 1);
+    if (entry != NULL)
+    {
+        memcpy(entry->value, value, size);
+        entry->size = size;
+    }
+    pthread_mutex_unlock(&nvs_lock);
+    return (entry != NULL) ? ESP_OK : ESP_ERR_NO_MEM;
+}
@@ -0,0 +1,427 @@
+/* ===== [sim_freertos.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+
+/* ===== Dependencies ===== */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/* ===== Macros of private constants ===== */
+#define TICK_US     (1000000 / configTICK_RATE_HZ)
+
+
+/* ===== Private structs and enums ===== */
+// ring buffer of items, item_size 0 only counts (semaphores)
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    uint8_t*        items;
+    UBaseType_t     length;
+    UBaseType_t     item_size;
+    UBaseType_t     head;
+    UBaseType_t     count;
+};
+
+typedef struct {
+    TaskFunction_t  task;
+    void*           parameters;
+    pthread_mutex_t lock;
+    pthread_cond_t  notified;
+    uint32_t        notifications;
+    uint32_t        polls;          // ulTaskNotifyTake calls that could not block
+}   sim_task_t;
+
+
+/* ===== Declaration of private or external variables ===== */
+static uint32_t time_scale = 1;
+static int64_t start_wall_us = 0;
+static pthread_once_t start_once = PTHREAD_ONCE_INIT;
+static int log_level = -1;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread sim_task_t* current_task = NULL;
+
+
+/* ===== Prototypes of private functions ===== */
+static int64_t monotonic_us(void);
+static void start_clock(void);
+static void* task_entry(void* argument);
+static int wait_queue(struct sim_queue* queue, pthread_cond_t* cond, TickType_t ticks_to_wait, uint8_t empty);
+
+
+/* ===== Implementations of public functions ===== */
+void sim_set_time_scale(uint32_t scale)
+{
+    time_scale = (scale > 0) ? scale : 1;
+}
+
+int64_t sim_wall_us(void)
+{
+    pthread_once(&start_once, start_clock);
+    return monotonic_us() - start_wall_us;
+}
+
+int64_t sim_time_us(void)
+{
+    return sim_wall_us() * time_scale;
+}
+
+void sim_sleep_us(int64_t sim_us)
+{
+    int64_t wall_us = sim_us / time_scale;
+    struct timespec duration;
+
+    if (wall_us <= 0)
+    {
+        sched_yield();
+        return;
+    }
+    duration.tv_sec = wall_us / 1000000;
+    duration.tv_nsec = (wall_us % 1000000) * 1000;
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR)
+    {
+    }
+}
+
+void sim_deadline(TickType_t ticks, struct timespec* deadline)
+{
+    int64_t wall_us = monotonic_us() + (int64_t)ticks * TICK_US / time_scale;
+
+    deadline->tv_sec = wall_us / 1000000;
+    deadline->tv_nsec = (wall_us % 1000000) * 1000;
+}
+
+void sim_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attributes;
+
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attributes);
+    pthread_condattr_destroy(&attributes);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return sim_time_us();
+}
+
+void sim_log(esp_log_level_t level, const char* tag, const char* format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    const char* env;
+    va_list args;
+
+    if (log_level < 0)
+    {
+        env = getenv("SIM_LOG_LEVEL");
+        log_level = (env != NULL) ? atoi(env) : ESP_LOG_NONE;
+    }
+    if ((int)level > log_level)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&log_lock);
+    printf("%c (%lld) %s: ", letters[level], (long long)(sim_time_us() / 1000), tag);
+    va_start(args, format);
+    vprintf(format, args);
+    va_end(args);
+    printf("\n");
+    pthread_mutex_unlock(&log_lock);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth, void* parameters,
+                       UBaseType_t priority, TaskHandle_t* created_task)
+{
+    sim_task_t* entry = malloc(sizeof(sim_task_t));
+    pthread_attr_t attributes;
+    pthread_t thread;
+    int error;
+
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+    if (entry == NULL)
+    {
+        return pdFAIL;
+    }
+    pthread_once(&start_once, start_clock);
+
+    entry->task = task;
+    entry->parameters = parameters;
+    entry->notifications = 0;
+    pthread_mutex_init(&entry->lock, NULL);
+    sim_cond_init(&entry->notified);
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    error = pthread_create(&thread, &attributes, task_entry, entry);
+    pthread_attr_destroy(&attributes);
+    if (error != 0)
+    {
+        free(entry);
+        return pdFAIL;
+    }
+
+    if (created_task != NULL)
+    {
+        *created_task = entry;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    // only a task can delete itself in the simulation
+    if (task == NULL)
+    {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_sleep_us((int64_t)ticks * TICK_US);
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(sim_time_us() / TICK_US);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    sim_task_t* entry = task;
+
+    pthread_mutex_lock(&entry->lock);
+    entry->notifications++;
+    pthread_cond_signal(&entry->notified);
+    pthread_mutex_unlock(&entry->lock);
+    return pdPASS;
+}
+
+uint32_t sim_task_polls(TaskHandle_t task)
+{
+    sim_task_t* entry = task;
+    uint32_t polls;
+
+    pthread_mutex_lock(&entry->lock);
+    polls = entry->polls;
+    pthread_mutex_unlock(&entry->lock);
+    return polls;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+    sim_task_t* entry = current_task;
+    struct timespec deadline;
+    uint32_t value;
+
+    if (ticks_to_wait != portMAX_DELAY)
+    {
+        sim_deadline(ticks_to_wait, &deadline);
+    }
+
+    pthread_mutex_lock(&entry->lock);
+    if (ticks_to_wait == 0)
+    {
+        entry->polls++;
+    }
+    while (entry->notifications == 0 && ticks_to_wait != 0)
+    {
+        if (ticks_to_wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(&entry->notified, &entry->lock);
+        }
+        else if (pthread_cond_timedwait(&entry->notified, &entry->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    value = entry->notifications;
+    if (value > 0)
+    {
+        entry->notifications = clear_on_exit ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&entry->lock);
+    return value;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue* queue = calloc(1, sizeof(struct sim_queue));
+
+    if (queue == NULL || length == 0)
+    {
+        free(queue);
+        return NULL;
+    }
+    if (item_size > 0)
+    {
+        queue->items = malloc(length * item_size);
+        if (queue->items == NULL)
+        {
+            free(queue);
+            return NULL;
+        }
+    }
+
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    sim_cond_init(&queue->not_empty);
+    sim_cond_init(&queue->not_full);
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks_to_wait)
+{
+    UBaseType_t tail;
+
+    pthread_mutex_lock(&queue->lock);
+    if (!wait_queue(queue, &queue->not_full, ticks_to_wait, 0))
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return errQUEUE_FULL;
+    }
+
+    if (queue->item_size > 0)
+    {
+        tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (!wait_queue(queue, &queue->not_empty, ticks_to_wait, 1))
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return errQUEUE_EMPTY;
+    }
+
+    if (queue->item_size > 0)
+    {
+        memcpy(buffer, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* buffer, TickType_t ticks_to_wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (!wait_queue(queue, &queue->not_empty, ticks_to_wait, 1))
+    {
+        pthread_mutex_unlock(&queue->lock);
+        return errQUEUE_EMPTY;
+    }
+
+    // the item stays in the queue
+    if (queue->item_size > 0)
+    {
+        memcpy(buffer, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&queue->lock);
+    count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+
+/* ===== Implementations of private functions ===== */
+static int64_t monotonic_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void start_clock(void)
+{
+    start_wall_us = monotonic_us();
+}
+
+static void* task_entry(void* argument)
+{
+    sim_task_t* entry = argument;
+
+    // the handle stays valid, FreeRTOS does not reuse it while the task runs
+    current_task = entry;
+    entry->task(entry->parameters);
+    return NULL;
+}
+
+// called with the queue locked, returns 0 on timeout
+static int wait_queue(struct sim_queue* queue, pthread_cond_t* cond, TickType_t ticks_to_wait, uint8_t empty)
+{
+    struct timespec deadline;
+
+    if (ticks_to_wait != portMAX_DELAY)
+    {
+        sim_deadline(ticks_to_wait, &deadline);
+    }
+
+    while (empty ? queue->count == 0 : queue->count == queue->length)
+    {
+        if (ticks_to_wait == 0)
+        {
+            return 0;
+        }
+        if (ticks_to_wait == portMAX_DELAY)
+        {
+            pthread_cond_wait(cond, &queue->lock);
+        }
+        else if (pthread_cond_timedwait(cond, &queue->lock, &deadline) == ETIMEDOUT)
+        {
+            return !(empty ? queue->count == 0 : queue->count == queue->length);
+        }
+    }
+    return 1;
+}
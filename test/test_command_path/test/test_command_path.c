@@ -0,0 +1,612 @@
+/* ===== [test_command_path.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "command_processor.h"
+#include "i2c_master.h"
+#include "slave_sim_task.h"
+#include "echo_uart.h"
+#include "message_bus.h"
+#include "slave_pipeline.h"
+#include "slave_state_cache.h"
+#include "serial_protocol_common.h"
+#include "command_codec.h"
+#include "command_script.h"
+#include "command_trace.h"
+#include "spsc_ring.h"
+#include "sim_drivers.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*------------------------------------------------------------------
+|  The command processor, I2C master, slave simulator and UART echo
+|  tasks of the firmware run as threads on the simulated FreeRTOS
+|  (test/support), the slave is on an in-memory I2C bus. The tasks
+|  are started once and keep running between tests, so every test
+|  looks at the change of the counters.
+*-------------------------------------------------------------------*/
+
+/* ===== Macros of private constants ===== */
+#define SIM_TIME_SCALE          10      // simulated us per wall clock us
+#define SIM_POLL_MS             10      // simulated time between checks of the counters
+#define SIM_TIMEOUT_MS          10000
+#define SIM_BUS_SEED            0x5EED
+#define SIM_BUS_LATENCY_US      20000   // extra time of every I2C transaction (latency test)
+#define SIM_BUS_STALL_US        (SLAVE_PIPELINE_TIMEOUT_MS * 1000 + SIM_BUS_LATENCY_US)    // expires the operation
+#define CLIENT_QUEUE_LEN        64      // replies waiting for a simulated RX module
+#define BENCHMARK_COMMANDS      4000
+#define BENCHMARK_STATUS_EVERY  8       // one slave status read every 8 commands
+#define BENCHMARK_SLAVE_EVERY   64      // one slave command every 64 commands, once the pipeline is idle
+#define PERCENTILES             3
+#define RING_SOURCE_LEN         8       // ring of the simulated BLE callback
+#define RING_COMMANDS           200
+#define SCRIPT_BUSY_WAIT        "CMD_SCRIPT_STORE 0 C5010300000600"    // OP_WAIT 0, OP_JUMP 0
+#define SCRIPT_RUN_MS           200
+
+/* ===== Private structs and enums ===== */
+// replies received by a simulated RX module
+typedef struct {
+    uint32_t    commands;
+    uint32_t    slave_states;
+    uint16_t    last_id;
+    uint8_t     last_value;
+    uint16_t    last_command_id;    // last TX_MSG_COMMAND
+    uint8_t     last_command;
+}   client_replies_t;
+
+/* ===== Declaration of private or external variables ===== */
+static const uint8_t percentiles[PERCENTILES] = { 50, 90, 99 };
+static uint8_t started = 0;
+static uint16_t next_id = 1;
+static client_replies_t replies[I2C_MASTER_MOD + 1];
+static pthread_mutex_t replies_lock = PTHREAD_MUTEX_INITIALIZER;
+static TaskHandle_t command_processor_handle;
+static spsc_ring_t ble_ring;
+static rx_command_t ble_ring_items[RING_SOURCE_LEN];
+
+/* ===== Prototypes of private functions ===== */
+static void start_command_path(void);
+static void client_task(void *pvParameter);
+static uint16_t submit(rx_module_t module, command_type_t command);
+static void submit_text(rx_module_t module, const char* text);
+static client_replies_t get_replies(rx_module_t module);
+static uint32_t trace_count(rx_module_t module);
+static uint32_t stage_count(rx_module_t module, trace_stage_t stage);
+static void wait_traces(rx_module_t module, uint32_t count);
+static void wait_replies(rx_module_t module, uint32_t count);
+static void wait_pipeline_idle(void);
+static void wait_bus_transactions(uint32_t count);
+static void print_latency(rx_module_t module, const char* name, const command_trace_stats_t* before);
+static latency_histogram_t histogram_delta(const latency_histogram_t* after, const latency_histogram_t* before);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    if (!started)
+    {
+        start_command_path();
+        started = 1;
+    }
+    sim_i2c_configure(0, 0, SIM_BUS_SEED);
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_uart_echo
+| ------------------------------------------------------------------
+|  Description: tests a command typed in the UART (CMD_ECHO is 10,
+|               so the byte is ':') through the echo task and the
+|               command processor, up to the reply.
+*-------------------------------------------------------------------*/
+void test_uart_echo(void)  {
+    uint32_t traces = trace_count(UART_RX);
+    uint32_t answered = stage_count(UART_RX, TRACE_STAGE_REPLY);
+    uint8_t echo = '0' + CMD_ECHO;
+
+    TEST_ASSERT_EQUAL(1, sim_uart_feed(&echo, 1));
+    wait_traces(UART_RX, traces + 1);
+
+    TEST_ASSERT_EQUAL(answered + 1, stage_count(UART_RX, TRACE_STAGE_REPLY));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_status_read
+| ------------------------------------------------------------------
+|  Description: tests a status request that goes to the slave: it
+|               is written on the bus and exactly one state reply
+|               comes back with the id of the request.
+*-------------------------------------------------------------------*/
+void test_status_read(void)  {
+    client_replies_t before = get_replies(MQTT_RX);
+    uint32_t writes = stage_count(MQTT_RX, TRACE_STAGE_I2C_WRITE);
+    sim_i2c_stats_t bus_before, bus;
+    uint16_t id;
+
+    sim_i2c_get_stats(&bus_before);
+
+    // a slave command first, so the state is not in the cache
+    submit(MQTT_RX, CMD_SLAVE_RESET);
+    id = submit(MQTT_RX, CMD_SLAVE_STATUS);
+    wait_replies(MQTT_RX, before.commands + before.slave_states + 2);
+    wait_pipeline_idle();
+
+    TEST_ASSERT_EQUAL(id, get_replies(MQTT_RX).last_id);
+    TEST_ASSERT_EQUAL(writes + 2, stage_count(MQTT_RX, TRACE_STAGE_I2C_WRITE));
+    sim_i2c_get_stats(&bus);
+    TEST_ASSERT_EQUAL(bus_before.nacks, bus.nacks);
+    TEST_ASSERT_EQUAL(bus_before.errors, bus.errors);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_bus_errors
+| ------------------------------------------------------------------
+|  Description: tests that slave operations fail (and are answered)
+|               when every I2C transaction fails.
+*-------------------------------------------------------------------*/
+void test_bus_errors(void)  {
+    client_replies_t before = get_replies(MQTT_RX);
+    slave_pipeline_stats_t pipeline_before, pipeline;
+    sim_i2c_stats_t bus_before, bus;
+
+    sim_i2c_configure(0, 1000, SIM_BUS_SEED);
+    sim_i2c_get_stats(&bus_before);
+    slave_pipeline_get_stats(&pipeline_before);
+    submit(MQTT_RX, CMD_SLAVE_RESET);
+    submit(MQTT_RX, CMD_SLAVE_STATUS);
+    wait_replies(MQTT_RX, before.commands + before.slave_states + 2);
+    wait_pipeline_idle();
+
+    slave_pipeline_get_stats(&pipeline);
+    TEST_ASSERT_EQUAL(pipeline_before.failed + 2, pipeline.failed);
+    TEST_ASSERT_EQUAL(pipeline_before.completed, pipeline.completed);
+    TEST_ASSERT_EQUAL(before.commands + 1, get_replies(MQTT_RX).commands);
+    TEST_ASSERT_EQUAL(CMD_SLAVE_FAIL, get_replies(MQTT_RX).last_command);
+    TEST_ASSERT_EQUAL(SLAVE_STATE_ERROR, get_replies(MQTT_RX).last_value);
+    sim_i2c_get_stats(&bus);
+    TEST_ASSERT_GREATER_OR_EQUAL(bus_before.errors + 2, bus.errors);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_slave_command_result
+| ------------------------------------------------------------------
+|  Description: tests that a slave command is answered with
+|               CMD_SLAVE_OK and the id of the request when the slave
+|               acknowledges it, and with CMD_SLAVE_FAIL when the
+|               operation times out.
+*-------------------------------------------------------------------*/
+void test_slave_command_result(void)  {
+    client_replies_t before = get_replies(MQTT_RX);
+    slave_pipeline_stats_t pipeline_before, pipeline;
+    sim_i2c_stats_t bus_before;
+    uint16_t id;
+
+    id = submit(MQTT_RX, CMD_SLAVE_START_A);
+    wait_replies(MQTT_RX, before.commands + before.slave_states + 1);
+
+    TEST_ASSERT_EQUAL(before.commands + 1, get_replies(MQTT_RX).commands);
+    TEST_ASSERT_EQUAL(id, get_replies(MQTT_RX).last_command_id);
+    TEST_ASSERT_EQUAL(CMD_SLAVE_OK, get_replies(MQTT_RX).last_command);
+
+    // the slave answers after the deadline of the operation
+    sim_i2c_configure(SIM_BUS_STALL_US, 0, SIM_BUS_SEED);
+    slave_pipeline_get_stats(&pipeline_before);
+    sim_i2c_get_stats(&bus_before);
+    id = submit(MQTT_RX, CMD_SLAVE_PAUSE);
+    wait_replies(MQTT_RX, before.commands + before.slave_states + 2);
+
+    slave_pipeline_get_stats(&pipeline);
+    TEST_ASSERT_EQUAL(pipeline_before.timeouts + 1, pipeline.timeouts);
+    TEST_ASSERT_EQUAL(before.commands + 2, get_replies(MQTT_RX).commands);
+    TEST_ASSERT_EQUAL(id, get_replies(MQTT_RX).last_command_id);
+    TEST_ASSERT_EQUAL(CMD_SLAVE_FAIL, get_replies(MQTT_RX).last_command);
+
+    // the write and the read of the slave answer, so the next test starts with an idle bus
+    wait_bus_transactions(bus_before.transactions + 2);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_bus_latency
+| ------------------------------------------------------------------
+|  Description: tests that the latency of the bus shows in the
+|               i2c_write span of the traces.
+*-------------------------------------------------------------------*/
+void test_bus_latency(void)  {
+    command_trace_stats_t before, after;
+
+    sim_i2c_configure(SIM_BUS_LATENCY_US, 0, SIM_BUS_SEED);
+    TEST_ASSERT_EQUAL(0, get_command_trace_stats(MQTT_RX, &before));
+    submit(MQTT_RX, CMD_SLAVE_PAUSE);
+    submit(MQTT_RX, CMD_SLAVE_RESET);
+    wait_traces(MQTT_RX, before.total.count + 2);
+
+    TEST_ASSERT_EQUAL(0, get_command_trace_stats(MQTT_RX, &after));
+    TEST_ASSERT_EQUAL(before.stage[TRACE_STAGE_I2C_WRITE].count + 2, after.stage[TRACE_STAGE_I2C_WRITE].count);
+    TEST_ASSERT_GREATER_OR_EQUAL(2 * SIM_BUS_LATENCY_US,
+                                 after.stage[TRACE_STAGE_I2C_WRITE].total_us - before.stage[TRACE_STAGE_I2C_WRITE].total_us);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_ring_source
+| ------------------------------------------------------------------
+|  Description: tests commands posted to a source ring (like the
+|               BLE GATT callback): every command is either drained
+|               by the command processor and answered, or counted
+|               as dropped by the ring.
+*-------------------------------------------------------------------*/
+void test_ring_source(void)  {
+    client_replies_t before = get_replies(BLE_SERVER);
+    uint32_t traces = trace_count(BLE_SERVER);
+    uint32_t dropped = spsc_ring_dropped(&ble_ring);
+    rx_command_t command = { 0 };
+    uint32_t posted = 0;
+    uint32_t i;
+
+    command.rx_id = BLE_SERVER;
+    command.command = CMD_ECHO;
+    for (i = 0; i < RING_COMMANDS; i++)
+    {
+        command.seq = next_id++;
+        command.ingress_us = esp_timer_get_time();
+        if (command_processor_post(&ble_ring, &command) == pdPASS)
+        {
+            posted++;
+        }
+        // bursts of half a ring, the command processor only runs when it is notified
+        if (i % (RING_SOURCE_LEN / 2) == 0)
+        {
+            vTaskDelay(1);
+        }
+    }
+    wait_traces(BLE_SERVER, traces + posted);
+    wait_replies(BLE_SERVER, before.commands + posted);
+
+    TEST_ASSERT_EQUAL(RING_COMMANDS, posted + spsc_ring_dropped(&ble_ring) - dropped);
+    TEST_ASSERT_GREATER_THAN(RING_COMMANDS / 2, posted);
+    TEST_ASSERT_EQUAL(traces + posted, trace_count(BLE_SERVER));
+    TEST_ASSERT_EQUAL(0, spsc_ring_count(&ble_ring));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_script_zero_wait
+| ------------------------------------------------------------------
+|  Description: tests a script that loops on a wait of 0 ms: the
+|               wait still lasts a tick, so the command processor
+|               keeps blocking instead of polling its lanes.
+*-------------------------------------------------------------------*/
+void test_script_zero_wait(void)  {
+    uint32_t traces = trace_count(HTTP_RX);
+    uint32_t polls;
+
+    submit_text(HTTP_RX, SCRIPT_BUSY_WAIT);
+    submit_text(HTTP_RX, "CMD_SCRIPT_RUN 0");
+    vTaskDelay(SIM_POLL_MS / portTICK_RATE_MS);
+
+    polls = sim_task_polls(command_processor_handle);
+    vTaskDelay(SCRIPT_RUN_MS / portTICK_RATE_MS);
+    polls = sim_task_polls(command_processor_handle) - polls;
+    submit_text(HTTP_RX, "CMD_SCRIPT_STOP");
+    wait_traces(HTTP_RX, traces + 3);
+
+    // at most one poll per tick (a wake up that finds the wait already over)
+    TEST_ASSERT_LESS_OR_EQUAL(SCRIPT_RUN_MS / portTICK_RATE_MS, polls);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_benchmark_command_path
+| ------------------------------------------------------------------
+|  Description: burst of echoes from HTTP with the slave traffic of
+|               the MQTT task in between (a status read once the last
+|               one was answered and a slave command once the
+|               previous operations finished). Every
+|               command must end its trace and be answered, no slave
+|               operation may be rejected and the cache must answer
+|               part of the status reads; prints the throughput, the
+|               latency percentiles of the echo and of the slave path
+|               and the counters of the slave path.
+*-------------------------------------------------------------------*/
+void test_benchmark_command_path(void)  {
+    client_replies_t echo_before = get_replies(HTTP_RX);
+    client_replies_t slave_before = get_replies(MQTT_RX);
+    command_trace_stats_t echo_latency, slave_latency;
+    slave_pipeline_stats_t pipeline_before, pipeline;
+    slave_state_cache_stats_t cache_before, cache;
+    sim_i2c_stats_t bus_before, bus;
+    uint32_t echo_traces = trace_count(HTTP_RX);
+    uint32_t slave_traces = trace_count(MQTT_RX);
+    uint32_t echoes = 0;
+    uint32_t status_reads = 0;
+    uint32_t slave_commands = 0;
+    int64_t start_us, start_wall_us, elapsed_us, elapsed_wall_us;
+    uint32_t i;
+
+    TEST_ASSERT_EQUAL(0, get_command_trace_stats(HTTP_RX, &echo_latency));
+    TEST_ASSERT_EQUAL(0, get_command_trace_stats(MQTT_RX, &slave_latency));
+    slave_pipeline_get_stats(&pipeline_before);
+    slave_state_cache_get_stats(&cache_before);
+    sim_i2c_get_stats(&bus_before);
+
+    start_us = sim_time_us();
+    start_wall_us = sim_wall_us();
+    for (i = 0; i < BENCHMARK_COMMANDS; i++)
+    {
+        if (i % BENCHMARK_SLAVE_EVERY == BENCHMARK_SLAVE_EVERY - 1)
+        {
+            // paced like a user, a slave command is not sent while the previous ones are in flight
+            wait_pipeline_idle();
+            submit(MQTT_RX, (i / BENCHMARK_SLAVE_EVERY) % 2 ? CMD_SLAVE_CONTINUE : CMD_SLAVE_PAUSE);
+            slave_commands++;
+        }
+        else if (i % BENCHMARK_STATUS_EVERY == 0)
+        {
+            // like the MQTT task, the next poll waits for the answer to the previous one
+            wait_replies(MQTT_RX, slave_before.commands + slave_before.slave_states + slave_commands + status_reads);
+            submit(MQTT_RX, CMD_SLAVE_STATUS);
+            status_reads++;
+        }
+        else
+        {
+            submit(HTTP_RX, CMD_ECHO);
+            echoes++;
+        }
+    }
+    wait_traces(HTTP_RX, echo_traces + echoes);
+    wait_traces(MQTT_RX, slave_traces + BENCHMARK_COMMANDS - echoes);
+    elapsed_us = sim_time_us() - start_us;
+    elapsed_wall_us = sim_wall_us() - start_wall_us;
+    wait_replies(HTTP_RX, echo_before.commands + echo_before.slave_states + echoes);
+    wait_replies(MQTT_RX, slave_before.commands + slave_before.slave_states + slave_commands + status_reads);
+    wait_pipeline_idle();
+
+    slave_pipeline_get_stats(&pipeline);
+    slave_state_cache_get_stats(&cache);
+    sim_i2c_get_stats(&bus);
+    printf("command path: %d commands in %.1f ms simulated (%.0f commands/s), %.1f ms wall (time scale %d)\n",
+           BENCHMARK_COMMANDS, elapsed_us / 1000.0, BENCHMARK_COMMANDS * 1e6 / elapsed_us,
+           elapsed_wall_us / 1000.0, SIM_TIME_SCALE);
+    print_latency(HTTP_RX, "echo (HTTP_RX)", &echo_latency);
+    print_latency(MQTT_RX, "slave path (MQTT_RX)", &slave_latency);
+    printf("slave pipeline: %u issued, %u completed, %u failed, %u timeouts, %u late, %u rejected, max %u in flight\n",
+           pipeline.issued - pipeline_before.issued, pipeline.completed - pipeline_before.completed,
+           pipeline.failed - pipeline_before.failed, pipeline.timeouts - pipeline_before.timeouts,
+           pipeline.late - pipeline_before.late, pipeline.rejected - pipeline_before.rejected,
+           pipeline.max_in_flight);
+    printf("state cache: %u requests, %u hits, %u coalesced, %u reads\n",
+           cache.requests - cache_before.requests, cache.hits - cache_before.hits,
+           cache.coalesced - cache_before.coalesced, cache.reads - cache_before.reads);
+    printf("i2c bus: %u transactions (%u writes, %u reads), %u errors, %u idle bytes, %u bytes not read, "
+           "%.1f ms busy\n", bus.transactions - bus_before.transactions, bus.writes - bus_before.writes,
+           bus.reads - bus_before.reads, bus.errors - bus_before.errors, bus.idle_bytes - bus_before.idle_bytes,
+           bus.pending_bytes - bus_before.pending_bytes, (bus.busy_us - bus_before.busy_us) / 1000.0);
+
+    TEST_ASSERT_EQUAL(echo_traces + echoes, trace_count(HTTP_RX));
+    TEST_ASSERT_EQUAL(slave_traces + BENCHMARK_COMMANDS - echoes, trace_count(MQTT_RX));
+    TEST_ASSERT_EQUAL(echo_before.commands + echoes, get_replies(HTTP_RX).commands);
+    TEST_ASSERT_EQUAL(slave_before.commands + slave_commands, get_replies(MQTT_RX).commands);
+    TEST_ASSERT_EQUAL(slave_before.slave_states + status_reads, get_replies(MQTT_RX).slave_states);
+    TEST_ASSERT_EQUAL(pipeline.issued, pipeline.completed + pipeline.failed + pipeline.timeouts);
+    TEST_ASSERT_EQUAL(pipeline_before.rejected, pipeline.rejected);
+    TEST_ASSERT_LESS_OR_EQUAL(SLAVE_PIPELINE_DEPTH, pipeline.max_in_flight);
+    TEST_ASSERT_EQUAL(status_reads, cache.requests - cache_before.requests);
+    TEST_ASSERT_GREATER_THAN(0, cache.hits - cache_before.hits);
+    TEST_ASSERT_LESS_THAN(status_reads, cache.reads - cache_before.reads);
+    TEST_ASSERT_EQUAL(0, message_bus_dropped());
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void start_command_path(void)
+{
+    sim_set_time_scale(SIM_TIME_SCALE);
+    sim_i2c_configure(0, 0, SIM_BUS_SEED);
+
+    // same order as app_main, the clients replace the HTTP and MQTT tasks
+    initialize_uart();
+    TEST_ASSERT_EQUAL(0, initialize_command_processor(HTTP_RX));
+    TEST_ASSERT_EQUAL(ESP_OK, initialize_i2c_master());
+    TEST_ASSERT_EQUAL(0, message_bus_register(HTTP_RX, CLIENT_QUEUE_LEN));
+    TEST_ASSERT_EQUAL(0, message_bus_register(MQTT_RX, CLIENT_QUEUE_LEN));
+    TEST_ASSERT_EQUAL(0, message_bus_register(BLE_SERVER, CLIENT_QUEUE_LEN));
+    TEST_ASSERT_EQUAL(0, spsc_ring_init(&ble_ring, ble_ring_items, sizeof(rx_command_t), RING_SOURCE_LEN));
+    TEST_ASSERT_EQUAL(0, command_processor_add_source(&ble_ring));
+
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(&client_task, "http_client", 2048, (void*)(uintptr_t)HTTP_RX, 6, NULL));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(&client_task, "mqtt_client", 2048, (void*)(uintptr_t)MQTT_RX, 6, NULL));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(&client_task, "ble_client", 2048, (void*)(uintptr_t)BLE_SERVER, 6, NULL));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(&command_processor_task, "command_processor_task", 2048, NULL, 5,
+                                          &command_processor_handle));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(&echo_task, "echo_task", 1024 * 1.5, NULL, 4, NULL));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(&i2c_master_task, "i2c_master_task", 1024 * 2, NULL, 4, NULL));
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(&slave_sim_task, "slave_sim_task", 1024 * 2, NULL, 4, NULL));
+}
+
+static void client_task(void *pvParameter)
+{
+    rx_module_t module = (rx_module_t)(uintptr_t)pvParameter;
+    tx_message_t message;
+
+    while (1)
+    {
+        if (message_bus_receive(module, &message, portMAX_DELAY) != pdPASS)
+        {
+            continue;
+        }
+
+        pthread_mutex_lock(&replies_lock);
+        if (message.kind == TX_MSG_SLAVE_STATE)
+        {
+            replies[module].slave_states++;
+        }
+        else
+        {
+            replies[module].commands++;
+            replies[module].last_command_id = message.correlation_id;
+            replies[module].last_command = message.payload.command;
+        }
+        replies[module].last_id = message.correlation_id;
+        replies[module].last_value = message_bus_value(&message);
+        pthread_mutex_unlock(&replies_lock);
+    }
+}
+
+static uint16_t submit(rx_module_t module, command_type_t command)
+{
+    rx_command_t rx_command = { 0 };
+
+    rx_command.rx_id = module;
+    rx_command.command = command;
+    rx_command.seq = next_id++;
+    rx_command.ingress_us = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(pdPASS, command_processor_submit(&rx_command, portMAX_DELAY));
+    return rx_command.seq;
+}
+
+static void submit_text(rx_module_t module, const char* text)
+{
+    rx_command_t rx_command = { 0 };
+
+    rx_command.rx_id = module;
+    rx_command.seq = next_id++;
+    rx_command.ingress_us = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(pdPASS, command_processor_submit_text(&rx_command, text, portMAX_DELAY));
+}
+
+static client_replies_t get_replies(rx_module_t module)
+{
+    client_replies_t copy;
+
+    pthread_mutex_lock(&replies_lock);
+    copy = replies[module];
+    pthread_mutex_unlock(&replies_lock);
+    return copy;
+}
+
+static uint32_t trace_count(rx_module_t module)
+{
+    command_trace_stats_t stats;
+
+    TEST_ASSERT_EQUAL(0, get_command_trace_stats(module, &stats));
+    return stats.total.count;
+}
+
+static uint32_t stage_count(rx_module_t module, trace_stage_t stage)
+{
+    command_trace_stats_t stats;
+
+    TEST_ASSERT_EQUAL(0, get_command_trace_stats(module, &stats));
+    return stats.stage[stage].count;
+}
+
+static void wait_traces(rx_module_t module, uint32_t count)
+{
+    int64_t deadline_us = sim_time_us() + SIM_TIMEOUT_MS * 1000LL;
+
+    while (trace_count(module) < count)
+    {
+        TEST_ASSERT_TRUE_MESSAGE(sim_time_us() < deadline_us, "commands not finished in time");
+        vTaskDelay(SIM_POLL_MS / portTICK_RATE_MS);
+    }
+}
+
+static void wait_replies(rx_module_t module, uint32_t count)
+{
+    int64_t deadline_us = sim_time_us() + SIM_TIMEOUT_MS * 1000LL;
+    client_replies_t received;
+
+    while (1)
+    {
+        received = get_replies(module);
+        if (received.commands + received.slave_states >= count)
+        {
+            return;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(sim_time_us() < deadline_us, "replies not received in time");
+        vTaskDelay(SIM_POLL_MS / portTICK_RATE_MS);
+    }
+}
+
+static void wait_pipeline_idle(void)
+{
+    int64_t deadline_us = sim_time_us() + SIM_TIMEOUT_MS * 1000LL;
+    slave_pipeline_stats_t stats;
+
+    while (1)
+    {
+        slave_pipeline_get_stats(&stats);
+        if (stats.issued == stats.completed + stats.failed + stats.timeouts)
+        {
+            return;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(sim_time_us() < deadline_us, "slave operations not finished in time");
+        vTaskDelay(SIM_POLL_MS / portTICK_RATE_MS);
+    }
+}
+
+static void wait_bus_transactions(uint32_t count)
+{
+    int64_t deadline_us = sim_time_us() + SIM_TIMEOUT_MS * 1000LL;
+    sim_i2c_stats_t stats;
+
+    while (1)
+    {
+        sim_i2c_get_stats(&stats);
+        if (stats.transactions >= count)
+        {
+            return;
+        }
+        TEST_ASSERT_TRUE_MESSAGE(sim_time_us() < deadline_us, "bus transactions not finished in time");
+        vTaskDelay(SIM_POLL_MS / portTICK_RATE_MS);
+    }
+}
+
+static void print_latency(rx_module_t module, const char* name, const command_trace_stats_t* before)
+{
+    command_trace_stats_t after;
+    latency_histogram_t total, span;
+    uint8_t stage;
+    uint8_t i;
+
+    // only the commands traced since before
+    TEST_ASSERT_EQUAL(0, get_command_trace_stats(module, &after));
+    total = histogram_delta(&after.total, &before->total);
+    printf("%s: %u traces, total", name, total.count);
+    for (i = 0; i < PERCENTILES; i++)
+    {
+        printf(" p%u = %lld us", percentiles[i], (long long)latency_histogram_percentile(&total, percentiles[i]));
+    }
+    printf(", p50 per span:");
+    for (stage = TRACE_STAGE_ENQUEUE; stage < TRACE_STAGE_COUNT; stage++)
+    {
+        span = histogram_delta(&after.stage[stage], &before->stage[stage]);
+        printf(" %s = %lld us (%u)", command_trace_span_name(stage),
+               (long long)latency_histogram_percentile(&span, 50), span.count);
+    }
+    printf("\n");
+}
+
+static latency_histogram_t histogram_delta(const latency_histogram_t* after, const latency_histogram_t* before)
+{
+    latency_histogram_t delta = *after;
+    uint8_t i;
+
+    for (i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++)
+    {
+        delta.buckets[i] -= before->buckets[i];
+    }
+    delta.count -= before->count;
+    delta.total_us -= before->total_us;
+    // max_us stays the overall one
+    return delta;
+}
@@ -0,0 +1,248 @@
+/* ===== [test_command_script.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "command_script.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Macros of private constants ===== */
+#define SLAVE_PROCESS_A         2       // slave_machine_state_t of the slave firmware
+#define SLAVE_DONE              4
+#define MAX_ACTIONS             100
+#define BENCHMARK_ITERATIONS    100000
+
+/* ===== Private structs and enums ===== */
+// slave answering the script: the process ends after a number of status reads
+typedef struct {
+    uint8_t     state;
+    uint8_t     reads_until_done;
+    uint8_t     fail_commands;
+    uint32_t    commands;
+    uint32_t    reads;
+    uint32_t    waited_ms;
+    command_type_t last_command;
+}   fake_slave_t;
+
+/* ===== Declaration of private or external variables ===== */
+// start A, poll every 100 ms (10 times at most) until the process is done, then reset
+static const uint8_t recipe[] = {
+    COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION,
+    /*  0 */ OP_CMD, CMD_SLAVE_START_A,
+    /*  2 */ OP_SET, 0, 10,
+    /*  5 */ OP_WAIT, 0x00, 0x64,
+    /*  8 */ OP_STATUS,
+    /*  9 */ OP_IF_STATE, SLAVE_DONE, 16,
+    /* 12 */ OP_LOOP, 0, 5,
+    /* 15 */ OP_FAIL,
+    /* 16 */ OP_CMD, CMD_SLAVE_RESET,
+    /* 18 */ OP_END,
+};
+
+static command_script_t vm;
+static fake_slave_t slave;
+
+/* ===== Prototypes of private functions ===== */
+static command_script_action_kind_t run(const uint8_t* script, uint16_t size);
+static double elapsed_ms(clock_t start);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    memset(&slave, 0, sizeof(slave));
+    slave.last_command = CMD_INVALID;
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_recipe_runs_to_the_end
+| ------------------------------------------------------------------
+|  Description: tests the whole recipe against a slave that ends
+|               the process after 3 status reads.
+*-------------------------------------------------------------------*/
+void test_recipe_runs_to_the_end(void)  {
+    slave.reads_until_done = 3;
+
+    TEST_ASSERT_EQUAL(SCRIPT_ACTION_DONE, run(recipe, sizeof(recipe)));
+    TEST_ASSERT_EQUAL(2, slave.commands);
+    TEST_ASSERT_EQUAL(CMD_SLAVE_RESET, slave.last_command);
+    TEST_ASSERT_EQUAL(3, slave.reads);
+    TEST_ASSERT_EQUAL(300, slave.waited_ms);
+    TEST_ASSERT_EQUAL(SCRIPT_ERROR_NONE, vm.error);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_recipe_timeout
+| ------------------------------------------------------------------
+|  Description: tests that the loop gives up after 10 polls and the
+|               script fails without resetting the slave.
+*-------------------------------------------------------------------*/
+void test_recipe_timeout(void)  {
+    slave.reads_until_done = 50;
+
+    TEST_ASSERT_EQUAL(SCRIPT_ACTION_FAILED, run(recipe, sizeof(recipe)));
+    TEST_ASSERT_EQUAL(SCRIPT_ERROR_FAIL, vm.error);
+    TEST_ASSERT_EQUAL(10, slave.reads);
+    TEST_ASSERT_EQUAL(1, slave.commands);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_slave_failure_stops_script
+| ------------------------------------------------------------------
+|  Description: tests that a command the slave did not acknowledge
+|               stops the script.
+*-------------------------------------------------------------------*/
+void test_slave_failure_stops_script(void)  {
+    slave.fail_commands = 1;
+
+    TEST_ASSERT_EQUAL(SCRIPT_ACTION_FAILED, run(recipe, sizeof(recipe)));
+    TEST_ASSERT_EQUAL(SCRIPT_ERROR_SLAVE, vm.error);
+    TEST_ASSERT_EQUAL(0, slave.reads);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_busy_loop_detected
+| ------------------------------------------------------------------
+|  Description: tests that a loop without actions is stopped.
+*-------------------------------------------------------------------*/
+void test_busy_loop_detected(void)  {
+    const uint8_t busy[] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION, OP_SET, 1, 3, OP_JUMP, 0 };
+
+    TEST_ASSERT_EQUAL(SCRIPT_ACTION_FAILED, run(busy, sizeof(busy)));
+    TEST_ASSERT_EQUAL(SCRIPT_ERROR_STEPS, vm.error);
+    TEST_ASSERT_EQUAL(COMMAND_SCRIPT_MAX_STEPS, vm.executed);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_validate
+| ------------------------------------------------------------------
+|  Description: tests that malformed scripts are rejected.
+*-------------------------------------------------------------------*/
+void test_validate(void)  {
+    const uint8_t bad_magic[] = { 0x00, COMMAND_SCRIPT_VERSION, OP_END };
+    const uint8_t bad_version[] = { COMMAND_SCRIPT_MAGIC, 9, OP_END };
+    const uint8_t truncated[] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION, OP_WAIT, 0x01 };
+    const uint8_t unknown_op[] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION, 0x7F };
+    const uint8_t not_slave[] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION, OP_CMD, CMD_WIFI };
+    const uint8_t bad_counter[] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION, OP_SET, COMMAND_SCRIPT_COUNTERS, 1 };
+    const uint8_t mid_jump[] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION, OP_WAIT, 0, 1, OP_JUMP, 1 };
+    const uint8_t far_jump[] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION, OP_JUMP, 2 };
+    uint8_t too_long[COMMAND_SCRIPT_MAX_SIZE + 1] = { COMMAND_SCRIPT_MAGIC, COMMAND_SCRIPT_VERSION };
+
+    TEST_ASSERT_EQUAL(0, command_script_validate(recipe, sizeof(recipe)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(bad_magic, sizeof(bad_magic)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(bad_version, sizeof(bad_version)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(truncated, sizeof(truncated)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(unknown_op, sizeof(unknown_op)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(not_slave, sizeof(not_slave)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(bad_counter, sizeof(bad_counter)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(mid_jump, sizeof(mid_jump)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(far_jump, sizeof(far_jump)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(too_long, sizeof(too_long)));
+    TEST_ASSERT_EQUAL(-1, command_script_validate(recipe, COMMAND_SCRIPT_HEADER_SIZE));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_from_hex
+| ------------------------------------------------------------------
+|  Description: tests the hex form used by CMD_SCRIPT_STORE.
+*-------------------------------------------------------------------*/
+void test_from_hex(void)  {
+    uint8_t script[COMMAND_SCRIPT_MAX_SIZE];
+
+    TEST_ASSERT_EQUAL(sizeof(recipe),
+                      command_script_from_hex("  C501010007000A0300640204041008000509010400\r\n", script, sizeof(script)));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(recipe, script, sizeof(recipe));
+    TEST_ASSERT_EQUAL(3, command_script_from_hex("c5ff00&x=1", script, sizeof(script)));
+    TEST_ASSERT_EQUAL(-1, command_script_from_hex("C50", script, sizeof(script)));
+    TEST_ASSERT_EQUAL(-1, command_script_from_hex("C5010203", script, 2));
+    TEST_ASSERT_EQUAL(0, command_script_from_hex("", script, sizeof(script)));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_benchmark_step
+| ------------------------------------------------------------------
+|  Description: time the interpreter adds to each step (the slave
+|               answers at once), compared with the seconds of a
+|               cloud round trip per command.
+*-------------------------------------------------------------------*/
+void test_benchmark_step(void)  {
+    uint32_t actions = 0;
+    double total_ms;
+    clock_t start;
+    uint32_t i;
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        setUp();
+        slave.reads_until_done = 3;
+        run(recipe, sizeof(recipe));
+        actions += slave.commands + slave.reads + slave.waited_ms / 100;
+    }
+    total_ms = elapsed_ms(start);
+
+    printf("script interpreter: %u actions, %.1f ns/action\n", actions, total_ms * 1e6 / actions);
+    TEST_ASSERT_EQUAL(BENCHMARK_ITERATIONS * 8, actions);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static command_script_action_kind_t run(const uint8_t* script, uint16_t size)
+{
+    command_script_action_t action;
+    uint32_t i;
+
+    TEST_ASSERT_EQUAL(0, command_script_start(&vm, script, size));
+
+    for (i = 0; i < MAX_ACTIONS; i++)
+    {
+        action = command_script_next(&vm);
+        switch (action.kind)
+        {
+            case SCRIPT_ACTION_COMMAND:
+                slave.commands++;
+                slave.last_command = action.command;
+                if (action.command == CMD_SLAVE_START_A)
+                {
+                    slave.state = SLAVE_PROCESS_A;
+                }
+                command_script_result(&vm, !slave.fail_commands, 0);
+                break;
+
+            case SCRIPT_ACTION_STATUS:
+                slave.reads++;
+                if (slave.reads >= slave.reads_until_done)
+                {
+                    slave.state = SLAVE_DONE;
+                }
+                command_script_result(&vm, 1, slave.state);
+                break;
+
+            case SCRIPT_ACTION_WAIT:
+                slave.waited_ms += action.wait_ms;
+                break;
+
+            default:
+                return action.kind;
+        }
+    }
+
+    TEST_FAIL_MESSAGE("script did not end");
+    return SCRIPT_ACTION_FAILED;
+}
+
+static double elapsed_ms(clock_t start)
+{
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
@@ -0,0 +1,224 @@
+/* ===== [test_command_trace.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "command_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Macros of private constants ===== */
+#define MQTT_RX                 2       // rx_module_t of the firmware
+#define CMD_SLAVE_STATUS        5       // command_type_t of the firmware
+#define BENCHMARK_ITERATIONS    1000000
+
+/* ===== Declaration of private or external variables ===== */
+static latency_histogram_t histogram;
+static command_trace_stats_t stats;
+static command_trace_t trace;
+
+/* ===== Prototypes of private functions ===== */
+static void status_read_trace(int64_t ingress_us);
+static uint32_t count_of(const char* text, const char* pattern);
+static double elapsed_ms(clock_t start);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    memset(&histogram, 0, sizeof(histogram));
+    memset(&stats, 0, sizeof(stats));
+    memset(&trace, 0, sizeof(trace));
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_histogram_percentiles
+| ------------------------------------------------------------------
+|  Description: tests the percentiles of 1..1000 us, they must be
+|               within a bucket of the exact value.
+*-------------------------------------------------------------------*/
+void test_histogram_percentiles(void)  {
+    uint32_t i;
+
+    for (i = 1; i <= 1000; i++)
+    {
+        latency_histogram_add(&histogram, i);
+    }
+
+    TEST_ASSERT_EQUAL(1000, histogram.count);
+    TEST_ASSERT_EQUAL(500500, histogram.total_us);
+    TEST_ASSERT_EQUAL(1000, histogram.max_us);
+    TEST_ASSERT_INT_WITHIN(256, 500, latency_histogram_percentile(&histogram, 50));
+    TEST_ASSERT_INT_WITHIN(512, 900, latency_histogram_percentile(&histogram, 90));
+    TEST_ASSERT_INT_WITHIN(512, 990, latency_histogram_percentile(&histogram, 99));
+    TEST_ASSERT_EQUAL(1000, latency_histogram_percentile(&histogram, 100));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_histogram_edges
+| ------------------------------------------------------------------
+|  Description: tests empty histograms, negative samples, samples
+|               above the last bucket and a single sample.
+*-------------------------------------------------------------------*/
+void test_histogram_edges(void)  {
+    TEST_ASSERT_EQUAL(0, latency_histogram_percentile(&histogram, 50));
+
+    latency_histogram_add(&histogram, -5);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[0]);
+    TEST_ASSERT_EQUAL(0, latency_histogram_percentile(&histogram, 99));
+
+    memset(&histogram, 0, sizeof(histogram));
+    latency_histogram_add(&histogram, 60000000);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[LATENCY_HISTOGRAM_BUCKETS - 1]);
+    TEST_ASSERT_EQUAL(60000000, latency_histogram_percentile(&histogram, 50));
+
+    memset(&histogram, 0, sizeof(histogram));
+    latency_histogram_add(&histogram, 100);
+    TEST_ASSERT_EQUAL(1, histogram.buckets[6]);
+    TEST_ASSERT_EQUAL(100, latency_histogram_percentile(&histogram, 50));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_slave_trace_spans
+| ------------------------------------------------------------------
+|  Description: tests that every stage of a status read goes into
+|               its span histogram, and the total.
+*-------------------------------------------------------------------*/
+void test_slave_trace_spans(void)  {
+    status_read_trace(1000);
+
+    TEST_ASSERT_EQUAL(101300, command_trace_add(&stats, &trace));
+    TEST_ASSERT_EQUAL(0, stats.stage[TRACE_STAGE_INGRESS].count);
+    TEST_ASSERT_EQUAL(50, stats.stage[TRACE_STAGE_ENQUEUE].max_us);
+    TEST_ASSERT_EQUAL(200, stats.stage[TRACE_STAGE_DEQUEUE].max_us);
+    TEST_ASSERT_EQUAL(900, stats.stage[TRACE_STAGE_I2C_WRITE].max_us);
+    TEST_ASSERT_EQUAL(100000, stats.stage[TRACE_STAGE_SLAVE_ACK].max_us);
+    TEST_ASSERT_EQUAL(150, stats.stage[TRACE_STAGE_REPLY].max_us);
+    TEST_ASSERT_EQUAL(101300, stats.total.max_us);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_skipped_stages
+| ------------------------------------------------------------------
+|  Description: tests a command answered without the slave, and
+|               one without known ingress time.
+*-------------------------------------------------------------------*/
+void test_skipped_stages(void)  {
+    command_trace_start(&trace, MQTT_RX, CMD_SLAVE_STATUS, 7, 1000, 1040, 1100);
+    command_trace_mark(&trace, TRACE_STAGE_REPLY, 1130);
+
+    TEST_ASSERT_EQUAL(130, command_trace_add(&stats, &trace));
+    TEST_ASSERT_EQUAL(30, stats.stage[TRACE_STAGE_REPLY].max_us);
+    TEST_ASSERT_EQUAL(0, stats.stage[TRACE_STAGE_I2C_WRITE].count);
+    TEST_ASSERT_EQUAL(0, stats.stage[TRACE_STAGE_SLAVE_ACK].count);
+
+    command_trace_start(&trace, MQTT_RX, CMD_SLAVE_STATUS, 8, 0, 2000, 2010);
+    TEST_ASSERT_EQUAL(2000, trace.stage_us[TRACE_STAGE_INGRESS]);
+    TEST_ASSERT_EQUAL(10, command_trace_add(&stats, &trace));
+    TEST_ASSERT_EQUAL(1, stats.stage[TRACE_STAGE_ENQUEUE].buckets[0]);
+    TEST_ASSERT_EQUAL(2, stats.total.count);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_inactive_trace
+| ------------------------------------------------------------------
+|  Description: tests that a trace not started is never added nor
+|               marked.
+*-------------------------------------------------------------------*/
+void test_inactive_trace(void)  {
+    char buffer[COMMAND_TRACE_CHROME_MAX_SIZE];
+
+    command_trace_mark(&trace, TRACE_STAGE_REPLY, 500);
+    TEST_ASSERT_EQUAL(0, trace.stage_us[TRACE_STAGE_REPLY]);
+    TEST_ASSERT_FALSE(command_trace_active(&trace));
+    TEST_ASSERT_EQUAL(-1, command_trace_add(&stats, &trace));
+    TEST_ASSERT_EQUAL(0, stats.total.count);
+    TEST_ASSERT_EQUAL(-1, command_trace_chrome_events(&trace, "MQTT_RX", "CMD_SLAVE_STATUS", buffer, sizeof(buffer)));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_chrome_events
+| ------------------------------------------------------------------
+|  Description: tests the exported events: the command and its five
+|               spans, back to back on the thread of the module.
+*-------------------------------------------------------------------*/
+void test_chrome_events(void)  {
+    char buffer[COMMAND_TRACE_CHROME_MAX_SIZE];
+    int32_t len;
+
+    status_read_trace(1000);
+    len = command_trace_chrome_events(&trace, "MQTT_RX", "CMD_SLAVE_STATUS", buffer, sizeof(buffer));
+
+    TEST_ASSERT_EQUAL(strlen(buffer), len);
+    TEST_ASSERT_EQUAL(6, count_of(buffer, "\"ph\":\"X\""));
+    TEST_ASSERT_EQUAL(6, count_of(buffer, "\"tid\":2,"));
+    TEST_ASSERT_EQUAL(5, count_of(buffer, "},{"));
+    TEST_ASSERT_EQUAL_PTR(buffer, strstr(buffer, "{\"name\":\"CMD_SLAVE_STATUS\",\"cat\":\"MQTT_RX\",\"ph\":\"X\","
+                                                 "\"ts\":1000,\"dur\":101300,"));
+    TEST_ASSERT_NOT_NULL(strstr(buffer, "{\"name\":\"slave\",\"cat\":\"MQTT_RX\",\"ph\":\"X\",\"ts\":2150,\"dur\":100000,"));
+    TEST_ASSERT_EQUAL('}', buffer[len - 1]);
+
+    TEST_ASSERT_EQUAL(-1, command_trace_chrome_events(&trace, "MQTT_RX", "CMD_SLAVE_STATUS", buffer, 200));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_benchmark_trace
+| ------------------------------------------------------------------
+|  Description: time the command processor spends per traced
+|               command (start, marks and histograms).
+*-------------------------------------------------------------------*/
+void test_benchmark_trace(void)  {
+    double total_ms;
+    clock_t start;
+    uint32_t i;
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        status_read_trace(1000 + (i & 0xFFF));
+        command_trace_add(&stats, &trace);
+    }
+    total_ms = elapsed_ms(start);
+
+    printf("command trace: %.1f ns/command, total p50 = %lld us, p99 = %lld us\n",
+           total_ms * 1e6 / BENCHMARK_ITERATIONS, (long long)latency_histogram_percentile(&stats.total, 50),
+           (long long)latency_histogram_percentile(&stats.total, 99));
+    TEST_ASSERT_EQUAL(BENCHMARK_ITERATIONS, stats.total.count);
+}
+
+
+/* ===== Implementations of private functions ===== */
+// MQTT status request that goes to the slave
+static void status_read_trace(int64_t ingress_us)
+{
+    command_trace_start(&trace, MQTT_RX, CMD_SLAVE_STATUS, 3, ingress_us, ingress_us + 50, ingress_us + 250);
+    command_trace_mark(&trace, TRACE_STAGE_I2C_WRITE, ingress_us + 1150);
+    command_trace_mark(&trace, TRACE_STAGE_SLAVE_ACK, ingress_us + 101150);
+    command_trace_mark(&trace, TRACE_STAGE_REPLY, ingress_us + 101300);
+}
+
+static uint32_t count_of(const char* text, const char* pattern)
+{
+    uint32_t count = 0;
+
+    while ((text = strstr(text, pattern)) != NULL)
+    {
+        count++;
+        text++;
+    }
+    return count;
+}
+
+static double elapsed_ms(clock_t start)
+{
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
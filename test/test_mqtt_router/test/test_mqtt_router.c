@@ -0,0 +1,310 @@
+/* ===== [test_mqtt_router.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "mqtt_router.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Macros of private constants ===== */
+#define MAX_NODES               512
+#define MAX_HANDLERS            8
+#define BENCHMARK_FILTERS       100
+#define BENCHMARK_TOPICS        8
+#define BENCHMARK_ITERATIONS    100000
+#define FILTER_MAX_SIZE         48
+
+/* ===== Declaration of private or external variables ===== */
+static mqtt_router_node_t nodes[MAX_NODES];
+static mqtt_router_t router;
+
+// handler calls, each handler gets its number as context
+static int calls[MAX_HANDLERS];
+static char last_data[32];
+static int handler_ids[MAX_HANDLERS] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+static char benchmark_filters[BENCHMARK_FILTERS][FILTER_MAX_SIZE];
+static const char* benchmark_topics[BENCHMARK_TOPICS] = {
+    "/devices/dev_17/commands/relay",
+    "/devices/dev_42/config",
+    "/devices/dev_99/commands/ota/start",
+    "building/floor_3/room_12/temperature",
+    "building/floor_7/room_44/humidity",
+    "mbrignone/feeds/command-sent",
+    "unknown/topic/with/many/levels",
+    "$SYS/broker/uptime",
+};
+
+/* ===== Prototypes of private functions ===== */
+static void count_handler(const char* topic, uint16_t topic_len, const char* data, uint16_t data_len, void* context);
+static uint8_t dispatch(const char* topic);
+static void build_benchmark_filters(void);
+static double elapsed_ms(clock_t start);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    memset(calls, 0, sizeof(calls));
+    memset(last_data, 0, sizeof(last_data));
+    TEST_ASSERT_EQUAL(0, mqtt_router_init(&router, nodes, MAX_NODES));
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_exact_filter
+| ------------------------------------------------------------------
+|  Description: tests plain filters (including the leading empty
+|               level of the Google Cloud topics).
+*-------------------------------------------------------------------*/
+void test_exact_filter(void)  {
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "mbrignone/feeds/command-sent", count_handler, &handler_ids[0]));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "/devices/esp32_real/config", count_handler, &handler_ids[1]));
+
+    TEST_ASSERT_EQUAL(1, mqtt_router_dispatch(&router, "mbrignone/feeds/command-sent", 28, "led_on", 6));
+    TEST_ASSERT_EQUAL_STRING("led_on", last_data);
+    TEST_ASSERT_EQUAL(1, dispatch("/devices/esp32_real/config"));
+    TEST_ASSERT_EQUAL(0, dispatch("devices/esp32_real/config"));
+    TEST_ASSERT_EQUAL(0, dispatch("mbrignone/feeds/command"));
+    TEST_ASSERT_EQUAL(0, dispatch("mbrignone/feeds/command-sent/x"));
+    TEST_ASSERT_EQUAL(1, calls[0]);
+    TEST_ASSERT_EQUAL(1, calls[1]);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_single_level_wildcard
+| ------------------------------------------------------------------
+|  Description: tests that '+' matches exactly one level.
+*-------------------------------------------------------------------*/
+void test_single_level_wildcard(void)  {
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "sensors/+/temp", count_handler, &handler_ids[0]));
+
+    TEST_ASSERT_EQUAL(1, dispatch("sensors/kitchen/temp"));
+    TEST_ASSERT_EQUAL(1, dispatch("sensors//temp"));
+    TEST_ASSERT_EQUAL(0, dispatch("sensors/temp"));
+    TEST_ASSERT_EQUAL(0, dispatch("sensors/a/b/temp"));
+    TEST_ASSERT_EQUAL(2, calls[0]);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_multi_level_wildcard
+| ------------------------------------------------------------------
+|  Description: tests that '#' matches any number of levels, and
+|               the parent level too.
+*-------------------------------------------------------------------*/
+void test_multi_level_wildcard(void)  {
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "/devices/esp32_real/commands/#", count_handler, &handler_ids[0]));
+
+    TEST_ASSERT_EQUAL(1, dispatch("/devices/esp32_real/commands"));
+    TEST_ASSERT_EQUAL(1, dispatch("/devices/esp32_real/commands/ota"));
+    TEST_ASSERT_EQUAL(1, dispatch("/devices/esp32_real/commands/ota/start"));
+    TEST_ASSERT_EQUAL(0, dispatch("/devices/esp32_real/config"));
+    TEST_ASSERT_EQUAL(3, calls[0]);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_overlapping_filters
+| ------------------------------------------------------------------
+|  Description: tests that every matching filter gets the message.
+*-------------------------------------------------------------------*/
+void test_overlapping_filters(void)  {
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "a/b/c", count_handler, &handler_ids[0]));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "a/+/c", count_handler, &handler_ids[1]));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "a/#", count_handler, &handler_ids[2]));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "+/+/+", count_handler, &handler_ids[3]));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "#", count_handler, &handler_ids[4]));
+
+    TEST_ASSERT_EQUAL(5, dispatch("a/b/c"));
+    TEST_ASSERT_EQUAL(4, dispatch("a/x/c"));
+    TEST_ASSERT_EQUAL(2, dispatch("a"));
+    TEST_ASSERT_EQUAL(1, dispatch("b"));
+    TEST_ASSERT_EQUAL_INT(1, calls[0]);
+    TEST_ASSERT_EQUAL_INT(2, calls[1]);
+    TEST_ASSERT_EQUAL_INT(3, calls[2]);
+    TEST_ASSERT_EQUAL_INT(2, calls[3]);
+    TEST_ASSERT_EQUAL_INT(4, calls[4]);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_system_topics
+| ------------------------------------------------------------------
+|  Description: tests that a wildcard in the first level does not
+|               match the topics starting with '$'.
+*-------------------------------------------------------------------*/
+void test_system_topics(void)  {
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "#", count_handler, &handler_ids[0]));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "+/broker/uptime", count_handler, &handler_ids[1]));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "$SYS/#", count_handler, &handler_ids[2]));
+
+    TEST_ASSERT_EQUAL(1, dispatch("$SYS/broker/uptime"));
+    TEST_ASSERT_EQUAL(1, calls[2]);
+    TEST_ASSERT_EQUAL(0, mqtt_topic_matches("#", "$SYS/broker/uptime", 18));
+    TEST_ASSERT_EQUAL(1, mqtt_topic_matches("$SYS/+/uptime", "$SYS/broker/uptime", 18));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_invalid_filters
+| ------------------------------------------------------------------
+|  Description: tests the filters that must be rejected.
+*-------------------------------------------------------------------*/
+void test_invalid_filters(void)  {
+    TEST_ASSERT_EQUAL(-1, mqtt_router_add(&router, "", count_handler, NULL));
+    TEST_ASSERT_EQUAL(-1, mqtt_router_add(&router, "a/#/b", count_handler, NULL));
+    TEST_ASSERT_EQUAL(-1, mqtt_router_add(&router, "a/b#", count_handler, NULL));
+    TEST_ASSERT_EQUAL(-1, mqtt_router_add(&router, "a/+b/c", count_handler, NULL));
+    TEST_ASSERT_EQUAL(-1, mqtt_router_add(&router, "a/b", NULL, NULL));
+
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "a/b", count_handler, NULL));
+    TEST_ASSERT_EQUAL(-1, mqtt_router_add(&router, "a/b", count_handler, NULL));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_out_of_nodes
+| ------------------------------------------------------------------
+|  Description: tests that a full node array is reported.
+*-------------------------------------------------------------------*/
+void test_out_of_nodes(void)  {
+    TEST_ASSERT_EQUAL(0, mqtt_router_init(&router, nodes, 3));
+    TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, "a/b", count_handler, NULL));
+    TEST_ASSERT_EQUAL(-1, mqtt_router_add(&router, "c", count_handler, NULL));
+    TEST_ASSERT_EQUAL(-1, mqtt_router_init(&router, nodes, 0));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_router_matches_reference
+| ------------------------------------------------------------------
+|  Description: tests that the trie and mqtt_topic_matches agree on
+|               the benchmark filters.
+*-------------------------------------------------------------------*/
+void test_router_matches_reference(void)  {
+    uint8_t expected;
+    uint16_t i, t;
+
+    build_benchmark_filters();
+    for (i = 0; i < BENCHMARK_FILTERS; i++)
+    {
+        TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, benchmark_filters[i], count_handler, NULL));
+    }
+
+    for (t = 0; t < BENCHMARK_TOPICS; t++)
+    {
+        expected = 0;
+        for (i = 0; i < BENCHMARK_FILTERS; i++)
+        {
+            expected += mqtt_topic_matches(benchmark_filters[i], benchmark_topics[t], strlen(benchmark_topics[t]));
+        }
+        TEST_ASSERT_EQUAL(expected, dispatch(benchmark_topics[t]));
+    }
+}
+
+/*------------------------------------------------------------------
+|  Test: test_benchmark_dispatch
+| ------------------------------------------------------------------
+|  Description: compares the trie with checking the 100 filters one
+|               after the other (only reported, never fails).
+*-------------------------------------------------------------------*/
+void test_benchmark_dispatch(void)  {
+    volatile uint32_t matches = 0;
+    double trie_ms, linear_ms;
+    clock_t start;
+    uint32_t i;
+    uint16_t f;
+    const char* topic;
+    uint16_t topic_len;
+
+    build_benchmark_filters();
+    for (f = 0; f < BENCHMARK_FILTERS; f++)
+    {
+        TEST_ASSERT_EQUAL(0, mqtt_router_add(&router, benchmark_filters[f], count_handler, NULL));
+    }
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        topic = benchmark_topics[i % BENCHMARK_TOPICS];
+        matches += mqtt_router_dispatch(&router, topic, strlen(topic), "", 0);
+    }
+    trie_ms = elapsed_ms(start);
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        topic = benchmark_topics[i % BENCHMARK_TOPICS];
+        topic_len = strlen(topic);
+        for (f = 0; f < BENCHMARK_FILTERS; f++)
+        {
+            matches += mqtt_topic_matches(benchmark_filters[f], topic, topic_len);
+        }
+    }
+    linear_ms = elapsed_ms(start);
+
+    printf("dispatch %d topics over %d filters (%u nodes): trie = %.1f ns/topic, linear = %.1f ns/topic\n",
+           BENCHMARK_ITERATIONS, BENCHMARK_FILTERS, router.used,
+           trie_ms * 1e6 / BENCHMARK_ITERATIONS, linear_ms * 1e6 / BENCHMARK_ITERATIONS);
+    TEST_ASSERT_GREATER_THAN(0, matches);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static void count_handler(const char* topic, uint16_t topic_len, const char* data, uint16_t data_len, void* context)
+{
+    if (context != NULL)
+    {
+        calls[*(int*)context]++;
+    }
+    if (data_len < sizeof(last_data))
+    {
+        memcpy(last_data, data, data_len);
+        last_data[data_len] = '\0';
+    }
+}
+
+static uint8_t dispatch(const char* topic)
+{
+    return mqtt_router_dispatch(&router, topic, strlen(topic), "", 0);
+}
+
+static void build_benchmark_filters(void)
+{
+    uint16_t i;
+
+    // a realistic mix: per device topics, per room sensors and a few wildcards
+    for (i = 0; i < BENCHMARK_FILTERS; i++)
+    {
+        switch (i % 5)
+        {
+            case 0:
+                snprintf(benchmark_filters[i], FILTER_MAX_SIZE, "/devices/dev_%u/config", i);
+                break;
+            case 1:
+                snprintf(benchmark_filters[i], FILTER_MAX_SIZE, "/devices/dev_%u/commands/#", i);
+                break;
+            case 2:
+                snprintf(benchmark_filters[i], FILTER_MAX_SIZE, "building/floor_%u/room_%u/temperature", i % 10, i);
+                break;
+            case 3:
+                snprintf(benchmark_filters[i], FILTER_MAX_SIZE, "building/+/room_%u/humidity", i);
+                break;
+            default:
+                snprintf(benchmark_filters[i], FILTER_MAX_SIZE, "feeds/%u/+", i);
+                break;
+        }
+    }
+    // plus the wildcards that match almost everything
+    snprintf(benchmark_filters[BENCHMARK_FILTERS - 1], FILTER_MAX_SIZE, "/devices/+/config");
+    snprintf(benchmark_filters[BENCHMARK_FILTERS - 2], FILTER_MAX_SIZE, "building/#");
+}
+
+static double elapsed_ms(clock_t start)
+{
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
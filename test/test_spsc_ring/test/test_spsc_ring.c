@@ -0,0 +1,360 @@
+/* ===== [test_spsc_ring.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "spsc_ring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Macros of private constants ===== */
+#define RING_CAPACITY           8
+#define CONCURRENT_ITEMS        2000000
+#define WAKEUP_ITEMS            200000
+#define WAKEUP_BURST            5           // items pushed back to back before the producer pauses
+#define WAKEUP_TIMEOUT_MS       200         // a lost wake up shows up as a timeout with items waiting
+
+/* ===== Private structs and enums ===== */
+// sequence and its complement, a torn or stale item breaks the pair
+typedef struct {
+    uint32_t    seq;
+    uint32_t    check;
+    uint8_t     payload[24];
+}   test_item_t;
+
+// task notification of the consumer (counting, cleared on take like ulTaskNotifyTake(pdTRUE, ...))
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    uint32_t        count;
+}   test_notification_t;
+
+typedef struct {
+    spsc_ring_t*            ring;
+    uint32_t                items;
+    uint8_t                 notify;     // wake the consumer up when the ring says so
+    test_notification_t*    notification;
+    uint32_t                wakeups;
+}   test_producer_t;
+
+/* ===== Declaration of private or external variables ===== */
+static spsc_ring_t ring;
+static test_item_t items[RING_CAPACITY];
+
+/* ===== Prototypes of private functions ===== */
+static test_item_t make_item(uint32_t seq);
+static void* producer_thread(void* argument);
+static void notify(test_notification_t* notification);
+static uint32_t notify_take(test_notification_t* notification, uint32_t timeout_ms);
+static double elapsed_ms(const struct timespec* start);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    memset(items, 0, sizeof(items));
+    TEST_ASSERT_EQUAL(0, spsc_ring_init(&ring, items, sizeof(test_item_t), RING_CAPACITY));
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_capacity_power_of_2
+| ------------------------------------------------------------------
+|  Description: tests that only power of 2 capacities are accepted.
+*-------------------------------------------------------------------*/
+void test_capacity_power_of_2(void)  {
+    TEST_ASSERT_EQUAL(-1, spsc_ring_init(&ring, items, sizeof(test_item_t), 0));
+    TEST_ASSERT_EQUAL(-1, spsc_ring_init(&ring, items, sizeof(test_item_t), 3));
+    TEST_ASSERT_EQUAL(-1, spsc_ring_init(&ring, items, sizeof(test_item_t), 6));
+    TEST_ASSERT_EQUAL(0, spsc_ring_init(&ring, items, sizeof(test_item_t), 1));
+    TEST_ASSERT_EQUAL(0, spsc_ring_init(&ring, items, sizeof(test_item_t), 8));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_fifo_and_full
+| ------------------------------------------------------------------
+|  Description: tests the order of the items and that a full ring
+|               drops (and counts) the new ones.
+*-------------------------------------------------------------------*/
+void test_fifo_and_full(void)  {
+    test_item_t item;
+    uint32_t i;
+
+    TEST_ASSERT_NULL(spsc_ring_peek(&ring));
+    TEST_ASSERT_EQUAL(0, spsc_ring_pop(&ring, &item));
+
+    for (i = 0; i < RING_CAPACITY; i++)
+    {
+        item = make_item(i);
+        TEST_ASSERT_TRUE(spsc_ring_push(&ring, &item) >= 0);
+    }
+    TEST_ASSERT_EQUAL(RING_CAPACITY, spsc_ring_count(&ring));
+
+    item = make_item(RING_CAPACITY);
+    TEST_ASSERT_EQUAL(-1, spsc_ring_push(&ring, &item));
+    TEST_ASSERT_NULL(spsc_ring_reserve(&ring));
+    TEST_ASSERT_EQUAL(2, spsc_ring_dropped(&ring));
+
+    for (i = 0; i < RING_CAPACITY; i++)
+    {
+        TEST_ASSERT_EQUAL(1, spsc_ring_pop(&ring, &item));
+        TEST_ASSERT_EQUAL(i, item.seq);
+    }
+    TEST_ASSERT_EQUAL(0, spsc_ring_pop(&ring, &item));
+    TEST_ASSERT_EQUAL(0, spsc_ring_count(&ring));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_wake_when_drained
+| ------------------------------------------------------------------
+|  Description: tests that the producer is only asked to wake the
+|               consumer up when the consumer took every item.
+*-------------------------------------------------------------------*/
+void test_wake_when_drained(void)  {
+    test_item_t item = make_item(0);
+
+    TEST_ASSERT_EQUAL(1, spsc_ring_push(&ring, &item));
+    TEST_ASSERT_EQUAL(0, spsc_ring_push(&ring, &item));
+    TEST_ASSERT_EQUAL(1, spsc_ring_pop(&ring, &item));
+    // one item still waiting, the consumer has not finished yet
+    TEST_ASSERT_EQUAL(0, spsc_ring_push(&ring, &item));
+    TEST_ASSERT_EQUAL(1, spsc_ring_pop(&ring, &item));
+    TEST_ASSERT_EQUAL(1, spsc_ring_pop(&ring, &item));
+    TEST_ASSERT_EQUAL(1, spsc_ring_push(&ring, &item));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_reserve_commit_in_place
+| ------------------------------------------------------------------
+|  Description: tests an item filled in the ring storage, it is
+|               not visible until it is committed.
+*-------------------------------------------------------------------*/
+void test_reserve_commit_in_place(void)  {
+    test_item_t* slot = spsc_ring_reserve(&ring);
+    test_item_t* peeked;
+
+    TEST_ASSERT_NOT_NULL(slot);
+    *slot = make_item(42);
+    TEST_ASSERT_NULL(spsc_ring_peek(&ring));
+
+    TEST_ASSERT_EQUAL(1, spsc_ring_commit(&ring));
+    peeked = spsc_ring_peek(&ring);
+    TEST_ASSERT_EQUAL_PTR(slot, peeked);
+    TEST_ASSERT_EQUAL(42, peeked->seq);
+
+    // peek does not take the item
+    TEST_ASSERT_EQUAL_PTR(peeked, spsc_ring_peek(&ring));
+    spsc_ring_release(&ring);
+    TEST_ASSERT_NULL(spsc_ring_peek(&ring));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_index_wrap_around
+| ------------------------------------------------------------------
+|  Description: tests the free running indexes when they overflow.
+*-------------------------------------------------------------------*/
+void test_index_wrap_around(void)  {
+    test_item_t item;
+    uint32_t i;
+
+    ring.head = UINT32_MAX - 2;
+    ring.tail = UINT32_MAX - 2;
+
+    for (i = 0; i < RING_CAPACITY; i++)
+    {
+        item = make_item(i);
+        TEST_ASSERT_TRUE(spsc_ring_push(&ring, &item) >= 0);
+    }
+    TEST_ASSERT_EQUAL(RING_CAPACITY, spsc_ring_count(&ring));
+    TEST_ASSERT_EQUAL(-1, spsc_ring_push(&ring, &item));
+
+    for (i = 0; i < RING_CAPACITY; i++)
+    {
+        TEST_ASSERT_EQUAL(1, spsc_ring_pop(&ring, &item));
+        TEST_ASSERT_EQUAL(i, item.seq);
+        TEST_ASSERT_EQUAL(~i, item.check);
+    }
+    TEST_ASSERT_EQUAL(0, spsc_ring_count(&ring));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_concurrent_order
+| ------------------------------------------------------------------
+|  Description: tests a producer and a consumer thread running
+|               flat out: every item arrives once, in order and
+|               complete.
+*-------------------------------------------------------------------*/
+void test_concurrent_order(void)  {
+    test_producer_t producer = { &ring, CONCURRENT_ITEMS, 0, NULL, 0 };
+    test_item_t item;
+    struct timespec start;
+    pthread_t thread;
+    uint32_t expected = 0;
+    double total_ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, producer_thread, &producer));
+
+    while (expected < CONCURRENT_ITEMS)
+    {
+        if (spsc_ring_pop(&ring, &item) == 0)
+        {
+            sched_yield();
+            continue;
+        }
+        if (item.seq != expected || item.check != ~expected || item.payload[23] != (uint8_t)expected)
+        {
+            break;
+        }
+        expected++;
+    }
+
+    pthread_join(thread, NULL);
+    total_ms = elapsed_ms(&start);
+    printf("spsc ring: %u items handed over in %.1f ms (%.1f ns/item)\n", CONCURRENT_ITEMS, total_ms,
+           total_ms * 1e6 / CONCURRENT_ITEMS);
+
+    TEST_ASSERT_EQUAL(CONCURRENT_ITEMS, expected);
+    TEST_ASSERT_EQUAL(0, spsc_ring_count(&ring));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_concurrent_wakeup
+| ------------------------------------------------------------------
+|  Description: tests a consumer that sleeps until it is notified
+|               and a producer that only notifies when the ring asks
+|               for it: no wake up may be lost.
+*-------------------------------------------------------------------*/
+void test_concurrent_wakeup(void)  {
+    test_notification_t notification = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+    test_producer_t producer = { &ring, WAKEUP_ITEMS, 1, &notification, 0 };
+    test_item_t item;
+    pthread_t thread;
+    uint32_t expected = 0;
+    uint32_t sleeps = 0;
+    uint32_t lost_wakeups = 0;
+    uint8_t in_order = 1;
+
+    TEST_ASSERT_EQUAL(0, pthread_create(&thread, NULL, producer_thread, &producer));
+
+    while (expected < WAKEUP_ITEMS)
+    {
+        while (spsc_ring_pop(&ring, &item))
+        {
+            in_order &= (item.seq == expected);
+            expected++;
+        }
+        if (expected == WAKEUP_ITEMS)
+        {
+            break;
+        }
+        sleeps++;
+        if (notify_take(&notification, WAKEUP_TIMEOUT_MS) == 0 && spsc_ring_count(&ring) > 0)
+        {
+            lost_wakeups++;
+        }
+    }
+
+    pthread_join(thread, NULL);
+    printf("spsc ring: %u consumer sleeps, %u wake ups, %u lost\n", sleeps, producer.wakeups, lost_wakeups);
+
+    TEST_ASSERT_EQUAL(WAKEUP_ITEMS, expected);
+    TEST_ASSERT_TRUE(in_order);
+    TEST_ASSERT_EQUAL(0, lost_wakeups);
+    TEST_ASSERT_TRUE(producer.wakeups > 0);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static test_item_t make_item(uint32_t seq)
+{
+    test_item_t item;
+
+    item.seq = seq;
+    item.check = ~seq;
+    memset(item.payload, (uint8_t)seq, sizeof(item.payload));
+    return item;
+}
+
+static void* producer_thread(void* argument)
+{
+    test_producer_t* producer = argument;
+    test_item_t item;
+    int8_t pushed;
+    uint32_t i;
+
+    for (i = 0; i < producer->items; i++)
+    {
+        item = make_item(i);
+        while ((pushed = spsc_ring_push(producer->ring, &item)) < 0)
+        {
+            sched_yield();
+        }
+        if (producer->notify && pushed > 0)
+        {
+            producer->wakeups++;
+            notify(producer->notification);
+        }
+        // let the consumer go to sleep now and then
+        if (producer->notify && i % WAKEUP_BURST == 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void notify(test_notification_t* notification)
+{
+    pthread_mutex_lock(&notification->lock);
+    notification->count++;
+    pthread_cond_signal(&notification->cond);
+    pthread_mutex_unlock(&notification->lock);
+}
+
+static uint32_t notify_take(test_notification_t* notification, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    uint32_t count;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&notification->lock);
+    while (notification->count == 0)
+    {
+        if (pthread_cond_timedwait(&notification->cond, &notification->lock, &deadline) == ETIMEDOUT)
+        {
+            break;
+        }
+    }
+    count = notification->count;
+    notification->count = 0;
+    pthread_mutex_unlock(&notification->lock);
+    return count;
+}
+
+static double elapsed_ms(const struct timespec* start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
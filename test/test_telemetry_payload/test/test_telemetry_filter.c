@@ -0,0 +1,160 @@
+/* ===== [test_telemetry_filter.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "telemetry_filter.h"
+
+#include <stdio.h>
+
+/* ===== Macros of private constants ===== */
+#define DEADBAND            2
+#define HEARTBEAT_S         300
+#define SAMPLE_PERIOD_S     30
+#define SIMULATED_SAMPLES   2880    // one day of 30 s samples
+
+/* ===== Declaration of private or external variables ===== */
+static telemetry_filter_t filter;
+static telemetry_sample_t sample;
+
+/* ===== Prototypes of private functions ===== */
+static telemetry_filter_reason_t check(long timestamp, int32_t state_int, int32_t temp);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    telemetry_filter_init(&filter, DEADBAND, HEARTBEAT_S);
+    sample.device = "esp32_real";
+    sample.state = "SLAVE_IDLE";
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_first_sample_published
+| ------------------------------------------------------------------
+|  Description: tests that the first sample is always published.
+*-------------------------------------------------------------------*/
+void test_first_sample_published(void)  {
+    TEST_ASSERT_TRUE(telemetry_filter_heartbeat_due(&filter, 0));
+    TEST_ASSERT_EQUAL(TELEMETRY_PUBLISH_FIRST, check(1000, 0, 25));
+    TEST_ASSERT_FALSE(telemetry_filter_heartbeat_due(&filter, 1000 + SAMPLE_PERIOD_S));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_deadband
+| ------------------------------------------------------------------
+|  Description: tests that changes inside the deadband are
+|               suppressed, and that the reference is the last
+|               published value (a slow drift is not lost).
+*-------------------------------------------------------------------*/
+void test_deadband(void)  {
+    check(1000, 0, 25);
+
+    TEST_ASSERT_EQUAL(TELEMETRY_SUPPRESSED, check(1030, 0, 27));
+    TEST_ASSERT_EQUAL(TELEMETRY_SUPPRESSED, check(1060, 0, 23));
+    TEST_ASSERT_EQUAL(TELEMETRY_PUBLISH_DEADBAND, check(1090, 0, 28));
+    TEST_ASSERT_EQUAL(TELEMETRY_SUPPRESSED, check(1120, 0, 26));
+    TEST_ASSERT_EQUAL(TELEMETRY_PUBLISH_DEADBAND, check(1150, 0, 25));
+
+    TEST_ASSERT_EQUAL(3, filter.stats.suppressed);
+    TEST_ASSERT_EQUAL(2, filter.stats.deadband);
+    TEST_ASSERT_EQUAL(6, filter.stats.evaluated);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_state_change_never_suppressed
+| ------------------------------------------------------------------
+|  Description: tests that every state change is published, even
+|               if the other values did not change.
+*-------------------------------------------------------------------*/
+void test_state_change_never_suppressed(void)  {
+    check(1000, 0, 25);
+
+    TEST_ASSERT_EQUAL(TELEMETRY_PUBLISH_STATE, check(1030, 2, 25));
+    TEST_ASSERT_EQUAL(TELEMETRY_SUPPRESSED, check(1060, 2, 25));
+    TEST_ASSERT_EQUAL(TELEMETRY_PUBLISH_STATE, check(1090, 4, 30));
+    TEST_ASSERT_EQUAL(TELEMETRY_PUBLISH_STATE, check(1120, 0, 30));
+
+    TEST_ASSERT_EQUAL(3, filter.stats.state);
+    TEST_ASSERT_EQUAL(0, filter.stats.deadband);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_heartbeat
+| ------------------------------------------------------------------
+|  Description: tests that a sample is published at least every
+|               heartbeat interval.
+*-------------------------------------------------------------------*/
+void test_heartbeat(void)  {
+    long t;
+
+    check(1000, 0, 25);
+    for (t = 1000 + SAMPLE_PERIOD_S; t < 1000 + HEARTBEAT_S; t += SAMPLE_PERIOD_S)
+    {
+        TEST_ASSERT_EQUAL(TELEMETRY_SUPPRESSED, check(t, 0, 25));
+    }
+
+    TEST_ASSERT_TRUE(telemetry_filter_heartbeat_due(&filter, t));
+    TEST_ASSERT_EQUAL(TELEMETRY_PUBLISH_HEARTBEAT, check(t, 0, 25));
+    TEST_ASSERT_EQUAL(TELEMETRY_SUPPRESSED, check(t + SAMPLE_PERIOD_S, 0, 25));
+    TEST_ASSERT_EQUAL(1, filter.stats.heartbeat);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_simulated_day
+| ------------------------------------------------------------------
+|  Description: runs a day of samples with the firmware temperature
+|               simulation and a few state changes, and reports the
+|               uplink reduction (every state change must be sent).
+*-------------------------------------------------------------------*/
+void test_simulated_day(void)  {
+    uint32_t published = 0;
+    uint32_t state_changes = 0;
+    int32_t state = 0, temp = 25;
+    long t = 1571500000;
+    uint32_t i;
+
+    for (i = 0; i < SIMULATED_SAMPLES; i++, t += SAMPLE_PERIOD_S)
+    {
+        if (i % 240 == 0)
+        {
+            state = (state + 1) % 5;
+            state_changes++;
+        }
+        if (check(t, state, temp) != TELEMETRY_SUPPRESSED)
+        {
+            published++;
+        }
+
+        // same pattern as the firmware fake temperature, kept bounded
+        temp += (t & 1) ? 1 : -1;
+        if (i % 7 == 0)
+        {
+            temp += (temp > 25) ? -1 : 1;
+        }
+    }
+
+    printf("telemetry filter: %u of %u samples published (%u state, %u deadband, %u heartbeat)\n",
+           published, SIMULATED_SAMPLES, filter.stats.state, filter.stats.deadband, filter.stats.heartbeat);
+    TEST_ASSERT_EQUAL(state_changes - 1, filter.stats.state);
+    TEST_ASSERT_EQUAL(SIMULATED_SAMPLES, published + filter.stats.suppressed);
+    TEST_ASSERT_LESS_THAN(SIMULATED_SAMPLES / 2, published);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static telemetry_filter_reason_t check(long timestamp, int32_t state_int, int32_t temp)
+{
+    sample.timestamp = timestamp;
+    sample.state_int = state_int;
+    sample.temp = temp;
+
+    return telemetry_filter_check(&filter, &sample);
+}
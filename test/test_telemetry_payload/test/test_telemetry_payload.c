@@ -0,0 +1,248 @@
+/* ===== [test_telemetry_payload.c] =====
+ * Copyright Matias Brignone <mnbrignone@gmail.com>
+ * All rights reserved.
+ *
+ * Version: 0.1.0
+ * Creation Date: 2019
+ */
+
+/* ===== Dependencies ===== */
+#include "unity.h"
+#include "cbor_encoder.h"
+#include "telemetry_payload.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Macros of private constants ===== */
+#define PAYLOAD_MAX_SIZE        200
+#define BENCHMARK_ITERATIONS    200000
+
+/* ===== Declaration of private or external variables ===== */
+static uint8_t buffer[PAYLOAD_MAX_SIZE];
+static cbor_encoder_t encoder;
+static telemetry_sample_t sample;
+
+/* ===== Prototypes of private functions ===== */
+static double elapsed_ms(clock_t start);
+
+
+/* ===== Implementations of public functions ===== */
+void setUp(void)    {
+    memset(buffer, 0xAA, sizeof(buffer));
+    cbor_encoder_init(&encoder, buffer, sizeof(buffer));
+
+    sample.timestamp = 1571500000;
+    sample.device = "esp32_device";
+    sample.state = "LED_ON_1";
+    sample.state_int = 3;
+    sample.temp = 27;
+}
+
+void tearDown(void) {
+}
+
+/*------------------------------------------------------------------
+|  Test: test_cbor_uint_heads
+| ------------------------------------------------------------------
+|  Description: tests the shortest head for each argument size.
+*-------------------------------------------------------------------*/
+void test_cbor_uint_heads(void)  {
+    const uint8_t expected[] = {0x00, 0x17, 0x18, 0x18, 0x19, 0x01, 0xF4,
+                                0x1A, 0x00, 0x01, 0x00, 0x00,
+                                0x1B, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+
+    cbor_encode_uint(&encoder, 0);
+    cbor_encode_uint(&encoder, 23);
+    cbor_encode_uint(&encoder, 24);
+    cbor_encode_uint(&encoder, 500);
+    cbor_encode_uint(&encoder, 65536);
+    cbor_encode_uint(&encoder, 4294967296ULL);
+
+    TEST_ASSERT_EQUAL(sizeof(expected), cbor_encoder_length(&encoder));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_cbor_negative_int
+| ------------------------------------------------------------------
+|  Description: tests that negative values use major type 1.
+*-------------------------------------------------------------------*/
+void test_cbor_negative_int(void)  {
+    const uint8_t expected[] = {0x20, 0x38, 0x63, 0x39, 0x03, 0xE7, 0x0A};
+
+    cbor_encode_int(&encoder, -1);
+    cbor_encode_int(&encoder, -100);
+    cbor_encode_int(&encoder, -1000);
+    cbor_encode_int(&encoder, 10);
+
+    TEST_ASSERT_EQUAL(sizeof(expected), cbor_encoder_length(&encoder));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_cbor_containers_and_text
+| ------------------------------------------------------------------
+|  Description: tests map, array, text and bool items.
+*-------------------------------------------------------------------*/
+void test_cbor_containers_and_text(void)  {
+    const uint8_t expected[] = {0xA2, 0x61, 'a', 0xF5, 0x62, 'b', 'c', 0x82, 0xF4, 0x01};
+
+    cbor_encode_map(&encoder, 2);
+    cbor_encode_cstr(&encoder, "a");
+    cbor_encode_bool(&encoder, 1);
+    cbor_encode_cstr(&encoder, "bc");
+    cbor_encode_array(&encoder, 2);
+    cbor_encode_bool(&encoder, 0);
+    cbor_encode_uint(&encoder, 1);
+
+    TEST_ASSERT_EQUAL(sizeof(expected), cbor_encoder_length(&encoder));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_cbor_overflow
+| ------------------------------------------------------------------
+|  Description: tests that the encoder never writes past the buffer
+|               and reports the overflow.
+*-------------------------------------------------------------------*/
+void test_cbor_overflow(void)  {
+    cbor_encoder_init(&encoder, buffer, 4);
+    cbor_encode_cstr(&encoder, "too long");
+    cbor_encode_uint(&encoder, 1);
+
+    TEST_ASSERT_EQUAL(-1, cbor_encoder_length(&encoder));
+    TEST_ASSERT_EQUAL_HEX8(0xAA, buffer[4]);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_json_matches_format
+| ------------------------------------------------------------------
+|  Description: tests that the JSON payload is the same one that was
+|               published before the encoder was added.
+*-------------------------------------------------------------------*/
+void test_json_matches_format(void)  {
+    char expected[PAYLOAD_MAX_SIZE];
+    int32_t len;
+
+    snprintf(expected, sizeof(expected), TELEMETRY_PAYLOAD_JSON, sample.timestamp, sample.device,
+             sample.state, sample.state_int, sample.temp);
+
+    len = telemetry_encode(&sample, TELEMETRY_FORMAT_JSON, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(expected), len);
+    TEST_ASSERT_EQUAL_STRING(expected, (char*)buffer);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_cbor_sample
+| ------------------------------------------------------------------
+|  Description: tests the start of the CBOR sample (a 5 pair map
+|               with the JSON keys) and the overflow handling.
+*-------------------------------------------------------------------*/
+void test_cbor_sample(void)  {
+    const uint8_t expected[] = {0xA5, 0x69, 't', 'i', 'm', 'e', 's', 't', 'a', 'm', 'p',
+                                0x1A, 0x5D, 0xAB, 0x2F, 0xE0};
+    int32_t len;
+
+    len = telemetry_encode(&sample, TELEMETRY_FORMAT_CBOR, buffer, sizeof(buffer));
+    TEST_ASSERT_GREATER_THAN(sizeof(expected), len);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+
+    TEST_ASSERT_EQUAL(-1, telemetry_encode(&sample, TELEMETRY_FORMAT_CBOR, buffer, len - 1));
+    TEST_ASSERT_EQUAL(-1, telemetry_encode(&sample, TELEMETRY_FORMAT_JSON, buffer, 10));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_measurements_only
+| ------------------------------------------------------------------
+|  Description: tests that a sample without state leaves the state
+|               keys out (it is reported on the state topic).
+*-------------------------------------------------------------------*/
+void test_measurements_only(void)  {
+    const char* expected = "{\"timestamp\": 1571500000, \"device\": \"esp32_device\", \"temp\": 27}";
+    int32_t full_len, len;
+
+    full_len = telemetry_encode(&sample, TELEMETRY_FORMAT_CBOR, buffer, sizeof(buffer));
+    sample.state = NULL;
+
+    len = telemetry_encode(&sample, TELEMETRY_FORMAT_JSON, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(expected), len);
+    TEST_ASSERT_EQUAL_STRING(expected, (char*)buffer);
+
+    len = telemetry_encode(&sample, TELEMETRY_FORMAT_CBOR, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_HEX8(0xA3, buffer[0]);
+    TEST_ASSERT_LESS_THAN(full_len, len);
+}
+
+/*------------------------------------------------------------------
+|  Test: test_device_state
+| ------------------------------------------------------------------
+|  Description: tests the device state payload and the change
+|               detection.
+*-------------------------------------------------------------------*/
+void test_device_state(void)  {
+    const char* expected = "{\"state\": \"LED_ON_1\", \"state_int\": 3, \"firmware\": \"0.1.0\", \"mode\": \"WIFI\"}";
+    char firmware[] = "0.1.0";
+    telemetry_device_state_t state = { .state = "LED_ON_1", .state_int = 3, .firmware = "0.1.0", .mode = "WIFI" };
+    telemetry_device_state_t reported = state;
+    int32_t len;
+
+    len = telemetry_encode_state(&state, TELEMETRY_FORMAT_JSON, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(strlen(expected), len);
+    TEST_ASSERT_EQUAL_STRING(expected, (char*)buffer);
+    TEST_ASSERT_EQUAL(-1, telemetry_encode_state(&state, TELEMETRY_FORMAT_JSON, buffer, len));
+
+    len = telemetry_encode_state(&state, TELEMETRY_FORMAT_CBOR, buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL_HEX8(0xA4, buffer[0]);
+    TEST_ASSERT_EQUAL(-1, telemetry_encode_state(&state, TELEMETRY_FORMAT_CBOR, buffer, len - 1));
+
+    // strings are compared by value
+    reported.firmware = firmware;
+    TEST_ASSERT_TRUE(telemetry_device_state_equal(&state, &reported));
+    reported.state_int = 4;
+    TEST_ASSERT_FALSE(telemetry_device_state_equal(&state, &reported));
+    reported.state_int = 3;
+    reported.mode = "BLE";
+    TEST_ASSERT_FALSE(telemetry_device_state_equal(&state, &reported));
+}
+
+/*------------------------------------------------------------------
+|  Test: test_benchmark_formats
+| ------------------------------------------------------------------
+|  Description: compares the payload size and the encoding time of
+|               both formats (the time is only reported).
+*-------------------------------------------------------------------*/
+void test_benchmark_formats(void)  {
+    int32_t json_len, cbor_len;
+    double json_ms, cbor_ms;
+    clock_t start;
+    uint32_t i;
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        sample.timestamp++;
+        json_len = telemetry_encode(&sample, TELEMETRY_FORMAT_JSON, buffer, sizeof(buffer));
+    }
+    json_ms = elapsed_ms(start);
+
+    start = clock();
+    for (i = 0; i < BENCHMARK_ITERATIONS; i++)
+    {
+        sample.timestamp++;
+        cbor_len = telemetry_encode(&sample, TELEMETRY_FORMAT_CBOR, buffer, sizeof(buffer));
+    }
+    cbor_ms = elapsed_ms(start);
+
+    printf("telemetry sample: JSON = %d bytes, %.1f ns/sample - CBOR = %d bytes, %.1f ns/sample\n",
+           json_len, json_ms * 1e6 / BENCHMARK_ITERATIONS, cbor_len, cbor_ms * 1e6 / BENCHMARK_ITERATIONS);
+    TEST_ASSERT_LESS_THAN(json_len, cbor_len);
+}
+
+
+/* ===== Implementations of private functions ===== */
+static double elapsed_ms(clock_t start)
+{
+    return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}